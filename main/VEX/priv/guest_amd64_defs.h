@@ -76,6 +76,11 @@ IRExpr* guest_amd64_spechelper ( const HChar* function_name,
 extern 
 Bool guest_amd64_state_requires_precise_mem_exns ( Int, Int );
 
+/* Prints the flag helper profile gathered when
+   VexControl.guest_cc_profile is set. */
+extern
+void guest_amd64_show_cc_profile ( void );
+
 extern
 VexGuestLayout amd64guest_layout;
 
@@ -65,11 +65,6 @@
 */
 
 
-/* Set to 1 to get detailed profiling info about use of the flag
-   machinery. */
-#define PROFILE_RFLAGS 0
-
-
 /*---------------------------------------------------------------*/
 /*--- %rflags run-time helpers.                               ---*/
 /*---------------------------------------------------------------*/
@@ -559,14 +554,18 @@ static inline ULong idULong ( ULong x )
 /*-------------------------------------------------------------*/
 
 
-#if PROFILE_RFLAGS
-
-static Bool initted     = False;
+/* Profiling of the flag helpers, enabled at run time by
+   VexControl.guest_cc_profile.  A call only gets to one of the
+   helpers below if guest_amd64_spechelper could not specialise it
+   away at translation time, so the per-(CC_OP, condition) counts
+   show which pairs are still worth specialising. */
 
 /* C flag, fast route */
 static UInt tabc_fast[AMD64G_CC_OP_NUMBER];
 /* C flag, slow route */
 static UInt tabc_slow[AMD64G_CC_OP_NUMBER];
+/* calc_all, per CC_OP */
+static UInt tab_all[AMD64G_CC_OP_NUMBER];
 /* table for calculate_cond */
 static UInt tab_cond[AMD64G_CC_OP_NUMBER][16];
 /* total entry counts for calc_all, calc_c, calc_cond. */
@@ -574,22 +573,35 @@ static UInt n_calc_all  = 0;
 static UInt n_calc_c    = 0;
 static UInt n_calc_cond = 0;
 
-#define SHOW_COUNTS_NOW (0 == (0x3FFFFF & (n_calc_all+n_calc_c+n_calc_cond)))
+#define PROFILE_RFLAGS (UNLIKELY(vex_control.guest_cc_profile))
 
 
-static void showCounts ( void )
+/* Print the counts gathered so far.  Called from LibVEX_ShowStats. */
+void guest_amd64_show_cc_profile ( void )
 {
    Int op, co;
    HChar ch;
-   vex_printf("\nTotal calls: calc_all=%u   calc_cond=%u   calc_c=%u\n",
+   if (n_calc_all + n_calc_c + n_calc_cond == 0)
+      return;
+
+   vex_printf("\namd64 flag helper calls: "
+              "calc_all=%u   calc_cond=%u   calc_c=%u\n",
               n_calc_all, n_calc_cond, n_calc_c);
 
-   vex_printf("      cSLOW  cFAST    O   NO    B   NB    Z   NZ   BE  NBE"
-              "    S   NS    P   NP    L   NL   LE  NLE\n");
+   vex_printf("        ALL  cSLOW  cFAST    O   NO    B   NB    Z   NZ"
+              "   BE  NBE    S   NS    P   NP    L   NL   LE  NLE\n");
    vex_printf("     -----------------------------------------------------"
-              "----------------------------------------\n");
+              "-----------------------------------------------------\n");
    for (op = 0; op < AMD64G_CC_OP_NUMBER; op++) {
 
+      if (tab_all[op] == 0 && tabc_slow[op] == 0 && tabc_fast[op] == 0) {
+         for (co = 0; co < 16; co++)
+            if (tab_cond[op][co] != 0)
+               break;
+         if (co == 16)
+            continue;
+      }
+
       ch = ' ';
       if (op > 0 && (op-1) % 4 == 0) 
          ch = 'B';
@@ -601,17 +613,15 @@ static void showCounts ( void )
          ch = 'Q';
 
       vex_printf("%2d%c: ", op, ch);
+      vex_printf("%6u ", tab_all[op]);
       vex_printf("%6u ", tabc_slow[op]);
       vex_printf("%6u ", tabc_fast[op]);
       for (co = 0; co < 16; co++) {
-         Int n = tab_cond[op][co];
+         UInt n = tab_cond[op][co];
          if (n >= 1000) {
-            vex_printf(" %3dK", n / 1000);
-         } else 
-         if (n >= 0) {
-            vex_printf(" %3d ", n );
+            vex_printf(" %3uK", n / 1000);
          } else {
-            vex_printf("     ");
+            vex_printf(" %3u ", n );
          }
       }
       vex_printf("\n");
@@ -619,19 +629,6 @@ static void showCounts ( void )
    vex_printf("\n");
 }
 
-static void initCounts ( void )
-{
-   Int op, co;
-   initted = True;
-   for (op = 0; op < AMD64G_CC_OP_NUMBER; op++) {
-      tabc_fast[op] = tabc_slow[op] = 0;
-      for (co = 0; co < 16; co++)
-         tab_cond[op][co] = 0;
-   }
-}
-
-#endif /* PROFILE_RFLAGS */
-
 
 /* CALLED FROM GENERATED CODE: CLEAN HELPER */
 /* Calculate all the 6 flags from the supplied thunk parameters.
@@ -750,11 +747,10 @@ ULong amd64g_calculate_rflags_all ( ULong cc_op,
                                     ULong cc_dep2,
                                     ULong cc_ndep )
 {
-#  if PROFILE_RFLAGS
-   if (!initted) initCounts();
-   n_calc_all++;
-   if (SHOW_COUNTS_NOW) showCounts();
-#  endif
+   if (PROFILE_RFLAGS && cc_op < AMD64G_CC_OP_NUMBER) {
+      n_calc_all++;
+      tab_all[cc_op]++;
+   }
    return
       amd64g_calculate_rflags_all_WRK ( cc_op, cc_dep1, cc_dep2, cc_ndep );
 }
@@ -767,12 +763,10 @@ ULong amd64g_calculate_rflags_c ( ULong cc_op,
                                   ULong cc_dep2,
                                   ULong cc_ndep )
 {
-#  if PROFILE_RFLAGS
-   if (!initted) initCounts();
-   n_calc_c++;
-   tabc_fast[cc_op]++;
-   if (SHOW_COUNTS_NOW) showCounts();
-#  endif
+   if (PROFILE_RFLAGS && cc_op < AMD64G_CC_OP_NUMBER) {
+      n_calc_c++;
+      tabc_fast[cc_op]++;
+   }
 
    /* Fast-case some common ones. */
    switch (cc_op) {
@@ -799,10 +793,10 @@ ULong amd64g_calculate_rflags_c ( ULong cc_op,
          break;
    }
 
-#  if PROFILE_RFLAGS
-   tabc_fast[cc_op]--;
-   tabc_slow[cc_op]++;
-#  endif
+   if (PROFILE_RFLAGS && cc_op < AMD64G_CC_OP_NUMBER) {
+      tabc_fast[cc_op]--;
+      tabc_slow[cc_op]++;
+   }
 
    return amd64g_calculate_rflags_all_WRK(cc_op,cc_dep1,cc_dep2,cc_ndep) 
           & AMD64G_CC_MASK_C;
@@ -822,12 +816,10 @@ ULong amd64g_calculate_condition ( ULong/*AMD64Condcode*/ cond,
    ULong of,sf,zf,cf,pf;
    ULong inv = cond & 1;
 
-#  if PROFILE_RFLAGS
-   if (!initted) initCounts();
-   tab_cond[cc_op][cond]++;
-   n_calc_cond++;
-   if (SHOW_COUNTS_NOW) showCounts();
-#  endif
+   if (PROFILE_RFLAGS && cc_op < AMD64G_CC_OP_NUMBER && cond < 16) {
+      tab_cond[cc_op][cond]++;
+      n_calc_cond++;
+   }
 
    switch (cond) {
       case AMD64CondNO:
@@ -948,6 +940,236 @@ static Bool isU64 ( IRExpr* e, ULong n )
                   && e->Iex.Const.con->Ico.U64 == n );
 }
 
+/* Generic specialisation of the flag helpers, used for the (CC_OP,
+   condition) pairs that the hand-written cases in
+   guest_amd64_spechelper don't cover.  The arithmetic, logic,
+   inc/dec, shift and rotate thunks come in groups of four sizes
+   (B, W, L, Q), so CC_OP decodes into a group and a width.  For
+   each group spec_rflag builds the O, C, Z or S flag straight from
+   the thunk parameters, following the ACTIONS_ macros above, as an
+   Ity_I64 that is 0 or 1.  spec_condition then combines them the
+   way amd64g_calculate_condition does.  PF, and so P/NP, is left to
+   the helper, as are the multiply and BMI thunks. */
+
+enum { SpecADD=0, SpecSUB, SpecADC, SpecSBB, SpecLOGIC,
+       SpecINC, SpecDEC, SpecSHL, SpecSHR, SpecROL, SpecROR };
+
+static IRExpr* spec_rflag ( Int flag, Int group, Int nbits,
+                            IRExpr* dep1, IRExpr* dep2, IRExpr* ndep )
+{
+#  define unop(_op,_a1) IRExpr_Unop((_op),(_a1))
+#  define binop(_op,_a1,_a2) IRExpr_Binop((_op),(_a1),(_a2))
+#  define mkU64(_n) IRExpr_Const(IRConst_U64(_n))
+#  define mkU8(_n)  IRExpr_Const(IRConst_U8(_n))
+   /* the low nbits of _e, zero extended */
+#  define NARROW(_e) \
+      (nbits == 64 ? (_e) \
+                   : binop(Iop_And64, (_e), mkU64((1ULL << nbits) - 1)))
+   /* bit _n of _e */
+#  define BIT(_e,_n) \
+      binop(Iop_And64, binop(Iop_Shr64, (_e), mkU8(_n)), mkU64(1))
+#  define TOPBIT(_e) BIT((_e), nbits-1)
+#  define B2W(_e1) unop(Iop_1Uto64, (_e1))
+
+   IRExpr *argL, *argR, *oldC, *res, *lhs, *rhs;
+   ULong   signMask = 1ULL << (nbits - 1);
+
+   switch (group) {
+      case SpecADD: case SpecSUB: case SpecADC: case SpecSBB:
+         oldC = (group == SpecADC || group == SpecSBB)
+                   ? binop(Iop_And64, ndep, mkU64(AMD64G_CC_MASK_C))
+                   : NULL;
+         argL = dep1;
+         argR = oldC ? binop(Iop_Xor64, dep2, oldC) : dep2;
+         if (group == SpecADD || group == SpecADC) {
+            res = binop(Iop_Add64, argL, argR);
+            if (oldC) res = binop(Iop_Add64, res, oldC);
+         } else {
+            res = binop(Iop_Sub64, argL, argR);
+            if (oldC) res = binop(Iop_Sub64, res, oldC);
+         }
+         switch (flag) {
+            case AMD64G_CC_SHIFT_Z:
+               return B2W(binop(Iop_CmpEQ64, NARROW(res), mkU64(0)));
+            case AMD64G_CC_SHIFT_S:
+               return TOPBIT(res);
+            case AMD64G_CC_SHIFT_O:
+               if (group == SpecADD || group == SpecADC)
+                  return TOPBIT(binop(Iop_And64,
+                                      unop(Iop_Not64,
+                                           binop(Iop_Xor64, argL, argR)),
+                                      binop(Iop_Xor64, argL, res)));
+               return TOPBIT(binop(Iop_And64,
+                                   binop(Iop_Xor64, argL, argR),
+                                   binop(Iop_Xor64, argL, res)));
+            case AMD64G_CC_SHIFT_C:
+               /* add: res <u argL;  sub: argL <u argR; and for adc/sbb
+                  with the old carry set, <=u instead of <u. */
+               if (group == SpecADD || group == SpecADC) {
+                  lhs = NARROW(res);  rhs = NARROW(argL);
+               } else {
+                  lhs = NARROW(argL); rhs = NARROW(argR);
+               }
+               if (!oldC)
+                  return B2W(binop(Iop_CmpLT64U, lhs, rhs));
+               return binop(Iop_Or64,
+                            B2W(binop(Iop_CmpLT64U, lhs, rhs)),
+                            binop(Iop_And64,
+                                  oldC,
+                                  B2W(binop(Iop_CmpEQ64, lhs, rhs))));
+            default:
+               return NULL;
+         }
+
+      case SpecLOGIC: case SpecINC: case SpecDEC:
+      case SpecSHL: case SpecSHR:
+         switch (flag) {
+            case AMD64G_CC_SHIFT_Z:
+               return B2W(binop(Iop_CmpEQ64, NARROW(dep1), mkU64(0)));
+            case AMD64G_CC_SHIFT_S:
+               return TOPBIT(dep1);
+            case AMD64G_CC_SHIFT_O:
+               if (group == SpecLOGIC)
+                  return mkU64(0);
+               if (group == SpecINC)
+                  return B2W(binop(Iop_CmpEQ64, NARROW(dep1),
+                                   mkU64(signMask)));
+               if (group == SpecDEC)
+                  return B2W(binop(Iop_CmpEQ64, NARROW(dep1),
+                                   mkU64(signMask - 1)));
+               /* shifts: DEP2 is the result shifted one bit less */
+               return TOPBIT(binop(Iop_Xor64, dep2, dep1));
+            case AMD64G_CC_SHIFT_C:
+               if (group == SpecLOGIC)
+                  return mkU64(0);
+               if (group == SpecINC || group == SpecDEC)
+                  return binop(Iop_And64, ndep, mkU64(AMD64G_CC_MASK_C));
+               if (group == SpecSHL)
+                  return TOPBIT(dep2);
+               return binop(Iop_And64, dep2, mkU64(1));
+            default:
+               return NULL;
+         }
+
+      case SpecROL: case SpecROR:
+         /* Only C and O change; the rest come from the old flags
+            in NDEP. */
+         switch (flag) {
+            case AMD64G_CC_SHIFT_Z:
+            case AMD64G_CC_SHIFT_S:
+               return BIT(ndep, flag);
+            case AMD64G_CC_SHIFT_C:
+               return group == SpecROL ? binop(Iop_And64, dep1, mkU64(1))
+                                       : TOPBIT(dep1);
+            case AMD64G_CC_SHIFT_O:
+               return binop(Iop_Xor64,
+                            TOPBIT(dep1),
+                            group == SpecROL ? binop(Iop_And64, dep1, mkU64(1))
+                                             : BIT(dep1, nbits-2));
+            default:
+               return NULL;
+         }
+
+      default:
+         return NULL;
+   }
+
+#  undef unop
+#  undef binop
+#  undef mkU64
+#  undef mkU8
+#  undef NARROW
+#  undef BIT
+#  undef TOPBIT
+#  undef B2W
+}
+
+/* Decode CC_OP into a group and width for spec_rflag.  Returns False
+   for thunks it doesn't handle. */
+static Bool spec_decode_cc_op ( IRExpr* cc_op, Int* group, Int* nbits )
+{
+   ULong op;
+   if (cc_op->tag != Iex_Const || cc_op->Iex.Const.con->tag != Ico_U64)
+      return False;
+   op = cc_op->Iex.Const.con->Ico.U64;
+   if (op < AMD64G_CC_OP_ADDB || op > AMD64G_CC_OP_RORQ)
+      return False;
+   *group = (Int)((op - AMD64G_CC_OP_ADDB) / 4);
+   *nbits = 8 << ((op - AMD64G_CC_OP_ADDB) % 4);
+   return True;
+}
+
+static IRExpr* spec_condition ( IRExpr* cond, IRExpr* cc_op,
+                                IRExpr* dep1, IRExpr* dep2, IRExpr* ndep )
+{
+#  define binop(_op,_a1,_a2) IRExpr_Binop((_op),(_a1),(_a2))
+#  define FLAG(_f) spec_rflag(AMD64G_CC_SHIFT_##_f, group, nbits, \
+                              dep1, dep2, ndep)
+   Int     group, nbits;
+   ULong   cnd;
+   IRExpr* res;
+
+   if (cond->tag != Iex_Const || cond->Iex.Const.con->tag != Ico_U64)
+      return NULL;
+   if (!spec_decode_cc_op(cc_op, &group, &nbits))
+      return NULL;
+   cnd = cond->Iex.Const.con->Ico.U64;
+
+   /* For sub/cmp, the unsigned and signed orderings are just
+      comparisons of the (suitably narrowed) arguments. */
+   if (group == SpecSUB
+       && (cnd & ~1ULL) != AMD64CondO && (cnd & ~1ULL) != AMD64CondS
+       && (cnd & ~1ULL) != AMD64CondP && cnd < AMD64CondAlways) {
+      IRExpr *l, *r;
+      IROp    op;
+      ULong   m = nbits == 64 ? ~0ULL : (1ULL << nbits) - 1;
+      Bool    sgnd = toBool((cnd & ~1ULL) == AMD64CondL
+                            || (cnd & ~1ULL) == AMD64CondLE);
+      if (sgnd) {
+         /* move the operands' sign bits to bit 63 */
+         l = nbits == 64 ? dep1
+                 : binop(Iop_Shl64, dep1, IRExpr_Const(IRConst_U8(64-nbits)));
+         r = nbits == 64 ? dep2
+                 : binop(Iop_Shl64, dep2, IRExpr_Const(IRConst_U8(64-nbits)));
+      } else {
+         l = nbits == 64 ? dep1
+                 : binop(Iop_And64, dep1, IRExpr_Const(IRConst_U64(m)));
+         r = nbits == 64 ? dep2
+                 : binop(Iop_And64, dep2, IRExpr_Const(IRConst_U64(m)));
+      }
+      switch (cnd & ~1ULL) {
+         case AMD64CondB:  op = Iop_CmpLT64U; break;
+         case AMD64CondZ:  op = Iop_CmpEQ64;  break;
+         case AMD64CondBE: op = Iop_CmpLE64U; break;
+         case AMD64CondL:  op = Iop_CmpLT64S; break;
+         case AMD64CondLE: op = Iop_CmpLE64S; break;
+         default: vassert(0);
+      }
+      res = IRExpr_Unop(Iop_1Uto64, binop(op, l, r));
+   } else {
+      switch (cnd & ~1ULL) {
+         case AMD64CondO:  res = FLAG(O); break;
+         case AMD64CondB:  res = FLAG(C); break;
+         case AMD64CondZ:  res = FLAG(Z); break;
+         case AMD64CondBE: res = binop(Iop_Or64, FLAG(C), FLAG(Z)); break;
+         case AMD64CondS:  res = FLAG(S); break;
+         case AMD64CondL:  res = binop(Iop_Xor64, FLAG(S), FLAG(O)); break;
+         case AMD64CondLE: res = binop(Iop_Or64,
+                                       binop(Iop_Xor64, FLAG(S), FLAG(O)),
+                                       FLAG(Z));
+                           break;
+         default:          return NULL;
+      }
+   }
+
+   if (cnd & 1)
+      res = binop(Iop_Xor64, res, IRExpr_Const(IRConst_U64(1)));
+   return res;
+
+#  undef binop
+#  undef FLAG
+}
+
 IRExpr* guest_amd64_spechelper ( const HChar* function_name,
                                  IRExpr** args,
                                  IRStmt** precedingStmts,
@@ -1465,7 +1687,9 @@ IRExpr* guest_amd64_spechelper ( const HChar* function_name,
             );
       }
 
-      return NULL;
+      /*---------------- everything else ----------------*/
+
+      return spec_condition(cond, cc_op, cc_dep1, cc_dep2, args[4]);
    }
 
    /* --------- specialising "amd64g_calculate_rflags_c" --------- */
@@ -1519,6 +1743,12 @@ IRExpr* guest_amd64_spechelper ( const HChar* function_name,
       }
 #     endif
 
+      { Int group, nbits;
+        if (spec_decode_cc_op(cc_op, &group, &nbits))
+           return spec_rflag(AMD64G_CC_SHIFT_C, group, nbits,
+                             cc_dep1, cc_dep2, cc_ndep);
+      }
+
       return NULL;
    }
 
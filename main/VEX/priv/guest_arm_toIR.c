@@ -15433,7 +15433,8 @@ DisResult disInstr_ARM_WRK (
       if (condT == IRTemp_INVALID) {
          /* unconditional transfer to 'dst'.  See if we can simply
             continue tracing at the destination. */
-         if (resteerOkFn( callback_opaque, (Addr64)dst )) {
+         if ((!link || vex_control.guest_chase_calls)
+             && resteerOkFn( callback_opaque, (Addr64)dst )) {
             /* yes */
             dres.whatNext   = Dis_ResteerU;
             dres.continueAt = (Addr64)dst;
@@ -76,6 +76,11 @@ IRExpr* guest_x86_spechelper ( const HChar* function_name,
 extern 
 Bool guest_x86_state_requires_precise_mem_exns ( Int, Int );
 
+/* Prints the flag helper profile gathered when
+   VexControl.guest_cc_profile is set. */
+extern
+void guest_x86_show_cc_profile ( void );
+
 extern
 VexGuestLayout x86guest_layout;
 
@@ -65,11 +65,6 @@
 */
 
 
-/* Set to 1 to get detailed profiling info about use of the flag
-   machinery. */
-#define PROFILE_EFLAGS 0
-
-
 /*---------------------------------------------------------------*/
 /*--- %eflags run-time helpers.                               ---*/
 /*---------------------------------------------------------------*/
@@ -415,14 +410,18 @@ static inline ULong idULong ( ULong x )
 }
 
 
-#if PROFILE_EFLAGS
-
-static Bool initted     = False;
+/* Profiling of the flag helpers, enabled at run time by
+   VexControl.guest_cc_profile.  A call only gets to one of the
+   helpers below if guest_x86_spechelper could not specialise it
+   away at translation time, so the per-(CC_OP, condition) counts
+   show which pairs are still worth specialising. */
 
 /* C flag, fast route */
 static UInt tabc_fast[X86G_CC_OP_NUMBER];
 /* C flag, slow route */
 static UInt tabc_slow[X86G_CC_OP_NUMBER];
+/* calc_all, per CC_OP */
+static UInt tab_all[X86G_CC_OP_NUMBER];
 /* table for calculate_cond */
 static UInt tab_cond[X86G_CC_OP_NUMBER][16];
 /* total entry counts for calc_all, calc_c, calc_cond. */
@@ -430,22 +429,35 @@ static UInt n_calc_all  = 0;
 static UInt n_calc_c    = 0;
 static UInt n_calc_cond = 0;
 
-#define SHOW_COUNTS_NOW (0 == (0x3FFFFF & (n_calc_all+n_calc_c+n_calc_cond)))
+#define PROFILE_EFLAGS (UNLIKELY(vex_control.guest_cc_profile))
 
 
-static void showCounts ( void )
+/* Print the counts gathered so far.  Called from LibVEX_ShowStats. */
+void guest_x86_show_cc_profile ( void )
 {
    Int op, co;
    HChar ch;
-   vex_printf("\nTotal calls: calc_all=%u   calc_cond=%u   calc_c=%u\n",
+   if (n_calc_all + n_calc_c + n_calc_cond == 0)
+      return;
+
+   vex_printf("\nx86 flag helper calls: "
+              "calc_all=%u   calc_cond=%u   calc_c=%u\n",
               n_calc_all, n_calc_cond, n_calc_c);
 
-   vex_printf("      cSLOW  cFAST    O   NO    B   NB    Z   NZ   BE  NBE"
-              "    S   NS    P   NP    L   NL   LE  NLE\n");
+   vex_printf("        ALL  cSLOW  cFAST    O   NO    B   NB    Z   NZ"
+              "   BE  NBE    S   NS    P   NP    L   NL   LE  NLE\n");
    vex_printf("     -----------------------------------------------------"
-              "----------------------------------------\n");
+              "-----------------------------------------------------\n");
    for (op = 0; op < X86G_CC_OP_NUMBER; op++) {
 
+      if (tab_all[op] == 0 && tabc_slow[op] == 0 && tabc_fast[op] == 0) {
+         for (co = 0; co < 16; co++)
+            if (tab_cond[op][co] != 0)
+               break;
+         if (co == 16)
+            continue;
+      }
+
       ch = ' ';
       if (op > 0 && (op-1) % 3 == 0) 
          ch = 'B';
@@ -455,17 +467,15 @@ static void showCounts ( void )
          ch = 'L';
 
       vex_printf("%2d%c: ", op, ch);
+      vex_printf("%6u ", tab_all[op]);
       vex_printf("%6u ", tabc_slow[op]);
       vex_printf("%6u ", tabc_fast[op]);
       for (co = 0; co < 16; co++) {
-         Int n = tab_cond[op][co];
+         UInt n = tab_cond[op][co];
          if (n >= 1000) {
-            vex_printf(" %3dK", n / 1000);
-         } else 
-         if (n >= 0) {
-            vex_printf(" %3d ", n );
+            vex_printf(" %3uK", n / 1000);
          } else {
-            vex_printf("     ");
+            vex_printf(" %3u ", n );
          }
       }
       vex_printf("\n");
@@ -473,19 +483,6 @@ static void showCounts ( void )
    vex_printf("\n");
 }
 
-static void initCounts ( void )
-{
-   Int op, co;
-   initted = True;
-   for (op = 0; op < X86G_CC_OP_NUMBER; op++) {
-      tabc_fast[op] = tabc_slow[op] = 0;
-      for (co = 0; co < 16; co++)
-         tab_cond[op][co] = 0;
-   }
-}
-
-#endif /* PROFILE_EFLAGS */
-
 
 /* CALLED FROM GENERATED CODE: CLEAN HELPER */
 /* Calculate all the 6 flags from the supplied thunk parameters.
@@ -577,11 +574,10 @@ UInt x86g_calculate_eflags_all ( UInt cc_op,
                                  UInt cc_dep2,
                                  UInt cc_ndep )
 {
-#  if PROFILE_EFLAGS
-   if (!initted) initCounts();
-   n_calc_all++;
-   if (SHOW_COUNTS_NOW) showCounts();
-#  endif
+   if (PROFILE_EFLAGS && cc_op < X86G_CC_OP_NUMBER) {
+      n_calc_all++;
+      tab_all[cc_op]++;
+   }
    return
       x86g_calculate_eflags_all_WRK ( cc_op, cc_dep1, cc_dep2, cc_ndep );
 }
@@ -595,12 +591,10 @@ UInt x86g_calculate_eflags_c ( UInt cc_op,
                                UInt cc_dep2,
                                UInt cc_ndep )
 {
-#  if PROFILE_EFLAGS
-   if (!initted) initCounts();
-   n_calc_c++;
-   tabc_fast[cc_op]++;
-   if (SHOW_COUNTS_NOW) showCounts();
-#  endif
+   if (PROFILE_EFLAGS && cc_op < X86G_CC_OP_NUMBER) {
+      n_calc_c++;
+      tabc_fast[cc_op]++;
+   }
 
    /* Fast-case some common ones. */
    switch (cc_op) {
@@ -624,10 +618,10 @@ UInt x86g_calculate_eflags_c ( UInt cc_op,
          break;
    }
 
-#  if PROFILE_EFLAGS
-   tabc_fast[cc_op]--;
-   tabc_slow[cc_op]++;
-#  endif
+   if (PROFILE_EFLAGS && cc_op < X86G_CC_OP_NUMBER) {
+      tabc_fast[cc_op]--;
+      tabc_slow[cc_op]++;
+   }
 
    return x86g_calculate_eflags_all_WRK(cc_op,cc_dep1,cc_dep2,cc_ndep) 
           & X86G_CC_MASK_C;
@@ -647,12 +641,10 @@ UInt x86g_calculate_condition ( UInt/*X86Condcode*/ cond,
    UInt of,sf,zf,cf,pf;
    UInt inv = cond & 1;
 
-#  if PROFILE_EFLAGS
-   if (!initted) initCounts();
-   tab_cond[cc_op][cond]++;
-   n_calc_cond++;
-   if (SHOW_COUNTS_NOW) showCounts();
-#  endif
+   if (PROFILE_EFLAGS && cc_op < X86G_CC_OP_NUMBER && cond < 16) {
+      tab_cond[cc_op][cond]++;
+      n_calc_cond++;
+   }
 
    switch (cond) {
       case X86CondNO:
@@ -773,6 +765,237 @@ static inline Bool isU32 ( IRExpr* e, UInt n )
               && e->Iex.Const.con->Ico.U32 == n );
 }
 
+/* Generic specialisation of the flag helpers, used for the (CC_OP,
+   condition) pairs that the hand-written cases in
+   guest_x86_spechelper don't cover.  The arithmetic, logic,
+   inc/dec, shift and rotate thunks come in groups of three sizes
+   (B, W, L), so CC_OP decodes into a group and a width.  For
+   each group spec_eflag builds the O, C, Z or S flag straight from
+   the thunk parameters, following the ACTIONS_ macros above, as an
+   Ity_I32 that is 0 or 1.  spec_condition then combines them the
+   way x86g_calculate_condition does.  PF, and so P/NP, is left to
+   the helper, as are the multiply thunks. */
+
+enum { SpecADD=0, SpecSUB, SpecADC, SpecSBB, SpecLOGIC,
+       SpecINC, SpecDEC, SpecSHL, SpecSHR, SpecROL, SpecROR };
+
+static IRExpr* spec_eflag ( Int flag, Int group, Int nbits,
+                            IRExpr* dep1, IRExpr* dep2, IRExpr* ndep )
+{
+#  define unop(_op,_a1) IRExpr_Unop((_op),(_a1))
+#  define binop(_op,_a1,_a2) IRExpr_Binop((_op),(_a1),(_a2))
+#  define mkU32(_n) IRExpr_Const(IRConst_U32(_n))
+#  define mkU8(_n)  IRExpr_Const(IRConst_U8(_n))
+   /* the low nbits of _e, zero extended */
+#  define NARROW(_e) \
+      (nbits == 32 ? (_e) \
+                   : binop(Iop_And32, (_e), mkU32((1U << nbits) - 1)))
+   /* bit _n of _e */
+#  define BIT(_e,_n) \
+      binop(Iop_And32, binop(Iop_Shr32, (_e), mkU8(_n)), mkU32(1))
+#  define TOPBIT(_e) BIT((_e), nbits-1)
+#  define B2W(_e1) unop(Iop_1Uto32, (_e1))
+
+   IRExpr *argL, *argR, *oldC, *res, *nres, *nL;
+   UInt    signMask = 1U << (nbits - 1);
+
+   switch (group) {
+      case SpecADD: case SpecSUB: case SpecADC: case SpecSBB:
+         oldC = (group == SpecADC || group == SpecSBB)
+                   ? binop(Iop_And32, ndep, mkU32(X86G_CC_MASK_C))
+                   : NULL;
+         argL = dep1;
+         argR = oldC ? binop(Iop_Xor32, dep2, oldC) : dep2;
+         if (group == SpecADD || group == SpecADC) {
+            res = binop(Iop_Add32, argL, argR);
+            if (oldC) res = binop(Iop_Add32, res, oldC);
+         } else {
+            res = binop(Iop_Sub32, argL, argR);
+            if (oldC) res = binop(Iop_Sub32, res, oldC);
+         }
+         switch (flag) {
+            case X86G_CC_SHIFT_Z:
+               return B2W(binop(Iop_CmpEQ32, NARROW(res), mkU32(0)));
+            case X86G_CC_SHIFT_S:
+               return TOPBIT(res);
+            case X86G_CC_SHIFT_O:
+               if (group == SpecADD || group == SpecADC)
+                  return TOPBIT(binop(Iop_And32,
+                                      unop(Iop_Not32,
+                                           binop(Iop_Xor32, argL, argR)),
+                                      binop(Iop_Xor32, argL, res)));
+               return TOPBIT(binop(Iop_And32,
+                                   binop(Iop_Xor32, argL, argR),
+                                   binop(Iop_Xor32, argL, res)));
+            case X86G_CC_SHIFT_C:
+               /* add: res <u argL;  sub: argL <u argR; and for adc/sbb
+                  with the old carry set, <=u instead of <u. */
+               nL   = NARROW(argL);
+               nres = (group == SpecADD || group == SpecADC)
+                         ? NARROW(res) : NARROW(argR);
+               if (group == SpecADD || group == SpecADC) {
+                  IRExpr* t = nL; nL = nres; nres = t;
+               }
+               if (!oldC)
+                  return B2W(binop(Iop_CmpLT32U, nL, nres));
+               return binop(Iop_Or32,
+                            B2W(binop(Iop_CmpLT32U, nL, nres)),
+                            binop(Iop_And32,
+                                  oldC,
+                                  B2W(binop(Iop_CmpEQ32, nL, nres))));
+            default:
+               return NULL;
+         }
+
+      case SpecLOGIC: case SpecINC: case SpecDEC:
+      case SpecSHL: case SpecSHR:
+         switch (flag) {
+            case X86G_CC_SHIFT_Z:
+               return B2W(binop(Iop_CmpEQ32, NARROW(dep1), mkU32(0)));
+            case X86G_CC_SHIFT_S:
+               return TOPBIT(dep1);
+            case X86G_CC_SHIFT_O:
+               if (group == SpecLOGIC)
+                  return mkU32(0);
+               if (group == SpecINC)
+                  return B2W(binop(Iop_CmpEQ32, NARROW(dep1),
+                                   mkU32(signMask)));
+               if (group == SpecDEC)
+                  return B2W(binop(Iop_CmpEQ32, NARROW(dep1),
+                                   mkU32(signMask - 1)));
+               /* shifts: DEP2 is the result shifted one bit less */
+               return TOPBIT(binop(Iop_Xor32, dep2, dep1));
+            case X86G_CC_SHIFT_C:
+               if (group == SpecLOGIC)
+                  return mkU32(0);
+               if (group == SpecINC || group == SpecDEC)
+                  return binop(Iop_And32, ndep, mkU32(X86G_CC_MASK_C));
+               if (group == SpecSHL)
+                  return TOPBIT(dep2);
+               return binop(Iop_And32, dep2, mkU32(1));
+            default:
+               return NULL;
+         }
+
+      case SpecROL: case SpecROR:
+         /* Only C and O change; the rest come from the old flags
+            in NDEP. */
+         switch (flag) {
+            case X86G_CC_SHIFT_Z:
+            case X86G_CC_SHIFT_S:
+               return BIT(ndep, flag);
+            case X86G_CC_SHIFT_C:
+               return group == SpecROL ? binop(Iop_And32, dep1, mkU32(1))
+                                       : TOPBIT(dep1);
+            case X86G_CC_SHIFT_O:
+               return binop(Iop_Xor32,
+                            TOPBIT(dep1),
+                            group == SpecROL ? binop(Iop_And32, dep1, mkU32(1))
+                                             : BIT(dep1, nbits-2));
+            default:
+               return NULL;
+         }
+
+      default:
+         return NULL;
+   }
+
+#  undef unop
+#  undef binop
+#  undef mkU32
+#  undef mkU8
+#  undef NARROW
+#  undef BIT
+#  undef TOPBIT
+#  undef B2W
+}
+
+/* Decode CC_OP into a group and width for spec_eflag.  Returns False
+   for thunks it doesn't handle. */
+static Bool spec_decode_cc_op ( IRExpr* cc_op, Int* group, Int* nbits )
+{
+   UInt op;
+   if (cc_op->tag != Iex_Const || cc_op->Iex.Const.con->tag != Ico_U32)
+      return False;
+   op = cc_op->Iex.Const.con->Ico.U32;
+   if (op < X86G_CC_OP_ADDB || op > X86G_CC_OP_RORL)
+      return False;
+   *group = (Int)((op - X86G_CC_OP_ADDB) / 3);
+   *nbits = 8 << ((op - X86G_CC_OP_ADDB) % 3);
+   return True;
+}
+
+static IRExpr* spec_condition ( IRExpr* cond, IRExpr* cc_op,
+                                IRExpr* dep1, IRExpr* dep2, IRExpr* ndep )
+{
+#  define binop(_op,_a1,_a2) IRExpr_Binop((_op),(_a1),(_a2))
+#  define FLAG(_f) spec_eflag(X86G_CC_SHIFT_##_f, group, nbits, \
+                              dep1, dep2, ndep)
+   Int     group, nbits;
+   UInt    cnd;
+   IRExpr* res;
+
+   if (cond->tag != Iex_Const || cond->Iex.Const.con->tag != Ico_U32)
+      return NULL;
+   if (!spec_decode_cc_op(cc_op, &group, &nbits))
+      return NULL;
+   cnd = cond->Iex.Const.con->Ico.U32;
+
+   /* For sub/cmp, the unsigned and signed orderings are just
+      comparisons of the (suitably narrowed) arguments. */
+   if (group == SpecSUB
+       && (cnd & ~1U) != X86CondO && (cnd & ~1U) != X86CondS
+       && (cnd & ~1U) != X86CondP && cnd < X86CondAlways) {
+      IRExpr *l, *r;
+      IROp    op;
+      UInt    m = nbits == 32 ? ~0U : (1U << nbits) - 1;
+      Bool    sgnd = toBool((cnd & ~1U) == X86CondL
+                            || (cnd & ~1U) == X86CondLE);
+      if (sgnd) {
+         /* move the operands' sign bits to bit 31 */
+         l = nbits == 32 ? dep1
+                 : binop(Iop_Shl32, dep1, IRExpr_Const(IRConst_U8(32-nbits)));
+         r = nbits == 32 ? dep2
+                 : binop(Iop_Shl32, dep2, IRExpr_Const(IRConst_U8(32-nbits)));
+      } else {
+         l = nbits == 32 ? dep1
+                 : binop(Iop_And32, dep1, IRExpr_Const(IRConst_U32(m)));
+         r = nbits == 32 ? dep2
+                 : binop(Iop_And32, dep2, IRExpr_Const(IRConst_U32(m)));
+      }
+      switch (cnd & ~1U) {
+         case X86CondB:  op = Iop_CmpLT32U; break;
+         case X86CondZ:  op = Iop_CmpEQ32;  break;
+         case X86CondBE: op = Iop_CmpLE32U; break;
+         case X86CondL:  op = Iop_CmpLT32S; break;
+         case X86CondLE: op = Iop_CmpLE32S; break;
+         default: vassert(0);
+      }
+      res = IRExpr_Unop(Iop_1Uto32, binop(op, l, r));
+   } else {
+      switch (cnd & ~1U) {
+         case X86CondO:  res = FLAG(O); break;
+         case X86CondB:  res = FLAG(C); break;
+         case X86CondZ:  res = FLAG(Z); break;
+         case X86CondBE: res = binop(Iop_Or32, FLAG(C), FLAG(Z)); break;
+         case X86CondS:  res = FLAG(S); break;
+         case X86CondL:  res = binop(Iop_Xor32, FLAG(S), FLAG(O)); break;
+         case X86CondLE: res = binop(Iop_Or32,
+                                       binop(Iop_Xor32, FLAG(S), FLAG(O)),
+                                       FLAG(Z));
+                           break;
+         default:          return NULL;
+      }
+   }
+
+   if (cnd & 1)
+      res = binop(Iop_Xor32, res, IRExpr_Const(IRConst_U32(1)));
+   return res;
+
+#  undef binop
+#  undef FLAG
+}
+
 IRExpr* guest_x86_spechelper ( const HChar* function_name,
                                IRExpr** args,
                                IRStmt** precedingStmts,
@@ -1212,7 +1435,9 @@ IRExpr* guest_x86_spechelper ( const HChar* function_name,
             );
       }
 
-      return NULL;
+      /*---------------- everything else ----------------*/
+
+      return spec_condition(cond, cc_op, cc_dep1, cc_dep2, args[4]);
    }
 
    /* --------- specialising "x86g_calculate_eflags_c" --------- */
@@ -1286,6 +1511,12 @@ IRExpr* guest_x86_spechelper ( const HChar* function_name,
       }
 #     endif
 
+      { Int group, nbits;
+        if (spec_decode_cc_op(cc_op, &group, &nbits))
+           return spec_eflag(X86G_CC_SHIFT_C, group, nbits,
+                             cc_dep1, cc_dep2, cc_ndep);
+      }
+
       return NULL;
    }
 
@@ -72,6 +72,11 @@ void ppHRegAMD64 ( HReg reg )
          vassert(r >= 0 && r < 16);
          vex_printf("%%xmm%d", r);
          return;
+      case HRcVec256:
+         r = hregNumber(reg);
+         vassert(r >= 0 && r < 16);
+         vex_printf("%%ymm%d", r);
+         return;
       default:
          vpanic("ppHRegAMD64");
    }
@@ -118,6 +123,12 @@ HReg hregAMD64_R13 ( void ) { return mkHReg(13, HRcInt64, False); }
 HReg hregAMD64_R14 ( void ) { return mkHReg(14, HRcInt64, False); }
 HReg hregAMD64_R15 ( void ) { return mkHReg(15, HRcInt64, False); }
 
+HReg hregAMD64_GuestRegCache ( Int i )
+{
+   vassert(i == 0 || i == 1);
+   return i == 0 ? hregAMD64_R15() : hregAMD64_R14();
+}
+
 HReg hregAMD64_XMM0  ( void ) { return mkHReg( 0, HRcVec128, False); }
 HReg hregAMD64_XMM1  ( void ) { return mkHReg( 1, HRcVec128, False); }
 HReg hregAMD64_XMM3  ( void ) { return mkHReg( 3, HRcVec128, False); }
@@ -131,6 +142,11 @@ HReg hregAMD64_XMM10 ( void ) { return mkHReg(10, HRcVec128, False); }
 HReg hregAMD64_XMM11 ( void ) { return mkHReg(11, HRcVec128, False); }
 HReg hregAMD64_XMM12 ( void ) { return mkHReg(12, HRcVec128, False); }
 
+HReg hregAMD64_YMM2  ( void ) { return mkHReg( 2, HRcVec256, False); }
+HReg hregAMD64_YMM13 ( void ) { return mkHReg(13, HRcVec256, False); }
+HReg hregAMD64_YMM14 ( void ) { return mkHReg(14, HRcVec256, False); }
+HReg hregAMD64_YMM15 ( void ) { return mkHReg(15, HRcVec256, False); }
+
 
 void getAllocableRegs_AMD64 ( Int* nregs, HReg** arr )
 {
@@ -146,7 +162,7 @@ void getAllocableRegs_AMD64 ( Int* nregs, HReg** arr )
    (*arr)[ 5] = hregAMD64_XMM9();
 #endif
 #if 1
-   *nregs = 20;
+   *nregs = 24;
    *arr = LibVEX_Alloc(*nregs * sizeof(HReg));
    (*arr)[ 0] = hregAMD64_RSI();
    (*arr)[ 1] = hregAMD64_RDI();
@@ -169,6 +185,12 @@ void getAllocableRegs_AMD64 ( Int* nregs, HReg** arr )
    (*arr)[17] = hregAMD64_XMM11();
    (*arr)[18] = hregAMD64_XMM12();
    (*arr)[19] = hregAMD64_R10();
+
+   /* Only used for V256 values, and then only on AVX2 hosts. */
+   (*arr)[20] = hregAMD64_YMM2();
+   (*arr)[21] = hregAMD64_YMM13();
+   (*arr)[22] = hregAMD64_YMM14();
+   (*arr)[23] = hregAMD64_YMM15();
 #endif
 }
 
@@ -601,6 +623,18 @@ const HChar* showAMD64SseOp ( AMD64SseOp op ) {
       case Asse_UNPCKLW:  return "punpcklw";
       case Asse_UNPCKLD:  return "punpckld";
       case Asse_UNPCKLQ:  return "punpcklq";
+      case Asse_CMPEQ64:  return "pcmpeqq";
+      case Asse_CMPGT64S: return "pcmpgtq";
+      case Asse_MUL32:    return "pmulld";
+      case Asse_MAX8S:    return "pmaxsb";
+      case Asse_MAX16U:   return "pmaxuw";
+      case Asse_MAX32S:   return "pmaxsd";
+      case Asse_MAX32U:   return "pmaxud";
+      case Asse_MIN8S:    return "pminsb";
+      case Asse_MIN16U:   return "pminuw";
+      case Asse_MIN32S:   return "pminsd";
+      case Asse_MIN32U:   return "pminud";
+      case Asse_PACKUSD:  return "packusdw";
       default: vpanic("showAMD64SseOp");
    }
 }
@@ -717,12 +751,13 @@ AMD64Instr* AMD64Instr_XDirect ( Addr64 dstGA, AMD64AMode* amRIP,
    return i;
 }
 AMD64Instr* AMD64Instr_XIndir ( HReg dstGA, AMD64AMode* amRIP,
-                                AMD64CondCode cond ) {
+                                AMD64CondCode cond, Bool isRet ) {
    AMD64Instr* i       = LibVEX_Alloc(sizeof(AMD64Instr));
    i->tag              = Ain_XIndir;
    i->Ain.XIndir.dstGA = dstGA;
    i->Ain.XIndir.amRIP = amRIP;
    i->Ain.XIndir.cond  = cond;
+   i->Ain.XIndir.isRet = isRet;
    return i;
 }
 AMD64Instr* AMD64Instr_XAssisted ( HReg dstGA, AMD64AMode* amRIP,
@@ -970,6 +1005,16 @@ AMD64Instr* AMD64Instr_SseCMov ( AMD64CondCode cond, HReg src, HReg dst ) {
    vassert(cond != Acc_ALWAYS);
    return i;
 }
+AMD64Instr* AMD64Instr_SseMOVQ ( HReg gpr, HReg xmm, Bool toXMM ) {
+   AMD64Instr* i         = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag                = Ain_SseMOVQ;
+   i->Ain.SseMOVQ.gpr    = gpr;
+   i->Ain.SseMOVQ.xmm    = xmm;
+   i->Ain.SseMOVQ.toXMM  = toXMM;
+   vassert(hregClass(gpr) == HRcInt64);
+   vassert(hregClass(xmm) == HRcVec128);
+   return i;
+}
 AMD64Instr* AMD64Instr_SseShuf ( Int order, HReg src, HReg dst ) {
    AMD64Instr* i        = LibVEX_Alloc(sizeof(AMD64Instr));
    i->tag               = Ain_SseShuf;
@@ -979,23 +1024,62 @@ AMD64Instr* AMD64Instr_SseShuf ( Int order, HReg src, HReg dst ) {
    vassert(order >= 0 && order <= 0xFF);
    return i;
 }
-//uu AMD64Instr* AMD64Instr_AvxLdSt ( Bool isLoad,
-//uu                                  HReg reg, AMD64AMode* addr ) {
-//uu    AMD64Instr* i         = LibVEX_Alloc(sizeof(AMD64Instr));
-//uu    i->tag                = Ain_AvxLdSt;
-//uu    i->Ain.AvxLdSt.isLoad = isLoad;
-//uu    i->Ain.AvxLdSt.reg    = reg;
-//uu    i->Ain.AvxLdSt.addr   = addr;
-//uu    return i;
-//uu }
-//uu AMD64Instr* AMD64Instr_AvxReRg ( AMD64SseOp op, HReg re, HReg rg ) {
-//uu    AMD64Instr* i      = LibVEX_Alloc(sizeof(AMD64Instr));
-//uu    i->tag             = Ain_AvxReRg;
-//uu    i->Ain.AvxReRg.op  = op;
-//uu    i->Ain.AvxReRg.src = re;
-//uu    i->Ain.AvxReRg.dst = rg;
-//uu    return i;
-//uu }
+AMD64Instr* AMD64Instr_AvxLdSt ( Bool isLoad,
+                                 HReg reg, AMD64AMode* addr ) {
+   AMD64Instr* i         = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag                = Ain_AvxLdSt;
+   i->Ain.AvxLdSt.isLoad = isLoad;
+   i->Ain.AvxLdSt.reg    = reg;
+   i->Ain.AvxLdSt.addr   = addr;
+   return i;
+}
+AMD64Instr* AMD64Instr_AvxReRg ( AMD64SseOp op, HReg re, HReg rg ) {
+   AMD64Instr* i      = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag             = Ain_AvxReRg;
+   i->Ain.AvxReRg.op  = op;
+   i->Ain.AvxReRg.src = re;
+   i->Ain.AvxReRg.dst = rg;
+   return i;
+}
+AMD64Instr* AMD64Instr_Avx32Fx8 ( AMD64SseOp op, HReg src, HReg dst ) {
+   AMD64Instr* i       = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag              = Ain_Avx32Fx8;
+   i->Ain.Avx32Fx8.op  = op;
+   i->Ain.Avx32Fx8.src = src;
+   i->Ain.Avx32Fx8.dst = dst;
+   vassert(op >= Asse_ADDF && op <= Asse_MINF);
+   return i;
+}
+AMD64Instr* AMD64Instr_Avx64Fx4 ( AMD64SseOp op, HReg src, HReg dst ) {
+   AMD64Instr* i       = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag              = Ain_Avx64Fx4;
+   i->Ain.Avx64Fx4.op  = op;
+   i->Ain.Avx64Fx4.src = src;
+   i->Ain.Avx64Fx4.dst = dst;
+   vassert(op >= Asse_ADDF && op <= Asse_MINF);
+   return i;
+}
+AMD64Instr* AMD64Instr_AvxHLto256 ( HReg srcHi, HReg srcLo, HReg dst ) {
+   AMD64Instr* i           = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag                  = Ain_AvxHLto256;
+   i->Ain.AvxHLto256.srcHi = srcHi;
+   i->Ain.AvxHLto256.srcLo = srcLo;
+   i->Ain.AvxHLto256.dst   = dst;
+   return i;
+}
+AMD64Instr* AMD64Instr_AvxExtract ( Bool hi, HReg src, HReg dst ) {
+   AMD64Instr* i         = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag                = Ain_AvxExtract;
+   i->Ain.AvxExtract.hi  = hi;
+   i->Ain.AvxExtract.src = src;
+   i->Ain.AvxExtract.dst = dst;
+   return i;
+}
+AMD64Instr* AMD64Instr_AvxZeroUpper ( void ) {
+   AMD64Instr* i = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag        = Ain_AvxZeroUpper;
+   return i;
+}
 AMD64Instr* AMD64Instr_EvCheck ( AMD64AMode* amCounter,
                                  AMD64AMode* amFailAddr ) {
    AMD64Instr* i             = LibVEX_Alloc(sizeof(AMD64Instr));
@@ -1100,7 +1184,8 @@ void ppAMD64Instr ( AMD64Instr* i, Bool mode64 )
          ppHRegAMD64(i->Ain.XIndir.dstGA);
          vex_printf(",");
          ppAMD64AMode(i->Ain.XIndir.amRIP);
-         vex_printf("; movabsq $disp_indir,%%r11; jmp *%%r11 }");
+         vex_printf("; movabsq $disp_indir%s,%%r11; jmp *%%r11 }",
+                    i->Ain.XIndir.isRet ? "_ret" : "");
          return;
       case Ain_XAssisted:
          vex_printf("(xAssisted) ");
@@ -1286,30 +1371,73 @@ void ppAMD64Instr ( AMD64Instr* i, Bool mode64 )
          vex_printf(",");
          ppHRegAMD64(i->Ain.SseCMov.dst);
          return;
+      case Ain_SseMOVQ:
+         vex_printf("movq ");
+         if (i->Ain.SseMOVQ.toXMM) {
+            ppHRegAMD64(i->Ain.SseMOVQ.gpr);
+            vex_printf(",");
+            ppHRegAMD64(i->Ain.SseMOVQ.xmm);
+         } else {
+            ppHRegAMD64(i->Ain.SseMOVQ.xmm);
+            vex_printf(",");
+            ppHRegAMD64(i->Ain.SseMOVQ.gpr);
+         }
+         return;
       case Ain_SseShuf:
          vex_printf("pshufd $0x%x,", i->Ain.SseShuf.order);
          ppHRegAMD64(i->Ain.SseShuf.src);
          vex_printf(",");
          ppHRegAMD64(i->Ain.SseShuf.dst);
          return;
-      //uu case Ain_AvxLdSt:
-      //uu    vex_printf("vmovups ");
-      //uu    if (i->Ain.AvxLdSt.isLoad) {
-      //uu       ppAMD64AMode(i->Ain.AvxLdSt.addr);
-      //uu       vex_printf(",");
-      //uu       ppHRegAMD64(i->Ain.AvxLdSt.reg);
-      //uu    } else {
-      //uu       ppHRegAMD64(i->Ain.AvxLdSt.reg);
-      //uu       vex_printf(",");
-      //uu       ppAMD64AMode(i->Ain.AvxLdSt.addr);
-      //uu    }
-      //uu    return;
-      //uu case Ain_AvxReRg:
-      //uu    vex_printf("v%s ", showAMD64SseOp(i->Ain.SseReRg.op));
-      //uu    ppHRegAMD64(i->Ain.AvxReRg.src);
-      //uu    vex_printf(",");
-      //uu    ppHRegAMD64(i->Ain.AvxReRg.dst);
-      //uu    return;
+      case Ain_AvxLdSt:
+         vex_printf("vmovups ");
+         if (i->Ain.AvxLdSt.isLoad) {
+            ppAMD64AMode(i->Ain.AvxLdSt.addr);
+            vex_printf(",");
+            ppHRegAMD64(i->Ain.AvxLdSt.reg);
+         } else {
+            ppHRegAMD64(i->Ain.AvxLdSt.reg);
+            vex_printf(",");
+            ppAMD64AMode(i->Ain.AvxLdSt.addr);
+         }
+         return;
+      case Ain_AvxReRg:
+         vex_printf("v%s ", showAMD64SseOp(i->Ain.AvxReRg.op));
+         ppHRegAMD64(i->Ain.AvxReRg.src);
+         vex_printf(",");
+         ppHRegAMD64(i->Ain.AvxReRg.dst);
+         return;
+      case Ain_Avx32Fx8:
+         vex_printf("v%sps ", showAMD64SseOp(i->Ain.Avx32Fx8.op));
+         ppHRegAMD64(i->Ain.Avx32Fx8.src);
+         vex_printf(",");
+         ppHRegAMD64(i->Ain.Avx32Fx8.dst);
+         return;
+      case Ain_Avx64Fx4:
+         vex_printf("v%spd ", showAMD64SseOp(i->Ain.Avx64Fx4.op));
+         ppHRegAMD64(i->Ain.Avx64Fx4.src);
+         vex_printf(",");
+         ppHRegAMD64(i->Ain.Avx64Fx4.dst);
+         return;
+      case Ain_AvxHLto256:
+         vex_printf("vmovaps ");
+         ppHRegAMD64(i->Ain.AvxHLto256.srcLo);
+         vex_printf(",lo128(");
+         ppHRegAMD64(i->Ain.AvxHLto256.dst);
+         vex_printf("); vinsertf128 $1,");
+         ppHRegAMD64(i->Ain.AvxHLto256.srcHi);
+         vex_printf(",");
+         ppHRegAMD64(i->Ain.AvxHLto256.dst);
+         return;
+      case Ain_AvxExtract:
+         vex_printf("vextractf128 $%d,", i->Ain.AvxExtract.hi ? 1 : 0);
+         ppHRegAMD64(i->Ain.AvxExtract.src);
+         vex_printf(",");
+         ppHRegAMD64(i->Ain.AvxExtract.dst);
+         return;
+      case Ain_AvxZeroUpper:
+         vex_printf("vzeroupper");
+         return;
       case Ain_EvCheck:
          vex_printf("(evCheck) decl ");
          ppAMD64AMode(i->Ain.EvCheck.amCounter);
@@ -1418,6 +1546,10 @@ void getRegUsage_AMD64Instr ( HRegUsage* u, AMD64Instr* i, Bool mode64 )
          addHRegUse(u, HRmWrite, hregAMD64_XMM10());
          addHRegUse(u, HRmWrite, hregAMD64_XMM11());
          addHRegUse(u, HRmWrite, hregAMD64_XMM12());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM2());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM13());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM14());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM15());
 
          /* Now we have to state any parameter-carrying registers
             which might be read.  This depends on the regparmness. */
@@ -1594,28 +1726,61 @@ void getRegUsage_AMD64Instr ( HRegUsage* u, AMD64Instr* i, Bool mode64 )
          addHRegUse(u, HRmRead,   i->Ain.SseCMov.src);
          addHRegUse(u, HRmModify, i->Ain.SseCMov.dst);
          return;
+      case Ain_SseMOVQ:
+         addHRegUse(u, i->Ain.SseMOVQ.toXMM ? HRmRead : HRmWrite,
+                       i->Ain.SseMOVQ.gpr);
+         addHRegUse(u, i->Ain.SseMOVQ.toXMM ? HRmWrite : HRmRead,
+                       i->Ain.SseMOVQ.xmm);
+         return;
       case Ain_SseShuf:
          addHRegUse(u, HRmRead,  i->Ain.SseShuf.src);
          addHRegUse(u, HRmWrite, i->Ain.SseShuf.dst);
          return;
-      //uu case Ain_AvxLdSt:
-      //uu addRegUsage_AMD64AMode(u, i->Ain.AvxLdSt.addr);
-      //uu addHRegUse(u, i->Ain.AvxLdSt.isLoad ? HRmWrite : HRmRead,
-      //uu               i->Ain.AvxLdSt.reg);
-      //uu return;
-      //uu case Ain_AvxReRg:
-      //uu    if ( (i->Ain.AvxReRg.op == Asse_XOR
-      //uu          || i->Ain.AvxReRg.op == Asse_CMPEQ32)
-      //uu         && i->Ain.AvxReRg.src == i->Ain.AvxReRg.dst) {
-      //uu       /* See comments on the case for Ain_SseReRg. */
-      //uu       addHRegUse(u, HRmWrite, i->Ain.AvxReRg.dst);
-      //uu    } else {
-      //uu       addHRegUse(u, HRmRead, i->Ain.AvxReRg.src);
-      //uu       addHRegUse(u, i->Ain.AvxReRg.op == Asse_MOV 
-      //uu                        ? HRmWrite : HRmModify, 
-      //uu                     i->Ain.AvxReRg.dst);
-      //uu    }
-      //uu    return;
+      case Ain_AvxLdSt:
+         addRegUsage_AMD64AMode(u, i->Ain.AvxLdSt.addr);
+         addHRegUse(u, i->Ain.AvxLdSt.isLoad ? HRmWrite : HRmRead,
+                       i->Ain.AvxLdSt.reg);
+         return;
+      case Ain_AvxReRg:
+         if ( (i->Ain.AvxReRg.op == Asse_XOR
+               || i->Ain.AvxReRg.op == Asse_CMPEQ32)
+              && sameHReg(i->Ain.AvxReRg.src, i->Ain.AvxReRg.dst)) {
+            /* See comments on the case for Ain_SseReRg. */
+            addHRegUse(u, HRmWrite, i->Ain.AvxReRg.dst);
+         } else {
+            addHRegUse(u, HRmRead, i->Ain.AvxReRg.src);
+            addHRegUse(u, i->Ain.AvxReRg.op == Asse_MOV 
+                             ? HRmWrite : HRmModify, 
+                          i->Ain.AvxReRg.dst);
+         }
+         return;
+      case Ain_Avx32Fx8:
+         addHRegUse(u, HRmRead,   i->Ain.Avx32Fx8.src);
+         addHRegUse(u, HRmModify, i->Ain.Avx32Fx8.dst);
+         return;
+      case Ain_Avx64Fx4:
+         addHRegUse(u, HRmRead,   i->Ain.Avx64Fx4.src);
+         addHRegUse(u, HRmModify, i->Ain.Avx64Fx4.dst);
+         return;
+      case Ain_AvxHLto256:
+         addHRegUse(u, HRmRead,  i->Ain.AvxHLto256.srcHi);
+         addHRegUse(u, HRmRead,  i->Ain.AvxHLto256.srcLo);
+         addHRegUse(u, HRmWrite, i->Ain.AvxHLto256.dst);
+         return;
+      case Ain_AvxExtract:
+         addHRegUse(u, HRmRead,  i->Ain.AvxExtract.src);
+         addHRegUse(u, HRmWrite, i->Ain.AvxExtract.dst);
+         return;
+      case Ain_AvxZeroUpper:
+         /* Trashes the upper halves of all the ymm registers, which
+            for our purposes means all of the Vec256 ones.  The
+            Vec128 registers only live in the lower halves and so are
+            unaffected. */
+         addHRegUse(u, HRmWrite, hregAMD64_YMM2());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM13());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM14());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM15());
+         return;
       case Ain_EvCheck:
          /* We expect both amodes only to mention %rbp, so this is in
             fact pointless, since %rbp isn't allocatable, but anyway.. */
@@ -1787,18 +1952,41 @@ void mapRegs_AMD64Instr ( HRegRemap* m, AMD64Instr* i, Bool mode64 )
          mapReg(m, &i->Ain.SseCMov.src);
          mapReg(m, &i->Ain.SseCMov.dst);
          return;
+      case Ain_SseMOVQ:
+         mapReg(m, &i->Ain.SseMOVQ.gpr);
+         mapReg(m, &i->Ain.SseMOVQ.xmm);
+         return;
       case Ain_SseShuf:
          mapReg(m, &i->Ain.SseShuf.src);
          mapReg(m, &i->Ain.SseShuf.dst);
          return;
-      //uu case Ain_AvxLdSt:
-      //uu    mapReg(m, &i->Ain.AvxLdSt.reg);
-      //uu    mapRegs_AMD64AMode(m, i->Ain.AvxLdSt.addr);
-      //uu    break;
-      //uu case Ain_AvxReRg:
-      //uu    mapReg(m, &i->Ain.AvxReRg.src);
-      //uu    mapReg(m, &i->Ain.AvxReRg.dst);
-      //uu    return;
+      case Ain_AvxLdSt:
+         mapReg(m, &i->Ain.AvxLdSt.reg);
+         mapRegs_AMD64AMode(m, i->Ain.AvxLdSt.addr);
+         return;
+      case Ain_AvxReRg:
+         mapReg(m, &i->Ain.AvxReRg.src);
+         mapReg(m, &i->Ain.AvxReRg.dst);
+         return;
+      case Ain_Avx32Fx8:
+         mapReg(m, &i->Ain.Avx32Fx8.src);
+         mapReg(m, &i->Ain.Avx32Fx8.dst);
+         return;
+      case Ain_Avx64Fx4:
+         mapReg(m, &i->Ain.Avx64Fx4.src);
+         mapReg(m, &i->Ain.Avx64Fx4.dst);
+         return;
+      case Ain_AvxHLto256:
+         mapReg(m, &i->Ain.AvxHLto256.srcHi);
+         mapReg(m, &i->Ain.AvxHLto256.srcLo);
+         mapReg(m, &i->Ain.AvxHLto256.dst);
+         return;
+      case Ain_AvxExtract:
+         mapReg(m, &i->Ain.AvxExtract.src);
+         mapReg(m, &i->Ain.AvxExtract.dst);
+         return;
+      case Ain_AvxZeroUpper:
+         return;
       case Ain_EvCheck:
          /* We expect both amodes only to mention %rbp, so this is in
             fact pointless, since %rbp isn't allocatable, but anyway.. */
@@ -1837,13 +2025,13 @@ Bool isMove_AMD64Instr ( AMD64Instr* i, HReg* src, HReg* dst )
          *src = i->Ain.SseReRg.src;
          *dst = i->Ain.SseReRg.dst;
          return True;
-      //uu case Ain_AvxReRg:
-      //uu    /* Moves between AVX regs */
-      //uu    if (i->Ain.AvxReRg.op != Asse_MOV)
-      //uu       return False;
-      //uu    *src = i->Ain.AvxReRg.src;
-      //uu    *dst = i->Ain.AvxReRg.dst;
-      //uu    return True;
+      case Ain_AvxReRg:
+         /* Moves between AVX regs */
+         if (i->Ain.AvxReRg.op != Asse_MOV)
+            return False;
+         *src = i->Ain.AvxReRg.src;
+         *dst = i->Ain.AvxReRg.dst;
+         return True;
       default:
          return False;
    }
@@ -1871,6 +2059,9 @@ void genSpill_AMD64 ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
       case HRcVec128:
          *i1 = AMD64Instr_SseLdSt ( False/*store*/, 16, rreg, am );
          return;
+      case HRcVec256:
+         *i1 = AMD64Instr_AvxLdSt ( False/*store*/, rreg, am );
+         return;
       default: 
          ppHRegClass(hregClass(rreg));
          vpanic("genSpill_AMD64: unimplemented regclass");
@@ -1893,12 +2084,35 @@ void genReload_AMD64 ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
       case HRcVec128:
          *i1 = AMD64Instr_SseLdSt ( True/*load*/, 16, rreg, am );
          return;
+      case HRcVec256:
+         *i1 = AMD64Instr_AvxLdSt ( True/*load*/, rreg, am );
+         return;
       default: 
          ppHRegClass(hregClass(rreg));
          vpanic("genReload_AMD64: unimplemented regclass");
    }
 }
 
+/* Generate a reg-reg move between two real regs of the same class,
+   for the register allocator's use when splitting a live range. */
+
+AMD64Instr* genMove_AMD64 ( HReg from, HReg to, Bool mode64 )
+{
+   vassert(mode64 == True);
+   vassert(hregClass(from) == hregClass(to));
+   switch (hregClass(from)) {
+      case HRcInt64:
+         return AMD64Instr_Alu64R ( Aalu_MOV, AMD64RMI_Reg(from), to );
+      case HRcVec128:
+         return AMD64Instr_SseReRg ( Asse_MOV, from, to );
+      case HRcVec256:
+         return AMD64Instr_AvxReRg ( Asse_MOV, from, to );
+      default: 
+         ppHRegClass(hregClass(from));
+         vpanic("genMove_AMD64: unimplemented regclass");
+   }
+}
+
 
 /* --------- The amd64 assembler (bleh.) --------- */
 
@@ -1950,16 +2164,16 @@ static HReg vreg2ireg ( HReg r )
    return mkHReg(n, HRcInt64, False);
 }
 
-//uu /* Ditto for ymm regs. */
-//uu static HReg dvreg2ireg ( HReg r )
-//uu {
-//uu    UInt n;
-//uu    vassert(hregClass(r) == HRcVec256);
-//uu    vassert(!hregIsVirtual(r));
-//uu    n = hregNumber(r);
-//uu    vassert(n <= 15);
-//uu    return mkHReg(n, HRcInt64, False);
-//uu }
+/* Ditto for ymm regs. */
+static HReg dvreg2ireg ( HReg r )
+{
+   UInt n;
+   vassert(hregClass(r) == HRcVec256);
+   vassert(!hregIsVirtual(r));
+   n = hregNumber(r);
+   vassert(n <= 15);
+   return mkHReg(n, HRcInt64, False);
+}
 
 static UChar mkModRegRM ( UInt mod, UInt reg, UInt regmem )
 {
@@ -2167,85 +2381,100 @@ static UChar rexAMode_R ( HReg greg, HReg ereg )
 }
 
 
-//uu /* May 2012: this VEX prefix stuff is currently unused, but has
-//uu    verified correct (I reckon).  Certainly it has been known to
-//uu    produce correct VEX prefixes during testing. */
-//uu 
-//uu /* Assemble a 2 or 3 byte VEX prefix from parts.  rexR, rexX, rexB and
-//uu    notVvvvv need to be not-ed before packing.  mmmmm, rexW, L and pp go
-//uu    in verbatim.  There's no range checking on the bits. */
-//uu static UInt packVexPrefix ( UInt rexR, UInt rexX, UInt rexB,
-//uu                             UInt mmmmm, UInt rexW, UInt notVvvv,
-//uu                             UInt L, UInt pp )
-//uu {
-//uu    UChar byte0 = 0;
-//uu    UChar byte1 = 0;
-//uu    UChar byte2 = 0;
-//uu    if (rexX == 0 && rexB == 0 && mmmmm == 1 && rexW == 0) {
-//uu       /* 2 byte encoding is possible. */
-//uu       byte0 = 0xC5;
-//uu       byte1 = ((rexR ^ 1) << 7) | ((notVvvv ^ 0xF) << 3) 
-//uu               | (L << 2) | pp;
-//uu    } else {
-//uu       /* 3 byte encoding is needed. */
-//uu       byte0 = 0xC4;
-//uu       byte1 = ((rexR ^ 1) << 7) | ((rexX ^ 1) << 6)
-//uu               | ((rexB ^ 1) << 5) | mmmmm;
-//uu       byte2 = (rexW << 7) | ((notVvvv ^ 0xF) << 3) | (L << 2) | pp;
-//uu    }
-//uu    return (((UInt)byte2) << 16) | (((UInt)byte1) << 8) | ((UInt)byte0);
-//uu }
-//uu 
-//uu /* Make up a VEX prefix for a (greg,amode) pair.  First byte in bits
-//uu    7:0 of result, second in 15:8, third (for a 3 byte prefix) in
-//uu    23:16.  Has m-mmmm set to indicate a prefix of 0F, pp set to
-//uu    indicate no SIMD prefix, W=0 (ignore), L=1 (size=256), and
-//uu    vvvv=1111 (unused 3rd reg). */
-//uu static UInt vexAMode_M ( HReg greg, AMD64AMode* am )
-//uu {
-//uu    UChar L       = 1; /* size = 256 */
-//uu    UChar pp      = 0; /* no SIMD prefix */
-//uu    UChar mmmmm   = 1; /* 0F */
-//uu    UChar notVvvv = 0; /* unused */
-//uu    UChar rexW    = 0;
-//uu    UChar rexR    = 0;
-//uu    UChar rexX    = 0;
-//uu    UChar rexB    = 0;
-//uu    /* Same logic as in rexAMode_M. */
-//uu    if (am->tag == Aam_IR) {
-//uu       rexR = iregBit3(greg);
-//uu       rexX = 0; /* not relevant */
-//uu       rexB = iregBit3(am->Aam.IR.reg);
-//uu    }
-//uu    else if (am->tag == Aam_IRRS) {
-//uu       rexR = iregBit3(greg);
-//uu       rexX = iregBit3(am->Aam.IRRS.index);
-//uu       rexB = iregBit3(am->Aam.IRRS.base);
-//uu    } else {
-//uu       vassert(0);
-//uu    }
-//uu    return packVexPrefix( rexR, rexX, rexB, mmmmm, rexW, notVvvv, L, pp );
-//uu }
-//uu 
-//uu static UChar* emitVexPrefix ( UChar* p, UInt vex )
-//uu {
-//uu    switch (vex & 0xFF) {
-//uu       case 0xC5:
-//uu          *p++ = 0xC5;
-//uu          *p++ = (vex >> 8) & 0xFF;
-//uu          vassert(0 == (vex >> 16));
-//uu          break;
-//uu       case 0xC4:
-//uu          *p++ = 0xC4;
-//uu          *p++ = (vex >> 8) & 0xFF;
-//uu          *p++ = (vex >> 16) & 0xFF;
-//uu          vassert(0 == (vex >> 24));
-//uu          break;
-//uu       default:
-//uu          vassert(0);
-//uu    }
-//uu    return p;
-//uu }
+/* Assemble a 2 or 3 byte VEX prefix from parts.  rexR, rexX, rexB and
+   notVvvvv need to be not-ed before packing.  mmmmm, rexW, L and pp go
+   in verbatim.  There's no range checking on the bits. */
+static UInt packVexPrefix ( UInt rexR, UInt rexX, UInt rexB,
+                            UInt mmmmm, UInt rexW, UInt notVvvv,
+                            UInt L, UInt pp )
+{
+   UChar byte0 = 0;
+   UChar byte1 = 0;
+   UChar byte2 = 0;
+   if (rexX == 0 && rexB == 0 && mmmmm == 1 && rexW == 0) {
+      /* 2 byte encoding is possible. */
+      byte0 = 0xC5;
+      byte1 = ((rexR ^ 1) << 7) | ((notVvvv ^ 0xF) << 3) 
+              | (L << 2) | pp;
+   } else {
+      /* 3 byte encoding is needed. */
+      byte0 = 0xC4;
+      byte1 = ((rexR ^ 1) << 7) | ((rexX ^ 1) << 6)
+              | ((rexB ^ 1) << 5) | mmmmm;
+      byte2 = (rexW << 7) | ((notVvvv ^ 0xF) << 3) | (L << 2) | pp;
+   }
+   return (((UInt)byte2) << 16) | (((UInt)byte1) << 8) | ((UInt)byte0);
+}
+
+/* Make up a VEX prefix for a (greg,amode) pair.  First byte in bits
+   7:0 of result, second in 15:8, third (for a 3 byte prefix) in
+   23:16.  L, pp and mmmmm are as in the Intel docs (mmmmm=1 for 0F,
+   2 for 0F38, 3 for 0F3A); W is always zero.  vvvv is the number of
+   the extra source register, or 0 if there isn't one. */
+static UInt vexAMode_M ( HReg greg, AMD64AMode* am,
+                         UInt L, UInt pp, UInt mmmmm, UInt vvvv )
+{
+   UChar rexW    = 0;
+   UChar rexR    = 0;
+   UChar rexX    = 0;
+   UChar rexB    = 0;
+   /* Same logic as in rexAMode_M. */
+   if (am->tag == Aam_IR) {
+      rexR = iregBit3(greg);
+      rexX = 0; /* not relevant */
+      rexB = iregBit3(am->Aam.IR.reg);
+   }
+   else if (am->tag == Aam_IRRS) {
+      rexR = iregBit3(greg);
+      rexX = iregBit3(am->Aam.IRRS.index);
+      rexB = iregBit3(am->Aam.IRRS.base);
+   } else {
+      vassert(0);
+   }
+   return packVexPrefix( rexR, rexX, rexB, mmmmm, rexW, vvvv, L, pp );
+}
+
+/* Ditto for a (greg,ereg) pair. */
+static UInt vexAMode_R ( HReg greg, HReg ereg,
+                         UInt L, UInt pp, UInt mmmmm, UInt vvvv )
+{
+   return packVexPrefix( iregBit3(greg), 0, iregBit3(ereg),
+                         mmmmm, 0/*W*/, vvvv, L, pp );
+}
+
+static UChar* emitVexPrefix ( UChar* p, UInt vex )
+{
+   switch (vex & 0xFF) {
+      case 0xC5:
+         *p++ = 0xC5;
+         *p++ = (vex >> 8) & 0xFF;
+         vassert(0 == (vex >> 16));
+         break;
+      case 0xC4:
+         *p++ = 0xC4;
+         *p++ = (vex >> 8) & 0xFF;
+         *p++ = (vex >> 16) & 0xFF;
+         vassert(0 == (vex >> 24));
+         break;
+      default:
+         vassert(0);
+   }
+   return p;
+}
+
+/* Emit a 3-operand VEX.256 reg-reg insn of the form
+   "dst = dst `op` src", with dst in both the reg and vvvv fields. */
+static UChar* emitAvxRR ( UChar* p, UInt pp, UInt mmmmm, UChar opc,
+                          HReg dst, HReg src )
+{
+   HReg gdst = dvreg2ireg(dst);
+   HReg esrc = dvreg2ireg(src);
+   p = emitVexPrefix(p, vexAMode_R(gdst, esrc, 1/*L*/, pp, mmmmm,
+                                   hregNumber(gdst)));
+   *p++ = opc;
+   p = doAMode_R(p, gdst, esrc);
+   return p;
+}
 
 
 /* Emit ffree %st(N) */
@@ -2269,7 +2498,9 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
                       void* disp_cp_chain_me_to_slowEP,
                       void* disp_cp_chain_me_to_fastEP,
                       void* disp_cp_xindir,
-                      void* disp_cp_xassisted )
+                      void* disp_cp_xassisted,
+                      void* disp_cp_prime_ic,
+                      void* disp_cp_xindir_ret )
 {
    UInt /*irno,*/ opc, opc_rr, subopc_imm, opc_imma, opc_cl, opc_imm, subopc;
    UInt   xtra;
@@ -2278,7 +2509,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
    UChar* p = &buf[0];
    UChar* ptmp;
    Int    j;
-   vassert(nbuf >= 32);
+   vassert(nbuf >= 64);
    vassert(mode64 == True);
 
    /* Wrap an integer as a int register, for use assembling
@@ -2671,25 +2902,37 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       }
 
    case Ain_Call: {
+      Bool diamond = False;
       if (i->Ain.Call.cond != Acc_ALWAYS
           && i->Ain.Call.rloc.pri != RLPri_None) {
          /* The call might not happen (it isn't unconditional) and it
-            returns a result.  In this case we will need to generate a
+            returns a result.  In this case we need to generate a
             control flow diamond to put 0x555..555 in the return
-            register(s) in the case where the call doesn't happen.  If
-            this ever becomes necessary, maybe copy code from the ARM
-            equivalent.  Until that day, just give up. */
-         goto bad;
+            register in the case where the call doesn't happen, as
+            the ARM equivalent does:
+
+               j{!cond} else
+               <load target into %r11; call *%r11>
+               jmp after
+             else:
+               movabsq $0x5555555555555555, %rax
+             after:
+
+            Only integer results are handled. */
+         if (i->Ain.Call.rloc.pri != RLPri_Int)
+            goto bad;
+         diamond = True;
       }
       /* As per detailed comment for Ain_Call in
          getRegUsage_AMD64Instr above, %r11 is used as an address
          temporary. */
       /* jump over the following two insns if the condition does not
-         hold */
+         hold, plus the 2-byte jump over the 'else' arm if there is
+         one */
       Bool shortImm = fitsIn32Bits(i->Ain.Call.target);
       if (i->Ain.Call.cond != Acc_ALWAYS) {
          *p++ = toUChar(0x70 + (0xF & (i->Ain.Call.cond ^ 1)));
-         *p++ = shortImm ? 10 : 13;
+         *p++ = toUChar((shortImm ? 10 : 13) + (diamond ? 2 : 0));
          /* 10 or 13 bytes in the next two insns */
       }
       if (shortImm) {
@@ -2708,6 +2951,16 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       *p++ = 0x41;
       *p++ = 0xFF;
       *p++ = 0xD3;
+      if (diamond) {
+         /* 2 bytes: jmp after */
+         *p++ = 0xEB;
+         *p++ = 10;
+         /* else: 10 bytes: movabsq $0x5555555555555555, %rax */
+         *p++ = 0x48;
+         *p++ = 0xB8;
+         p = emit64(p, 0x5555555555555555ULL);
+         /* after: */
+      }
       goto done;
    }
 
@@ -2782,6 +3035,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
    }
 
    case Ain_XIndir: {
+      void* disp_indir;
       /* We're generating transfers that could lead indirectly to a
          chain-me, so we need to be sure this is actually allowed --
          no-redir translations are not allowed to reach normal
@@ -2790,6 +3044,12 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
          Hence: */
       vassert(disp_cp_xindir != NULL);
 
+      /* Returns go to their own dispatcher, if there is one, and are
+         never given an inline cache. */
+      disp_indir = disp_cp_xindir;
+      if (i->Ain.XIndir.isRet && disp_cp_xindir_ret != NULL)
+         disp_indir = disp_cp_xindir_ret;
+
       /* Use ptmp for backpatching conditional jumps. */
       ptmp = NULL;
 
@@ -2807,30 +3067,69 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       *p++ = 0x89;
       p = doAMode_M(p, i->Ain.XIndir.dstGA, i->Ain.XIndir.amRIP);
 
-      /* get $disp_cp_xindir into %r11 */
-      if (fitsIn32Bits(Ptr_to_ULong(disp_cp_xindir))) {
-         /* use a shorter encoding */
-         /* movl sign-extend(disp_cp_xindir), %r11 */
+      if (disp_cp_prime_ic != NULL && disp_indir == disp_cp_xindir) {
+         /* Inline cache.  NB: what goes on here has to be very
+            closely coordinated with primeXIndirIC_AMD64 below, and
+            the chain-me part with chainXDirect_AMD64 and
+            unchainXDirect_AMD64.  Initially the prediction is the
+            bogus guest address 1, so the first transfer goes to
+            disp_cp_prime_ic. */
+         HReg r11 = hregAMD64_R11();
+         /* movabsq $predicted_guest_addr, %r11 */
          *p++ = 0x49;
-         *p++ = 0xC7;
-         *p++ = 0xC3;
-         p = emit32(p, (UInt)Ptr_to_ULong(disp_cp_xindir));
-      } else {
-         /* movabsq $disp_cp_xindir, %r11 */
+         *p++ = 0xBB;
+         p = emit64(p, 1ULL);
+         /* cmpq %r11, dstGA */
+         *p++ = rexAMode_R(r11, i->Ain.XIndir.dstGA);
+         *p++ = 0x39;
+         p = doAMode_R(p, r11, i->Ain.XIndir.dstGA);
+         /* jnz over the chain-me */
+         *p++ = 0x75;
+         *p++ = 13;
+         /* movabsq $disp_cp_chain_me_to_slowEP,%r11; call *%r11.
+            This is an ordinary chain-me point.  It goes to the slow
+            entry point, since indirect transfers may well form
+            loops. */
          *p++ = 0x49;
          *p++ = 0xBB;
-         p = emit64(p, Ptr_to_ULong(disp_cp_xindir));
-      }
+         p = emit64(p, Ptr_to_ULong(disp_cp_chain_me_to_slowEP));
+         *p++ = 0x41;
+         *p++ = 0xFF;
+         *p++ = 0xD3;
+         /* movabsq $disp_cp_prime_ic,%r11; call *%r11.  Once primed,
+            this becomes movabsq $disp_cp_xindir,%r11; jmp *%r11. */
+         *p++ = 0x49;
+         *p++ = 0xBB;
+         p = emit64(p, Ptr_to_ULong(disp_cp_prime_ic));
+         *p++ = 0x41;
+         *p++ = 0xFF;
+         *p++ = 0xD3;
+      } else {
+         /* get $disp_indir into %r11 */
+         if (fitsIn32Bits(Ptr_to_ULong(disp_indir))) {
+            /* use a shorter encoding */
+            /* movl sign-extend(disp_indir), %r11 */
+            *p++ = 0x49;
+            *p++ = 0xC7;
+            *p++ = 0xC3;
+            p = emit32(p, (UInt)Ptr_to_ULong(disp_indir));
+         } else {
+            /* movabsq $disp_indir, %r11 */
+            *p++ = 0x49;
+            *p++ = 0xBB;
+            p = emit64(p, Ptr_to_ULong(disp_indir));
+         }
 
-      /* jmp *%r11 */
-      *p++ = 0x41;
-      *p++ = 0xFF;
-      *p++ = 0xE3;
+         /* jmp *%r11 */
+         *p++ = 0x41;
+         *p++ = 0xFF;
+         *p++ = 0xE3;
+      }
 
       /* Fix up the conditional jump, if there was one. */
       if (i->Ain.XIndir.cond != Acc_ALWAYS) {
          Int delta = p - ptmp;
-         vassert(delta > 0 && delta < 40);
+         vassert(delta > 0 && delta < 80);
          *ptmp = toUChar(delta-1);
       }
       goto done;
@@ -3395,6 +3694,31 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
          case Asse_UNPCKLW:  XX(0x66); XX(rex); XX(0x0F); XX(0x61); break;
          case Asse_UNPCKLD:  XX(0x66); XX(rex); XX(0x0F); XX(0x62); break;
          case Asse_UNPCKLQ:  XX(0x66); XX(rex); XX(0x0F); XX(0x6C); break;
+         /* SSE4.1/4.2 */
+         case Asse_CMPEQ64:  XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x29);
+                             break;
+         case Asse_CMPGT64S: XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x37);
+                             break;
+         case Asse_MUL32:    XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x40);
+                             break;
+         case Asse_MAX8S:    XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x3C);
+                             break;
+         case Asse_MAX16U:   XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x3E);
+                             break;
+         case Asse_MAX32S:   XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x3D);
+                             break;
+         case Asse_MAX32U:   XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x3F);
+                             break;
+         case Asse_MIN8S:    XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x38);
+                             break;
+         case Asse_MIN16U:   XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x3A);
+                             break;
+         case Asse_MIN32S:   XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x39);
+                             break;
+         case Asse_MIN32U:   XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x3B);
+                             break;
+         case Asse_PACKUSD:  XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x2B);
+                             break;
          default: goto bad;
       }
       p = doAMode_R(p, vreg2ireg(i->Ain.SseReRg.dst),
@@ -3421,6 +3745,20 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       *(ptmp-1) = toUChar(p - ptmp);
       goto done;
 
+   case Ain_SseMOVQ: {
+      Bool toXMM = i->Ain.SseMOVQ.toXMM;
+      HReg gpr   = i->Ain.SseMOVQ.gpr;
+      HReg xmm   = vreg2ireg(i->Ain.SseMOVQ.xmm);
+      /* movq %gpr,%xmm is 66 REX.W 0F 6E /r; the reverse is 7E /r.
+         In both cases the xmm register is in the greg field. */
+      *p++ = 0x66;
+      *p++ = rexAMode_R(xmm, gpr);
+      *p++ = 0x0F;
+      *p++ = toUChar(toXMM ? 0x6E : 0x7E);
+      p = doAMode_R(p, xmm, gpr);
+      goto done;
+   }
+
    case Ain_SseShuf:
       *p++ = 0x66; 
       *p++ = clearWBit(
@@ -3433,14 +3771,146 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       *p++ = (UChar)(i->Ain.SseShuf.order);
       goto done;
 
-   //uu case Ain_AvxLdSt: {
-   //uu    UInt vex = vexAMode_M( dvreg2ireg(i->Ain.AvxLdSt.reg),
-   //uu                           i->Ain.AvxLdSt.addr );
-   //uu    p = emitVexPrefix(p, vex);
-   //uu    *p++ = toUChar(i->Ain.AvxLdSt.isLoad ? 0x10 : 0x11);
-   //uu    p = doAMode_M(p, dvreg2ireg(i->Ain.AvxLdSt.reg), i->Ain.AvxLdSt.addr);
-   //uu      goto done;
-   //uu }
+   case Ain_AvxLdSt: {
+      HReg g = dvreg2ireg(i->Ain.AvxLdSt.reg);
+      /* vmovups, VEX.256.0F 10 /r (load) or 11 /r (store) */
+      p = emitVexPrefix(p, vexAMode_M(g, i->Ain.AvxLdSt.addr,
+                                      1/*L*/, 0/*pp*/, 1/*0F*/, 0));
+      *p++ = toUChar(i->Ain.AvxLdSt.isLoad ? 0x10 : 0x11);
+      p = doAMode_M(p, g, i->Ain.AvxLdSt.addr);
+      goto done;
+   }
+
+   case Ain_AvxReRg: {
+      /* Element-wise integer and logical ops only; the shifts, packs
+         and interleaves work within 128-bit lanes in their 256-bit
+         forms and so are not offered here. */
+      HReg dst = i->Ain.AvxReRg.dst;
+      HReg src = i->Ain.AvxReRg.src;
+      UInt pp = 1, mm = 1;
+      switch (i->Ain.AvxReRg.op) {
+         case Asse_MOV: {
+            /* vmovaps, VEX.256.0F 28 /r; no vvvv operand */
+            HReg g = dvreg2ireg(dst), e = dvreg2ireg(src);
+            p = emitVexPrefix(p, vexAMode_R(g, e, 1, 0, 1, 0));
+            *p++ = 0x28;
+            p = doAMode_R(p, g, e);
+            goto done;
+         }
+         case Asse_AND:      pp = 0; opc = 0x54; break;
+         case Asse_ANDN:     pp = 0; opc = 0x55; break;
+         case Asse_OR:       pp = 0; opc = 0x56; break;
+         case Asse_XOR:      pp = 0; opc = 0x57; break;
+         case Asse_ADD8:     opc = 0xFC; break;
+         case Asse_ADD16:    opc = 0xFD; break;
+         case Asse_ADD32:    opc = 0xFE; break;
+         case Asse_ADD64:    opc = 0xD4; break;
+         case Asse_QADD8S:   opc = 0xEC; break;
+         case Asse_QADD16S:  opc = 0xED; break;
+         case Asse_QADD8U:   opc = 0xDC; break;
+         case Asse_QADD16U:  opc = 0xDD; break;
+         case Asse_AVG8U:    opc = 0xE0; break;
+         case Asse_AVG16U:   opc = 0xE3; break;
+         case Asse_CMPEQ8:   opc = 0x74; break;
+         case Asse_CMPEQ16:  opc = 0x75; break;
+         case Asse_CMPEQ32:  opc = 0x76; break;
+         case Asse_CMPGT8S:  opc = 0x64; break;
+         case Asse_CMPGT16S: opc = 0x65; break;
+         case Asse_CMPGT32S: opc = 0x66; break;
+         case Asse_MAX16S:   opc = 0xEE; break;
+         case Asse_MAX8U:    opc = 0xDE; break;
+         case Asse_MIN16S:   opc = 0xEA; break;
+         case Asse_MIN8U:    opc = 0xDA; break;
+         case Asse_MULHI16U: opc = 0xE4; break;
+         case Asse_MULHI16S: opc = 0xE5; break;
+         case Asse_MUL16:    opc = 0xD5; break;
+         case Asse_SUB8:     opc = 0xF8; break;
+         case Asse_SUB16:    opc = 0xF9; break;
+         case Asse_SUB32:    opc = 0xFA; break;
+         case Asse_SUB64:    opc = 0xFB; break;
+         case Asse_QSUB8S:   opc = 0xE8; break;
+         case Asse_QSUB16S:  opc = 0xE9; break;
+         case Asse_QSUB8U:   opc = 0xD8; break;
+         case Asse_QSUB16U:  opc = 0xD9; break;
+         /* The rest live in the 0F38 map. */
+         case Asse_CMPEQ64:  mm = 2; opc = 0x29; break;
+         case Asse_CMPGT64S: mm = 2; opc = 0x37; break;
+         case Asse_MUL32:    mm = 2; opc = 0x40; break;
+         case Asse_MAX8S:    mm = 2; opc = 0x3C; break;
+         case Asse_MAX16U:   mm = 2; opc = 0x3E; break;
+         case Asse_MAX32S:   mm = 2; opc = 0x3D; break;
+         case Asse_MAX32U:   mm = 2; opc = 0x3F; break;
+         case Asse_MIN8S:    mm = 2; opc = 0x38; break;
+         case Asse_MIN16U:   mm = 2; opc = 0x3A; break;
+         case Asse_MIN32S:   mm = 2; opc = 0x39; break;
+         case Asse_MIN32U:   mm = 2; opc = 0x3B; break;
+         default: goto bad;
+      }
+      p = emitAvxRR(p, pp, mm, toUChar(opc), dst, src);
+      goto done;
+   }
+
+   case Ain_Avx32Fx8:
+   case Ain_Avx64Fx4: {
+      Bool is64 = i->tag == Ain_Avx64Fx4;
+      AMD64SseOp op = is64 ? i->Ain.Avx64Fx4.op : i->Ain.Avx32Fx8.op;
+      switch (op) {
+         case Asse_ADDF: opc = 0x58; break;
+         case Asse_SUBF: opc = 0x5C; break;
+         case Asse_MULF: opc = 0x59; break;
+         case Asse_DIVF: opc = 0x5E; break;
+         case Asse_MAXF: opc = 0x5F; break;
+         case Asse_MINF: opc = 0x5D; break;
+         default: goto bad;
+      }
+      p = emitAvxRR(p, is64 ? 1 : 0, 1, toUChar(opc),
+                    is64 ? i->Ain.Avx64Fx4.dst : i->Ain.Avx32Fx8.dst,
+                    is64 ? i->Ain.Avx64Fx4.src : i->Ain.Avx32Fx8.src);
+      goto done;
+   }
+
+   case Ain_AvxHLto256: {
+      HReg g  = dvreg2ireg(i->Ain.AvxHLto256.dst);
+      HReg lo = vreg2ireg(i->Ain.AvxHLto256.srcLo);
+      HReg hi = vreg2ireg(i->Ain.AvxHLto256.srcHi);
+      /* vmovaps %xmmLo, %xmmDst  (VEX.128.0F 28 /r) */
+      p = emitVexPrefix(p, vexAMode_R(g, lo, 0/*L*/, 0, 1, 0));
+      *p++ = 0x28;
+      p = doAMode_R(p, g, lo);
+      /* vinsertf128 $1, %xmmHi, %ymmDst, %ymmDst
+         (VEX.256.66.0F3A.W0 18 /r ib) */
+      p = emitVexPrefix(p, vexAMode_R(g, hi, 1, 1, 3, hregNumber(g)));
+      *p++ = 0x18;
+      p = doAMode_R(p, g, hi);
+      *p++ = 1;
+      goto done;
+   }
+
+   case Ain_AvxExtract: {
+      HReg g = dvreg2ireg(i->Ain.AvxExtract.src);
+      HReg e = vreg2ireg(i->Ain.AvxExtract.dst);
+      if (!i->Ain.AvxExtract.hi) {
+         /* vmovaps %xmmSrc, %xmmDst  (VEX.128.0F 28 /r), which also
+            zeroes the upper half of the destination. */
+         p = emitVexPrefix(p, vexAMode_R(e, g, 0/*L*/, 0, 1, 0));
+         *p++ = 0x28;
+         p = doAMode_R(p, e, g);
+         goto done;
+      }
+      /* vextractf128 $1, %ymmSrc, %xmmDst
+         (VEX.256.66.0F3A.W0 19 /r ib) */
+      p = emitVexPrefix(p, vexAMode_R(g, e, 1, 1, 3, 0));
+      *p++ = 0x19;
+      p = doAMode_R(p, g, e);
+      *p++ = 1;
+      goto done;
+   }
+
+   case Ain_AvxZeroUpper:
+      *p++ = 0xC5;
+      *p++ = 0xF8;
+      *p++ = 0x77;
+      goto done;
 
    case Ain_EvCheck: {
       /* We generate:
@@ -3516,7 +3986,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
    /*NOTREACHED*/
    
   done:
-   vassert(p - &buf[0] <= 32);
+   vassert(p - &buf[0] <= 64);
    return p - &buf[0];
 
 #  undef fake
@@ -3682,6 +4152,66 @@ VexInvalRange unchainXDirect_AMD64 ( void* place_to_unchain,
 }
 
 
+/* NB: what goes on here has to be very closely coordinated with the
+   emitInstr case for XIndir, above. */
+VexInvalRange primeXIndirIC_AMD64 ( void*  place_to_prime,
+                                    Addr64 guest_addr,
+                                    void*  disp_cp_prime_ic_EXPECTED,
+                                    void*  disp_cp_xindir )
+{
+   /* What we're expecting to see, with place_to_prime being the
+      address of the second movabsq, is:
+        movabsq $predicted_guest_addr, %r11
+        cmpq    %r11, dstGA
+        jnz     .+13
+        <13 bytes of chain-me point, chained or not>
+        movabsq $disp_cp_prime_ic_EXPECTED, %r11
+        call    *%r11
+      viz
+        49 BB <8 bytes value == 1>
+        <3 bytes: REX 39 ModRM>
+        75 0D
+        <13 bytes>
+        49 BB <8 bytes value == disp_cp_prime_ic_EXPECTED>
+        41 FF D3
+   */
+   UChar* p  = (UChar*)place_to_prime;
+   UChar* ic = p - 13 - 2 - 3 - 10;
+   vassert(ic[0] == 0x49);
+   vassert(ic[1] == 0xBB);
+   vassert(*(ULong*)(&ic[2]) == 1ULL);
+   vassert(ic[11] == 0x39);
+   vassert(ic[13] == 0x75);
+   vassert(ic[14] == 0x0D);
+   vassert(p[0] == 0x49);
+   vassert(p[1] == 0xBB);
+   vassert(*(ULong*)(&p[2]) == Ptr_to_ULong(disp_cp_prime_ic_EXPECTED));
+   vassert(p[10] == 0x41);
+   vassert(p[11] == 0xFF);
+   vassert(p[12] == 0xD3);
+   /* And what we want to change it to is:
+        movabsq $guest_addr, %r11
+        cmpq    %r11, dstGA
+        jnz     .+13
+        <13 bytes of chain-me point, unchanged>
+        movabsq $disp_cp_xindir, %r11
+        jmp     *%r11
+      viz
+        49 BB <8 bytes value == guest_addr>
+        <3 bytes: REX 39 ModRM>
+        75 0D
+        <13 bytes>
+        49 BB <8 bytes value == disp_cp_xindir>
+        41 FF E3
+   */
+   *(ULong*)(&ic[2]) = guest_addr;
+   *(ULong*)(&p[2])  = Ptr_to_ULong(disp_cp_xindir);
+   p[12] = 0xE3;
+   VexInvalRange vir = { (HWord)ic, (HWord)(p + 13 - ic) };
+   return vir;
+}
+
+
 /* Patch the counter address into a profile inc point, as previously
    created by the Ain_ProfInc case for emit_AMD64Instr. */
 VexInvalRange patchProfInc_AMD64 ( void*  place_to_patch,
@@ -43,7 +43,10 @@
 /* --------- Registers. --------- */
 
 /* The usual HReg abstraction.  There are 16 real int regs, 6 real
-   float regs, and 16 real vector regs.
+   float regs, and 16 real vector regs.  The ymm registers overlay
+   the xmm ones, so the two classes are given disjoint sets of
+   physical registers: xmm3 .. xmm12 are Vec128, and ymm2, ymm13 ..
+   ymm15 are Vec256.
 */
 
 extern void ppHRegAMD64 ( HReg );
@@ -65,6 +68,10 @@ extern HReg hregAMD64_R13 ( void );
 extern HReg hregAMD64_R14 ( void );
 extern HReg hregAMD64_R15 ( void );
 
+/* The host registers holding the guest registers named by
+   VexAbiInfo.host_amd64_guest_reg_cache[0] and [1]. */
+extern HReg hregAMD64_GuestRegCache ( Int i );
+
 extern HReg hregAMD64_FAKE0 ( void );
 extern HReg hregAMD64_FAKE1 ( void );
 extern HReg hregAMD64_FAKE2 ( void );
@@ -85,6 +92,11 @@ extern HReg hregAMD64_XMM10 ( void );
 extern HReg hregAMD64_XMM11 ( void );
 extern HReg hregAMD64_XMM12 ( void );
 
+extern HReg hregAMD64_YMM2  ( void );
+extern HReg hregAMD64_YMM13 ( void );
+extern HReg hregAMD64_YMM14 ( void );
+extern HReg hregAMD64_YMM15 ( void );
+
 
 /* --------- Condition codes, AMD encoding. --------- */
 
@@ -342,7 +354,14 @@ typedef
       Asse_SAR16, Asse_SAR32, 
       Asse_PACKSSD, Asse_PACKSSW, Asse_PACKUSW,
       Asse_UNPCKHB, Asse_UNPCKHW, Asse_UNPCKHD, Asse_UNPCKHQ,
-      Asse_UNPCKLB, Asse_UNPCKLW, Asse_UNPCKLD, Asse_UNPCKLQ
+      Asse_UNPCKLB, Asse_UNPCKLW, Asse_UNPCKLD, Asse_UNPCKLQ,
+      /* SSE4.1/4.2 (0F38 map); there are no SSE2 encodings of these.
+         Also available in 256-bit form on AVX2 hosts. */
+      Asse_CMPEQ64, Asse_CMPGT64S,
+      Asse_MUL32,
+      Asse_MAX8S, Asse_MAX16U, Asse_MAX32S, Asse_MAX32U,
+      Asse_MIN8S, Asse_MIN16U, Asse_MIN32S, Asse_MIN32U,
+      Asse_PACKUSD
    }
    AMD64SseOp;
 
@@ -391,6 +410,7 @@ typedef
       Ain_SseLdSt,     /* SSE load/store 32/64/128 bits, no alignment
                           constraints, upper 96/64/0 bits arbitrary */
       Ain_SseLdzLO,    /* SSE load low 32/64 bits, zero remainder of reg */
+      Ain_SseMOVQ,     /* SSE2 movq of xmm[63:0] to/from GPR */
       Ain_Sse32Fx4,    /* SSE binary, 32Fx4 */
       Ain_Sse32FLo,    /* SSE binary, 32F in lowest lane only */
       Ain_Sse64Fx2,    /* SSE binary, 64Fx2 */
@@ -398,9 +418,14 @@ typedef
       Ain_SseReRg,     /* SSE binary general reg-reg, Re, Rg */
       Ain_SseCMov,     /* SSE conditional move */
       Ain_SseShuf,     /* SSE2 shuffle (pshufd) */
-      //uu Ain_AvxLdSt,     /* AVX load/store 256 bits,
-      //uu                     no alignment constraints */
-      //uu Ain_AvxReRg,     /* AVX binary general reg-reg, Re, Rg */
+      Ain_AvxLdSt,     /* AVX load/store 256 bits,
+                          no alignment constraints */
+      Ain_AvxReRg,     /* AVX binary general reg-reg, Re, Rg */
+      Ain_Avx32Fx8,    /* AVX binary, 32Fx8 */
+      Ain_Avx64Fx4,    /* AVX binary, 64Fx4 */
+      Ain_AvxHLto256,  /* AVX: glue two xmm regs into a ymm reg */
+      Ain_AvxExtract,  /* AVX: copy one half of a ymm reg to a xmm reg */
+      Ain_AvxZeroUpper,/* vzeroupper */
       Ain_EvCheck,     /* Event check */
       Ain_ProfInc      /* 64-bit profile counter increment */
    }
@@ -489,6 +514,7 @@ typedef
             HReg          dstGA;
             AMD64AMode*   amRIP;
             AMD64CondCode cond; /* can be Acc_ALWAYS */
+            Bool          isRet; /* for an Ijk_Ret exit? */
          } XIndir;
          /* Assisted transfer to a guest address, most general case.
             Not chainable.  May be conditional. */
@@ -630,6 +656,11 @@ typedef
             HReg        reg;
             AMD64AMode* addr;
          } SseLdzLO;
+         struct {
+            HReg        gpr;
+            HReg        xmm;
+            Bool        toXMM; // when moving to xmm, xmm[127:64] is zeroed
+         } SseMOVQ;
          struct {
             AMD64SseOp op;
             HReg       src;
@@ -667,16 +698,36 @@ typedef
             HReg   src;
             HReg   dst;
          } SseShuf;
-         //uu struct {
-         //uu    Bool        isLoad;
-         //uu    HReg        reg;
-         //uu    AMD64AMode* addr;
-         //uu } AvxLdSt;
-         //uu struct {
-         //uu    AMD64SseOp op;
-         //uu    HReg       src;
-         //uu    HReg       dst;
-         //uu } AvxReRg;
+         struct {
+            Bool        isLoad;
+            HReg        reg;
+            AMD64AMode* addr;
+         } AvxLdSt;
+         struct {
+            AMD64SseOp op;
+            HReg       src;
+            HReg       dst;
+         } AvxReRg;
+         struct {
+            AMD64SseOp op;
+            HReg       src;
+            HReg       dst;
+         } Avx32Fx8;
+         struct {
+            AMD64SseOp op;
+            HReg       src;
+            HReg       dst;
+         } Avx64Fx4;
+         struct {
+            HReg       srcHi; /* xmm */
+            HReg       srcLo; /* xmm */
+            HReg       dst;   /* ymm */
+         } AvxHLto256;
+         struct {
+            Bool       hi;    /* which half */
+            HReg       src;   /* ymm */
+            HReg       dst;   /* xmm */
+         } AvxExtract;
          struct {
             AMD64AMode* amCounter;
             AMD64AMode* amFailAddr;
@@ -706,7 +757,7 @@ extern AMD64Instr* AMD64Instr_Call       ( AMD64CondCode, Addr64, Int, RetLoc );
 extern AMD64Instr* AMD64Instr_XDirect    ( Addr64 dstGA, AMD64AMode* amRIP,
                                            AMD64CondCode cond, Bool toFastEP );
 extern AMD64Instr* AMD64Instr_XIndir     ( HReg dstGA, AMD64AMode* amRIP,
-                                           AMD64CondCode cond );
+                                           AMD64CondCode cond, Bool isRet );
 extern AMD64Instr* AMD64Instr_XAssisted  ( HReg dstGA, AMD64AMode* amRIP,
                                            AMD64CondCode cond, IRJumpKind jk );
 extern AMD64Instr* AMD64Instr_CMov64     ( AMD64CondCode, AMD64RM* src, HReg dst );
@@ -732,6 +783,7 @@ extern AMD64Instr* AMD64Instr_SseSF2SI   ( Int szS, Int szD, HReg src, HReg dst
 extern AMD64Instr* AMD64Instr_SseSDSS    ( Bool from64, HReg src, HReg dst );
 extern AMD64Instr* AMD64Instr_SseLdSt    ( Bool isLoad, Int sz, HReg, AMD64AMode* );
 extern AMD64Instr* AMD64Instr_SseLdzLO   ( Int sz, HReg, AMD64AMode* );
+extern AMD64Instr* AMD64Instr_SseMOVQ    ( HReg gpr, HReg xmm, Bool toXMM );
 extern AMD64Instr* AMD64Instr_Sse32Fx4   ( AMD64SseOp, HReg, HReg );
 extern AMD64Instr* AMD64Instr_Sse32FLo   ( AMD64SseOp, HReg, HReg );
 extern AMD64Instr* AMD64Instr_Sse64Fx2   ( AMD64SseOp, HReg, HReg );
@@ -739,8 +791,13 @@ extern AMD64Instr* AMD64Instr_Sse64FLo   ( AMD64SseOp, HReg, HReg );
 extern AMD64Instr* AMD64Instr_SseReRg    ( AMD64SseOp, HReg, HReg );
 extern AMD64Instr* AMD64Instr_SseCMov    ( AMD64CondCode, HReg src, HReg dst );
 extern AMD64Instr* AMD64Instr_SseShuf    ( Int order, HReg src, HReg dst );
-//uu extern AMD64Instr* AMD64Instr_AvxLdSt    ( Bool isLoad, HReg, AMD64AMode* );
-//uu extern AMD64Instr* AMD64Instr_AvxReRg    ( AMD64SseOp, HReg, HReg );
+extern AMD64Instr* AMD64Instr_AvxLdSt    ( Bool isLoad, HReg, AMD64AMode* );
+extern AMD64Instr* AMD64Instr_AvxReRg    ( AMD64SseOp, HReg, HReg );
+extern AMD64Instr* AMD64Instr_Avx32Fx8   ( AMD64SseOp, HReg, HReg );
+extern AMD64Instr* AMD64Instr_Avx64Fx4   ( AMD64SseOp, HReg, HReg );
+extern AMD64Instr* AMD64Instr_AvxHLto256 ( HReg srcHi, HReg srcLo, HReg dst );
+extern AMD64Instr* AMD64Instr_AvxExtract ( Bool hi, HReg src, HReg dst );
+extern AMD64Instr* AMD64Instr_AvxZeroUpper ( void );
 extern AMD64Instr* AMD64Instr_EvCheck    ( AMD64AMode* amCounter,
                                            AMD64AMode* amFailAddr );
 extern AMD64Instr* AMD64Instr_ProfInc    ( void );
@@ -759,12 +816,15 @@ extern Int          emit_AMD64Instr        ( /*MB_MOD*/Bool* is_profInc,
                                              void* disp_cp_chain_me_to_slowEP,
                                              void* disp_cp_chain_me_to_fastEP,
                                              void* disp_cp_xindir,
-                                             void* disp_cp_xassisted );
+                                             void* disp_cp_xassisted,
+                                             void* disp_cp_prime_ic,
+                                             void* disp_cp_xindir_ret );
 
 extern void genSpill_AMD64  ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                               HReg rreg, Int offset, Bool );
 extern void genReload_AMD64 ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                               HReg rreg, Int offset, Bool );
+extern AMD64Instr* genMove_AMD64 ( HReg from, HReg to, Bool );
 
 extern void         getAllocableRegs_AMD64 ( Int*, HReg** );
 extern HInstrArray* iselSB_AMD64           ( IRSB*, 
@@ -793,6 +853,13 @@ extern VexInvalRange unchainXDirect_AMD64 ( void* place_to_unchain,
                                             void* place_to_jump_to_EXPECTED,
                                             void* disp_cp_chain_me );
 
+/* Prime the inline cache of an XIndir, given the address of its
+   call to disp_cp_prime_ic. */
+extern VexInvalRange primeXIndirIC_AMD64 ( void*  place_to_prime,
+                                           Addr64 guest_addr,
+                                           void*  disp_cp_prime_ic_EXPECTED,
+                                           void*  disp_cp_xindir );
+
 /* Patch the counter location into an existing ProfInc point. */
 extern VexInvalRange patchProfInc_AMD64 ( void*  place_to_patch,
                                           ULong* location_of_counter );
@@ -119,7 +119,9 @@ static Bool isZeroU8 ( IRExpr* e )
         - vregmapHI is only used for 128-bit integer-typed
              IRTemps.  It holds the identity of a second
              64-bit virtual HReg, which holds the high half
-             of the value.
+             of the value.  It is also used for V256-typed
+             IRTemps, unless avx256 (below) is set, in which
+             case those live in a single Vec256 register.
 
    - The host subarchitecture we are selecting insns for.  
      This is set at the start and does not change.
@@ -132,6 +134,11 @@ static Bool isZeroU8 ( IRExpr* e )
      instructions for control flow transfers, or whether we must use
      XAssisted.
 
+   - A Bool indicating whether V256 values are to be handled
+     natively in ymm registers.  This is only so for AVX2 hosts, and
+     then only for blocks which contain V256-typed IRTemps.
+     Otherwise they are split into pairs of xmm registers.
+
    - The maximum guest address of any guest insn in this block.
      Actually, the address of the highest-addressed byte from any insn
      in this block.  Is set at the start and does not change.  This is
@@ -154,10 +161,16 @@ typedef
       Int          n_vregmap;
 
       UInt         hwcaps;
+      Bool         avx256;
 
       Bool         chainingAllowed;
       Addr64       max_ga;
 
+      /* Guest state offsets of the guest registers which live in
+         hregAMD64_GuestRegCache(0) and (1), or -1.  See
+         VexAbiInfo.host_amd64_guest_reg_cache. */
+      Int          guest_reg_cache[2];
+
       /* These are modified as we go along. */
       HInstrArray* code;
       Int          vreg_ctr;
@@ -184,6 +197,11 @@ static void lookupIRTempPair ( HReg* vrHI, HReg* vrLO,
 
 static void addInstr ( ISelEnv* env, AMD64Instr* instr )
 {
+   /* Avoid the AVX-to-SSE transition penalty in helpers, which will
+      have been compiled for legacy SSE.  The call trashes the ymm
+      registers anyway, so this costs nothing extra. */
+   if (env->avx256 && instr->tag == Ain_Call)
+      addInstr(env, AMD64Instr_AvxZeroUpper());
    addHInstr(env->code, instr);
    if (vex_traceflags & VEX_TRACE_VCODE) {
       ppAMD64Instr(instr, True);
@@ -191,6 +209,26 @@ static void addInstr ( ISelEnv* env, AMD64Instr* instr )
    }
 }
 
+/* If the guest state slice [offset, offset+size) is part of a guest
+   register kept in a host register, return the index of that host
+   register (for hregAMD64_GuestRegCache), else -1.  The amd64 front
+   end only accesses the integer registers as 1, 2, 4 or 8 bytes at
+   their start, or as the single byte at offset 1 (%ah etc), so
+   nothing else is allowed to overlap. */
+static Int cachedGuestReg ( ISelEnv* env, Int offset, Int size )
+{
+   Int i, base;
+   for (i = 0; i < 2; i++) {
+      base = env->guest_reg_cache[i];
+      if (base < 0 || offset + size <= base || offset >= base + 8)
+         continue;
+      vassert((offset == base && size <= 8)
+              || (offset == base + 1 && size == 1));
+      return i;
+   }
+   return -1;
+}
+
 static HReg newVRegI ( ISelEnv* env )
 {
    HReg reg = mkHReg(env->vreg_ctr, HRcInt64, True/*virtual reg*/);
@@ -205,6 +243,14 @@ static HReg newVRegV ( ISelEnv* env )
    return reg;
 }
 
+static HReg newVRegDV ( ISelEnv* env )
+{
+   vassert(env->avx256);
+   HReg reg = mkHReg(env->vreg_ctr, HRcVec256, True/*virtual reg*/);
+   env->vreg_ctr++;
+   return reg;
+}
+
 
 /*---------------------------------------------------------*/
 /*--- ISEL: Forward declarations                        ---*/
@@ -253,6 +299,9 @@ static void          iselDVecExpr_wrk ( /*OUT*/HReg* rHi, HReg* rLo,
 static void          iselDVecExpr     ( /*OUT*/HReg* rHi, HReg* rLo, 
                                         ISelEnv* env, IRExpr* e );
 
+static HReg          iselV256Expr_wrk    ( ISelEnv* env, IRExpr* e );
+static HReg          iselV256Expr        ( ISelEnv* env, IRExpr* e );
+
 
 /*---------------------------------------------------------*/
 /*--- ISEL: Misc helpers                                ---*/
@@ -397,6 +446,9 @@ static AMD64Instr* iselIntExpr_single_instruction ( ISelEnv* env,
 
    if (e->tag == Iex_Get) {
       vassert(e->Iex.Get.ty == Ity_I64);
+      Int c = cachedGuestReg(env, e->Iex.Get.offset, 8);
+      if (c >= 0)
+         return mk_iMOVsd_RR(hregAMD64_GuestRegCache(c), dst);
       return AMD64Instr_Alu64R(
                 Aalu_MOV,
                 AMD64RMI_Mem(
@@ -1078,7 +1130,136 @@ static HReg iselIntExpr_R_wrk ( ISelEnv* env, IRExpr* e )
          return dst;
       }
 
-      /* Deal with 64-bit SIMD binary ops */
+      /* Deal with 64-bit SIMD binary ops.  Where SSE2 has an
+         element-wise equivalent, do them in the low halves of xmm
+         registers; the upper halves compute junk which is never
+         looked at. */
+      {
+      AMD64SseOp op = Asse_INVALID;
+      Bool arg1isEReg = False;
+      Bool hiHalf = False, packBoth = False;
+      switch (e->Iex.Binop.op) {
+         case Iop_Add8x8:     op = Asse_ADD8;     break;
+         case Iop_Add16x4:    op = Asse_ADD16;    break;
+         case Iop_Add32x2:    op = Asse_ADD32;    break;
+         case Iop_Avg8Ux8:    op = Asse_AVG8U;    break;
+         case Iop_Avg16Ux4:   op = Asse_AVG16U;   break;
+         case Iop_CmpEQ8x8:   op = Asse_CMPEQ8;   break;
+         case Iop_CmpEQ16x4:  op = Asse_CMPEQ16;  break;
+         case Iop_CmpEQ32x2:  op = Asse_CMPEQ32;  break;
+         case Iop_CmpGT8Sx8:  op = Asse_CMPGT8S;  break;
+         case Iop_CmpGT16Sx4: op = Asse_CMPGT16S; break;
+         case Iop_CmpGT32Sx2: op = Asse_CMPGT32S; break;
+         case Iop_Max8Ux8:    op = Asse_MAX8U;    break;
+         case Iop_Max16Sx4:   op = Asse_MAX16S;   break;
+         case Iop_Min8Ux8:    op = Asse_MIN8U;    break;
+         case Iop_Min16Sx4:   op = Asse_MIN16S;   break;
+         case Iop_Mul16x4:    op = Asse_MUL16;    break;
+         case Iop_MulHi16Sx4: op = Asse_MULHI16S; break;
+         case Iop_MulHi16Ux4: op = Asse_MULHI16U; break;
+         case Iop_QAdd8Sx8:   op = Asse_QADD8S;   break;
+         case Iop_QAdd16Sx4:  op = Asse_QADD16S;  break;
+         case Iop_QAdd8Ux8:   op = Asse_QADD8U;   break;
+         case Iop_QAdd16Ux4:  op = Asse_QADD16U;  break;
+         case Iop_QSub8Sx8:   op = Asse_QSUB8S;   break;
+         case Iop_QSub16Sx4:  op = Asse_QSUB16S;  break;
+         case Iop_QSub8Ux8:   op = Asse_QSUB8U;   break;
+         case Iop_QSub16Ux4:  op = Asse_QSUB16U;  break;
+         case Iop_Sub8x8:     op = Asse_SUB8;     break;
+         case Iop_Sub16x4:    op = Asse_SUB16;    break;
+         case Iop_Sub32x2:    op = Asse_SUB32;    break;
+         case Iop_Mul32x2:
+            /* SSE4.1 pmulld.  There's no hwcaps bit for SSE4, but
+               all AVX-capable hosts have it. */
+            if (env->hwcaps & VEX_HWCAPS_AMD64_AVX)
+               op = Asse_MUL32;
+            break;
+         /* The interleaves produce their 64-bit result in the low
+            (LO) or high (HI) half of the 128-bit one. */
+         case Iop_InterleaveLO8x8:
+            op = Asse_UNPCKLB; arg1isEReg = True; break;
+         case Iop_InterleaveLO16x4:
+            op = Asse_UNPCKLW; arg1isEReg = True; break;
+         case Iop_InterleaveLO32x2:
+            op = Asse_UNPCKLD; arg1isEReg = True; break;
+         case Iop_InterleaveHI8x8:
+            op = Asse_UNPCKLB; arg1isEReg = True; hiHalf = True; break;
+         case Iop_InterleaveHI16x4:
+            op = Asse_UNPCKLW; arg1isEReg = True; hiHalf = True; break;
+         case Iop_InterleaveHI32x2:
+            op = Asse_UNPCKLD; arg1isEReg = True; hiHalf = True; break;
+         /* The narrows need both operands in the same register:
+            arg2 in the low half and arg1 in the high half. */
+         case Iop_QNarrowBin32Sto16Sx4:
+            op = Asse_PACKSSD; packBoth = True; break;
+         case Iop_QNarrowBin16Sto8Sx8:
+            op = Asse_PACKSSW; packBoth = True; break;
+         case Iop_QNarrowBin16Sto8Ux8:
+            op = Asse_PACKUSW; packBoth = True; break;
+         default:
+            break;
+      }
+      if (op != Asse_INVALID) {
+         HReg dst  = newVRegI(env);
+         HReg argL = iselIntExpr_R(env, e->Iex.Binop.arg1);
+         HReg argR = iselIntExpr_R(env, e->Iex.Binop.arg2);
+         HReg vL   = newVRegV(env);
+         HReg vR   = newVRegV(env);
+         HReg vD   = vL;
+         addInstr(env, AMD64Instr_SseMOVQ(argL, vL, True/*toXMM*/));
+         addInstr(env, AMD64Instr_SseMOVQ(argR, vR, True/*toXMM*/));
+         if (packBoth) {
+            addInstr(env, AMD64Instr_SseReRg(Asse_UNPCKLQ, vL, vR));
+            addInstr(env, AMD64Instr_SseReRg(op, vR, vR));
+            vD = vR;
+         } else if (arg1isEReg) {
+            addInstr(env, AMD64Instr_SseReRg(op, vL, vR));
+            vD = vR;
+         } else {
+            addInstr(env, AMD64Instr_SseReRg(op, vR, vL));
+         }
+         if (hiHalf) {
+            HReg vT = newVRegV(env);
+            addInstr(env, AMD64Instr_SseShuf(0xEE, vD, vT));
+            vD = vT;
+         }
+         addInstr(env, AMD64Instr_SseMOVQ(dst, vD, False/*!toXMM*/));
+         return dst;
+      }
+      }
+
+      /* 64-bit SIMD shifts, likewise. */
+      {
+      AMD64SseOp op = Asse_INVALID;
+      switch (e->Iex.Binop.op) {
+         case Iop_ShlN16x4: op = Asse_SHL16; break;
+         case Iop_ShlN32x2: op = Asse_SHL32; break;
+         case Iop_ShrN16x4: op = Asse_SHR16; break;
+         case Iop_ShrN32x2: op = Asse_SHR32; break;
+         case Iop_SarN16x4: op = Asse_SAR16; break;
+         case Iop_SarN32x2: op = Asse_SAR32; break;
+         default: break;
+      }
+      if (op != Asse_INVALID) {
+         HReg dst  = newVRegI(env);
+         HReg argL = iselIntExpr_R(env, e->Iex.Binop.arg1);
+         HReg argR = iselIntExpr_R(env, e->Iex.Binop.arg2);
+         HReg vL   = newVRegV(env);
+         HReg vR   = newVRegV(env);
+         HReg amt  = newVRegI(env);
+         /* The shift amount is an I8, but the SSE shifts use all 64
+            bits of the count, so zero-extend it first. */
+         addInstr(env, mk_iMOVsd_RR(argR, amt));
+         addInstr(env, AMD64Instr_Alu64R(Aalu_AND, AMD64RMI_Imm(0xFF), amt));
+         addInstr(env, AMD64Instr_SseMOVQ(argL, vL, True/*toXMM*/));
+         addInstr(env, AMD64Instr_SseMOVQ(amt,  vR, True/*toXMM*/));
+         addInstr(env, AMD64Instr_SseReRg(op, vR, vL));
+         addInstr(env, AMD64Instr_SseMOVQ(dst, vL, False/*!toXMM*/));
+         return dst;
+      }
+      }
+
+      /* Anything else goes to a helper. */
       second_is_UInt = False;
       switch (e->Iex.Binop.op) {
          case Iop_Add8x8:
@@ -1222,6 +1403,7 @@ static HReg iselIntExpr_R_wrk ( ISelEnv* env, IRExpr* e )
             not marked as regparm functions. 
          */
          HReg dst  = newVRegI(env);
+         h_generic_note_use(e->Iex.Binop.op);
          HReg argL = iselIntExpr_R(env, e->Iex.Binop.arg1);
          HReg argR = iselIntExpr_R(env, e->Iex.Binop.arg2);
          if (second_is_UInt)
@@ -1697,6 +1879,7 @@ static HReg iselIntExpr_R_wrk ( ISelEnv* env, IRExpr* e )
             HReg dst = newVRegI(env);
             HReg arg = iselIntExpr_R(env, e->Iex.Unop.arg);
             fn = (HWord)h_generic_calc_GetMSBs8x8;
+            h_generic_note_use(e->Iex.Unop.op);
             addInstr(env, mk_iMOVsd_RR(arg, hregAMD64_RDI()) );
             addInstr(env, AMD64Instr_Call( Acc_ALWAYS, (ULong)fn,
                                            1, mk_RetLoc_simple(RLPri_Int) ));
@@ -1717,6 +1900,7 @@ static HReg iselIntExpr_R_wrk ( ISelEnv* env, IRExpr* e )
             HReg vec = iselVecExpr(env, e->Iex.Unop.arg);
             HReg rsp = hregAMD64_RSP();
             fn = (HWord)h_generic_calc_GetMSBs8x16;
+            h_generic_note_use(e->Iex.Unop.op);
             AMD64AMode* m8_rsp  = AMD64AMode_IR( -8, rsp);
             AMD64AMode* m16_rsp = AMD64AMode_IR(-16, rsp);
             addInstr(env, AMD64Instr_SseLdSt(False/*store*/,
@@ -1744,7 +1928,29 @@ static HReg iselIntExpr_R_wrk ( ISelEnv* env, IRExpr* e )
             break;
       }
 
-      /* Deal with unary 64-bit SIMD ops. */
+      /* Deal with unary 64-bit SIMD ops.  CmpNEZ can be done with SSE2
+         in the same way as the 128-bit versions. */
+      {
+      AMD64SseOp op = Asse_INVALID;
+      switch (e->Iex.Unop.op) {
+         case Iop_CmpNEZ32x2: op = Asse_CMPEQ32; break;
+         case Iop_CmpNEZ16x4: op = Asse_CMPEQ16; break;
+         case Iop_CmpNEZ8x8:  op = Asse_CMPEQ8;  break;
+         default: break;
+      }
+      if (op != Asse_INVALID) {
+         HReg dst  = newVRegI(env);
+         HReg arg  = iselIntExpr_R(env, e->Iex.Unop.arg);
+         HReg vA   = newVRegV(env);
+         HReg zero = generate_zeroes_V128(env);
+         addInstr(env, AMD64Instr_SseMOVQ(arg, vA, True/*toXMM*/));
+         addInstr(env, AMD64Instr_SseReRg(op, zero, vA));
+         addInstr(env, AMD64Instr_SseMOVQ(dst, do_sse_NotV128(env, vA),
+                                          False/*!toXMM*/));
+         return dst;
+      }
+      }
+
       switch (e->Iex.Unop.op) {
          case Iop_CmpNEZ32x2:
             fn = (HWord)h_generic_calc_CmpNEZ32x2; break;
@@ -1763,6 +1969,7 @@ static HReg iselIntExpr_R_wrk ( ISelEnv* env, IRExpr* e )
          */
          HReg dst = newVRegI(env);
          HReg arg = iselIntExpr_R(env, e->Iex.Unop.arg);
+         h_generic_note_use(e->Iex.Unop.op);
          addInstr(env, mk_iMOVsd_RR(arg, hregAMD64_RDI()) );
          addInstr(env, AMD64Instr_Call( Acc_ALWAYS, (ULong)fn, 1,
                                         mk_RetLoc_simple(RLPri_Int) ));
@@ -1775,6 +1982,18 @@ static HReg iselIntExpr_R_wrk ( ISelEnv* env, IRExpr* e )
 
    /* --------- GET --------- */
    case Iex_Get: {
+      if (ty == Ity_I64 || ty == Ity_I32 || ty == Ity_I16 || ty == Ity_I8) {
+         Int c = cachedGuestReg(env, e->Iex.Get.offset, sizeofIRType(ty));
+         if (c >= 0) {
+            /* Only the low bits of the result are significant, so a
+               copy will do, except for %ah and friends. */
+            HReg dst = newVRegI(env);
+            addInstr(env, mk_iMOVsd_RR(hregAMD64_GuestRegCache(c), dst));
+            if (e->Iex.Get.offset != env->guest_reg_cache[c])
+               addInstr(env, AMD64Instr_Sh64(Ash_SHR, 8, dst));
+            return dst;
+         }
+      }
       if (ty == Ity_I64) {
          HReg dst = newVRegI(env);
          addInstr(env, AMD64Instr_Alu64R(
@@ -2070,7 +2289,8 @@ static AMD64RMI* iselIntExpr_RMI_wrk ( ISelEnv* env, IRExpr* e )
    }
 
    /* special case: 64-bit GET */
-   if (e->tag == Iex_Get && ty == Ity_I64) {
+   if (e->tag == Iex_Get && ty == Ity_I64
+       && cachedGuestReg(env, e->Iex.Get.offset, 8) < 0) {
       return AMD64RMI_Mem(AMD64AMode_IR(e->Iex.Get.offset,
                                         hregAMD64_RBP()));
    }
@@ -2176,7 +2396,8 @@ static AMD64RM* iselIntExpr_RM_wrk ( ISelEnv* env, IRExpr* e )
    vassert(ty == Ity_I64 || ty == Ity_I32 || ty == Ity_I16 || ty == Ity_I8);
 
    /* special case: 64-bit GET */
-   if (e->tag == Iex_Get && ty == Ity_I64) {
+   if (e->tag == Iex_Get && ty == Ity_I64
+       && cachedGuestReg(env, e->Iex.Get.offset, 8) < 0) {
       return AMD64RM_Mem(AMD64AMode_IR(e->Iex.Get.offset,
                                        hregAMD64_RBP()));
    }
@@ -3301,6 +3522,14 @@ static HReg iselVecExpr_wrk ( ISelEnv* env, IRExpr* e )
       case Iop_V256toV128_0:
       case Iop_V256toV128_1: {
          HReg vHi, vLo;
+         if (env->avx256) {
+            HReg src = iselV256Expr(env, e->Iex.Unop.arg);
+            HReg dst = newVRegV(env);
+            addInstr(env, AMD64Instr_AvxExtract(
+                             e->Iex.Unop.op == Iop_V256toV128_1,
+                             src, dst));
+            return dst;
+         }
          iselDVecExpr(&vHi, &vLo, env, e->Iex.Unop.arg);
          return (e->Iex.Unop.op == Iop_V256toV128_1) ? vHi : vLo;
       }
@@ -3525,32 +3754,52 @@ static HReg iselVecExpr_wrk ( ISelEnv* env, IRExpr* e )
          return dst;
       }
 
-      case Iop_Mul32x4:    fn = (HWord)h_generic_calc_Mul32x4;
-                           goto do_SseAssistedBinary;
-      case Iop_Max32Sx4:   fn = (HWord)h_generic_calc_Max32Sx4;
-                           goto do_SseAssistedBinary;
-      case Iop_Min32Sx4:   fn = (HWord)h_generic_calc_Min32Sx4;
-                           goto do_SseAssistedBinary;
-      case Iop_Max32Ux4:   fn = (HWord)h_generic_calc_Max32Ux4;
-                           goto do_SseAssistedBinary;
-      case Iop_Min32Ux4:   fn = (HWord)h_generic_calc_Min32Ux4;
-                           goto do_SseAssistedBinary;
-      case Iop_Max16Ux8:   fn = (HWord)h_generic_calc_Max16Ux8;
-                           goto do_SseAssistedBinary;
-      case Iop_Min16Ux8:   fn = (HWord)h_generic_calc_Min16Ux8;
-                           goto do_SseAssistedBinary;
-      case Iop_Max8Sx16:   fn = (HWord)h_generic_calc_Max8Sx16;
-                           goto do_SseAssistedBinary;
-      case Iop_Min8Sx16:   fn = (HWord)h_generic_calc_Min8Sx16;
-                           goto do_SseAssistedBinary;
-      case Iop_CmpEQ64x2:  fn = (HWord)h_generic_calc_CmpEQ64x2;
-                           goto do_SseAssistedBinary;
-      case Iop_CmpGT64Sx2: fn = (HWord)h_generic_calc_CmpGT64Sx2;
-                           goto do_SseAssistedBinary;
-      case Iop_Perm32x4:   fn = (HWord)h_generic_calc_Perm32x4;
-                           goto do_SseAssistedBinary;
+      /* These have SSE4.1/4.2 equivalents.  There's no hwcaps bit
+         for SSE4, but all AVX-capable hosts have it; otherwise use a
+         helper. */
+      case Iop_Mul32x4:    op = Asse_MUL32;
+                           fn = (HWord)h_generic_calc_Mul32x4;
+                           goto do_Sse4OrAssisted;
+      case Iop_Max32Sx4:   op = Asse_MAX32S;
+                           fn = (HWord)h_generic_calc_Max32Sx4;
+                           goto do_Sse4OrAssisted;
+      case Iop_Min32Sx4:   op = Asse_MIN32S;
+                           fn = (HWord)h_generic_calc_Min32Sx4;
+                           goto do_Sse4OrAssisted;
+      case Iop_Max32Ux4:   op = Asse_MAX32U;
+                           fn = (HWord)h_generic_calc_Max32Ux4;
+                           goto do_Sse4OrAssisted;
+      case Iop_Min32Ux4:   op = Asse_MIN32U;
+                           fn = (HWord)h_generic_calc_Min32Ux4;
+                           goto do_Sse4OrAssisted;
+      case Iop_Max16Ux8:   op = Asse_MAX16U;
+                           fn = (HWord)h_generic_calc_Max16Ux8;
+                           goto do_Sse4OrAssisted;
+      case Iop_Min16Ux8:   op = Asse_MIN16U;
+                           fn = (HWord)h_generic_calc_Min16Ux8;
+                           goto do_Sse4OrAssisted;
+      case Iop_Max8Sx16:   op = Asse_MAX8S;
+                           fn = (HWord)h_generic_calc_Max8Sx16;
+                           goto do_Sse4OrAssisted;
+      case Iop_Min8Sx16:   op = Asse_MIN8S;
+                           fn = (HWord)h_generic_calc_Min8Sx16;
+                           goto do_Sse4OrAssisted;
+      case Iop_CmpEQ64x2:  op = Asse_CMPEQ64;
+                           fn = (HWord)h_generic_calc_CmpEQ64x2;
+                           goto do_Sse4OrAssisted;
+      case Iop_CmpGT64Sx2: op = Asse_CMPGT64S;
+                           fn = (HWord)h_generic_calc_CmpGT64Sx2;
+                           goto do_Sse4OrAssisted;
       case Iop_QNarrowBin32Sto16Ux8:
+                           op = Asse_PACKUSD; arg1isEReg = True;
                            fn = (HWord)h_generic_calc_QNarrowBin32Sto16Ux8;
+                           goto do_Sse4OrAssisted;
+      do_Sse4OrAssisted:
+         if (env->hwcaps & VEX_HWCAPS_AMD64_AVX)
+            goto do_SseReRg;
+         goto do_SseAssistedBinary;
+
+      case Iop_Perm32x4:   fn = (HWord)h_generic_calc_Perm32x4;
                            goto do_SseAssistedBinary;
       case Iop_NarrowBin16to8x16:
                            fn = (HWord)h_generic_calc_NarrowBin16to8x16;
@@ -3562,6 +3811,7 @@ static HReg iselVecExpr_wrk ( ISelEnv* env, IRExpr* e )
          /* RRRufff!  RRRufff code is what we're generating here.  Oh
             well. */
          vassert(fn != 0);
+         h_generic_note_use(e->Iex.Binop.op);
          HReg dst = newVRegV(env);
          HReg argL = iselVecExpr(env, e->Iex.Binop.arg1);
          HReg argR = iselVecExpr(env, e->Iex.Binop.arg2);
@@ -3614,6 +3864,7 @@ static HReg iselVecExpr_wrk ( ISelEnv* env, IRExpr* e )
          /* RRRufff!  RRRufff code is what we're generating here.  Oh
             well. */
          vassert(fn != 0);
+         h_generic_note_use(e->Iex.Binop.op);
          HReg dst = newVRegV(env);
          HReg argL = iselVecExpr(env, e->Iex.Binop.arg1);
          HReg argR = iselIntExpr_R(env, e->Iex.Binop.arg2);
@@ -3709,6 +3960,17 @@ static void iselDVecExpr_wrk ( /*OUT*/HReg* rHi, /*OUT*/HReg* rLo,
 
    /* read 256-bit IRTemp */
    if (e->tag == Iex_RdTmp) {
+      if (env->avx256) {
+         /* It lives in a ymm register; split it. */
+         HReg src = lookupIRTemp(env, e->Iex.RdTmp.tmp);
+         HReg vHi = newVRegV(env);
+         HReg vLo = newVRegV(env);
+         addInstr(env, AMD64Instr_AvxExtract(True/*hi*/,  src, vHi));
+         addInstr(env, AMD64Instr_AvxExtract(False/*lo*/, src, vLo));
+         *rHi = vHi;
+         *rLo = vLo;
+         return;
+      }
       lookupIRTempPair( rHi, rLo, env, e->Iex.RdTmp.tmp);
       return;
    }
@@ -3980,32 +4242,50 @@ static void iselDVecExpr_wrk ( /*OUT*/HReg* rHi, /*OUT*/HReg* rLo,
          return;
       }
 
-      case Iop_Mul32x8:    fn = (HWord)h_generic_calc_Mul32x4;
-                           goto do_SseAssistedBinary;
-      case Iop_Max32Sx8:   fn = (HWord)h_generic_calc_Max32Sx4;
-                           goto do_SseAssistedBinary;
-      case Iop_Min32Sx8:   fn = (HWord)h_generic_calc_Min32Sx4;
-                           goto do_SseAssistedBinary;
-      case Iop_Max32Ux8:   fn = (HWord)h_generic_calc_Max32Ux4;
-                           goto do_SseAssistedBinary;
-      case Iop_Min32Ux8:   fn = (HWord)h_generic_calc_Min32Ux4;
-                           goto do_SseAssistedBinary;
-      case Iop_Max16Ux16:  fn = (HWord)h_generic_calc_Max16Ux8;
-                           goto do_SseAssistedBinary;
-      case Iop_Min16Ux16:  fn = (HWord)h_generic_calc_Min16Ux8;
-                           goto do_SseAssistedBinary;
-      case Iop_Max8Sx32:   fn = (HWord)h_generic_calc_Max8Sx16;
-                           goto do_SseAssistedBinary;
-      case Iop_Min8Sx32:   fn = (HWord)h_generic_calc_Min8Sx16;
-                           goto do_SseAssistedBinary;
-      case Iop_CmpEQ64x4:  fn = (HWord)h_generic_calc_CmpEQ64x2;
-                           goto do_SseAssistedBinary;
-      case Iop_CmpGT64Sx4: fn = (HWord)h_generic_calc_CmpGT64Sx2;
-                           goto do_SseAssistedBinary;
+      /* As for the 128-bit versions, these can be done with SSE4 on
+         AVX-capable hosts. */
+      case Iop_Mul32x8:    op = Asse_MUL32;
+                           fn = (HWord)h_generic_calc_Mul32x4;
+                           goto do_Sse4OrAssisted;
+      case Iop_Max32Sx8:   op = Asse_MAX32S;
+                           fn = (HWord)h_generic_calc_Max32Sx4;
+                           goto do_Sse4OrAssisted;
+      case Iop_Min32Sx8:   op = Asse_MIN32S;
+                           fn = (HWord)h_generic_calc_Min32Sx4;
+                           goto do_Sse4OrAssisted;
+      case Iop_Max32Ux8:   op = Asse_MAX32U;
+                           fn = (HWord)h_generic_calc_Max32Ux4;
+                           goto do_Sse4OrAssisted;
+      case Iop_Min32Ux8:   op = Asse_MIN32U;
+                           fn = (HWord)h_generic_calc_Min32Ux4;
+                           goto do_Sse4OrAssisted;
+      case Iop_Max16Ux16:  op = Asse_MAX16U;
+                           fn = (HWord)h_generic_calc_Max16Ux8;
+                           goto do_Sse4OrAssisted;
+      case Iop_Min16Ux16:  op = Asse_MIN16U;
+                           fn = (HWord)h_generic_calc_Min16Ux8;
+                           goto do_Sse4OrAssisted;
+      case Iop_Max8Sx32:   op = Asse_MAX8S;
+                           fn = (HWord)h_generic_calc_Max8Sx16;
+                           goto do_Sse4OrAssisted;
+      case Iop_Min8Sx32:   op = Asse_MIN8S;
+                           fn = (HWord)h_generic_calc_Min8Sx16;
+                           goto do_Sse4OrAssisted;
+      case Iop_CmpEQ64x4:  op = Asse_CMPEQ64;
+                           fn = (HWord)h_generic_calc_CmpEQ64x2;
+                           goto do_Sse4OrAssisted;
+      case Iop_CmpGT64Sx4: op = Asse_CMPGT64S;
+                           fn = (HWord)h_generic_calc_CmpGT64Sx2;
+                           goto do_Sse4OrAssisted;
+      do_Sse4OrAssisted:
+         if (env->hwcaps & VEX_HWCAPS_AMD64_AVX)
+            goto do_SseReRg;
+         goto do_SseAssistedBinary;
       do_SseAssistedBinary: {
          /* RRRufff!  RRRufff code is what we're generating here.  Oh
             well. */
          vassert(fn != 0);
+         h_generic_note_use(e->Iex.Binop.op);
          HReg dstHi = newVRegV(env);
          HReg dstLo = newVRegV(env);
          HReg argLhi, argLlo, argRhi, argRlo;
@@ -4084,6 +4364,7 @@ static void iselDVecExpr_wrk ( /*OUT*/HReg* rHi, /*OUT*/HReg* rLo,
          /* RRRufff!  RRRufff code is what we're generating here.  Oh
             well. */
          vassert(fn != 0);
+         h_generic_note_use(e->Iex.Binop.op);
          HReg dstHi = newVRegV(env);
          HReg dstLo = newVRegV(env);
          HReg argLhi, argLlo, argRhi, argRlo;
@@ -4194,6 +4475,304 @@ static void iselDVecExpr_wrk ( /*OUT*/HReg* rHi, /*OUT*/HReg* rLo,
 }
 
 
+/*---------------------------------------------------------*/
+/*--- ISEL: SIMD (V256) expressions, into a YMM reg.     --*/
+/*---------------------------------------------------------*/
+
+/* Only used on AVX2 hosts (env->avx256).  Operations which have a
+   direct 256-bit equivalent are done in a single instruction;
+   everything else goes via iselDVecExpr and the halves are glued
+   back together afterwards. */
+
+static HReg iselV256Expr ( ISelEnv* env, IRExpr* e )
+{
+   HReg r = iselV256Expr_wrk( env, e );
+#  if 0
+   vex_printf("\n"); ppIRExpr(e); vex_printf("\n");
+#  endif
+   vassert(hregClass(r) == HRcVec256);
+   vassert(hregIsVirtual(r));
+   return r;
+}
+
+
+/* DO NOT CALL THIS DIRECTLY */
+static HReg iselV256Expr_wrk ( ISelEnv* env, IRExpr* e )
+{
+   AMD64SseOp op = Asse_INVALID;
+   vassert(e);
+   vassert(env->avx256);
+   vassert(typeOfIRExpr(env->type_env,e) == Ity_V256);
+
+   if (e->tag == Iex_RdTmp) {
+      return lookupIRTemp(env, e->Iex.RdTmp.tmp);
+   }
+
+   if (e->tag == Iex_Get) {
+      HReg dst = newVRegDV(env);
+      addInstr(env, AMD64Instr_AvxLdSt(
+                       True/*load*/, dst,
+                       AMD64AMode_IR(e->Iex.Get.offset, hregAMD64_RBP())));
+      return dst;
+   }
+
+   if (e->tag == Iex_Load) {
+      HReg        dst = newVRegDV(env);
+      AMD64AMode* am  = iselIntExpr_AMode(env, e->Iex.Load.addr);
+      addInstr(env, AMD64Instr_AvxLdSt(True/*load*/, dst, am));
+      return dst;
+   }
+
+   if (e->tag == Iex_Const) {
+      vassert(e->Iex.Const.con->tag == Ico_V256);
+      switch (e->Iex.Const.con->Ico.V256) {
+         case 0x00000000: {
+            HReg dst = newVRegDV(env);
+            addInstr(env, AMD64Instr_AvxReRg(Asse_XOR, dst, dst));
+            return dst;
+         }
+         case 0xFFFFFFFF: {
+            HReg dst = newVRegDV(env);
+            addInstr(env, AMD64Instr_AvxReRg(Asse_CMPEQ32, dst, dst));
+            return dst;
+         }
+         default:
+            break;
+      }
+   }
+
+   if (e->tag == Iex_Unop) {
+   switch (e->Iex.Unop.op) {
+
+      case Iop_NotV256: {
+         HReg arg = iselV256Expr(env, e->Iex.Unop.arg);
+         HReg dst = newVRegDV(env);
+         addInstr(env, AMD64Instr_AvxReRg(Asse_CMPEQ32, dst, dst));
+         addInstr(env, AMD64Instr_AvxReRg(Asse_XOR, arg, dst));
+         return dst;
+      }
+
+      case Iop_CmpNEZ64x4:  op = Asse_CMPEQ64; goto do_CmpNEZ_vector;
+      case Iop_CmpNEZ32x8:  op = Asse_CMPEQ32; goto do_CmpNEZ_vector;
+      case Iop_CmpNEZ16x16: op = Asse_CMPEQ16; goto do_CmpNEZ_vector;
+      case Iop_CmpNEZ8x32:  op = Asse_CMPEQ8;  goto do_CmpNEZ_vector;
+      do_CmpNEZ_vector:
+      {
+         HReg arg  = iselV256Expr(env, e->Iex.Unop.arg);
+         HReg tmp  = newVRegDV(env);
+         HReg dst  = newVRegDV(env);
+         addInstr(env, AMD64Instr_AvxReRg(Asse_XOR, tmp, tmp));
+         addInstr(env, AMD64Instr_AvxReRg(op, arg, tmp));
+         addInstr(env, AMD64Instr_AvxReRg(Asse_CMPEQ32, dst, dst));
+         addInstr(env, AMD64Instr_AvxReRg(Asse_XOR, tmp, dst));
+         return dst;
+      }
+
+      default:
+         break;
+   } /* switch (e->Iex.Unop.op) */
+   } /* if (e->tag == Iex_Unop) */
+
+   if (e->tag == Iex_Binop) {
+   switch (e->Iex.Binop.op) {
+
+      case Iop_Add64Fx4:   op = Asse_ADDF;   goto do_64Fx4;
+      case Iop_Sub64Fx4:   op = Asse_SUBF;   goto do_64Fx4;
+      case Iop_Mul64Fx4:   op = Asse_MULF;   goto do_64Fx4;
+      case Iop_Div64Fx4:   op = Asse_DIVF;   goto do_64Fx4;
+      case Iop_Max64Fx4:   op = Asse_MAXF;   goto do_64Fx4;
+      case Iop_Min64Fx4:   op = Asse_MINF;   goto do_64Fx4;
+      do_64Fx4:
+      {
+         HReg argL = iselV256Expr(env, e->Iex.Binop.arg1);
+         HReg argR = iselV256Expr(env, e->Iex.Binop.arg2);
+         HReg dst  = newVRegDV(env);
+         addInstr(env, AMD64Instr_AvxReRg(Asse_MOV, argL, dst));
+         addInstr(env, AMD64Instr_Avx64Fx4(op, argR, dst));
+         return dst;
+      }
+
+      case Iop_Add32Fx8:   op = Asse_ADDF;   goto do_32Fx8;
+      case Iop_Sub32Fx8:   op = Asse_SUBF;   goto do_32Fx8;
+      case Iop_Mul32Fx8:   op = Asse_MULF;   goto do_32Fx8;
+      case Iop_Div32Fx8:   op = Asse_DIVF;   goto do_32Fx8;
+      case Iop_Max32Fx8:   op = Asse_MAXF;   goto do_32Fx8;
+      case Iop_Min32Fx8:   op = Asse_MINF;   goto do_32Fx8;
+      do_32Fx8:
+      {
+         HReg argL = iselV256Expr(env, e->Iex.Binop.arg1);
+         HReg argR = iselV256Expr(env, e->Iex.Binop.arg2);
+         HReg dst  = newVRegDV(env);
+         addInstr(env, AMD64Instr_AvxReRg(Asse_MOV, argL, dst));
+         addInstr(env, AMD64Instr_Avx32Fx8(op, argR, dst));
+         return dst;
+      }
+
+      case Iop_AndV256:    op = Asse_AND;      goto do_AvxReRg;
+      case Iop_OrV256:     op = Asse_OR;       goto do_AvxReRg;
+      case Iop_XorV256:    op = Asse_XOR;      goto do_AvxReRg;
+      case Iop_Add8x32:    op = Asse_ADD8;     goto do_AvxReRg;
+      case Iop_Add16x16:   op = Asse_ADD16;    goto do_AvxReRg;
+      case Iop_Add32x8:    op = Asse_ADD32;    goto do_AvxReRg;
+      case Iop_Add64x4:    op = Asse_ADD64;    goto do_AvxReRg;
+      case Iop_QAdd8Sx32:  op = Asse_QADD8S;   goto do_AvxReRg;
+      case Iop_QAdd16Sx16: op = Asse_QADD16S;  goto do_AvxReRg;
+      case Iop_QAdd8Ux32:  op = Asse_QADD8U;   goto do_AvxReRg;
+      case Iop_QAdd16Ux16: op = Asse_QADD16U;  goto do_AvxReRg;
+      case Iop_Avg8Ux32:   op = Asse_AVG8U;    goto do_AvxReRg;
+      case Iop_Avg16Ux16:  op = Asse_AVG16U;   goto do_AvxReRg;
+      case Iop_CmpEQ8x32:  op = Asse_CMPEQ8;   goto do_AvxReRg;
+      case Iop_CmpEQ16x16: op = Asse_CMPEQ16;  goto do_AvxReRg;
+      case Iop_CmpEQ32x8:  op = Asse_CMPEQ32;  goto do_AvxReRg;
+      case Iop_CmpEQ64x4:  op = Asse_CMPEQ64;  goto do_AvxReRg;
+      case Iop_CmpGT8Sx32: op = Asse_CMPGT8S;  goto do_AvxReRg;
+      case Iop_CmpGT16Sx16: op = Asse_CMPGT16S; goto do_AvxReRg;
+      case Iop_CmpGT32Sx8: op = Asse_CMPGT32S; goto do_AvxReRg;
+      case Iop_CmpGT64Sx4: op = Asse_CMPGT64S; goto do_AvxReRg;
+      case Iop_Max8Sx32:   op = Asse_MAX8S;    goto do_AvxReRg;
+      case Iop_Max16Sx16:  op = Asse_MAX16S;   goto do_AvxReRg;
+      case Iop_Max32Sx8:   op = Asse_MAX32S;   goto do_AvxReRg;
+      case Iop_Max8Ux32:   op = Asse_MAX8U;    goto do_AvxReRg;
+      case Iop_Max16Ux16:  op = Asse_MAX16U;   goto do_AvxReRg;
+      case Iop_Max32Ux8:   op = Asse_MAX32U;   goto do_AvxReRg;
+      case Iop_Min8Sx32:   op = Asse_MIN8S;    goto do_AvxReRg;
+      case Iop_Min16Sx16:  op = Asse_MIN16S;   goto do_AvxReRg;
+      case Iop_Min32Sx8:   op = Asse_MIN32S;   goto do_AvxReRg;
+      case Iop_Min8Ux32:   op = Asse_MIN8U;    goto do_AvxReRg;
+      case Iop_Min16Ux16:  op = Asse_MIN16U;   goto do_AvxReRg;
+      case Iop_Min32Ux8:   op = Asse_MIN32U;   goto do_AvxReRg;
+      case Iop_MulHi16Ux16: op = Asse_MULHI16U; goto do_AvxReRg;
+      case Iop_MulHi16Sx16: op = Asse_MULHI16S; goto do_AvxReRg;
+      case Iop_Mul16x16:   op = Asse_MUL16;    goto do_AvxReRg;
+      case Iop_Mul32x8:    op = Asse_MUL32;    goto do_AvxReRg;
+      case Iop_Sub8x32:    op = Asse_SUB8;     goto do_AvxReRg;
+      case Iop_Sub16x16:   op = Asse_SUB16;    goto do_AvxReRg;
+      case Iop_Sub32x8:    op = Asse_SUB32;    goto do_AvxReRg;
+      case Iop_Sub64x4:    op = Asse_SUB64;    goto do_AvxReRg;
+      case Iop_QSub8Sx32:  op = Asse_QSUB8S;   goto do_AvxReRg;
+      case Iop_QSub16Sx16: op = Asse_QSUB16S;  goto do_AvxReRg;
+      case Iop_QSub8Ux32:  op = Asse_QSUB8U;   goto do_AvxReRg;
+      case Iop_QSub16Ux16: op = Asse_QSUB16U;  goto do_AvxReRg;
+      do_AvxReRg:
+      {
+         HReg argL = iselV256Expr(env, e->Iex.Binop.arg1);
+         HReg argR = iselV256Expr(env, e->Iex.Binop.arg2);
+         HReg dst  = newVRegDV(env);
+         addInstr(env, AMD64Instr_AvxReRg(Asse_MOV, argL, dst));
+         addInstr(env, AMD64Instr_AvxReRg(op, argR, dst));
+         return dst;
+      }
+
+      case Iop_V128HLtoV256: {
+         HReg vHi = iselVecExpr(env, e->Iex.Binop.arg1);
+         HReg vLo = iselVecExpr(env, e->Iex.Binop.arg2);
+         HReg dst = newVRegDV(env);
+         addInstr(env, AMD64Instr_AvxHLto256(vHi, vLo, dst));
+         return dst;
+      }
+
+      default:
+         break;
+   } /* switch (e->Iex.Binop.op) */
+   } /* if (e->tag == Iex_Binop) */
+
+   /* Anything else is done a half at a time. */
+   {
+      HReg vHi, vLo;
+      HReg dst = newVRegDV(env);
+      iselDVecExpr(&vHi, &vLo, env, e);
+      addInstr(env, AMD64Instr_AvxHLto256(vHi, vLo, dst));
+      return dst;
+   }
+}
+
+
+/*---------------------------------------------------------*/
+/*--- ISEL: Guest registers kept in host registers      ---*/
+/*---------------------------------------------------------*/
+
+/* Write a PUT of 'data' (of type ty) at 'offset' to the host register
+   caching guest register c.  Partial writes merge the new bits into
+   the existing value. */
+static void iselCachedPut ( ISelEnv* env, Int c, Int offset,
+                            IRType ty, IRExpr* data )
+{
+   HReg rC = hregAMD64_GuestRegCache(c);
+   HReg src, tmp;
+
+   if (ty == Ity_I64) {
+      addInstr(env, AMD64Instr_Alu64R(Aalu_MOV,
+                                      iselIntExpr_RMI(env, data), rC));
+      return;
+   }
+
+   src = iselIntExpr_R(env, data);
+   tmp = newVRegI(env);
+   if (ty == Ity_I32) {
+      addInstr(env, AMD64Instr_MovxLQ(False, src, tmp));
+      addInstr(env, AMD64Instr_Sh64(Ash_SHR, 32, rC));
+      addInstr(env, AMD64Instr_Sh64(Ash_SHL, 32, rC));
+   } else {
+      UInt mask = ty == Ity_I16 ? 0xFFFF : 0xFF;
+      addInstr(env, mk_iMOVsd_RR(src, tmp));
+      addInstr(env, AMD64Instr_Alu64R(Aalu_AND, AMD64RMI_Imm(mask), tmp));
+      if (offset != env->guest_reg_cache[c]) {
+         /* %ah and friends */
+         addInstr(env, AMD64Instr_Sh64(Ash_SHL, 8, tmp));
+         mask <<= 8;
+      }
+      /* The immediate is sign extended, so this clears exactly the
+         bits being replaced. */
+      addInstr(env, AMD64Instr_Alu64R(Aalu_AND, AMD64RMI_Imm(~mask), rC));
+   }
+   addInstr(env, AMD64Instr_Alu64R(Aalu_OR, AMD64RMI_Reg(tmp), rC));
+}
+
+/* Bring the in-memory copies of cached guest registers up to date
+   around a dirty helper call.  Before the call, store every cached
+   register the helper's fxState mentions; also store them all if the
+   helper accesses memory, so that they are correct in the guest state
+   should it fault, since the signal handler can't recover them from
+   a C function's frame.  After the call, reload the ones the helper
+   may have written.  A store is done even if the helper only writes
+   the register, as the call may be conditional.  Returns True if
+   anything was stored. */
+static Bool syncCachedGuestRegs ( ISelEnv* env, IRDirty* d, Bool before )
+{
+   Int  c, i, k, lo, hi;
+   Bool any = False;
+
+   for (c = 0; c < 2; c++) {
+      Int  base   = env->guest_reg_cache[c];
+      Bool reads  = False;
+      Bool writes = False;
+      if (base < 0)
+         continue;
+      for (i = 0; i < d->nFxState; i++) {
+         for (k = 0; k <= d->fxState[i].nRepeats; k++) {
+            lo = d->fxState[i].offset + k * d->fxState[i].repeatLen;
+            hi = lo + d->fxState[i].size;
+            if (hi <= base || lo >= base + 8)
+               continue;
+            if (d->fxState[i].fx != Ifx_Write)
+               reads = True;
+            if (d->fxState[i].fx != Ifx_Read)
+               writes = True;
+         }
+      }
+      AMD64AMode* am = AMD64AMode_IR(base, hregAMD64_RBP());
+      HReg        rC = hregAMD64_GuestRegCache(c);
+      if (before && (reads || writes || d->mFx != Ifx_None)) {
+         addInstr(env, AMD64Instr_Alu64M(Aalu_MOV, AMD64RI_Reg(rC), am));
+         any = True;
+      }
+      if (!before && writes)
+         addInstr(env, AMD64Instr_Alu64R(Aalu_MOV, AMD64RMI_Mem(am), rC));
+   }
+   return any;
+}
+
+
 /*---------------------------------------------------------*/
 /*--- ISEL: Statements                                  ---*/
 /*---------------------------------------------------------*/
@@ -4249,6 +4828,12 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
          addInstr(env, AMD64Instr_SseLdSt(False/*store*/, 16, r, am));
          return;
       }
+      if (tyd == Ity_V256 && env->avx256) {
+         AMD64AMode* am = iselIntExpr_AMode(env, stmt->Ist.Store.addr);
+         HReg r = iselV256Expr(env, stmt->Ist.Store.data);
+         addInstr(env, AMD64Instr_AvxLdSt(False/*store*/, r, am));
+         return;
+      }
       if (tyd == Ity_V256) {
          HReg        rA   = iselIntExpr_R(env, stmt->Ist.Store.addr);
          AMD64AMode* am0  = AMD64AMode_IR(0,  rA);
@@ -4265,6 +4850,14 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
    /* --------- PUT --------- */
    case Ist_Put: {
       IRType ty = typeOfIRExpr(env->type_env, stmt->Ist.Put.data);
+      if (ty == Ity_I64 || ty == Ity_I32 || ty == Ity_I16 || ty == Ity_I8) {
+         Int c = cachedGuestReg(env, stmt->Ist.Put.offset, sizeofIRType(ty));
+         if (c >= 0) {
+            iselCachedPut(env, c, stmt->Ist.Put.offset, ty,
+                          stmt->Ist.Put.data);
+            return;
+         }
+      }
       if (ty == Ity_I64) {
          /* We're going to write to memory, so compute the RHS into an
             AMD64RI. */
@@ -4308,6 +4901,13 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
          addInstr(env, AMD64Instr_SseLdSt(False/*store*/, 16, vec, am));
          return;
       }
+      if (ty == Ity_V256 && env->avx256) {
+         HReg        vec = iselV256Expr(env, stmt->Ist.Put.data);
+         AMD64AMode* am  = AMD64AMode_IR(stmt->Ist.Put.offset, 
+                                         hregAMD64_RBP());
+         addInstr(env, AMD64Instr_AvxLdSt(False/*store*/, vec, am));
+         return;
+      }
       if (ty == Ity_V256) {
          HReg vHi, vLo;
          iselDVecExpr(&vHi, &vLo, env, stmt->Ist.Put.data);
@@ -4416,6 +5016,12 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
          addInstr(env, mk_vMOVsd_RR(src, dst));
          return;
       }
+      if (ty == Ity_V256 && env->avx256) {
+         HReg dst = lookupIRTemp(env, tmp);
+         HReg src = iselV256Expr(env, stmt->Ist.WrTmp.data);
+         addInstr(env, AMD64Instr_AvxReRg(Asse_MOV, src, dst));
+         return;
+      }
       if (ty == Ity_V256) {
          HReg rHi, rLo, dstHi, dstLo;
          iselDVecExpr(&rHi,&rLo, env, stmt->Ist.WrTmp.data);
@@ -4454,8 +5060,11 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
          and the call is skipped. */
       UInt   addToSp = 0;
       RetLoc rloc    = mk_RetLoc_INVALID();
+      Bool   synced  = syncCachedGuestRegs(env, d, True/*before*/);
       doHelperCall( &addToSp, &rloc, env, d->guard, d->cee, retty, d->args );
       vassert(is_sane_RetLoc(rloc));
+      if (synced)
+         syncCachedGuestRegs(env, d, False/*after*/);
 
       /* Now figure out what to do with the returned value, if any. */
       switch (retty) {
@@ -4492,6 +5101,13 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
             /* See comments for Ity_V128. */
             vassert(rloc.pri == RLPri_V256SpRel);
             vassert(addToSp >= 32);
+            if (env->avx256) {
+               HReg        dst = lookupIRTemp(env, d->tmp);
+               AMD64AMode* am  = AMD64AMode_IR(rloc.spOff, hregAMD64_RSP());
+               addInstr(env, AMD64Instr_AvxLdSt( True/*load*/, dst, am ));
+               add_to_rsp(env, addToSp);
+               return;
+            }
             HReg        dstLo, dstHi;
             lookupIRTempPair(&dstHi, &dstLo, env, d->tmp);
             AMD64AMode* amLo  = AMD64AMode_IR(rloc.spOff, hregAMD64_RSP());
@@ -4618,8 +5234,12 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
       AMD64AMode*   amRIP = AMD64AMode_IR(stmt->Ist.Exit.offsIP,
                                           hregAMD64_RBP());
 
-      /* Case: boring transfer to known address */
-      if (stmt->Ist.Exit.jk == Ijk_Boring) {
+      /* Case: boring transfer to known address.  Call and Ret are
+         only hints; the destination is a constant, so they can be
+         chained just the same. */
+      if (stmt->Ist.Exit.jk == Ijk_Boring
+          || stmt->Ist.Exit.jk == Ijk_Call
+          || stmt->Ist.Exit.jk == Ijk_Ret) {
          if (env->chainingAllowed) {
             /* .. almost always true .. */
             /* Skip the event check at the dst if this is a forwards
@@ -4687,12 +5307,19 @@ static void iselNext ( ISelEnv* env,
       vex_printf( "\n");
    }
 
+   /* Leave the upper halves of the ymm registers clean for whatever
+      runs next.  |next| is an atom, so it can't need them. */
+   if (env->avx256)
+      addInstr(env, AMD64Instr_AvxZeroUpper());
+
    /* Case: boring transfer to known address */
    if (next->tag == Iex_Const) {
       IRConst* cdst = next->Iex.Const.con;
       vassert(cdst->tag == Ico_U64);
-      if (jk == Ijk_Boring || jk == Ijk_Call) {
-         /* Boring transfer to known address */
+      if (jk == Ijk_Boring || jk == Ijk_Call || jk == Ijk_Ret) {
+         /* Boring transfer to known address.  A return to a
+            constant address (eg, after push $imm; ret) is no
+            different. */
          AMD64AMode* amRIP = AMD64AMode_IR(offsIP, hregAMD64_RBP());
          if (env->chainingAllowed) {
             /* .. almost always true .. */
@@ -4723,7 +5350,8 @@ static void iselNext ( ISelEnv* env,
          HReg        r     = iselIntExpr_R(env, next);
          AMD64AMode* amRIP = AMD64AMode_IR(offsIP, hregAMD64_RBP());
          if (env->chainingAllowed) {
-            addInstr(env, AMD64Instr_XIndir(r, amRIP, Acc_ALWAYS));
+            addInstr(env, AMD64Instr_XIndir(r, amRIP, Acc_ALWAYS,
+                                            jk == Ijk_Ret));
          } else {
             addInstr(env, AMD64Instr_XAssisted(r, amRIP, Acc_ALWAYS,
                                                Ijk_Boring));
@@ -4773,7 +5401,7 @@ static void iselNext ( ISelEnv* env,
 HInstrArray* iselSB_AMD64 ( IRSB* bb,
                             VexArch      arch_host,
                             VexArchInfo* archinfo_host,
-                            VexAbiInfo*  vbi/*UNUSED*/,
+                            VexAbiInfo*  vbi,
                             Int offs_Host_EvC_Counter,
                             Int offs_Host_EvC_FailAddr,
                             Bool chainingAllowed,
@@ -4817,6 +5445,22 @@ HInstrArray* iselSB_AMD64 ( IRSB* bb,
    env->chainingAllowed = chainingAllowed;
    env->hwcaps          = hwcaps_host;
    env->max_ga          = max_ga;
+   env->guest_reg_cache[0] = vbi->host_amd64_guest_reg_cache[0];
+   env->guest_reg_cache[1] = vbi->host_amd64_guest_reg_cache[1];
+
+   /* Keep V256 values in ymm registers if the host can do integer
+      as well as FP arithmetic on them, and if the block has any V256
+      temps in the first place; there's no point otherwise, and
+      leaving it off avoids having to use vzeroupper. */
+   env->avx256 = False;
+   if (hwcaps_host & VEX_HWCAPS_AMD64_AVX2) {
+      for (i = 0; i < env->n_vregmap; i++) {
+         if (bb->tyenv->types[i] == Ity_V256) {
+            env->avx256 = True;
+            break;
+         }
+      }
+   }
 
    /* For each IR temporary, allocate a suitably-kinded virtual
       register. */
@@ -4838,8 +5482,12 @@ HInstrArray* iselSB_AMD64 ( IRSB* bb,
             hreg = mkHReg(j++, HRcVec128, True);
             break;
          case Ity_V256:
-            hreg   = mkHReg(j++, HRcVec128, True);
-            hregHI = mkHReg(j++, HRcVec128, True);
+            if (env->avx256) {
+               hreg   = mkHReg(j++, HRcVec256, True);
+            } else {
+               hreg   = mkHReg(j++, HRcVec128, True);
+               hregHI = mkHReg(j++, HRcVec128, True);
+            }
             break;
          default:
             ppIRType(bb->tyenv->types[i]);
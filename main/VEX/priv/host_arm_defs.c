@@ -719,6 +719,35 @@ const HChar* showARMMulOp ( ARMMulOp op ) {
    }
 }
 
+const HChar* showARMMediaOp ( ARMMediaOp op ) {
+   switch (op) {
+      case ARMmed_ADD16:   return "uadd16";
+      case ARMmed_SUB16:   return "usub16";
+      case ARMmed_SHADD16: return "shadd16";
+      case ARMmed_UHADD16: return "uhadd16";
+      case ARMmed_SHSUB16: return "shsub16";
+      case ARMmed_UHSUB16: return "uhsub16";
+      case ARMmed_QADD16:  return "qadd16";
+      case ARMmed_UQADD16: return "uqadd16";
+      case ARMmed_QSUB16:  return "qsub16";
+      case ARMmed_UQSUB16: return "uqsub16";
+      case ARMmed_ADD8:    return "uadd8";
+      case ARMmed_SUB8:    return "usub8";
+      case ARMmed_SHADD8:  return "shadd8";
+      case ARMmed_UHADD8:  return "uhadd8";
+      case ARMmed_SHSUB8:  return "shsub8";
+      case ARMmed_UHSUB8:  return "uhsub8";
+      case ARMmed_QADD8:   return "qadd8";
+      case ARMmed_UQADD8:  return "uqadd8";
+      case ARMmed_QSUB8:   return "qsub8";
+      case ARMmed_UQSUB8:  return "uqsub8";
+      case ARMmed_USAD8:   return "usad8";
+      case ARMmed_QADD:    return "qadd";
+      case ARMmed_QSUB:    return "qsub";
+      default: vpanic("showARMMediaOp");
+   }
+}
+
 const HChar* showARMVfpOp ( ARMVfpOp op ) {
    switch (op) {
       case ARMvfp_ADD: return "add";
@@ -1201,12 +1230,13 @@ ARMInstr* ARMInstr_XDirect ( Addr32 dstGA, ARMAMode1* amR15T,
    return i;
 }
 ARMInstr* ARMInstr_XIndir ( HReg dstGA, ARMAMode1* amR15T,
-                            ARMCondCode cond ) {
+                            ARMCondCode cond, Bool isRet ) {
    ARMInstr* i            = LibVEX_Alloc(sizeof(ARMInstr));
    i->tag                 = ARMin_XIndir;
    i->ARMin.XIndir.dstGA  = dstGA;
    i->ARMin.XIndir.amR15T = amR15T;
    i->ARMin.XIndir.cond   = cond;
+   i->ARMin.XIndir.isRet  = isRet;
    return i;
 }
 ARMInstr* ARMInstr_XAssisted ( HReg dstGA, ARMAMode1* amR15T,
@@ -1245,6 +1275,16 @@ ARMInstr* ARMInstr_Mul ( ARMMulOp op ) {
    i->ARMin.Mul.op = op;
    return i;
 }
+ARMInstr* ARMInstr_Media ( ARMMediaOp op,
+                           HReg dst, HReg argL, HReg argR ) {
+   ARMInstr* i = LibVEX_Alloc(sizeof(ARMInstr));
+   i->tag              = ARMin_Media;
+   i->ARMin.Media.op   = op;
+   i->ARMin.Media.dst  = dst;
+   i->ARMin.Media.argL = argL;
+   i->ARMin.Media.argR = argR;
+   return i;
+}
 ARMInstr* ARMInstr_LdrEX ( Int szB ) {
    ARMInstr* i = LibVEX_Alloc(sizeof(ARMInstr));
    i->tag             = ARMin_LdrEX;
@@ -1574,6 +1614,14 @@ void ppARMInstr ( ARMInstr* i ) {
          vex_printf(", ");
          ppHRegARM(i->ARMin.Unary.src);
          return;
+      case ARMin_Media:
+         vex_printf("%s ", showARMMediaOp(i->ARMin.Media.op));
+         ppHRegARM(i->ARMin.Media.dst);
+         vex_printf(", ");
+         ppHRegARM(i->ARMin.Media.argL);
+         vex_printf(", ");
+         ppHRegARM(i->ARMin.Media.argR);
+         return;
       case ARMin_CmpOrTst:
          vex_printf("%s   ", i->ARMin.CmpOrTst.isCmp ? "cmp" : "tst");
          ppHRegARM(i->ARMin.CmpOrTst.argL);
@@ -1671,8 +1719,10 @@ void ppARMInstr ( ARMInstr* i ) {
          ppHRegARM(i->ARMin.XIndir.dstGA);
          vex_printf(",");
          ppARMAMode1(i->ARMin.XIndir.amR15T);
-         vex_printf("; movw r12,LO16($disp_cp_xindir); ");
-         vex_printf("movt r12,HI16($disp_cp_xindir); ");
+         vex_printf("; movw r12,LO16($disp_cp_xindir%s); ",
+                    i->ARMin.XIndir.isRet ? "_ret" : "");
+         vex_printf("movt r12,HI16($disp_cp_xindir%s); ",
+                    i->ARMin.XIndir.isRet ? "_ret" : "");
          vex_printf("blx r12 }");
          return;
       case ARMin_XAssisted:
@@ -2036,6 +2086,11 @@ void getRegUsage_ARMInstr ( HRegUsage* u, ARMInstr* i, Bool mode64 )
          addHRegUse(u, HRmWrite, i->ARMin.Unary.dst);
          addHRegUse(u, HRmRead, i->ARMin.Unary.src);
          return;
+      case ARMin_Media:
+         addHRegUse(u, HRmWrite, i->ARMin.Media.dst);
+         addHRegUse(u, HRmRead, i->ARMin.Media.argL);
+         addHRegUse(u, HRmRead, i->ARMin.Media.argR);
+         return;
       case ARMin_CmpOrTst:
          addHRegUse(u, HRmRead, i->ARMin.CmpOrTst.argL);
          addRegUsage_ARMRI84(u, i->ARMin.CmpOrTst.argR);
@@ -2341,6 +2396,11 @@ void mapRegs_ARMInstr ( HRegRemap* m, ARMInstr* i, Bool mode64 )
          i->ARMin.Unary.dst = lookupHRegRemap(m, i->ARMin.Unary.dst);
          i->ARMin.Unary.src = lookupHRegRemap(m, i->ARMin.Unary.src);
          return;
+      case ARMin_Media:
+         i->ARMin.Media.dst  = lookupHRegRemap(m, i->ARMin.Media.dst);
+         i->ARMin.Media.argL = lookupHRegRemap(m, i->ARMin.Media.argL);
+         i->ARMin.Media.argR = lookupHRegRemap(m, i->ARMin.Media.argR);
+         return;
       case ARMin_CmpOrTst:
          i->ARMin.CmpOrTst.argL = lookupHRegRemap(m, i->ARMin.CmpOrTst.argL);
          mapRegs_ARMRI84(m, i->ARMin.CmpOrTst.argR);
@@ -2676,6 +2736,28 @@ void genReload_ARM ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
    }
 }
 
+/* Generate a reg-reg move between two real regs of the same class,
+   for the register allocator's use when splitting a live range. */
+
+ARMInstr* genMove_ARM ( HReg from, HReg to, Bool mode64 )
+{
+   vassert(mode64 == False);
+   vassert(hregClass(from) == hregClass(to));
+   switch (hregClass(from)) {
+      case HRcInt32:
+         return ARMInstr_Mov ( to, ARMRI84_R(from) );
+      case HRcFlt32:
+         return ARMInstr_VUnaryS ( ARMvfpu_COPY, to, from );
+      case HRcFlt64:
+         return ARMInstr_VUnaryD ( ARMvfpu_COPY, to, from );
+      case HRcVec128:
+         return ARMInstr_NUnary ( ARMneon_COPY, to, from, 4, True );
+      default: 
+         ppHRegClass(hregClass(from));
+         vpanic("genMove_ARM: unimplemented regclass");
+   }
+}
+
 
 /* Emit an instruction into buf and return the number of bytes used.
    Note that buf is not the insn's final place, and therefore it is
@@ -2974,10 +3056,12 @@ Int emit_ARMInstr ( /*MB_MOD*/Bool* is_profInc,
                     void* disp_cp_chain_me_to_slowEP,
                     void* disp_cp_chain_me_to_fastEP,
                     void* disp_cp_xindir,
-                    void* disp_cp_xassisted )
+                    void* disp_cp_xassisted,
+                    void* disp_cp_prime_ic,
+                    void* disp_cp_xindir_ret )
 {
    UInt* p = (UInt*)buf;
-   vassert(nbuf >= 32);
+   vassert(nbuf >= 64);
    vassert(mode64 == False);
    vassert(0 == (((HWord)buf) & 3));
 
@@ -3267,6 +3351,12 @@ Int emit_ARMInstr ( /*MB_MOD*/Bool* is_profInc,
             translations.  Hence: */
          vassert(disp_cp_xindir != NULL);
 
+         /* Returns go to their own dispatcher, if there is one, and
+            are never given an inline cache. */
+         void* disp_indir = disp_cp_xindir;
+         if (i->ARMin.XIndir.isRet && disp_cp_xindir_ret != NULL)
+            disp_indir = disp_cp_xindir_ret;
+
          /* Use ptmp for backpatching conditional jumps. */
          UInt* ptmp = NULL;
 
@@ -3285,17 +3375,49 @@ Int emit_ARMInstr ( /*MB_MOD*/Bool* is_profInc,
                                 iregNo(i->ARMin.XIndir.dstGA),
                                 i->ARMin.XIndir.amR15T);
 
-         /* movw r12, lo16(VG_(disp_cp_xindir)) */
-         /* movt r12, hi16(VG_(disp_cp_xindir)) */
-         /* bx   r12  (A1) */
-         p = imm32_to_iregNo(p, /*r*/12,
-                             (UInt)Ptr_to_ULong(disp_cp_xindir));
-         *p++ = 0xE12FFF1C;
+         if (disp_cp_prime_ic != NULL && disp_indir == disp_cp_xindir) {
+            /* Inline cache.  NB: what goes on here has to be very
+               closely coordinated with primeXIndirIC_ARM below, and
+               the chain-me part with chainXDirect_ARM and
+               unchainXDirect_ARM.  Initially the prediction is the
+               bogus guest address 1, so the first transfer goes to
+               disp_cp_prime_ic. */
+            /* movw r12, lo16(predicted_guest_addr) */
+            /* movt r12, hi16(predicted_guest_addr) */
+            p = imm32_to_iregNo_EXACTLY2(p, /*r*/12, 1);
+            /* cmp r-dstGA, r12 */
+            *p++ = 0xE150000C | (iregNo(i->ARMin.XIndir.dstGA) << 16);
+            /* bne over the chain-me */
+            *p++ = 0x1A000002;
+            /* movw r12, lo16(VG_(disp_cp_chain_me_to_slowEP)) */
+            /* movt r12, hi16(VG_(disp_cp_chain_me_to_slowEP)) */
+            /* blx  r12  (A1) */
+            /* This is an ordinary chain-me point.  It goes to the
+               slow entry point, since indirect transfers may well
+               form loops. */
+            p = imm32_to_iregNo_EXACTLY2(
+                   p, /*r*/12, (UInt)Ptr_to_ULong(disp_cp_chain_me_to_slowEP));
+            *p++ = 0xE12FFF3C;
+            /* movw r12, lo16(VG_(disp_cp_prime_ic)) */
+            /* movt r12, hi16(VG_(disp_cp_prime_ic)) */
+            /* blx  r12  (A1) */
+            /* Once primed, this becomes a bx to VG_(disp_cp_xindir). */
+            p = imm32_to_iregNo_EXACTLY2(
+                   p, /*r*/12, (UInt)Ptr_to_ULong(disp_cp_prime_ic));
+            *p++ = 0xE12FFF3C;
+         } else {
+            /* movw r12, lo16(disp_indir) */
+            /* movt r12, hi16(disp_indir) */
+            /* bx   r12  (A1) */
+            p = imm32_to_iregNo(p, /*r*/12,
+                                (UInt)Ptr_to_ULong(disp_indir));
+            *p++ = 0xE12FFF1C;
+         }
 
          /* Fix up the conditional jump, if there was one. */
          if (i->ARMin.XIndir.cond != ARMcc_AL) {
             Int delta = (UChar*)p - (UChar*)ptmp; /* must be signed */
-            vassert(delta > 0 && delta < 40);
+            vassert(delta > 0 && delta < 80);
             vassert((delta & 3) == 0);
             UInt notCond = 1 ^ (UInt)i->ARMin.XIndir.cond;
             vassert(notCond <= 13); /* Neither AL nor NV */
@@ -3474,6 +3596,59 @@ Int emit_ARMInstr ( /*MB_MOD*/Bool* is_profInc,
          goto done;
       }
 
+      case ARMin_Media: {
+         UInt rD = iregNo(i->ARMin.Media.dst);
+         UInt rL = iregNo(i->ARMin.Media.argL);
+         UInt rR = iregNo(i->ARMin.Media.argR);
+         UInt op1 = 0, op2 = 0;
+         switch (i->ARMin.Media.op) {
+            /* Parallel add/subtract:
+               cond 0110 0 op1 Rn Rd 1111 op2 1 Rm, computing
+               Rn `op` Rm.  op1 gives the flavour: 001 signed,
+               010 signed saturating, 011 signed halving, 101 unsigned,
+               110 unsigned saturating, 111 unsigned halving.  op2
+               gives the operation: 000 add16, 011 sub16, 100 add8,
+               111 sub8.  The plain add/sub results don't depend on
+               the signedness; the GE flags they set are ignored. */
+            case ARMmed_ADD16:   op1 = 5; op2 = 0; break;
+            case ARMmed_SUB16:   op1 = 5; op2 = 3; break;
+            case ARMmed_SHADD16: op1 = 3; op2 = 0; break;
+            case ARMmed_UHADD16: op1 = 7; op2 = 0; break;
+            case ARMmed_SHSUB16: op1 = 3; op2 = 3; break;
+            case ARMmed_UHSUB16: op1 = 7; op2 = 3; break;
+            case ARMmed_QADD16:  op1 = 2; op2 = 0; break;
+            case ARMmed_UQADD16: op1 = 6; op2 = 0; break;
+            case ARMmed_QSUB16:  op1 = 2; op2 = 3; break;
+            case ARMmed_UQSUB16: op1 = 6; op2 = 3; break;
+            case ARMmed_ADD8:    op1 = 5; op2 = 4; break;
+            case ARMmed_SUB8:    op1 = 5; op2 = 7; break;
+            case ARMmed_SHADD8:  op1 = 3; op2 = 4; break;
+            case ARMmed_UHADD8:  op1 = 7; op2 = 4; break;
+            case ARMmed_SHSUB8:  op1 = 3; op2 = 7; break;
+            case ARMmed_UHSUB8:  op1 = 7; op2 = 7; break;
+            case ARMmed_QADD8:   op1 = 2; op2 = 4; break;
+            case ARMmed_UQADD8:  op1 = 6; op2 = 4; break;
+            case ARMmed_QSUB8:   op1 = 2; op2 = 7; break;
+            case ARMmed_UQSUB8:  op1 = 6; op2 = 7; break;
+            case ARMmed_USAD8:
+               /* cond 0111 1000 Rd 1111 Rm 0001 Rn */
+               *p++ = 0xE780F010 | (rD << 16) | (rR << 8) | rL;
+               goto done;
+            case ARMmed_QADD:
+               /* cond 0001 0000 Rn Rd 0000 0101 Rm; Rd = sat(Rm + Rn) */
+               *p++ = 0xE1000050 | (rR << 16) | (rD << 12) | rL;
+               goto done;
+            case ARMmed_QSUB:
+               /* cond 0001 0010 Rn Rd 0000 0101 Rm; Rd = sat(Rm - Rn) */
+               *p++ = 0xE1200050 | (rR << 16) | (rD << 12) | rL;
+               goto done;
+            default:
+               goto bad;
+         }
+         *p++ = 0xE6000F10 | (op1 << 20) | (rL << 16) | (rD << 12)
+                           | (op2 << 5) | rR;
+         goto done;
+      }
       case ARMin_Mul: {
          /* E0000392   mul     r0, r2, r3
             E0810392   umull   r0(LO), r1(HI), r2, r3
@@ -4686,7 +4861,7 @@ Int emit_ARMInstr ( /*MB_MOD*/Bool* is_profInc,
    /*NOTREACHED*/
 
   done:
-   vassert(((UChar*)p) - &buf[0] <= 32);
+   vassert(((UChar*)p) - &buf[0] <= 64);
    return ((UChar*)p) - &buf[0];
 }
 
@@ -4841,6 +5016,66 @@ VexInvalRange unchainXDirect_ARM ( void* place_to_unchain,
 }
 
 
+/* NB: what goes on here has to be very closely coordinated with the
+   emitInstr case for XIndir, above. */
+VexInvalRange primeXIndirIC_ARM ( void*  place_to_prime,
+                                  Addr64 guest_addr,
+                                  void*  disp_cp_prime_ic_EXPECTED,
+                                  void*  disp_cp_xindir )
+{
+   /* What we're expecting to see, with place_to_prime being the
+      address of the second movw r12, is:
+        movw r12, lo16(1)
+        movt r12, hi16(1)
+        cmp  r-dstGA, r12
+        bne  .+16
+        <12 bytes of chain-me point, chained or not>
+        movw r12, lo16(disp_cp_prime_ic_EXPECTED)
+        movt r12, hi16(disp_cp_prime_ic_EXPECTED)
+        blx  r12
+      viz
+        <8 bytes generated by imm32_to_iregNo_EXACTLY2>
+        E1 5x 00 0C
+        1A 00 00 02
+        <12 bytes>
+        <8 bytes generated by imm32_to_iregNo_EXACTLY2>
+        E1 2F FF 3C
+   */
+   UInt* p  = (UInt*)place_to_prime;
+   UInt* ic = p - 3 - 2 - 2;
+   vassert(0 == (3 & (HWord)p));
+   vassert(is_imm32_to_iregNo_EXACTLY2(ic, /*r*/12, 1));
+   vassert((ic[2] & 0xFFF0FFFF) == 0xE150000C);
+   vassert(ic[3] == 0x1A000002);
+   vassert(is_imm32_to_iregNo_EXACTLY2(
+              p, /*r*/12, (UInt)Ptr_to_ULong(disp_cp_prime_ic_EXPECTED)));
+   vassert(p[2] == 0xE12FFF3C);
+   /* And what we want to change it to is:
+        movw r12, lo16(guest_addr)
+        movt r12, hi16(guest_addr)
+        cmp  r-dstGA, r12
+        bne  .+16
+        <12 bytes of chain-me point, unchanged>
+        movw r12, lo16(disp_cp_xindir)
+        movt r12, hi16(disp_cp_xindir)
+        bx   r12
+      viz
+        <8 bytes generated by imm32_to_iregNo_EXACTLY2>
+        E1 5x 00 0C
+        1A 00 00 02
+        <12 bytes>
+        <8 bytes generated by imm32_to_iregNo_EXACTLY2>
+        E1 2F FF 1C
+   */
+   (void)imm32_to_iregNo_EXACTLY2(ic, /*r*/12, (UInt)guest_addr);
+   (void)imm32_to_iregNo_EXACTLY2(
+            p, /*r*/12, (UInt)Ptr_to_ULong(disp_cp_xindir));
+   p[2] = 0xE12FFF1C;
+   VexInvalRange vir = { (HWord)ic, (HWord)((UChar*)(p + 3) - (UChar*)ic) };
+   return vir;
+}
+
+
 /* Patch the counter address into a profile inc point, as previously
    created by the ARMin_ProfInc case for emit_ARMInstr. */
 VexInvalRange patchProfInc_ARM ( void*  place_to_patch,
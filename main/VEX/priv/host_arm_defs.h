@@ -394,6 +394,40 @@ typedef
 extern const HChar* showARMMulOp ( ARMMulOp op );
 
 
+/* ARMv6 media ops: parallel add/subtract on the 16- or 8-bit lanes of
+   a 32-bit register, plain, saturating or halving, and the
+   saturating 32-bit add/subtract. */
+typedef
+   enum {
+      ARMmed_ADD16=65,
+      ARMmed_SUB16,
+      ARMmed_SHADD16,
+      ARMmed_UHADD16,
+      ARMmed_SHSUB16,
+      ARMmed_UHSUB16,
+      ARMmed_QADD16,
+      ARMmed_UQADD16,
+      ARMmed_QSUB16,
+      ARMmed_UQSUB16,
+      ARMmed_ADD8,
+      ARMmed_SUB8,
+      ARMmed_SHADD8,
+      ARMmed_UHADD8,
+      ARMmed_SHSUB8,
+      ARMmed_UHSUB8,
+      ARMmed_QADD8,
+      ARMmed_UQADD8,
+      ARMmed_QSUB8,
+      ARMmed_UQSUB8,
+      ARMmed_USAD8,
+      ARMmed_QADD,
+      ARMmed_QSUB
+   }
+   ARMMediaOp;
+
+extern const HChar* showARMMediaOp ( ARMMediaOp op );
+
+
 typedef
    enum {
       ARMvfp_ADD=70,
@@ -561,6 +595,7 @@ typedef
       ARMin_Alu=220,
       ARMin_Shift,
       ARMin_Unary,
+      ARMin_Media,
       ARMin_CmpOrTst,
       ARMin_Mov,
       ARMin_Imm32,
@@ -644,6 +679,13 @@ typedef
             HReg       dst;
             HReg       src;
          } Unary;
+         /* dst = argL `op` argR, lane-wise */
+         struct {
+            ARMMediaOp op;
+            HReg       dst;
+            HReg       argL;
+            HReg       argR;
+         } Media;
          /* CMP/TST; subtract/and, discard result, set NZCV */
          struct {
             Bool     isCmp;
@@ -703,6 +745,7 @@ typedef
             HReg        dstGA;
             ARMAMode1*  amR15T;
             ARMCondCode cond; /* can be ARMcc_AL */
+            Bool        isRet; /* for an Ijk_Ret exit? */
          } XIndir;
          /* Assisted transfer to a guest address, most general case.
             Not chainable.  May be conditional. */
@@ -971,13 +1014,14 @@ extern ARMInstr* ARMInstr_Ld8S     ( ARMCondCode, HReg, ARMAMode2* );
 extern ARMInstr* ARMInstr_XDirect  ( Addr32 dstGA, ARMAMode1* amR15T,
                                      ARMCondCode cond, Bool toFastEP );
 extern ARMInstr* ARMInstr_XIndir   ( HReg dstGA, ARMAMode1* amR15T,
-                                     ARMCondCode cond );
+                                     ARMCondCode cond, Bool isRet );
 extern ARMInstr* ARMInstr_XAssisted ( HReg dstGA, ARMAMode1* amR15T,
                                       ARMCondCode cond, IRJumpKind jk );
 extern ARMInstr* ARMInstr_CMov     ( ARMCondCode, HReg dst, ARMRI84* src );
 extern ARMInstr* ARMInstr_Call     ( ARMCondCode, HWord, Int nArgRegs,
                                      RetLoc rloc );
 extern ARMInstr* ARMInstr_Mul      ( ARMMulOp op );
+extern ARMInstr* ARMInstr_Media    ( ARMMediaOp, HReg, HReg, HReg );
 extern ARMInstr* ARMInstr_LdrEX    ( Int szB );
 extern ARMInstr* ARMInstr_StrEX    ( Int szB );
 extern ARMInstr* ARMInstr_VLdStD   ( Bool isLoad, HReg, ARMAModeV* );
@@ -1029,12 +1073,15 @@ extern Int  emit_ARMInstr        ( /*MB_MOD*/Bool* is_profInc,
                                    void* disp_cp_chain_me_to_slowEP,
                                    void* disp_cp_chain_me_to_fastEP,
                                    void* disp_cp_xindir,
-                                   void* disp_cp_xassisted );
+                                   void* disp_cp_xassisted,
+                                   void* disp_cp_prime_ic,
+                                   void* disp_cp_xindir_ret );
 
 extern void genSpill_ARM  ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                             HReg rreg, Int offset, Bool );
 extern void genReload_ARM ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                             HReg rreg, Int offset, Bool );
+extern ARMInstr* genMove_ARM ( HReg from, HReg to, Bool );
 
 extern void getAllocableRegs_ARM ( Int*, HReg** );
 extern HInstrArray* iselSB_ARM   ( IRSB*, 
@@ -1061,6 +1108,13 @@ extern VexInvalRange unchainXDirect_ARM ( void* place_to_unchain,
                                           void* place_to_jump_to_EXPECTED,
                                           void* disp_cp_chain_me );
 
+/* Prime the inline cache of an XIndir, given the address of its
+   call to disp_cp_prime_ic. */
+extern VexInvalRange primeXIndirIC_ARM ( void*  place_to_prime,
+                                         Addr64 guest_addr,
+                                         void*  disp_cp_prime_ic_EXPECTED,
+                                         void*  disp_cp_xindir );
+
 /* Patch the counter location into an existing ProfInc point. */
 extern VexInvalRange patchProfInc_ARM ( void*  place_to_patch,
                                         ULong* location_of_counter );
@@ -1420,6 +1420,42 @@ static HReg iselIntExpr_R_wrk ( ISelEnv* env, IRExpr* e )
          return res;
       }
 
+      /* ARMv6 media instructions, for the 32-bit SIMD ops. */
+      ARMMediaOp mop = 0;
+      switch (e->Iex.Binop.op) {
+         case Iop_Add16x2:   mop = ARMmed_ADD16;   break;
+         case Iop_Sub16x2:   mop = ARMmed_SUB16;   break;
+         case Iop_HAdd16Ux2: mop = ARMmed_UHADD16; break;
+         case Iop_HAdd16Sx2: mop = ARMmed_SHADD16; break;
+         case Iop_HSub16Ux2: mop = ARMmed_UHSUB16; break;
+         case Iop_HSub16Sx2: mop = ARMmed_SHSUB16; break;
+         case Iop_QAdd16Sx2: mop = ARMmed_QADD16;  break;
+         case Iop_QAdd16Ux2: mop = ARMmed_UQADD16; break;
+         case Iop_QSub16Sx2: mop = ARMmed_QSUB16;  break;
+         case Iop_QSub16Ux2: mop = ARMmed_UQSUB16; break;
+         case Iop_Add8x4:    mop = ARMmed_ADD8;    break;
+         case Iop_Sub8x4:    mop = ARMmed_SUB8;    break;
+         case Iop_HAdd8Ux4:  mop = ARMmed_UHADD8;  break;
+         case Iop_HAdd8Sx4:  mop = ARMmed_SHADD8;  break;
+         case Iop_HSub8Ux4:  mop = ARMmed_UHSUB8;  break;
+         case Iop_HSub8Sx4:  mop = ARMmed_SHSUB8;  break;
+         case Iop_QAdd8Sx4:  mop = ARMmed_QADD8;   break;
+         case Iop_QAdd8Ux4:  mop = ARMmed_UQADD8;  break;
+         case Iop_QSub8Sx4:  mop = ARMmed_QSUB8;   break;
+         case Iop_QSub8Ux4:  mop = ARMmed_UQSUB8;  break;
+         case Iop_Sad8Ux4:   mop = ARMmed_USAD8;   break;
+         case Iop_QAdd32S:   mop = ARMmed_QADD;    break;
+         case Iop_QSub32S:   mop = ARMmed_QSUB;    break;
+         default: break;
+      }
+      if (mop != 0) {
+         HReg regL = iselIntExpr_R(env, e->Iex.Binop.arg1);
+         HReg regR = iselIntExpr_R(env, e->Iex.Binop.arg2);
+         HReg res  = newVRegI(env);
+         addInstr(env, ARMInstr_Media(mop, res, regL, regR));
+         return res;
+      }
+
       /* All cases involving host-side helper calls. */
       void* fn = NULL;
       switch (e->Iex.Binop.op) {
@@ -1481,6 +1517,8 @@ static HReg iselIntExpr_R_wrk ( ISelEnv* env, IRExpr* e )
          HReg regL = iselIntExpr_R(env, e->Iex.Binop.arg1);
          HReg regR = iselIntExpr_R(env, e->Iex.Binop.arg2);
          HReg res  = newVRegI(env);
+         if (e->Iex.Binop.op != Iop_DivU32 && e->Iex.Binop.op != Iop_DivS32)
+            h_generic_note_use(e->Iex.Binop.op);
          addInstr(env, mk_iMOVds_RR(hregARM_R0(), regL));
          addInstr(env, mk_iMOVds_RR(hregARM_R1(), regR));
          addInstr(env, ARMInstr_Call( ARMcc_AL, (HWord)Ptr_to_ULong(fn),
@@ -1771,6 +1809,7 @@ static HReg iselIntExpr_R_wrk ( ISelEnv* env, IRExpr* e )
       if (fn) {
          HReg arg = iselIntExpr_R(env, e->Iex.Unop.arg);
          HReg res = newVRegI(env);
+         h_generic_note_use(e->Iex.Unop.op);
          addInstr(env, mk_iMOVds_RR(hregARM_R0(), arg));
          addInstr(env, ARMInstr_Call( ARMcc_AL, (HWord)Ptr_to_ULong(fn),
                                       1, mk_RetLoc_simple(RLPri_Int) ));
@@ -6188,7 +6227,9 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
       ARMAMode1*  amR15T = ARMAMode1_RI(hregARM_R8(),
                                         stmt->Ist.Exit.offsIP);
 
-      /* Case: boring transfer to known address */
+      /* Case: boring transfer to known address.  Call and Ret are
+         only hints; the destination is a constant, so they can be
+         chained just the same. */
       if (stmt->Ist.Exit.jk == Ijk_Boring
           || stmt->Ist.Exit.jk == Ijk_Call
           || stmt->Ist.Exit.jk == Ijk_Ret) {
@@ -6261,8 +6302,10 @@ static void iselNext ( ISelEnv* env,
    if (next->tag == Iex_Const) {
       IRConst* cdst = next->Iex.Const.con;
       vassert(cdst->tag == Ico_U32);
-      if (jk == Ijk_Boring || jk == Ijk_Call) {
-         /* Boring transfer to known address */
+      if (jk == Ijk_Boring || jk == Ijk_Call || jk == Ijk_Ret) {
+         /* Boring transfer to known address.  A return to a
+            constant address (eg, after push $imm; ret) is no
+            different. */
          ARMAMode1* amR15T = ARMAMode1_RI(hregARM_R8(), offsIP);
          if (env->chainingAllowed) {
             /* .. almost always true .. */
@@ -6292,7 +6335,8 @@ static void iselNext ( ISelEnv* env,
          HReg       r      = iselIntExpr_R(env, next);
          ARMAMode1* amR15T = ARMAMode1_RI(hregARM_R8(), offsIP);
          if (env->chainingAllowed) {
-            addInstr(env, ARMInstr_XIndir(r, amR15T, ARMcc_AL));
+            addInstr(env, ARMInstr_XIndir(r, amR15T, ARMcc_AL,
+                                          jk == Ijk_Ret));
          } else {
             addInstr(env, ARMInstr_XAssisted(r, amR15T, ARMcc_AL,
                                                 Ijk_Boring));
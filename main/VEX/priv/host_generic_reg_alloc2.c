@@ -43,6 +43,16 @@
 #define DEBUG_REGALLOC 0
 
 
+/* Counts of what the allocators have done, for showRegAllocStats. */
+static UInt n_ra_blocks      = 0;
+static UInt n_ra_insns_in    = 0;
+static UInt n_ra_spills      = 0;
+static UInt n_ra_reloads     = 0;
+static UInt n_ra_coalesced   = 0;
+static UInt n_ra_split_moves = 0;
+static UInt n_ra_max_slots   = 0;
+
+
 /* TODO 27 Oct 04:
 
    Better consistency checking from what isMove tells us.
@@ -208,7 +218,7 @@ Int findMostDistantlyMentionedVReg (
 static inline void sanity_check_spill_offset ( VRegLR* vreg )
 {
    switch (vreg->reg_class) {
-      case HRcVec128: case HRcFlt64:
+      case HRcVec256: case HRcVec128: case HRcFlt64:
          vassert(0 == ((UShort)vreg->spill_offset % 16)); break;
       default:
          vassert(0 == ((UShort)vreg->spill_offset % 8)); break;
@@ -216,6 +226,27 @@ static inline void sanity_check_spill_offset ( VRegLR* vreg )
 }
 
 
+/* How many 64-bit spill slots does a vreg of this class need?  This
+   needs to be kept in sync with the size info on the definition of
+   HRegClass. */
+static inline Int n_spill_slots_for ( HRegClass rc )
+{
+   switch (rc) {
+      case HRcVec256:                 return 4;
+      case HRcVec128: case HRcFlt64:  return 2;
+      default:                        return 1;
+   }
+}
+
+/* Update the spill slot high-water mark, for the stats. */
+static inline void note_spill_slots_used ( Int first, HRegClass rc )
+{
+   UInt top = first + n_spill_slots_for(rc);
+   if (top > n_ra_max_slots)
+      n_ra_max_slots = top;
+}
+
+
 /* Double the size of the real-reg live-range array, if needed. */
 static void ensureRRLRspace ( RRegLR** info, Int* size, Int used )
 {
@@ -304,7 +335,7 @@ static void sortRRLRarray ( RRegLR* arr,
    Takes an expandable array of pointers to unallocated insns.
    Returns an expandable array of pointers to allocated insns.
 */
-HInstrArray* doRegisterAllocation (
+HInstrArray* doRegisterAllocation_v2 (
 
    /* Incoming virtual-registerised code. */ 
    HInstrArray* instrs_in,
@@ -455,6 +486,9 @@ HInstrArray* doRegisterAllocation (
 
    instrs_out = newHInstrArray();
 
+   n_ra_blocks++;
+   n_ra_insns_in += instrs_in->arr_used;
+
    /* ... and initialise running state. */
    /* n_rregs is no more than a short name for n_available_real_regs. */
    n_rregs = n_available_real_regs;
@@ -855,6 +889,26 @@ HInstrArray* doRegisterAllocation (
             ss_busy_until_before[k+1] = vreg_lrs[j].dead_before;
             break;
 
+         case HRcVec256:
+            /* Find four adjacent free slots, starting at a slot
+               number which is zero mod 4, in which to spill the
+               vreg. */
+            for (k = 0; k < N_SPILL64S-3; k += 4)
+               if (ss_busy_until_before[k+0] <= vreg_lrs[j].live_after
+                   && ss_busy_until_before[k+1] <= vreg_lrs[j].live_after
+                   && ss_busy_until_before[k+2] <= vreg_lrs[j].live_after
+                   && ss_busy_until_before[k+3] <= vreg_lrs[j].live_after)
+                  break;
+            if (k >= N_SPILL64S-3) {
+               vpanic("LibVEX_N_SPILL_BYTES is too low.  " 
+                      "Increase and recompile.");
+            }
+            ss_busy_until_before[k+0] = vreg_lrs[j].dead_before;
+            ss_busy_until_before[k+1] = vreg_lrs[j].dead_before;
+            ss_busy_until_before[k+2] = vreg_lrs[j].dead_before;
+            ss_busy_until_before[k+3] = vreg_lrs[j].dead_before;
+            break;
+
          default:
             /* The ordinary case -- just find a single spill slot. */
             /* Find the lowest-numbered spill slot which is available
@@ -879,6 +933,7 @@ HInstrArray* doRegisterAllocation (
 
       /* Independent check that we've made a sane choice of slot */
       sanity_check_spill_offset( &vreg_lrs[j] );
+      note_spill_slots_used( k, vreg_lrs[j].reg_class );
       /* if (j > max_ss_no) */
       /*    max_ss_no = j; */
    }
@@ -1063,6 +1118,7 @@ HInstrArray* doRegisterAllocation (
 
          /* Finally, we can do the coalescing.  It's trivial -- merely
             claim vregS's register for vregD. */
+         n_ra_coalesced++;
          rreg_state[m].vreg = vregD;
          vassert(IS_VALID_VREGNO(hregNumber(vregD)));
          vassert(IS_VALID_VREGNO(hregNumber(vregS)));
@@ -1162,6 +1218,7 @@ HInstrArray* doRegisterAllocation (
                   (*genSpill)( &spill1, &spill2, rreg_state[k].rreg,
                                vreg_lrs[m].spill_offset, mode64 );
                   vassert(spill1 || spill2); /* can't both be NULL */
+                  n_ra_spills++;
                   if (spill1)
                      EMIT_INSTR(spill1);
                   if (spill2)
@@ -1343,6 +1400,7 @@ HInstrArray* doRegisterAllocation (
                (*genReload)( &reload1, &reload2, rreg_state[k].rreg,
                              vreg_lrs[m].spill_offset, mode64 );
                vassert(reload1 || reload2); /* can't both be NULL */
+               n_ra_reloads++;
                if (reload1)
                   EMIT_INSTR(reload1);
                if (reload2)
@@ -1426,6 +1484,7 @@ HInstrArray* doRegisterAllocation (
             (*genSpill)( &spill1, &spill2, rreg_state[spillee].rreg,
                          vreg_lrs[m].spill_offset, mode64 );
             vassert(spill1 || spill2); /* can't both be NULL */
+            n_ra_spills++;
             if (spill1)
                EMIT_INSTR(spill1);
             if (spill2)
@@ -1452,6 +1511,7 @@ HInstrArray* doRegisterAllocation (
             (*genReload)( &reload1, &reload2, rreg_state[spillee].rreg,
                           vreg_lrs[m].spill_offset, mode64 );
             vassert(reload1 || reload2); /* can't both be NULL */
+            n_ra_reloads++;
             if (reload1)
                EMIT_INSTR(reload1);
             if (reload2)
@@ -1553,6 +1613,856 @@ HInstrArray* doRegisterAllocation (
 
 
 
+/*---------------------------------------------------------------*/
+/*--- The linear-scan allocator                               ---*/
+/*---------------------------------------------------------------*/
+
+/* The incoming code is straight-line, so the live range of each vreg
+   is a single interval.  doRegisterAllocation_v2 treats that
+   interval as a unit: the vreg gets a spill slot for all of it
+   whether or not it is ever spilled, and choosing a vreg to evict
+   means calling getRegUsage on each following insn until every
+   candidate has been found.
+
+   This allocator instead splits live ranges as it scans the code.
+   At any point a live vreg is in an rreg, or in its spill slot, or
+   in both when they are known to agree.  In more detail:
+
+   * The mentions of each vreg are listed up front, so the next use
+     of any vreg is known without rescanning the code, and the vreg
+     to evict is the one whose next use is furthest away.
+
+   * A spill slot is only allocated when a vreg is first spilled.
+     It is free again once the vreg is dead, so vregs whose spilled
+     parts don't overlap share slots.
+
+   * When a vreg's rreg is about to enter a hard live range, the
+     vreg is moved to a free rreg of its class, if there is one,
+     rather than spilled.  When picking a free rreg, ones not needed
+     for a hard live range before the vreg dies are preferred.
+
+   * A vreg-vreg move which ends the source's live range and starts
+     the destination's is removed, both when the source is in an
+     rreg (as _v2 does) and when it is only in its spill slot.  The
+     destination inherits the source's slot, so an rreg which agrees
+     with the slot still does so after the move.
+
+   * Dead vregs are freed just after their last mention, rather than
+     by scanning the whole rreg state before every insn.
+*/
+
+#define NO_SPILL_SLOT ((Short)(-1))
+
+/* Running state for each vreg. */
+typedef
+   struct {
+      /* Becomes live for the first time after this insn ... */
+      Short live_after;
+      /* Becomes dead for the last time before this insn ... */
+      Short dead_before;
+      /* The first 64-bit spill slot allocated to this vreg, or
+         NO_SPILL_SLOT if it hasn't needed one yet. */
+      Short spill_slot;
+      /* Index in rreg_state of the rreg holding this vreg, or
+         INVALID_RREG_NO if it is only in its spill slot. */
+      Short rreg;
+      /* What kind of register this is. */
+      HRegClass reg_class;
+      /* The next mention of this vreg not yet processed, as an index
+         into the mention lists, or -1 if there are no more. */
+      Int next_use;
+   }
+   VRegState;
+
+
+/* Find spill slots for a vreg of class rc which are unused from insn
+   'from' onwards, and claim them until insn 'until'.  As for _v2,
+   128- and 256-bit values get slots aligned to their size.  Returns
+   the number of the first slot. */
+static Short alloc_spill_slots ( Int* ss_busy_until_before,
+                                 HRegClass rc, Int from, Int until )
+{
+   Int n = n_spill_slots_for(rc);
+   Int k, m;
+   for (k = 0; k + n <= N_SPILL64S; k += n) {
+      for (m = 0; m < n; m++)
+         if (ss_busy_until_before[k+m] > from)
+            break;
+      if (m == n)
+         break;
+   }
+   if (k + n > N_SPILL64S) {
+      vpanic("LibVEX_N_SPILL_BYTES is too low.  " 
+             "Increase and recompile.");
+   }
+   for (m = 0; m < n; m++)
+      ss_busy_until_before[k+m] = until;
+   note_spill_slots_used(k, rc);
+   return toShort(k);
+}
+
+
+/* Choose a free rreg of class rc for a vreg which is live until
+   'until'.  Prefer one which is not needed for a hard live range
+   before then, otherwise take the one whose next hard live range is
+   furthest away.  Returns -1 if there is no free rreg of the class
+   whose next hard live range starts after insn 'after'. */
+static Int find_free_rreg ( RRegState* rreg_state, Int n_rregs,
+                            Int* rreg_next_hlr, RRegLR* rreg_lrs_la,
+                            HRegClass rc, Int after, Int until )
+{
+   Int k, start;
+   Int best = -1, best_start = -1;
+   for (k = 0; k < n_rregs; k++) {
+      if (rreg_state[k].disp != Free
+          || hregClass(rreg_state[k].rreg) != rc)
+         continue;
+      start = rreg_next_hlr[k] < 0
+                 ? 0x7FFF : rreg_lrs_la[rreg_next_hlr[k]].live_after;
+      if (start >= until)
+         return k;
+      if (start > best_start) {
+         best       = k;
+         best_start = start;
+      }
+   }
+   return best_start > after ? best : -1;
+}
+
+
+/* Make sure the mention lists have room for one more entry. */
+static void ensureUseSpace ( Short** pos, Int** next, Int* size, Int used )
+{
+   Int    k;
+   Short* pos2;
+   Int*   next2;
+   if (used < *size) return;
+   vassert(used == *size);
+   pos2  = LibVEX_Alloc(2 * *size * sizeof(Short));
+   next2 = LibVEX_Alloc(2 * *size * sizeof(Int));
+   for (k = 0; k < *size; k++) {
+      pos2[k]  = (*pos)[k];
+      next2[k] = (*next)[k];
+   }
+   *size *= 2;
+   *pos  = pos2;
+   *next = next2;
+}
+
+
+/* The linear-scan allocator.  The interface and the requirements on
+   the incoming code are the same as for doRegisterAllocation_v2,
+   plus the optional genMove. */
+HInstrArray* doRegisterAllocation_v3 (
+   HInstrArray* instrs_in,
+   HReg* available_real_regs,
+   Int   n_available_real_regs,
+   Bool (*isMove) ( HInstr*, HReg*, HReg* ),
+   void (*getRegUsage) ( HRegUsage*, HInstr*, Bool ),
+   void (*mapRegs) ( HRegRemap*, HInstr*, Bool ),
+   void    (*genSpill)  ( HInstr**, HInstr**, HReg, Int, Bool ),
+   void    (*genReload) ( HInstr**, HInstr**, HReg, Int, Bool ),
+   HInstr* (*directReload) ( HInstr*, HReg, Short ),
+   HInstr* (*genMove) ( HReg, HReg, Bool ),
+   Int     guest_sizeB,
+   void (*ppInstr) ( HInstr*, Bool ),
+   void (*ppReg) ( HReg ),
+   Bool mode64
+)
+{
+   /* Iterators and temporaries. */
+   Int       ii, j, k, m, w;
+   HReg      rreg, vreg, vregS, vregD;
+   HRegUsage reg_usage;
+
+   /* Running state of vregs and rregs. */
+   Int        n_vregs;
+   VRegState* vreg_state;  /* [0 .. n_vregs-1] */
+   Int        n_rregs;
+   RRegState* rreg_state;  /* [0 .. n_rregs-1] */
+
+   /* The mention lists.  Entry i records a mention of some vreg at
+      insn use_pos[i]; use_next[i] is the vreg's next mention, or
+      -1.  last_use is only used while building them. */
+   Short* use_pos;
+   Int*   use_next;
+   Int*   last_use;     /* [0 .. n_vregs-1] */
+   Int    uses_size;
+   Int    uses_used;
+
+   /* Real-reg live ranges, sorted both ways, as for _v2.  In
+      addition, each entry of the _la array records which rreg_state
+      entry it belongs to, and chains to the next entry for the same
+      rreg, and rreg_next_hlr gives for each rreg the first of its
+      hard live ranges not yet started. */
+   RRegLR* rreg_lrs_la;
+   RRegLR* rreg_lrs_db;
+   Int     rreg_lrs_size;
+   Int     rreg_lrs_used;
+   Int     rreg_lrs_la_next;
+   Int     rreg_lrs_db_next;
+   Short*  rreg_lrs_la_ix;
+   Int*    hlr_chain;
+   Int*    rreg_next_hlr;    /* [0 .. n_rregs-1] */
+   Int*    rreg_live_after;
+   Int*    rreg_dead_before;
+
+   /* For each 64-bit spill slot, the insn before which it becomes
+      free. */
+   Int ss_busy_until_before[N_SPILL64S];
+
+   HRegRemap    remap;
+   HInstrArray* instrs_out;
+   Bool         do_sanity_check;
+
+   vassert(0 == (guest_sizeB % 32));
+   vassert(0 == (LibVEX_N_SPILL_BYTES % 32));
+   vassert(0 == (N_SPILL64S % 4));
+
+   /* As for _v2, live range numbers are signed shorts. */
+   vassert(instrs_in->arr_used <= 15000);
+
+#  define INVALID_INSTRNO (-2)
+
+#  define EMIT_INSTR(_instr)                  \
+      do {                                    \
+        HInstr* _tmp = (_instr);              \
+        if (DEBUG_REGALLOC) {                 \
+           vex_printf("**  ");                \
+           (*ppInstr)(_tmp, mode64);          \
+           vex_printf("\n\n");                \
+        }                                     \
+        addHInstr ( instrs_out, _tmp );       \
+      } while (0)
+
+#  define SPILL_OFFSET(_vregno) \
+      (guest_sizeB * 3 + vreg_state[_vregno].spill_slot * 8)
+
+   /* Store _rreg to the spill slot of vreg number _vregno, allocating
+      the slot first if need be. */
+#  define EMIT_SPILL(_rreg, _vregno)                                \
+      do {                                                          \
+         HInstr* _s1 = NULL;                                        \
+         HInstr* _s2 = NULL;                                        \
+         if (vreg_state[_vregno].spill_slot == NO_SPILL_SLOT)       \
+            vreg_state[_vregno].spill_slot                          \
+               = alloc_spill_slots( ss_busy_until_before,           \
+                                    vreg_state[_vregno].reg_class,  \
+                                    ii,                             \
+                                    vreg_state[_vregno].dead_before ); \
+         (*genSpill)( &_s1, &_s2, (_rreg),                          \
+                      SPILL_OFFSET(_vregno), mode64 );              \
+         vassert(_s1 || _s2); /* can't both be NULL */              \
+         n_ra_spills++;                                             \
+         if (_s1) EMIT_INSTR(_s1);                                  \
+         if (_s2) EMIT_INSTR(_s2);                                  \
+      } while (0)
+
+#  define EMIT_RELOAD(_rreg, _vregno)                               \
+      do {                                                          \
+         HInstr* _r1 = NULL;                                        \
+         HInstr* _r2 = NULL;                                        \
+         vassert(vreg_state[_vregno].spill_slot != NO_SPILL_SLOT);  \
+         (*genReload)( &_r1, &_r2, (_rreg),                         \
+                       SPILL_OFFSET(_vregno), mode64 );             \
+         vassert(_r1 || _r2); /* can't both be NULL */              \
+         n_ra_reloads++;                                            \
+         if (_r1) EMIT_INSTR(_r1);                                  \
+         if (_r2) EMIT_INSTR(_r2);                                  \
+      } while (0)
+
+#  define NEXT_USE(_vregno)                               \
+      (vreg_state[_vregno].next_use < 0                   \
+          ? 0x7FFF : use_pos[vreg_state[_vregno].next_use])
+
+   /* --------- Stage 0: allocate/initialise running state. --------- */
+
+   instrs_out = newHInstrArray();
+
+   n_ra_blocks++;
+   n_ra_insns_in += instrs_in->arr_used;
+
+   n_rregs = n_available_real_regs;
+   n_vregs = instrs_in->n_vregs;
+
+   /* If this is not so, the Short vreg and rreg indices will
+      overflow. */
+   vassert(n_vregs < 32767);
+   vassert(n_rregs > 0);
+
+   rreg_state = LibVEX_Alloc(n_rregs * sizeof(RRegState));
+   for (j = 0; j < n_rregs; j++) {
+      rreg_state[j].rreg          = available_real_regs[j];
+      rreg_state[j].has_hlrs      = False;
+      rreg_state[j].disp          = Free;
+      rreg_state[j].vreg          = INVALID_HREG;
+      rreg_state[j].is_spill_cand = False;
+      rreg_state[j].eq_spill_slot = False;
+   }
+
+   vreg_state = NULL;
+   last_use   = NULL;
+   if (n_vregs > 0) {
+      vreg_state = LibVEX_Alloc(n_vregs * sizeof(VRegState));
+      last_use   = LibVEX_Alloc(n_vregs * sizeof(Int));
+   }
+   for (j = 0; j < n_vregs; j++) {
+      vreg_state[j].live_after  = INVALID_INSTRNO;
+      vreg_state[j].dead_before = INVALID_INSTRNO;
+      vreg_state[j].spill_slot  = NO_SPILL_SLOT;
+      vreg_state[j].rreg        = INVALID_RREG_NO;
+      vreg_state[j].reg_class   = HRcINVALID;
+      vreg_state[j].next_use    = -1;
+      last_use[j] = -1;
+   }
+
+   uses_used = 0;
+   uses_size = 4 * instrs_in->arr_used + 4;
+   use_pos   = LibVEX_Alloc(uses_size * sizeof(Short));
+   use_next  = LibVEX_Alloc(uses_size * sizeof(Int));
+
+   rreg_lrs_used = 0;
+   rreg_lrs_size = 4;
+   rreg_lrs_la = LibVEX_Alloc(rreg_lrs_size * sizeof(RRegLR));
+
+   rreg_live_after  = LibVEX_Alloc(n_rregs * sizeof(Int));
+   rreg_dead_before = LibVEX_Alloc(n_rregs * sizeof(Int));
+   for (j = 0; j < n_rregs; j++) {
+      rreg_live_after[j] = 
+      rreg_dead_before[j] = INVALID_INSTRNO;
+   }
+
+   /* --------- Stage 1: compute vreg live ranges and mentions. --------- */
+   /* --------- Stage 2: compute rreg live ranges. --------- */
+
+   for (ii = 0; ii < instrs_in->arr_used; ii++) {
+
+      (*getRegUsage)( &reg_usage, instrs_in->arr[ii], mode64 );
+
+      for (j = 0; j < reg_usage.n_used; j++) {
+
+         Int  flush_la = INVALID_INSTRNO, flush_db = INVALID_INSTRNO;
+         Bool flush;
+
+         vreg = reg_usage.hreg[j];
+
+         if (hregIsVirtual(vreg)) {
+            k = hregNumber(vreg);
+            if (k < 0 || k >= n_vregs) {
+               vex_printf("\n");
+               (*ppInstr)(instrs_in->arr[ii], mode64);
+               vex_printf("\n");
+               vex_printf("vreg %d, n_vregs %d\n", k, n_vregs);
+               vpanic("doRegisterAllocation_v3: out-of-range vreg");
+            }
+            if (vreg_state[k].reg_class == HRcINVALID) {
+               vreg_state[k].reg_class = hregClass(vreg);
+            } else {
+               vassert(vreg_state[k].reg_class == hregClass(vreg));
+            }
+            switch (reg_usage.mode[j]) {
+               case HRmRead: 
+               case HRmModify:
+                  if (vreg_state[k].live_after == INVALID_INSTRNO) {
+                     vex_printf("\n\nOFFENDING VREG = %d\n", k);
+                     vpanic("doRegisterAllocation_v3: "
+                            "first event for vreg is Read/Modify");
+                  }
+                  break;
+               case HRmWrite:
+                  if (vreg_state[k].live_after == INVALID_INSTRNO)
+                     vreg_state[k].live_after = toShort(ii);
+                  break;
+               default:
+                  vpanic("doRegisterAllocation_v3(1)");
+            }
+            vreg_state[k].dead_before = toShort(ii + 1);
+
+            /* Add this insn to the vreg's mention list. */
+            ensureUseSpace(&use_pos, &use_next, &uses_size, uses_used);
+            use_pos[uses_used]  = toShort(ii);
+            use_next[uses_used] = -1;
+            if (last_use[k] == -1)
+               vreg_state[k].next_use = uses_used;
+            else
+               use_next[last_use[k]] = uses_used;
+            last_use[k] = uses_used;
+            uses_used++;
+            continue;
+         }
+
+         /* A real reg.  Ignore it unless it's allocatable. */
+         rreg = vreg;
+         for (k = 0; k < n_rregs; k++)
+            if (sameHReg(available_real_regs[k], rreg))
+               break;
+         if (k == n_rregs) 
+            continue;
+         flush = False;
+         switch (reg_usage.mode[j]) {
+            case HRmWrite:
+               flush_la = rreg_live_after[k];
+               flush_db = rreg_dead_before[k];
+               if (flush_la != INVALID_INSTRNO 
+                   && flush_db != INVALID_INSTRNO)
+                  flush = True;
+               rreg_live_after[k]  = ii;
+               rreg_dead_before[k] = ii+1;
+               break;
+            case HRmRead:
+            case HRmModify:
+               if (rreg_live_after[k] == INVALID_INSTRNO) {
+                  vex_printf("\nOFFENDING RREG = ");
+                  (*ppReg)(available_real_regs[k]);
+                  vex_printf("\n");
+                  vex_printf("\nOFFENDING instr = ");
+                  (*ppInstr)(instrs_in->arr[ii], mode64);
+                  vex_printf("\n");
+                  vpanic("doRegisterAllocation_v3: "
+                         "first event for rreg is Read/Modify");
+               }
+               rreg_dead_before[k] = ii+1;
+               break;
+            default:
+               vpanic("doRegisterAllocation_v3(2)");
+         }
+
+         if (flush) {
+            ensureRRLRspace(&rreg_lrs_la, &rreg_lrs_size, rreg_lrs_used);
+            rreg_lrs_la[rreg_lrs_used].rreg        = rreg;
+            rreg_lrs_la[rreg_lrs_used].live_after  = toShort(flush_la);
+            rreg_lrs_la[rreg_lrs_used].dead_before = toShort(flush_db);
+            rreg_lrs_used++;
+         }
+      }
+   }
+
+   /* Finish up any rreg live ranges left over. */
+   for (j = 0; j < n_rregs; j++) {
+      if (rreg_live_after[j] == INVALID_INSTRNO)
+         continue;
+      ensureRRLRspace(&rreg_lrs_la, &rreg_lrs_size, rreg_lrs_used);
+      rreg_lrs_la[rreg_lrs_used].rreg        = available_real_regs[j];
+      rreg_lrs_la[rreg_lrs_used].live_after  = toShort(rreg_live_after[j]);
+      rreg_lrs_la[rreg_lrs_used].dead_before = toShort(rreg_dead_before[j]);
+      rreg_lrs_used++;
+   }
+
+   rreg_lrs_db = LibVEX_Alloc(rreg_lrs_used * sizeof(RRegLR));
+   for (j = 0; j < rreg_lrs_used; j++)
+      rreg_lrs_db[j] = rreg_lrs_la[j];
+
+   sortRRLRarray( rreg_lrs_la, rreg_lrs_used, True /* by .live_after*/  );
+   sortRRLRarray( rreg_lrs_db, rreg_lrs_used, False/* by .dead_before*/ );
+
+   /* Chain together the _la entries of each rreg.  Building the
+      chains backwards leaves them in .live_after order. */
+   rreg_lrs_la_ix = LibVEX_Alloc(rreg_lrs_used * sizeof(Short));
+   hlr_chain      = LibVEX_Alloc(rreg_lrs_used * sizeof(Int));
+   rreg_next_hlr  = LibVEX_Alloc(n_rregs * sizeof(Int));
+   for (k = 0; k < n_rregs; k++)
+      rreg_next_hlr[k] = -1;
+   for (j = rreg_lrs_used - 1; j >= 0; j--) {
+      for (k = 0; k < n_rregs; k++)
+         if (sameHReg(rreg_state[k].rreg, rreg_lrs_la[j].rreg))
+            break;
+      vassert(k < n_rregs);
+      rreg_lrs_la_ix[j]      = toShort(k);
+      hlr_chain[j]           = rreg_next_hlr[k];
+      rreg_next_hlr[k]       = j;
+      rreg_state[k].has_hlrs = True;
+   }
+
+   rreg_lrs_la_next = 0;
+   rreg_lrs_db_next = 0;
+
+   for (j = 0; j < N_SPILL64S; j++)
+      ss_busy_until_before[j] = 0;
+
+   /* --------- Stage 3: process instructions --------- */
+
+   for (ii = 0; ii < instrs_in->arr_used; ii++) {
+
+#     if DEBUG_REGALLOC
+      vex_printf("\n====----====---- Insn %d ----====----====\n", ii);
+      vex_printf("---- ");
+      (*ppInstr)(instrs_in->arr[ii], mode64);
+      vex_printf("\n\n");
+#     endif
+
+      (*getRegUsage)( &reg_usage, instrs_in->arr[ii], mode64 );
+
+      /* Step the mention cursors of the vregs this insn mentions past
+         it.  After this, the cursor of every vreg gives its next
+         mention after this insn. */
+      for (j = 0; j < reg_usage.n_used; j++) {
+         vreg = reg_usage.hreg[j];
+         if (!hregIsVirtual(vreg))
+            continue;
+         m = hregNumber(vreg);
+         vassert(IS_VALID_VREGNO(m));
+         vassert(vreg_state[m].next_use >= 0);
+         vassert(use_pos[vreg_state[m].next_use] == ii);
+         vreg_state[m].next_use = use_next[vreg_state[m].next_use];
+      }
+
+      /* ------------ Sanity checks ------------ */
+
+      do_sanity_check
+         = toBool(
+              False  /* Set to True for sanity checking of all insns. */
+              || ii == instrs_in->arr_used-1
+              || (ii > 0 && (ii % 7) == 0)
+           );
+
+      if (do_sanity_check) {
+         /* An rreg is Unavail exactly when a hard live range crosses
+            this insn. */
+         for (j = 0; j < rreg_lrs_used; j++) {
+            if (rreg_lrs_la[j].live_after < ii 
+                && ii < rreg_lrs_la[j].dead_before)
+               vassert(rreg_state[rreg_lrs_la_ix[j]].disp == Unavail);
+         }
+         for (k = 0; k < n_rregs; k++) {
+            if (rreg_state[k].disp != Unavail)
+               continue;
+            for (j = 0; j < rreg_lrs_used; j++)
+               if (rreg_lrs_la_ix[j] == k
+                   && rreg_lrs_la[j].live_after < ii 
+                   && ii < rreg_lrs_la[j].dead_before) 
+                  break;
+            vassert(j < rreg_lrs_used);
+         }
+         /* The vreg and rreg bindings agree, bind registers of the
+            same class, and only bind live vregs. */
+         for (k = 0; k < n_rregs; k++) {
+            if (rreg_state[k].disp != Bound) {
+               vassert(rreg_state[k].eq_spill_slot == False);
+               continue;
+            }
+            vassert( hregIsVirtual(rreg_state[k].vreg));
+            vassert(!hregIsVirtual(rreg_state[k].rreg));
+            vassert(hregClass(rreg_state[k].rreg) 
+                    == hregClass(rreg_state[k].vreg));
+            m = hregNumber(rreg_state[k].vreg);
+            vassert(IS_VALID_VREGNO(m));
+            vassert(vreg_state[m].rreg == k);
+            vassert(vreg_state[m].dead_before > ii);
+            if (rreg_state[k].eq_spill_slot)
+               vassert(vreg_state[m].spill_slot != NO_SPILL_SLOT);
+         }
+         for (m = 0; m < n_vregs; m++) {
+            k = vreg_state[m].rreg;
+            if (k == INVALID_RREG_NO)
+               continue;
+            vassert(IS_VALID_RREGNO(k));
+            vassert(rreg_state[k].disp == Bound);
+            vassert(hregNumber(rreg_state[k].vreg) == m);
+         }
+      }
+
+      /* ------------ Move coalescing ------------ */
+
+      /* If this is a move between two vregs, the src's live range
+         ends here and the dst's starts here, the dst simply takes
+         over the src's rreg and spill slot, and the move goes.  This
+         works even if the src is only in its spill slot. */
+      if ( (*isMove)( instrs_in->arr[ii], &vregS, &vregD )
+           && hregIsVirtual(vregS) && hregIsVirtual(vregD)
+           && !sameHReg(vregS, vregD) ) {
+         vassert(hregClass(vregS) == hregClass(vregD));
+         k = hregNumber(vregS);
+         m = hregNumber(vregD);
+         vassert(IS_VALID_VREGNO(k));
+         vassert(IS_VALID_VREGNO(m));
+         if (vreg_state[k].dead_before == ii + 1
+             && vreg_state[m].live_after == ii) {
+#           if DEBUG_REGALLOC
+            vex_printf("COALESCE ");
+            (*ppReg)(vregS);
+            vex_printf(" -> ");
+            (*ppReg)(vregD);
+            vex_printf("\n\n");
+#           endif
+            w = vreg_state[k].rreg;
+            if (w != INVALID_RREG_NO) {
+               vassert(rreg_state[w].disp == Bound);
+               rreg_state[w].vreg   = vregD;
+               vreg_state[m].rreg   = toShort(w);
+               vreg_state[k].rreg   = INVALID_RREG_NO;
+            } else {
+               vassert(vreg_state[k].spill_slot != NO_SPILL_SLOT);
+            }
+            if (vreg_state[k].spill_slot != NO_SPILL_SLOT) {
+               Int first = vreg_state[k].spill_slot;
+               vreg_state[m].spill_slot = toShort(first);
+               for (j = 0; j < n_spill_slots_for(vreg_state[m].reg_class);
+                    j++) {
+                  if (ss_busy_until_before[first+j]
+                      < vreg_state[m].dead_before)
+                     ss_busy_until_before[first+j]
+                        = vreg_state[m].dead_before;
+               }
+            } else {
+               vassert(!rreg_state[w].eq_spill_slot);
+            }
+            n_ra_coalesced++;
+            goto post_insn;
+         }
+      }
+
+      /* ------ Pre-instruction actions for fixed rreg uses ------ */
+
+      /* Free up rregs which are entering a hard live range.  If one
+         holds a vreg, move the vreg to another rreg if possible,
+         else spill it. */
+      while (True) {
+         vassert(rreg_lrs_la_next >= 0);
+         vassert(rreg_lrs_la_next <= rreg_lrs_used);
+         if (rreg_lrs_la_next == rreg_lrs_used)
+            break;
+         if (ii < rreg_lrs_la[rreg_lrs_la_next].live_after)
+            break;
+         vassert(ii == rreg_lrs_la[rreg_lrs_la_next].live_after);
+         k = rreg_lrs_la_ix[rreg_lrs_la_next];
+         vassert(IS_VALID_RREGNO(k));
+         rreg_next_hlr[k] = hlr_chain[rreg_lrs_la_next];
+         if (rreg_state[k].disp == Bound) {
+            m = hregNumber(rreg_state[k].vreg);
+            vassert(IS_VALID_VREGNO(m));
+            vassert(vreg_state[m].dead_before > ii);
+            w = -1;
+            if (genMove)
+               w = find_free_rreg( rreg_state, n_rregs, rreg_next_hlr,
+                                   rreg_lrs_la, vreg_state[m].reg_class,
+                                   ii, vreg_state[m].dead_before );
+            if (w >= 0) {
+               EMIT_INSTR( (*genMove)( rreg_state[k].rreg,
+                                       rreg_state[w].rreg, mode64 ) );
+               n_ra_split_moves++;
+               rreg_state[w].disp          = Bound;
+               rreg_state[w].vreg          = rreg_state[k].vreg;
+               rreg_state[w].eq_spill_slot = rreg_state[k].eq_spill_slot;
+               vreg_state[m].rreg          = toShort(w);
+            } else {
+               if (!rreg_state[k].eq_spill_slot)
+                  EMIT_SPILL(rreg_state[k].rreg, m);
+               vreg_state[m].rreg = INVALID_RREG_NO;
+            }
+         }
+         rreg_state[k].disp = Unavail;
+         rreg_state[k].vreg = INVALID_HREG;
+         rreg_state[k].eq_spill_slot = False;
+         rreg_lrs_la_next++;
+      }
+
+      /* ------ Deal with the current instruction. ------ */
+
+      initHRegRemap(&remap);
+
+      /* If the instruction reads exactly one vreg, which is only in
+         its spill slot and dies here, try to have it read the slot
+         directly.  As for _v2. */
+      if (directReload && reg_usage.n_used <= 2) { 
+         HReg  cand     = INVALID_HREG;
+         Int   nreads   = 0;
+         Short spilloff = 0;
+
+         for (j = 0; j < reg_usage.n_used; j++) {
+            vreg = reg_usage.hreg[j];
+            if (!hregIsVirtual(vreg)) 
+               continue;
+            if (reg_usage.mode[j] == HRmRead) {
+               nreads++;
+               m = hregNumber(vreg);
+               if (vreg_state[m].rreg == INVALID_RREG_NO
+                   && vreg_state[m].dead_before == ii+1
+                   && hregIsInvalid(cand)) {
+                  spilloff = toShort(SPILL_OFFSET(m));
+                  cand = vreg;
+               }
+            }
+         }
+
+         if (nreads == 1 && ! hregIsInvalid(cand)) {
+            HInstr* reloaded;
+            if (reg_usage.n_used == 2)
+               vassert(! sameHReg(reg_usage.hreg[0], reg_usage.hreg[1]));
+            reloaded = directReload ( instrs_in->arr[ii], cand, spilloff );
+            if (reloaded) {
+               instrs_in->arr[ii] = reloaded;
+               (*getRegUsage)( &reg_usage, instrs_in->arr[ii], mode64 );
+            }
+         }
+      }
+
+      for (j = 0; j < reg_usage.n_used; j++) {
+
+         vreg = reg_usage.hreg[j];
+         if (!hregIsVirtual(vreg)) 
+            continue;
+
+         m = hregNumber(vreg);
+         vassert(IS_VALID_VREGNO(m));
+
+         /* Already in an rreg? */
+         k = vreg_state[m].rreg;
+         if (k != INVALID_RREG_NO) {
+            vassert(rreg_state[k].disp == Bound);
+            vassert(sameHReg(rreg_state[k].vreg, vreg));
+            addToHRegRemap(&remap, vreg, rreg_state[k].rreg);
+            if (reg_usage.mode[j] != HRmRead)
+               rreg_state[k].eq_spill_slot = False;
+            continue;
+         }
+
+         /* No.  Try for a free rreg. */
+         k = find_free_rreg( rreg_state, n_rregs, rreg_next_hlr,
+                             rreg_lrs_la, hregClass(vreg),
+                             ii, vreg_state[m].dead_before );
+
+         if (k < 0) {
+            /* None free.  Evict the vreg of this class, not mentioned
+               by this insn, whose next use is furthest away.  Among
+               equals, prefer one which needs no spill store. */
+            Int spillee  = -1;
+            Int furthest = -1;
+            for (k = 0; k < n_rregs; k++) {
+               Int next;
+               if (rreg_state[k].disp != Bound
+                   || hregClass(rreg_state[k].rreg) != hregClass(vreg))
+                  continue;
+               for (w = 0; w < reg_usage.n_used; w++)
+                  if (sameHReg(rreg_state[k].vreg, reg_usage.hreg[w]))
+                     break;
+               if (w < reg_usage.n_used)
+                  continue;
+               next = NEXT_USE(hregNumber(rreg_state[k].vreg));
+               if (next > furthest
+                   || (next == furthest
+                       && rreg_state[k].eq_spill_slot
+                       && !rreg_state[spillee].eq_spill_slot)) {
+                  furthest = next;
+                  spillee  = k;
+               }
+            }
+
+            if (spillee == -1) {
+               vex_printf("reg_alloc: can't find a register in class: ");
+               ppHRegClass(hregClass(vreg));
+               vex_printf("\n");
+               vpanic("reg_alloc: can't create a free register.");
+            }
+
+            k = spillee;
+            w = hregNumber(rreg_state[k].vreg);
+            vassert(IS_VALID_VREGNO(w));
+            vassert(vreg_state[w].dead_before > ii);
+            if (!rreg_state[k].eq_spill_slot)
+               EMIT_SPILL(rreg_state[k].rreg, w);
+            vreg_state[w].rreg = INVALID_RREG_NO;
+         }
+
+         rreg_state[k].disp = Bound;
+         rreg_state[k].vreg = vreg;
+         vreg_state[m].rreg = toShort(k);
+         addToHRegRemap(&remap, vreg, rreg_state[k].rreg);
+
+         /* Reload if the value is needed.  If it is merely read, the
+            rreg then agrees with the spill slot. */
+         if (reg_usage.mode[j] != HRmWrite) {
+            EMIT_RELOAD(rreg_state[k].rreg, m);
+            rreg_state[k].eq_spill_slot
+               = toBool(reg_usage.mode[j] == HRmRead);
+         } else {
+            rreg_state[k].eq_spill_slot = False;
+         }
+      }
+
+      /* NOTE, DESTRUCTIVELY MODIFIES instrs_in->arr[ii]. */
+      (*mapRegs)( &remap, instrs_in->arr[ii], mode64 );
+      EMIT_INSTR( instrs_in->arr[ii] );
+
+     post_insn:
+
+      /* ------ Free the rregs of vregs which just died. ------ */
+
+      for (j = 0; j < reg_usage.n_used; j++) {
+         vreg = reg_usage.hreg[j];
+         if (!hregIsVirtual(vreg))
+            continue;
+         m = hregNumber(vreg);
+         if (vreg_state[m].dead_before != ii + 1)
+            continue;
+         k = vreg_state[m].rreg;
+         if (k == INVALID_RREG_NO)
+            continue;
+         rreg_state[k].disp = Free;
+         rreg_state[k].vreg = INVALID_HREG;
+         rreg_state[k].eq_spill_slot = False;
+         vreg_state[m].rreg = INVALID_RREG_NO;
+      }
+
+      /* ------ Post-instruction actions for fixed rreg uses ------ */
+
+      while (True) {
+         vassert(rreg_lrs_db_next >= 0);
+         vassert(rreg_lrs_db_next <= rreg_lrs_used);
+         if (rreg_lrs_db_next == rreg_lrs_used)
+            break;
+         if (ii+1 < rreg_lrs_db[rreg_lrs_db_next].dead_before)
+            break;
+         vassert(ii+1 == rreg_lrs_db[rreg_lrs_db_next].dead_before);
+         for (k = 0; k < n_rregs; k++)
+            if (sameHReg(rreg_state[k].rreg,
+                         rreg_lrs_db[rreg_lrs_db_next].rreg))
+               break;
+         vassert(k < n_rregs);
+         vassert(rreg_state[k].disp == Unavail);
+         rreg_state[k].disp = Free;
+         rreg_state[k].vreg = INVALID_HREG;
+         rreg_state[k].eq_spill_slot = False;
+         rreg_lrs_db_next++;
+      }
+   }
+
+   /* Paranoia */
+   for (j = 0; j < n_rregs; j++) {
+      vassert(sameHReg(rreg_state[j].rreg, available_real_regs[j]));
+      vassert(rreg_state[j].disp != Bound);
+   }
+   vassert(rreg_lrs_la_next == rreg_lrs_used);
+   vassert(rreg_lrs_db_next == rreg_lrs_used);
+
+   return instrs_out;
+
+#  undef INVALID_INSTRNO
+#  undef EMIT_INSTR
+#  undef SPILL_OFFSET
+#  undef EMIT_SPILL
+#  undef EMIT_RELOAD
+#  undef NEXT_USE
+}
+
+
+void showRegAllocStats ( void )
+{
+   vex_printf("vex: regalloc: %u blocks, %u insns in, "
+              "%u spills, %u reloads, max %u spill slots\n",
+              n_ra_blocks, n_ra_insns_in,
+              n_ra_spills, n_ra_reloads, n_ra_max_slots);
+   vex_printf("vex: regalloc: %u moves coalesced, "
+              "%u moves splitting live ranges\n",
+              n_ra_coalesced, n_ra_split_moves);
+}
+
+UInt regAllocSpillsSoFar ( void )
+{
+   return n_ra_spills + n_ra_reloads;
+}
+
+
+
 /*---------------------------------------------------------------*/
 /*---                                       host_reg_alloc2.c ---*/
 /*---------------------------------------------------------------*/
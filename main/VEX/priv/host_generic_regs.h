@@ -91,6 +91,7 @@ typedef
                              so won't fit in a 64-bit slot)
       HRcVec64     64 bits
       HRcVec128    128 bits
+      HRcVec256    256 bits
 
    If you add another regclass, you must remember to update
    host_generic_reg_alloc2.c accordingly.
@@ -103,7 +104,8 @@ typedef
       HRcFlt32=5,     /* 32-bit float */
       HRcFlt64=6,     /* 64-bit float */
       HRcVec64=7,     /* 64-bit SIMD */
-      HRcVec128=8     /* 128-bit SIMD */
+      HRcVec128=8,    /* 128-bit SIMD */
+      HRcVec256=9     /* 256-bit SIMD */
    }
    HRegClass;
 
@@ -128,7 +130,7 @@ static inline HReg mkHReg ( UInt regno, HRegClass rc, Bool virtual ) {
 static inline HRegClass hregClass ( HReg r ) {
    UInt rc = r.reg;
    rc = (rc >> 28) & 0x0F;
-   vassert(rc >= HRcInt32 && rc <= HRcVec128);
+   vassert(rc >= HRcInt32 && rc <= HRcVec256);
    return (HRegClass)rc;
 }
 
@@ -313,8 +315,9 @@ static inline Bool is_RetLoc_INVALID ( RetLoc rl ) {
 /*--- Reg alloc: TODO: move somewhere else              ---*/
 /*---------------------------------------------------------*/
 
+/* The original allocator. */
 extern
-HInstrArray* doRegisterAllocation (
+HInstrArray* doRegisterAllocation_v2 (
 
    /* Incoming virtual-registerised code. */ 
    HInstrArray* instrs_in,
@@ -349,6 +352,36 @@ HInstrArray* doRegisterAllocation (
    Bool mode64
 );
 
+/* The linear-scan allocator.  Same arguments as _v2, plus an
+   optional function to generate a reg-reg move between two real
+   regs of the same class, which is used to move a vreg out of the
+   way of a hard live range rather than spilling it.  May be NULL. */
+extern
+HInstrArray* doRegisterAllocation_v3 (
+   HInstrArray* instrs_in,
+   HReg* available_real_regs,
+   Int   n_available_real_regs,
+   Bool (*isMove) (HInstr*, HReg*, HReg*),
+   void (*getRegUsage) (HRegUsage*, HInstr*, Bool),
+   void (*mapRegs) (HRegRemap*, HInstr*, Bool),
+   void    (*genSpill) (  HInstr**, HInstr**, HReg, Int, Bool ),
+   void    (*genReload) ( HInstr**, HInstr**, HReg, Int, Bool ),
+   HInstr* (*directReload) ( HInstr*, HReg, Short ),
+   HInstr* (*genMove) ( HReg, HReg, Bool ),
+   Int     guest_sizeB,
+   void (*ppInstr) ( HInstr*, Bool ),
+   void (*ppReg) ( HReg ),
+   Bool mode64
+);
+
+/* Show counts of the spills, reloads and moves the allocators have
+   generated so far. */
+extern void showRegAllocStats ( void );
+
+/* The total number of spill and reload instructions the allocators
+   have generated so far. */
+extern UInt regAllocSpillsSoFar ( void );
+
 
 #endif /* ndef __VEX_HOST_GENERIC_REGS_H */
 
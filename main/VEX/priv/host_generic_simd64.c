@@ -39,6 +39,7 @@
    from IR.  There are also helpers for 32-bit arithmetic in here. */
 
 #include "libvex_basictypes.h"
+#include "libvex_ir.h"
 #include "main_util.h"              // LIKELY, UNLIKELY
 #include "host_generic_simd64.h"
 
@@ -1580,6 +1581,43 @@ Int h_calc_sdiv32_w_arm_semantics ( Int x, Int y )
 }
 
 
+/* ------------------------------------------------------------------ */
+/* Helper-use accounting.  These are called at instruction selection */
+/* time, not from generated code.                                     */
+/* ------------------------------------------------------------------ */
+
+/* Number of times each IROp has been lowered to a helper call,
+   indexed by (op - Iop_INVALID). */
+static UInt n_helper_uses[Iop_LAST - Iop_INVALID];
+
+void h_generic_note_use ( IROp op )
+{
+   vassert(op > Iop_INVALID && op < Iop_LAST);
+   n_helper_uses[op - Iop_INVALID]++;
+}
+
+void h_generic_show_uses ( void )
+{
+   Int  i;
+   UInt n_ops = 0, n_sites = 0;
+   for (i = 0; i < Iop_LAST - Iop_INVALID; i++) {
+      if (n_helper_uses[i] == 0)
+         continue;
+      n_ops++;
+      n_sites += n_helper_uses[i];
+   }
+   vex_printf("vex: %u IROps lowered to generic helpers, at %u sites%s\n",
+              n_ops, n_sites, n_ops > 0 ? ":" : "");
+   for (i = 0; i < Iop_LAST - Iop_INVALID; i++) {
+      if (n_helper_uses[i] == 0)
+         continue;
+      vex_printf("vex:   %8u  ", n_helper_uses[i]);
+      ppIROp((IROp)(Iop_INVALID + i));
+      vex_printf("\n");
+   }
+}
+
+
 /*---------------------------------------------------------------*/
 /*--- end                               host_generic_simd64.c ---*/
 /*---------------------------------------------------------------*/
@@ -49,6 +49,7 @@
 #define __VEX_HOST_GENERIC_SIMD64_H
 
 #include "libvex_basictypes.h"
+#include "libvex_ir.h"              // IROp
 
 /* DO NOT MAKE THESE INTO REGPARM FNS!  THIS WILL BREAK CALLING
    SEQUENCES GENERATED BY host-x86/isel.c. */
@@ -169,6 +170,15 @@ extern ULong h_calc_BCDtoDPB ( ULong bcd );
 extern UInt  h_calc_udiv32_w_arm_semantics ( UInt, UInt );
 extern  Int  h_calc_sdiv32_w_arm_semantics (  Int,  Int );
 
+/* Coverage accounting.  Instruction selectors call
+   h_generic_note_use each time they lower an IROp to a call to one
+   of the h_generic_calc_* helpers (64, 128 or 256 bit), and
+   h_generic_show_uses prints the ops which needed them, and how
+   often, so that the remaining gaps in native SIMD coverage on the
+   host can be seen.  It is called by LibVEX_ShowStats. */
+extern void h_generic_note_use  ( IROp op );
+extern void h_generic_show_uses ( void );
+
 #endif /* ndef __VEX_HOST_GENERIC_SIMD64_H */
 
 /*---------------------------------------------------------------*/
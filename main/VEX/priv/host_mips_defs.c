@@ -2835,7 +2835,9 @@ Int emit_MIPSInstr ( /*MB_MOD*/Bool* is_profInc,
                      void* disp_cp_chain_me_to_slowEP,
                      void* disp_cp_chain_me_to_fastEP,
                      void* disp_cp_xindir,
-                     void* disp_cp_xassisted )
+                     void* disp_cp_xassisted,
+                     void* disp_cp_prime_ic,
+                     void* disp_cp_xindir_ret )
 {
    UChar *p = &buf[0];
    UChar *ptmp = p;
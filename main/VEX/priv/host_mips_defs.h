@@ -705,7 +705,9 @@ extern Int        emit_MIPSInstr        (/*MB_MOD*/Bool* is_profInc,
                                          void* disp_cp_chain_me_to_slowEP,
                                          void* disp_cp_chain_me_to_fastEP,
                                          void* disp_cp_xindir,
-                                         void* disp_cp_xassisted );
+                                         void* disp_cp_xassisted,
+                                         void* disp_cp_prime_ic,
+                                         void* disp_cp_xindir_ret );
 
 extern void genSpill_MIPS ( /*OUT*/ HInstr ** i1, /*OUT*/ HInstr ** i2,
                             HReg rreg, Int offset, Bool);
@@ -5708,10 +5708,12 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
       PPCAMode*   amCIA = PPCAMode_IR(stmt->Ist.Exit.offsIP,
                                       hregPPC_GPR31(mode64));
 
-      /* Case: boring transfer to known address */
+      /* Case: boring transfer to known address.  Call and Ret are
+         only hints; the destination is a constant, so they can be
+         chained just the same. */
       if (stmt->Ist.Exit.jk == Ijk_Boring
           || stmt->Ist.Exit.jk == Ijk_Call
-          /* || stmt->Ist.Exit.jk == Ijk_Ret */) {
+          || stmt->Ist.Exit.jk == Ijk_Ret) {
          if (env->chainingAllowed) {
             /* .. almost always true .. */
             /* Skip the event check at the dst if this is a forwards
@@ -5790,8 +5792,10 @@ static void iselNext ( ISelEnv* env,
    if (next->tag == Iex_Const) {
       IRConst* cdst = next->Iex.Const.con;
       vassert(cdst->tag == (env->mode64 ? Ico_U64 :Ico_U32));
-      if (jk == Ijk_Boring || jk == Ijk_Call) {
-         /* Boring transfer to known address */
+      if (jk == Ijk_Boring || jk == Ijk_Call || jk == Ijk_Ret) {
+         /* Boring transfer to known address.  A return to a
+            constant address (eg, after push $imm; ret) is no
+            different. */
          PPCAMode* amCIA = PPCAMode_IR(offsIP, hregPPC_GPR31(env->mode64));
          if (env->chainingAllowed) {
             /* .. almost always true .. */
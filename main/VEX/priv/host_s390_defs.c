@@ -9895,7 +9895,8 @@ Int
 emit_S390Instr(Bool *is_profinc, UChar *buf, Int nbuf, s390_insn *insn,
                Bool mode64, void *disp_cp_chain_me_to_slowEP,
                void *disp_cp_chain_me_to_fastEP, void *disp_cp_xindir,
-               void *disp_cp_xassisted)
+               void *disp_cp_xassisted, void *disp_cp_prime_ic,
+               void *disp_cp_xindir_ret)
 {
    UChar *end;
 
@@ -3894,8 +3894,12 @@ no_memcpy_put:
       s390_amode *guest_IA = s390_amode_for_guest_state(stmt->Ist.Exit.offsIP);
       cond = s390_isel_cc(env, stmt->Ist.Exit.guard);
 
-      /* Case: boring transfer to known address */
-      if (stmt->Ist.Exit.jk == Ijk_Boring) {
+      /* Case: boring transfer to known address.  Call and Ret are
+         only hints; the destination is a constant, so they can be
+         chained just the same. */
+      if (stmt->Ist.Exit.jk == Ijk_Boring
+          || stmt->Ist.Exit.jk == Ijk_Call
+          || stmt->Ist.Exit.jk == Ijk_Ret) {
          if (env->chaining_allowed) {
             /* .. almost always true .. */
             /* Skip the event check at the dst if this is a forwards
@@ -3990,8 +3994,10 @@ iselNext(ISelEnv *env, IRExpr *next, IRJumpKind jk, Int offsIP)
    if (next->tag == Iex_Const) {
       IRConst *cdst = next->Iex.Const.con;
       vassert(cdst->tag == Ico_U64);
-      if (jk == Ijk_Boring || jk == Ijk_Call) {
-         /* Boring transfer to known address */
+      if (jk == Ijk_Boring || jk == Ijk_Call || jk == Ijk_Ret) {
+         /* Boring transfer to known address.  A return to a
+            constant address (eg, after push $imm; ret) is no
+            different. */
          if (env->chaining_allowed) {
             /* .. almost always true .. */
             /* Skip the event check at the dst if this is a forwards
@@ -1753,6 +1753,26 @@ void genReload_X86 ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
    }
 }
 
+/* Generate a reg-reg move between two real regs of the same class,
+   for the register allocator's use when splitting a live range. */
+
+X86Instr* genMove_X86 ( HReg from, HReg to, Bool mode64 )
+{
+   vassert(mode64 == False);
+   vassert(hregClass(from) == hregClass(to));
+   switch (hregClass(from)) {
+      case HRcInt32:
+         return X86Instr_Alu32R ( Xalu_MOV, X86RMI_Reg(from), to );
+      case HRcFlt64:
+         return X86Instr_FpUnary ( Xfp_MOV, from, to );
+      case HRcVec128:
+         return X86Instr_SseReRg ( Xsse_MOV, from, to );
+      default: 
+         ppHRegClass(hregClass(from));
+         vpanic("genMove_X86: unimplemented regclass");
+   }
+}
+
 /* The given instruction reads the specified vreg exactly once, and
    that vreg is currently located at the given spill offset.  If
    possible, return a variant of the instruction to one which instead
@@ -2092,7 +2112,9 @@ Int emit_X86Instr ( /*MB_MOD*/Bool* is_profInc,
                     void* disp_cp_chain_me_to_slowEP,
                     void* disp_cp_chain_me_to_fastEP,
                     void* disp_cp_xindir,
-                    void* disp_cp_xassisted )
+                    void* disp_cp_xassisted,
+                    void* disp_cp_prime_ic,
+                    void* disp_cp_xindir_ret )
 {
    UInt irno, opc, opc_rr, subopc_imm, opc_imma, opc_cl, opc_imm, subopc;
 
@@ -2383,16 +2405,27 @@ Int emit_X86Instr ( /*MB_MOD*/Bool* is_profInc,
             goto bad;
       }
 
-   case Xin_Call:
+   case Xin_Call: {
+      Bool diamond = False;
       if (i->Xin.Call.cond != Xcc_ALWAYS
           && i->Xin.Call.rloc.pri != RLPri_None) {
          /* The call might not happen (it isn't unconditional) and it
-            returns a result.  In this case we will need to generate a
+            returns a result.  In this case we need to generate a
             control flow diamond to put 0x555..555 in the return
-            register(s) in the case where the call doesn't happen.  If
-            this ever becomes necessary, maybe copy code from the ARM
-            equivalent.  Until that day, just give up. */
-         goto bad;
+            register in the case where the call doesn't happen, as
+            the ARM equivalent does:
+
+               j{!cond} else
+               movl $target, %tmp ; call *%tmp
+               jmp after
+             else:
+               movl $0x55555555, %eax
+             after:
+
+            Only 32-bit integer results are handled. */
+         if (i->Xin.Call.rloc.pri != RLPri_Int)
+            goto bad;
+         diamond = True;
       }
       /* See detailed comment for Xin_Call in getRegUsage_X86Instr above
          for explanation of this. */
@@ -2404,10 +2437,12 @@ Int emit_X86Instr ( /*MB_MOD*/Bool* is_profInc,
          default: vpanic(" emit_X86Instr:call:regparms");
       }
       /* jump over the following two insns if the condition does not
-         hold */
+         hold, plus the 2-byte jump over the 'else' arm if there is
+         one */
       if (i->Xin.Call.cond != Xcc_ALWAYS) {
          *p++ = toUChar(0x70 + (0xF & (i->Xin.Call.cond ^ 1)));
-         *p++ = 0x07; /* 7 bytes in the next two insns */
+         *p++ = toUChar(diamond ? 0x09 : 0x07);
+         /* 7 bytes in the next two insns */
       }
       /* movl $target, %tmp */
       *p++ = toUChar(0xB8 + irno);
@@ -2415,7 +2450,17 @@ Int emit_X86Instr ( /*MB_MOD*/Bool* is_profInc,
       /* call *%tmp */
       *p++ = 0xFF;
       *p++ = toUChar(0xD0 + irno);
+      if (diamond) {
+         /* 2 bytes: jmp after */
+         *p++ = 0xEB;
+         *p++ = 0x05;
+         /* else: 5 bytes: movl $0x55555555, %eax */
+         *p++ = 0xB8;
+         p = emit32(p, 0x55555555);
+         /* after: */
+      }
       goto done;
+   }
 
    case Xin_XDirect: {
       /* NB: what goes on here has to be very closely coordinated with the
@@ -720,12 +720,15 @@ extern Int          emit_X86Instr        ( /*MB_MOD*/Bool* is_profInc,
                                            void* disp_cp_chain_me_to_slowEP,
                                            void* disp_cp_chain_me_to_fastEP,
                                            void* disp_cp_xindir,
-                                           void* disp_cp_xassisted );
+                                           void* disp_cp_xassisted,
+                                           void* disp_cp_prime_ic,
+                                           void* disp_cp_xindir_ret );
 
 extern void genSpill_X86  ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                             HReg rreg, Int offset, Bool );
 extern void genReload_X86 ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                             HReg rreg, Int offset, Bool );
+extern X86Instr* genMove_X86 ( HReg from, HReg to, Bool );
 
 extern X86Instr*    directReload_X86     ( X86Instr* i, 
                                            HReg vreg, Short spill_off );
@@ -4210,8 +4210,12 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
       X86AMode*   amEIP = X86AMode_IR(stmt->Ist.Exit.offsIP,
                                       hregX86_EBP());
 
-      /* Case: boring transfer to known address */
-      if (stmt->Ist.Exit.jk == Ijk_Boring) {
+      /* Case: boring transfer to known address.  Call and Ret are
+         only hints; the destination is a constant, so they can be
+         chained just the same. */
+      if (stmt->Ist.Exit.jk == Ijk_Boring
+          || stmt->Ist.Exit.jk == Ijk_Call
+          || stmt->Ist.Exit.jk == Ijk_Ret) {
          if (env->chainingAllowed) {
             /* .. almost always true .. */
             /* Skip the event check at the dst if this is a forwards
@@ -4287,8 +4291,10 @@ static void iselNext ( ISelEnv* env,
    if (next->tag == Iex_Const) {
       IRConst* cdst = next->Iex.Const.con;
       vassert(cdst->tag == Ico_U32);
-      if (jk == Ijk_Boring || jk == Ijk_Call) {
-         /* Boring transfer to known address */
+      if (jk == Ijk_Boring || jk == Ijk_Call || jk == Ijk_Ret) {
+         /* Boring transfer to known address.  A return to a
+            constant address (eg, after push $imm; ret) is no
+            different. */
          X86AMode* amEIP = X86AMode_IR(offsIP, hregX86_EBP());
          if (env->chainingAllowed) {
             /* .. almost always true .. */
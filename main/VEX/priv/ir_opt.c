@@ -6011,6 +6011,155 @@ IRSB* do_iropt_BB(
 }
 
 
+/*---------------------------------------------------------------*/
+/*--- Post-instrumentation shadow-state optimisation          ---*/
+/*---------------------------------------------------------------*/
+
+/* Tool instrumentation (eg Memcheck's) roughly triples the size of a
+   block, and much of what it adds is redundant: the same shadow
+   value computed at several places, shadow GETs of values that were
+   PUT a few statements earlier, and shadow PUTs overwritten before
+   anything could read them.  The cleanup pass run after
+   instrumentation is only cprop plus dead code removal, so none of
+   that goes away.  do_shadow_opt_BB has another go, for tools that
+   ask for it.
+
+   Shadow state is everything at offsets >= guest_sizeB.  Unlike the
+   guest state proper, nothing inspects it mid-block: signal delivery
+   and error reporting look only at the guest registers, and dirty
+   helpers can only see what they declare in their fxState.  Hence a
+   shadow PUT is dead if, scanning forwards, another PUT to the same
+   slice is reached before any GET of it, any side exit, or any dirty
+   call that accesses the guest state.  Memory accesses don't matter,
+   except when the user asked for all registers to be precise at
+   memory exceptions. */
+
+static UInt n_so_blocks    = 0;
+static UInt n_so_stmts_in  = 0;
+static UInt n_so_stmts_out = 0;
+static UInt n_so_dead_puts = 0;
+
+static UInt count_live_stmts ( IRSB* bb )
+{
+   Int  i;
+   UInt n = 0;
+   for (i = 0; i < bb->stmts_used; i++)
+      if (bb->stmts[i]->tag != Ist_NoOp)
+         n++;
+   return n;
+}
+
+static void dead_shadow_put_removal_BB ( IRSB* bb, Int guest_sizeB )
+{
+   Int      i, j;
+   UInt     key;
+   IRStmt*  st;
+   IRExpr*  e;
+   IRDirty* d;
+   Bool     memRW;
+   HashHW*  env = newHHW();
+
+   for (i = bb->stmts_used-1; i >= 0; i--) {
+      st    = bb->stmts[i];
+      memRW = False;
+
+      switch (st->tag) {
+         case Ist_Put:
+            if (st->Ist.Put.offset < guest_sizeB)
+               break;
+            key = mk_key_GetPut( st->Ist.Put.offset,
+                                 typeOfIRExpr(bb->tyenv,st->Ist.Put.data) );
+            if (lookupHHW(env, NULL, (HWord)key)) {
+               if (DEBUG_IROPT) {
+                  vex_printf("dsPUT: "); ppIRStmt(st);
+                  vex_printf("\n");
+               }
+               bb->stmts[i] = IRStmt_NoOp();
+               n_so_dead_puts++;
+            } else {
+               addToHHW(env, (HWord)key, 0);
+            }
+            break;
+         case Ist_WrTmp:
+            e = st->Ist.WrTmp.data;
+            if (e->tag == Iex_Get)
+               key = mk_key_GetPut( e->Iex.Get.offset, e->Iex.Get.ty );
+            else if (e->tag == Iex_GetI)
+               key = mk_key_GetIPutI( e->Iex.GetI.descr );
+            else {
+               memRW = toBool(e->tag == Iex_Load);
+               break;
+            }
+            invalidateOverlaps(env, (key >> 16) & 0xFFFF, key & 0xFFFF);
+            break;
+         case Ist_Exit:
+            /* The next block reads the shadow state. */
+            for (j = 0; j < env->used; j++)
+               env->inuse[j] = False;
+            break;
+         case Ist_Dirty:
+            d = st->Ist.Dirty.details;
+            if (d->nFxState > 0) {
+               for (j = 0; j < env->used; j++)
+                  env->inuse[j] = False;
+            }
+            memRW = toBool(d->mFx != Ifx_None);
+            break;
+         case Ist_Store: case Ist_StoreG: case Ist_LoadG:
+         case Ist_CAS: case Ist_LLSC:
+            memRW = True;
+            break;
+         case Ist_NoOp: case Ist_IMark: case Ist_AbiHint:
+         case Ist_MBE: case Ist_PutI:
+            break;
+         default:
+            vex_printf("\n"); ppIRStmt(st); vex_printf("\n");
+            vpanic("dead_shadow_put_removal_BB");
+      }
+
+      if (memRW
+          && vex_control.iropt_register_updates >= VexRegUpdAllregsAtMemAccess) {
+         for (j = 0; j < env->used; j++)
+            env->inuse[j] = False;
+      }
+   }
+}
+
+/* Run after instrumentation, for tools which ask for it.  Forwards
+   PUTs to later GETs of the same state, does CSE over the pure
+   expressions in the whole superblock (side exits don't end the
+   scope of an available expression, so a shadow value computed
+   before an exit is reused after it rather than recomputed), and
+   removes dead shadow PUTs.  The final dead code pass then gets rid
+   of the temps computing the values those PUTs stored, and of the
+   ones the CSE made redundant. */
+
+IRSB* do_shadow_opt_BB ( IRSB* bb, Int guest_sizeB )
+{
+   n_so_blocks++;
+   n_so_stmts_in += count_live_stmts(bb);
+
+   redundant_get_removal_BB( bb );
+   if (do_cse_BB( bb ))
+      bb = cprop_BB( bb );
+   if (vex_control.iropt_register_updates < VexRegUpdAllregsAtEachInsn)
+      dead_shadow_put_removal_BB( bb, guest_sizeB );
+   do_deadcode_BB( bb );
+
+   n_so_stmts_out += count_live_stmts(bb);
+   return bb;
+}
+
+void showShadowOptStats ( void )
+{
+   if (n_so_blocks == 0)
+      return;
+   vex_printf("vex: shadow opt: %u blocks, %u stmts in, %u stmts out, "
+              "%u dead shadow PUTs\n",
+              n_so_blocks, n_so_stmts_in, n_so_stmts_out, n_so_dead_puts);
+}
+
+
 /*---------------------------------------------------------------*/
 /*--- end                                            ir_opt.c ---*/
 /*---------------------------------------------------------------*/
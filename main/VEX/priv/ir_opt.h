@@ -59,6 +59,16 @@ IRSB* cprop_BB ( IRSB* );
 extern
 void do_deadcode_BB ( IRSB* bb );
 
+/* Post-instrumentation optimisation of shadow state computations.
+   State at offsets >= guest_sizeB is taken to be shadow state.
+   Returns a new BB. */
+extern
+IRSB* do_shadow_opt_BB ( IRSB* bb, Int guest_sizeB );
+
+/* Print statistics for do_shadow_opt_BB. */
+extern
+void showShadowOptStats ( void );
+
 /* The tree-builder.  Make (approximately) maximal safe trees.  bb is
    destructively modified.  Returns (unrelatedly, but useful later on)
    the guest address of the highest addressed byte from any insn in
@@ -64,6 +64,7 @@
 #include "guest_s390_defs.h"
 #include "guest_mips_defs.h"
 
+#include "host_generic_simd64.h"
 #include "host_generic_simd128.h"
 
 
@@ -96,6 +97,9 @@ void LibVEX_default_VexControl ( /*OUT*/ VexControl* vcon )
    vcon->guest_max_insns            = 60;
    vcon->guest_chase_thresh         = 10;
    vcon->guest_chase_cond           = False;
+   vcon->guest_chase_calls          = True;
+   vcon->regalloc_version           = 2;
+   vcon->guest_cc_profile           = False;
 }
 
 
@@ -137,6 +141,11 @@ void LibVEX_Init (
    vassert(vcon->guest_chase_thresh < vcon->guest_max_insns);
    vassert(vcon->guest_chase_cond == True 
            || vcon->guest_chase_cond == False);
+   vassert(vcon->guest_chase_calls == True
+           || vcon->guest_chase_calls == False);
+   vassert(vcon->regalloc_version == 2 || vcon->regalloc_version == 3);
+   vassert(vcon->guest_cc_profile == True
+           || vcon->guest_cc_profile == False);
 
    /* Check that Vex has been built with sizes of basic types as
       stated in priv/libvex_basictypes.h.  Failure of any of these is
@@ -215,13 +224,15 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    void         (*genSpill)     ( HInstr**, HInstr**, HReg, Int, Bool );
    void         (*genReload)    ( HInstr**, HInstr**, HReg, Int, Bool );
    HInstr*      (*directReload) ( HInstr*, HReg, Short );
+   HInstr*      (*genMove)      ( HReg, HReg, Bool );
    void         (*ppInstr)      ( HInstr*, Bool );
    void         (*ppReg)        ( HReg );
    HInstrArray* (*iselSB)       ( IRSB*, VexArch, VexArchInfo*, VexAbiInfo*,
                                   Int, Int, Bool, Bool, Addr64 );
    Int          (*emit)         ( /*MB_MOD*/Bool*,
                                   UChar*, Int, HInstr*, Bool,
-                                  void*, void*, void*, void* );
+                                  void*, void*, void*, void*, void*,
+                                  void* );
    IRExpr*      (*specHelper)   ( const HChar*, IRExpr**, IRStmt**, Int );
    Bool         (*preciseMemExnsFn) ( Int, Int );
 
@@ -250,6 +261,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    genSpill               = NULL;
    genReload              = NULL;
    directReload           = NULL;
+   genMove                = NULL;
    ppInstr                = NULL;
    ppReg                  = NULL;
    iselSB                 = NULL;
@@ -281,6 +293,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    } else {
       vassert(vta->disp_cp_chain_me_to_fastEP == NULL);
       vassert(vta->disp_cp_xindir             == NULL);
+      vassert(vta->disp_cp_xindir_ret         == NULL);
    }
 
    vexSetAllocModeTEMP_and_clear();
@@ -304,11 +317,12 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          genReload    = (void(*)(HInstr**,HInstr**,HReg,Int,Bool))
                         genReload_X86;
          directReload = (HInstr*(*)(HInstr*,HReg,Short)) directReload_X86;
+         genMove      = (HInstr*(*)(HReg,HReg,Bool)) genMove_X86;
          ppInstr      = (void(*)(HInstr*, Bool)) ppX86Instr;
          ppReg        = (void(*)(HReg)) ppHRegX86;
          iselSB       = iselSB_X86;
          emit         = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                         emit_X86Instr;
          host_is_bigendian = False;
          host_word_type    = Ity_I32;
@@ -327,11 +341,12 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
                        genSpill_AMD64;
          genReload   = (void(*)(HInstr**,HInstr**,HReg,Int,Bool))
                        genReload_AMD64;
+         genMove     = (HInstr*(*)(HReg,HReg,Bool)) genMove_AMD64;
          ppInstr     = (void(*)(HInstr*, Bool)) ppAMD64Instr;
          ppReg       = (void(*)(HReg)) ppHRegAMD64;
          iselSB      = iselSB_AMD64;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                        emit_AMD64Instr;
          host_is_bigendian = False;
          host_word_type    = Ity_I64;
@@ -351,7 +366,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppReg       = (void(*)(HReg)) ppHRegPPC;
          iselSB      = iselSB_PPC;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                        emit_PPCInstr;
          host_is_bigendian = True;
          host_word_type    = Ity_I32;
@@ -371,7 +386,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppReg       = (void(*)(HReg)) ppHRegPPC;
          iselSB      = iselSB_PPC;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                        emit_PPCInstr;
          host_is_bigendian = True;
          host_word_type    = Ity_I64;
@@ -391,7 +406,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppReg       = (void(*)(HReg)) ppHRegS390;
          iselSB      = iselSB_S390;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*)) emit_S390Instr;
+                               void*,void*,void*,void*,void*,void*)) emit_S390Instr;
          host_is_bigendian = True;
          host_word_type    = Ity_I64;
          vassert(are_valid_hwcaps(VexArchS390X, vta->archinfo_host.hwcaps));
@@ -406,11 +421,12 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          mapRegs     = (void(*)(HRegRemap*,HInstr*, Bool)) mapRegs_ARMInstr;
          genSpill    = (void(*)(HInstr**,HInstr**,HReg,Int,Bool)) genSpill_ARM;
          genReload   = (void(*)(HInstr**,HInstr**,HReg,Int,Bool)) genReload_ARM;
+         genMove     = (HInstr*(*)(HReg,HReg,Bool)) genMove_ARM;
          ppInstr     = (void(*)(HInstr*, Bool)) ppARMInstr;
          ppReg       = (void(*)(HReg)) ppHRegARM;
          iselSB      = iselSB_ARM;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                        emit_ARMInstr;
          host_is_bigendian = False;
          host_word_type    = Ity_I32;
@@ -430,7 +446,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppReg       = (void(*)(HReg)) ppHRegMIPS;
          iselSB      = iselSB_MIPS;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                        emit_MIPSInstr;
 #        if defined(VKI_LITTLE_ENDIAN)
          host_is_bigendian = False;
@@ -454,7 +470,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppReg       = (void(*)(HReg)) ppHRegMIPS;
          iselSB      = iselSB_MIPS;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                        emit_MIPSInstr;
 #        if defined(VKI_LITTLE_ENDIAN)
          host_is_bigendian = False;
@@ -643,6 +659,23 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    res.n_sc_extents   = 0;
    res.offs_profInc   = -1;
    res.n_guest_instrs = 0;
+   res.n_ir_stmts     = 0;
+   res.n_vregs        = 0;
+   res.n_spills       = 0;
+   for (i = 0; i < VexPhase_N; i++)
+      res.phase_cost[i] = 0;
+
+   /* Phase timing, if asked for.  PHASE_DONE charges the time since
+      the previous phase ended to the given phase. */
+   ULong phase_t0 = vta->phase_clock ? vta->phase_clock() : 0;
+#  define PHASE_DONE(_ph)                                      \
+      do {                                                     \
+         if (UNLIKELY(vta->phase_clock != NULL)) {             \
+            ULong _t = vta->phase_clock();                     \
+            res.phase_cost[_ph] += _t - phase_t0;              \
+            phase_t0 = _t;                                     \
+         }                                                     \
+      } while (0)
 
    /* yet more sanity checks ... */
    if (vta->arch_guest == vta->arch_host) {
@@ -652,6 +685,35 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
       vassert(vta->archinfo_guest.hwcaps == vta->archinfo_host.hwcaps);
    }
 
+   /* Guest registers kept in host registers.  The host registers
+      concerned are then not available for allocation. */
+   if (vta->abiinfo_both.host_amd64_guest_reg_cache[0] >= 0) {
+      vassert(vta->arch_guest == VexArchAMD64);
+      vassert(vta->arch_host == VexArchAMD64);
+      vassert(vex_control.iropt_register_updates
+              < VexRegUpdAllregsAtMemAccess);
+      for (i = 0; i < 2; i++) {
+         Int off = vta->abiinfo_both.host_amd64_guest_reg_cache[i];
+         if (off < 0)
+            continue;
+         vassert(off >= offsetof(VexGuestAMD64State,guest_RAX));
+         vassert(off <= offsetof(VexGuestAMD64State,guest_R15));
+         vassert(off % 8 == 0);
+         vassert(off != offsetof(VexGuestAMD64State,guest_RSP));
+         vassert(off != offsetof(VexGuestAMD64State,guest_RBP));
+         for (j = k = 0; j < n_available_real_regs; j++) {
+            if (!sameHReg(available_real_regs[j], hregAMD64_GuestRegCache(i)))
+               available_real_regs[k++] = available_real_regs[j];
+         }
+         vassert(k == n_available_real_regs - 1);
+         n_available_real_regs = k;
+      }
+      vassert(vta->abiinfo_both.host_amd64_guest_reg_cache[0]
+              != vta->abiinfo_both.host_amd64_guest_reg_cache[1]);
+   } else {
+      vassert(vta->abiinfo_both.host_amd64_guest_reg_cache[1] < 0);
+   }
+
    vexAllocSanityCheck();
 
    if (vex_traceflags & VEX_TRACE_FE)
@@ -680,6 +742,8 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
                      offB_GUEST_IP,
                      szB_GUEST_IP );
 
+   PHASE_DONE(VexPhaseFrontEnd);
+
    vexAllocSanityCheck();
 
    if (irsb == NULL) {
@@ -728,6 +792,8 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    sanityCheckIRSB( irsb, "after initial iropt", 
                     True/*must be flat*/, guest_word_type );
 
+   PHASE_DONE(VexPhaseOpt1);
+
    if (vex_traceflags & VEX_TRACE_OPT1) {
       vex_printf("\n------------------------" 
                    " After pre-instr IR optimisation "
@@ -745,6 +811,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
                               vta->guest_extents,
                               &vta->archinfo_host,
                               guest_word_type, host_word_type);
+   PHASE_DONE(VexPhaseInstrument1);
    vexAllocSanityCheck();
 
    if (vta->instrument2)
@@ -753,6 +820,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
                               vta->guest_extents,
                               &vta->archinfo_host,
                               guest_word_type, host_word_type);
+   PHASE_DONE(VexPhaseInstrument2);
       
    if (vex_traceflags & VEX_TRACE_INST) {
       vex_printf("\n------------------------" 
@@ -770,6 +838,8 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    if (vta->instrument1 || vta->instrument2) {
       do_deadcode_BB( irsb );
       irsb = cprop_BB( irsb );
+      if (vta->shadow_opt)
+         irsb = do_shadow_opt_BB( irsb, guest_sizeB );
       do_deadcode_BB( irsb );
       sanityCheckIRSB( irsb, "after post-instrumentation cleanup",
                        True/*must be flat*/, guest_word_type );
@@ -793,6 +863,9 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
       irsb = vta->finaltidy(irsb);
    }
 
+   res.n_ir_stmts = irsb->stmts_used;
+   PHASE_DONE(VexPhaseOpt2);
+
    vexAllocSanityCheck();
 
    if (vex_traceflags & VEX_TRACE_TREES) {
@@ -829,6 +902,9 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
                     vta->addProfInc,
                     max_ga );
 
+   res.n_vregs = vcode->n_vregs;
+   PHASE_DONE(VexPhaseISel);
+
    vexAllocSanityCheck();
 
    if (vex_traceflags & VEX_TRACE_VCODE)
@@ -844,12 +920,24 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    }
 
    /* Register allocate. */
-   rcode = doRegisterAllocation ( vcode, available_real_regs,
-                                  n_available_real_regs,
-                                  isMove, getRegUsage, mapRegs, 
-                                  genSpill, genReload, directReload, 
-                                  guest_sizeB,
-                                  ppInstr, ppReg, mode64 );
+   res.n_spills = regAllocSpillsSoFar();
+   if (vex_control.regalloc_version == 3)
+      rcode = doRegisterAllocation_v3 ( vcode, available_real_regs,
+                                        n_available_real_regs,
+                                        isMove, getRegUsage, mapRegs, 
+                                        genSpill, genReload, directReload, 
+                                        genMove, guest_sizeB,
+                                        ppInstr, ppReg, mode64 );
+   else
+      rcode = doRegisterAllocation_v2 ( vcode, available_real_regs,
+                                        n_available_real_regs,
+                                        isMove, getRegUsage, mapRegs, 
+                                        genSpill, genReload, directReload, 
+                                        guest_sizeB,
+                                        ppInstr, ppReg, mode64 );
+
+   res.n_spills = regAllocSpillsSoFar() - res.n_spills;
+   PHASE_DONE(VexPhaseRegAlloc);
 
    vexAllocSanityCheck();
 
@@ -892,7 +980,9 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
                 vta->disp_cp_chain_me_to_slowEP,
                 vta->disp_cp_chain_me_to_fastEP,
                 vta->disp_cp_xindir,
-                vta->disp_cp_xassisted );
+                vta->disp_cp_xassisted,
+                vta->disp_cp_prime_ic,
+                vta->disp_cp_xindir_ret );
       if (UNLIKELY(vex_traceflags & VEX_TRACE_ASM)) {
          for (k = 0; k < j; k++)
             if (insn_bytes[k] < 16)
@@ -923,6 +1013,9 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    }
    *(vta->host_bytes_used) = out_used;
 
+   PHASE_DONE(VexPhaseAssemble);
+#  undef PHASE_DONE
+
    vexAllocSanityCheck();
 
    vexSetAllocModeTEMP_and_clear();
@@ -1027,6 +1120,28 @@ VexInvalRange LibVEX_UnChain ( VexArch arch_host,
    return vir;
 }
 
+VexInvalRange LibVEX_PrimeIC ( VexArch arch_host,
+                               void*   place_to_prime,
+                               Addr64  guest_addr,
+                               void*   disp_cp_prime_ic_EXPECTED,
+                               void*   disp_cp_xindir )
+{
+   switch (arch_host) {
+      case VexArchAMD64:
+         return primeXIndirIC_AMD64(place_to_prime, guest_addr,
+                                    disp_cp_prime_ic_EXPECTED,
+                                    disp_cp_xindir);
+      case VexArchARM:
+         return primeXIndirIC_ARM(place_to_prime, guest_addr,
+                                  disp_cp_prime_ic_EXPECTED,
+                                  disp_cp_xindir);
+      default:
+         /* No other host generates inline caches, so we should
+            never get asked to prime one. */
+         vassert(0);
+   }
+}
+
 Int LibVEX_evCheckSzB ( VexArch arch_host )
 {
    static Int cached = 0; /* DO NOT MAKE NON-STATIC */
@@ -1143,6 +1258,17 @@ const HChar* LibVEX_EmNote_string ( VexEmNote ew )
    }
 }
 
+/* ------------------ Statistics. ------------------ */
+
+void LibVEX_ShowStats ( void )
+{
+   h_generic_show_uses();
+   showRegAllocStats();
+   showShadowOptStats();
+   guest_x86_show_cc_profile();
+   guest_amd64_show_cc_profile();
+}
+
 /* ------------------ Arch/HwCaps stuff. ------------------ */
 
 const HChar* LibVEX_ppVexArch ( VexArch arch )
@@ -1193,6 +1319,8 @@ void LibVEX_default_VexAbiInfo ( /*OUT*/VexAbiInfo* vbi )
    vbi->guest_ppc_sc_continues_at_LR   = False;
    vbi->host_ppc_calls_use_fndescrs    = False;
    vbi->host_ppc32_regalign_int64_args = False;
+   vbi->host_amd64_guest_reg_cache[0]  = -1;
+   vbi->host_amd64_guest_reg_cache[1]  = -1;
 }
 
 
@@ -331,6 +331,11 @@ void LibVEX_default_VexArchInfo ( /*OUT*/VexArchInfo* vai );
       host is ppc32-linux                 ==> True
       host is ppc32-aix5                  ==> False
       host is other                       ==> inapplicable
+
+   host_amd64_guest_reg_cache:
+      guest and host are amd64            ==> any, subject to the
+                                              dispatcher's agreement
+      other                               ==> { -1, -1 }
 */
 
 typedef
@@ -373,6 +378,19 @@ typedef
          (actual parameter) in a pair of regs, should we skip an arg
          reg if it is even-numbered?  True => yes, False => no. */
       Bool host_ppc32_regalign_int64_args;
+
+      /* AMD64 GUEST on AMD64 HOST only: guest state offsets of up to
+         two guest integer registers (not %rsp or %rbp) which are kept
+         in %r15 and %r14 respectively, rather than in the guest
+         state, while generated code runs; -1 if unused.  The guest
+         state copies are stale in the meantime, except across dirty
+         helper calls which say they access the registers.  The
+         dispatcher must load the host registers on entry to
+         generated code and store them back when it returns, and all
+         translations must be made with the same setting.  Using this
+         requires iropt_register_updates to be less than
+         VexRegUpdAllregsAtMemAccess. */
+      Int host_amd64_guest_reg_cache[2];
    }
    VexAbiInfo;
 
@@ -435,6 +453,21 @@ typedef
       /* EXPERIMENTAL: chase across conditional branches?  Not all
          front ends honour this.  Default: NO. */
       Bool guest_chase_cond;
+      /* May front ends chase into the targets of direct calls?  If
+         not, every call ends its block with Ijk_Call, which is what a
+         return-prediction scheme keyed on Ijk_Call needs.
+         Default: YES. */
+      Bool guest_chase_calls;
+      /* Which register allocator to use: 2 (default) = the original
+         one, which keeps each vreg's spill slot for its whole live
+         range; 3 = the linear-scan one, which splits live ranges and
+         allocates and coalesces spill slots as it goes.  3 has so far
+         only been tested on amd64 hosts. */
+      Int regalloc_version;
+      /* Count the x86/amd64 flag helper calls that survive
+         specialisation, per (CC_OP, condition), and show them in
+         LibVEX_ShowStats.  Default: NO. */
+      Bool guest_cc_profile;
    }
    VexControl;
 
@@ -592,6 +625,21 @@ extern void LibVEX_Init (
 /*--- Make a translation                              ---*/
 /*-------------------------------------------------------*/
 
+/* The phases of LibVEX_Translate, for VexTranslateResult.phase_cost. */
+typedef
+   enum {
+      VexPhaseFrontEnd=0,  /* disassembly to IR */
+      VexPhaseOpt1,        /* pre-instrumentation IR optimisation */
+      VexPhaseInstrument1, /* instrument1 callback */
+      VexPhaseInstrument2, /* instrument2 callback */
+      VexPhaseOpt2,        /* post-instrumentation cleanup, tree building */
+      VexPhaseISel,        /* instruction selection */
+      VexPhaseRegAlloc,    /* register allocation */
+      VexPhaseAssemble,    /* assembly */
+      VexPhase_N
+   }
+   VexPhase;
+
 /* Describes the outcome of a translation attempt. */
 typedef
    struct {
@@ -606,6 +654,15 @@ typedef
       /* Stats only: the number of guest insns included in the
          translation.  It may be zero (!). */
       UInt n_guest_instrs;
+      /* Stats only, and only filled in if VexTranslateArgs.phase_clock
+         was supplied: the time spent in each phase, in phase_clock
+         units; the number of IR statements after instrumentation and
+         cleanup; the number of virtual registers; and the number of
+         spill and reload instructions the register allocator added. */
+      ULong phase_cost[VexPhase_N];
+      UInt  n_ir_stmts;
+      UInt  n_vregs;
+      UInt  n_spills;
    }
    VexTranslateResult;
 
@@ -712,6 +769,16 @@ typedef
          translation? */
       Bool    addProfInc;
 
+      /* IN: run the shadow-state optimiser (GVN, dead shadow PUT
+         removal) after instrumentation?  Only worth it for tools
+         whose instrumentation maintains shadow registers. */
+      Bool    shadow_opt;
+
+      /* IN: optionally, a clock (of any units, but cheap to read) used
+         to time each phase of the translation.  May be NULL, in which
+         case the profiling fields of VexTranslateResult are zero. */
+      ULong   (*phase_clock) ( void );
+
       /* IN: address of the dispatcher entry points.  Describes the
          places where generated code should jump to at the end of each
          bb.
@@ -751,6 +818,26 @@ typedef
       void* disp_cp_chain_me_to_fastEP;
       void* disp_cp_xindir;
       void* disp_cp_xassisted;
+
+      /* IN: optional.  If non-NULL, and the host supports it (amd64
+         and arm at present), XIndir transfers (indirect Boring, Call
+         and Ret exits) are given a monomorphic inline cache: the
+         target is compared against a patchable guest address, and on
+         a match control goes through an ordinary chain-me point, so
+         that it can be chained directly to the predicted block just
+         like an XDirect.  The first miss at a site calls
+         disp_cp_prime_ic, which (like the chain-me entry points)
+         hands the site address back to the caller, so it can fill in
+         the predicted guest address with LibVEX_PrimeIC.  Subsequent
+         misses go to disp_cp_xindir as usual. */
+      void* disp_cp_prime_ic;
+
+      /* IN: optional.  If non-NULL, and the host supports it (amd64
+         and arm at present), XIndirs made for Ijk_Ret exits go to
+         disp_cp_xindir_ret rather than disp_cp_xindir, and are never
+         given an inline cache, so that the caller can predict
+         returns some other way. */
+      void* disp_cp_xindir_ret;
    }
    VexTranslateArgs;
 
@@ -806,6 +893,20 @@ VexInvalRange LibVEX_UnChain ( VexArch arch_host,
                                void*   place_to_jump_to_EXPECTED,
                                void*   disp_cp_chain_me );
 
+/* Prime the inline cache of an XIndir located at place_to_prime, as
+   found by disp_cp_prime_ic, so that it predicts guest_addr.  It is
+   expected (and checked) that the site currently contains a call to
+   disp_cp_prime_ic_EXPECTED.  After priming, misses at the site jump
+   to disp_cp_xindir instead.  The chain-me point guarded by the
+   prediction is left as-is; it gets chained in the normal way when
+   it is first reached, and unchained by LibVEX_UnChain. */
+extern
+VexInvalRange LibVEX_PrimeIC ( VexArch arch_host,
+                               void*   place_to_prime,
+                               Addr64  guest_addr,
+                               void*   disp_cp_prime_ic_EXPECTED,
+                               void*   disp_cp_xindir );
+
 /* Returns a constant -- the size of the event check that is put at
    the start of every translation.  This makes it possible to
    calculate the fast entry point address if the slow entry point
@@ -893,7 +994,9 @@ extern void LibVEX_InitIRI ( const IRICB * );
 
    amd64
    ~~~~~
-   Analogous to x86.
+   Analogous to x86.  If VexAbiInfo.host_amd64_guest_reg_cache is in
+   use, %r15 (and %r14) must hold the guest registers concerned on
+   entry, and will hold their current values on exit.
 
    ppc32
    ~~~~~
@@ -181,8 +181,8 @@ SysRes VG_(am_do_mmap_NO_NOTIFY)( Addr start, SizeT length, UInt prot,
    return res;
 }
 
-static
-SysRes local_do_mprotect_NO_NOTIFY(Addr start, SizeT length, UInt prot)
+/* Note: this is VG_, not ML_. */
+SysRes VG_(am_do_mprotect_NO_NOTIFY)(Addr start, SizeT length, UInt prot)
 {
    return VG_(do_syscall3)(__NR_mprotect, (UWord)start, length, prot );
 }
@@ -373,7 +373,7 @@ VgStack* VG_(am_alloc_VgStack)( /*OUT*/Addr* initial_sp )
    aspacem_assert(VG_IS_PAGE_ALIGNED(stack));
 
    /* Protect the guard areas. */
-   sres = local_do_mprotect_NO_NOTIFY( 
+   sres = VG_(am_do_mprotect_NO_NOTIFY)( 
              (Addr) &stack[0], 
              VG_STACK_GUARD_SZB, VKI_PROT_NONE 
           );
@@ -383,7 +383,7 @@ VgStack* VG_(am_alloc_VgStack)( /*OUT*/Addr* initial_sp )
       VG_STACK_GUARD_SZB, VKI_PROT_NONE 
    );
 
-   sres = local_do_mprotect_NO_NOTIFY( 
+   sres = VG_(am_do_mprotect_NO_NOTIFY)( 
              (Addr) &stack->bytes[VG_STACK_GUARD_SZB + VG_STACK_ACTIVE_SZB], 
              VG_STACK_GUARD_SZB, VKI_PROT_NONE 
           );
@@ -30,6 +30,8 @@
 
 #include "pub_core_basics.h"
 #include "pub_core_debuglog.h"
+#include "pub_core_debuginfo.h"     // VG_(CF_info_generation)
+#include "pub_core_libcbase.h"
 #include "pub_core_libcassert.h"
 #include "pub_core_libcprint.h"     // For VG_(message)()
 #include "pub_core_mallocfree.h"
@@ -39,6 +41,8 @@
 #include "pub_core_vki.h"           // To keep pub_core_threadstate.h happy
 #include "pub_core_libcsetjmp.h"    // Ditto
 #include "pub_core_threadstate.h"   // VG_(is_valid_tid)
+#include "pub_core_stacks.h"        // VG_(stack_limits)
+#include "pub_core_aspacemgr.h"     // VG_(am_is_valid_for_client)
 #include "pub_core_execontext.h"    // self
 
 /*------------------------------------------------------------*/
@@ -116,6 +120,12 @@ static ULong ec_cmp2s;
 static ULong ec_cmp4s;
 static ULong ec_cmpAlls;
 
+/* Stats only: stack trace cache (see below) usage. */
+static ULong stc_hits;
+static ULong stc_misses;
+static ULong stc_checked;
+static ULong stc_wrong;
+
 
 /*------------------------------------------------------------*/
 /*--- Exported functions.                                  ---*/
@@ -192,6 +202,12 @@ void VG_(print_ExeContext_stats) ( Bool with_stacktraces )
       "   exectx: %'llu cmp2, %'llu cmp4, %'llu cmpAll\n",
       ec_cmp2s, ec_cmp4s, ec_cmpAlls 
    );
+   if (VG_(clo_stack_trace_cache))
+      VG_(message)(Vg_DebugMsg,
+         "   exectx: trace cache: %'llu hits, %'llu misses, "
+         "%'llu checked, %'llu wrong\n",
+         stc_hits, stc_misses, stc_checked, stc_wrong
+      );
 }
 
 
@@ -318,6 +334,158 @@ static void resize_ec_htab ( void )
    ec_htab_size_idx++;
 }
 
+/* Stack trace cache.  Allocation-heavy programs often record the
+   same stack trace over and over, e.g. when allocating in a loop, and
+   unwinding the stack each time is the expensive part of recording
+   it.  With --stack-trace-cache=yes, each thread remembers the last
+   few ExeContexts it recorded, together with what the unwind depended
+   on: the registers it started from, the stack limits, the CFI
+   generation and, for each frame i >= 1, the two stack words below
+   the stack pointer value of frame i, which are the return address
+   into frame i and (usually) the saved frame pointer.  If all of these
+   are unchanged, the remembered ExeContext is returned without
+   unwinding.
+
+   This is not exact: an unwind can also depend on other stack words
+   (e.g. a callee-saved register spilled elsewhere in a frame).
+   --stack-trace-cache-check=N unwinds anyway for one hit in N, and
+   counts the hits which were wrong (shown by --stats=yes).
+
+   Only full-depth traces are remembered, as the unwinder decides to
+   stop early on words we do not check, and the cache is not used with
+   --merge-recursive-frames, which makes frames and trace entries
+   differ.  And only x86 and amd64 are
+   handled: there, the return address into frame i is the word just
+   below the stack pointer value of frame i given by
+   VG_(get_StackTrace). */
+
+#if defined(VGA_x86) || defined(VGA_amd64)
+
+#define N_STC_ENTRIES 4
+
+typedef
+   struct {
+      ExeContext*     ec;        /* NULL if the entry is unused */
+      UnwindStartRegs regs;
+      Word            first_ip_delta;
+      Addr            stack_lowest_word;
+      Addr            stack_highest_word;
+      UInt            cf_generation;
+      Addr*           sps;       /* [1 .. ec->n_ips-1] */
+      Addr*           words;     /* 2 words below each sps[i] */
+   }
+   STCEntry;
+
+/* Per thread, allocated on first use. */
+static STCEntry* stc[VG_N_THREADS];
+
+static void stc_get_key ( ThreadId tid, /*OUT*/UnwindStartRegs* regs,
+                          /*OUT*/Addr* lowest, /*OUT*/Addr* highest )
+{
+   /* As in VG_(get_StackTrace). */
+   VG_(memset)( regs, 0, sizeof(*regs) );
+   VG_(get_UnwindStartRegs)( regs, tid );
+   *lowest  = 0;
+   *highest = VG_(threads)[tid].client_stack_highest_word;
+   VG_(stack_limits)( (Addr)regs->r_sp, lowest, highest );
+}
+
+static Bool stc_words_unchanged ( STCEntry* e )
+{
+   UInt i;
+   Addr lo = (Addr)e->regs.r_sp;
+   Addr hi = e->sps[e->ec->n_ips - 1];
+   if (hi <= lo || !VG_(am_is_valid_for_client)(lo, hi - lo, VKI_PROT_READ))
+      return False;
+   for (i = 1; i < e->ec->n_ips; i++) {
+      Addr* w = (Addr*)(e->sps[i] - 2 * sizeof(Addr));
+      if (w[0] != e->words[2*i] || w[1] != e->words[2*i+1])
+         return False;
+   }
+   return True;
+}
+
+static ExeContext* record_ExeContext_cached ( ThreadId tid,
+                                              Word first_ip_delta )
+{
+   static UInt     hit_ctr = 0;
+   Addr            ips[VG_(clo_backtrace_size)];
+   Addr            sps[VG_(clo_backtrace_size)];
+   UInt            n_ips, i;
+   UnwindStartRegs regs;
+   Addr            lowest, highest;
+   STCEntry*       e;
+   ExeContext*     ec;
+
+   if (stc[tid] == NULL) {
+      stc[tid] = VG_(calloc)("execontext.stc.1",
+                             N_STC_ENTRIES, sizeof(STCEntry));
+      for (i = 0; i < N_STC_ENTRIES; i++) {
+         stc[tid][i].sps   = VG_(malloc)("execontext.stc.2",
+                               VG_(clo_backtrace_size) * sizeof(Addr));
+         stc[tid][i].words = VG_(malloc)("execontext.stc.3",
+                               2 * VG_(clo_backtrace_size) * sizeof(Addr));
+      }
+   }
+
+   stc_get_key( tid, &regs, &lowest, &highest );
+   e = &stc[tid][(regs.r_pc ^ (regs.r_sp >> 4)) % N_STC_ENTRIES];
+
+   if (e->ec != NULL
+       && e->first_ip_delta == first_ip_delta
+       && e->stack_lowest_word == lowest
+       && e->stack_highest_word == highest
+       && e->cf_generation == VG_(CF_info_generation)()
+       && 0 == VG_(memcmp)( &e->regs, &regs, sizeof(regs) )
+       && stc_words_unchanged( e )) {
+      if (VG_(clo_stack_trace_cache_check) == 0
+          || ++hit_ctr < VG_(clo_stack_trace_cache_check)) {
+         stc_hits++;
+         return e->ec;
+      }
+      hit_ctr = 0;
+      stc_checked++;
+      n_ips = VG_(get_StackTrace)( tid, ips, VG_(clo_backtrace_size),
+                                   sps, NULL, first_ip_delta );
+      ec = record_ExeContext_wrk2 ( ips, n_ips );
+      if (ec != e->ec)
+         stc_wrong++;
+   } else {
+      stc_misses++;
+      n_ips = VG_(get_StackTrace)( tid, ips, VG_(clo_backtrace_size),
+                                   sps, NULL, first_ip_delta );
+      ec = record_ExeContext_wrk2 ( ips, n_ips );
+   }
+
+   /* Remember the trace, if it is complete and its stack words can
+      be read. */
+   e->ec = NULL;
+   if (n_ips == VG_(clo_backtrace_size)
+       && sps[n_ips-1] > (Addr)regs.r_sp
+       && VG_(am_is_valid_for_client)( (Addr)regs.r_sp,
+                                       sps[n_ips-1] - (Addr)regs.r_sp,
+                                       VKI_PROT_READ )) {
+      for (i = 1; i < n_ips; i++) {
+         Addr* w;
+         if (sps[i] < (Addr)regs.r_sp + 2 * sizeof(Addr))
+            return ec;
+         w = (Addr*)(sps[i] - 2 * sizeof(Addr));
+         e->sps[i]        = sps[i];
+         e->words[2*i]    = w[0];
+         e->words[2*i+1]  = w[1];
+      }
+      e->ec                 = ec;
+      e->regs               = regs;
+      e->first_ip_delta     = first_ip_delta;
+      e->stack_lowest_word  = lowest;
+      e->stack_highest_word = highest;
+      e->cf_generation      = VG_(CF_info_generation)();
+   }
+   return ec;
+}
+
+#endif /* defined(VGA_x86) || defined(VGA_amd64) */
+
 /* Do the first part of getting a stack trace: actually unwind the
    stack, and hand the results off to the duplicate-trace-finder
    (_wrk2). */
@@ -337,6 +505,11 @@ static ExeContext* record_ExeContext_wrk ( ThreadId tid, Word first_ip_delta,
    if (first_ip_only) {
       n_ips = 1;
       ips[0] = VG_(get_IP)(tid) + first_ip_delta;
+#  if defined(VGA_x86) || defined(VGA_amd64)
+   } else if (VG_(clo_stack_trace_cache)
+              && VG_(clo_merge_recursive_frames) == 0) {
+      return record_ExeContext_cached( tid, first_ip_delta );
+#  endif
    } else {
       n_ips = VG_(get_StackTrace)( tid, ips, VG_(clo_backtrace_size),
                                    NULL/*array to dump SP values in*/,
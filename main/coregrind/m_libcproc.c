@@ -654,6 +654,32 @@ UInt VG_(read_millisecond_timer) ( void )
    return (now - base) / 1000;
 }
 
+ULong VG_(read_cycle_counter) ( void )
+{
+#  if defined(VGA_x86) || defined(VGA_amd64)
+   UInt lo, hi;
+   __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+   return ((ULong)hi << 32) | (ULong)lo;
+
+#  elif defined(VGA_ppc64)
+   ULong tb;
+   __asm__ __volatile__("mftb %0" : "=r"(tb));
+   return tb;
+
+#  elif defined(VGO_linux)
+   SysRes res;
+   struct vki_timespec ts;
+   res = VG_(do_syscall2)(__NR_clock_gettime, VKI_CLOCK_MONOTONIC,
+                          (UWord)&ts);
+   if (sr_isError(res))
+      return 0;
+   return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+#  else
+   return 1000000ULL * (ULong)VG_(read_millisecond_timer)();
+#  endif
+}
+
 
 /* ---------------------------------------------------------------------
    atfork()
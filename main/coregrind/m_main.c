@@ -39,6 +39,7 @@
 #include "pub_core_aspacehl.h"
 #include "pub_core_commandline.h"
 #include "pub_core_debuglog.h"
+#include "pub_core_dispatch.h"
 #include "pub_core_errormgr.h"
 #include "pub_core_execontext.h"
 #include "pub_core_gdbserver.h"
@@ -79,6 +80,7 @@
 static void print_all_stats ( void )
 {
    VG_(print_translation_stats)();
+   LibVEX_ShowStats();
    VG_(print_tt_tc_stats)();
    VG_(print_scheduler_stats)();
    VG_(print_ExeContext_stats)( False /* with_stacktraces */ );
@@ -103,6 +105,56 @@ static void print_all_stats ( void )
 
 // See pub_{core,tool}_options.h for explanations of all these.
 
+/* Parse the argument of --vex-guest-reg-cache, a comma separated list
+   of one or two guest integer register names, into
+   VG_(disp_guest_reg_cache).  Returns False if it is malformed or the
+   platform doesn't support it. */
+static Bool parse_guest_reg_cache ( const HChar* str )
+{
+#  if defined(VGP_amd64_linux)
+   static const struct { const HChar* name; Int offset; } regs[] = {
+      { "rax", offsetof(VexGuestAMD64State, guest_RAX) },
+      { "rbx", offsetof(VexGuestAMD64State, guest_RBX) },
+      { "rcx", offsetof(VexGuestAMD64State, guest_RCX) },
+      { "rdx", offsetof(VexGuestAMD64State, guest_RDX) },
+      { "rsi", offsetof(VexGuestAMD64State, guest_RSI) },
+      { "rdi", offsetof(VexGuestAMD64State, guest_RDI) },
+      { "r8",  offsetof(VexGuestAMD64State, guest_R8)  },
+      { "r9",  offsetof(VexGuestAMD64State, guest_R9)  },
+      { "r10", offsetof(VexGuestAMD64State, guest_R10) },
+      { "r11", offsetof(VexGuestAMD64State, guest_R11) },
+      { "r12", offsetof(VexGuestAMD64State, guest_R12) },
+      { "r13", offsetof(VexGuestAMD64State, guest_R13) },
+      { "r14", offsetof(VexGuestAMD64State, guest_R14) },
+      { "r15", offsetof(VexGuestAMD64State, guest_R15) }
+   };
+   Long offs[2] = { -1, -1 };
+   Int  n = 0, i, len = 0;
+
+   while (True) {
+      for (i = 0; i < sizeof(regs)/sizeof(regs[0]); i++) {
+         len = VG_(strlen)(regs[i].name);
+         if (VG_(strncmp)(str, regs[i].name, len) == 0
+             && (str[len] == ',' || str[len] == 0))
+            break;
+      }
+      if (i == sizeof(regs)/sizeof(regs[0]) || n == 2
+          || (n == 1 && offs[0] == regs[i].offset))
+         return False;
+      offs[n++] = regs[i].offset;
+      str += len;
+      if (*str == 0)
+         break;
+      str++;
+   }
+   VG_(disp_guest_reg_cache)[0] = offs[0];
+   VG_(disp_guest_reg_cache)[1] = offs[1];
+   return True;
+#  else
+   return False;
+#  endif
+}
+
 static void usage_NORETURN ( Bool debug_help )
 {
    /* 'usage1' contains a %s 
@@ -181,10 +233,12 @@ static void usage_NORETURN ( Bool debug_help )
 "    --allow-mismatched-debuginfo=no|yes  [no]\n"
 "                              for the above two flags only, accept debuginfo\n"
 "                              objects that don't \"match\" the main object\n"
-"    --smc-check=none|stack|all|all-non-file [stack]\n"
+"    --smc-check=none|stack|all|all-non-file|page-protect [stack]\n"
 "                              checks for self-modifying code: none, only for\n"
-"                              code found in stacks, for all code, or for all\n"
-"                              code except that from file-backed mappings\n"
+"                              code found in stacks, for all code, for all\n"
+"                              code except that from file-backed mappings, or\n"
+"                              as 'stack' but write-protecting other pages\n"
+"                              that code is translated from\n"
 "    --read-var-info=yes|no    read debug info on stack and global variables\n"
 "                              and use it to print better error messages in\n"
 "                              tools that make use of it (Memcheck, Helgrind,\n"
@@ -229,6 +283,8 @@ static void usage_NORETURN ( Bool debug_help )
 "    --profile-flags=<XXXXXXXX> ditto, but for profiling (X = 0|1) [00000000]\n"
 "    --profile-interval=<number> show profile every <number> event checks\n"
 "                                [0, meaning only at the end of the run]\n"
+"    --profile-translation=no|yes  show where time spent translating\n"
+"                              goes, by JIT phase, at exit [no]\n"
 "    --trace-notbelow=<number> only show BBs above <number> [999999999]\n"
 "    --trace-notabove=<number> only show BBs below <number> [0]\n"
 "    --trace-syscalls=no|yes   show all system calls? [no]\n"
@@ -242,6 +298,12 @@ static void usage_NORETURN ( Bool debug_help )
 "    --trace-redir=no|yes      show redirection details? [no]\n"
 "    --trace-sched=no|yes      show thread scheduler details? [no]\n"
 "    --profile-heap=no|yes     profile Valgrind's own space use\n"
+"    --inline-ic=no|yes        use inline caches for indirect jumps? [no]\n"
+"    --ret-stack=no|yes        predict returns with a shadow stack? [no]\n"
+"    --stack-trace-cache=no|yes  reuse stack traces recorded again from\n"
+"                              unchanged registers and frames? [no]\n"
+"    --stack-trace-cache-check=<number>  unwind anyway for 1 in <number>\n"
+"                              stack trace cache hits, to check them [0]\n"
 "    --core-redzone-size=<number>  set minimum size of redzones added before/after\n"
 "                              heap blocks allocated for Valgrind internal use (in bytes) [4]\n"
 "    --wait-for-gdb=yes|no     pause on startup to wait for gdb attach\n"
@@ -259,6 +321,9 @@ static void usage_NORETURN ( Bool debug_help )
 "    --vex-guest-max-insns=<1..100>         [50]\n"
 "    --vex-guest-chase-thresh=<0..99>       [10]\n"
 "    --vex-guest-chase-cond=no|yes          [no]\n"
+"    --vex-regalloc-version=2|3             [2]\n"
+"    --vex-guest-cc-profile=no|yes          [no]\n"
+"    --vex-guest-reg-cache=<reg>[,<reg>]    [none]\n"
 "    --trace-flags and --profile-flags values (omit the middle space):\n"
 "       1000 0000   show conversion into IR\n"
 "       0100 0000   show after initial opt\n"
@@ -591,6 +656,12 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
 
       }
       else if VG_BOOL_CLO(arg, "--trace-sched",      VG_(clo_trace_sched)) {}
+      else if VG_BOOL_CLO(arg, "--inline-ic",        VG_(clo_inline_ic)) {}
+      else if VG_BOOL_CLO(arg, "--ret-stack",        VG_(clo_ret_stack)) {}
+      else if VG_BOOL_CLO(arg, "--stack-trace-cache",
+                          VG_(clo_stack_trace_cache)) {}
+      else if VG_BINT_CLO(arg, "--stack-trace-cache-check",
+                          VG_(clo_stack_trace_cache_check), 0, 1000000) {}
       else if VG_BOOL_CLO(arg, "--trace-signals",    VG_(clo_trace_signals)) {}
       else if VG_BOOL_CLO(arg, "--trace-symtab",     VG_(clo_trace_symtab)) {}
       else if VG_STR_CLO (arg, "--trace-symtab-patt", VG_(clo_trace_symtab_patt)) {}
@@ -630,6 +701,9 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
       else if VG_XACT_CLO(arg, "--smc-check=all-non-file",
                                                     VG_(clo_smc_check),
                                                     Vg_SmcAllNonFile);
+      else if VG_XACT_CLO(arg, "--smc-check=page-protect",
+                                                    VG_(clo_smc_check),
+                                                    Vg_SmcPageProtect);
 
       else if VG_STR_CLO (arg, "--kernel-variant",  VG_(clo_kernel_variant)) {}
 
@@ -668,6 +742,17 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
                        VG_(clo_vex_control).guest_chase_thresh, 0, 99) {}
       else if VG_BOOL_CLO(arg, "--vex-guest-chase-cond",
                        VG_(clo_vex_control).guest_chase_cond) {}
+      else if VG_BINT_CLO(arg, "--vex-regalloc-version",
+                       VG_(clo_vex_control).regalloc_version, 2, 3) {}
+      else if VG_BOOL_CLO(arg, "--vex-guest-cc-profile",
+                       VG_(clo_vex_control).guest_cc_profile) {}
+      else if VG_STR_CLO(arg, "--vex-guest-reg-cache", tmp_str) {
+         if (!parse_guest_reg_cache(tmp_str))
+            VG_(fmsg_bad_option)(arg,
+               "Expected one or two of rax, rbx, rcx, rdx, rsi, rdi and\n"
+               "r8 to r15, separated by a comma.  Only supported on\n"
+               "amd64-linux.\n");
+      }
 
       else if VG_INT_CLO(arg, "--log-fd", tmp_log_fd) {
          log_to = VgLogTo_Fd;
@@ -795,6 +880,8 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
 
       else if VG_INT_CLO (arg, "--profile-interval",
                           VG_(clo_profyle_interval)) {}
+      else if VG_BOOL_CLO(arg, "--profile-translation",
+                          VG_(clo_profile_translation)) {}
 
       else if VG_XACT_CLO(arg, "--gen-suppressions=no",
                                VG_(clo_gen_suppressions), 0) {}
@@ -830,6 +917,13 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
    if (VG_(clo_vex_control).guest_chase_thresh < 0)
       VG_(clo_vex_control).guest_chase_thresh = 0;
 
+#  if defined(VGA_amd64) || defined(VGA_arm)
+   /* The return stack is pushed by blocks ending in a call, so calls
+      must not be chased into. */
+   if (VG_(clo_ret_stack))
+      VG_(clo_vex_control).guest_chase_calls = False;
+#  endif
+
    /* Check various option values */
 
    if (VG_(clo_verbosity) < 0)
@@ -858,6 +952,23 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
 
    VG_(dyn_vgdb_error) = VG_(clo_vgdb_error);
 
+#  if defined(VGP_amd64_linux)
+   /* The guest state doesn't hold the current values of cached guest
+      registers, so anything which inspects it in the middle of
+      generated code would see stale values. */
+   if (VG_(disp_guest_reg_cache)[0] >= 0) {
+      if (VG_(clo_vgdb) != Vg_VgdbNo)
+         VG_(fmsg_bad_option)("--vex-guest-reg-cache",
+            "Can't use --vex-guest-reg-cache with gdbserver.\n"
+            "Use --vgdb=no as well.\n");
+      if (VG_(clo_vex_control).iropt_register_updates
+          >= VexRegUpdAllregsAtMemAccess)
+         VG_(fmsg_bad_option)("--vex-guest-reg-cache",
+            "Can't use --vex-guest-reg-cache with\n"
+            "--vex-iropt-register-updates=allregs-at-*.\n");
+   }
+#  endif
+
    if (VG_(clo_gen_suppressions) > 0 && 
        !VG_(needs).core_errors && !VG_(needs).tool_errors) {
       VG_(fmsg_bad_option)("--gen-suppressions=yes",
@@ -2502,6 +2613,9 @@ void shutdown_actions_NORETURN( ThreadId tid,
       VG_(get_and_show_SB_profile)(0/*denoting end-of-run*/);
    }
 
+   if (VG_(clo_profile_translation))
+      VG_(print_translation_profile)();
+
    /* Print Vex storage stats */
    if (0)
        LibVEX_ShowAllocStats();
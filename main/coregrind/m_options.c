@@ -86,6 +86,7 @@ UChar  VG_(clo_trace_flags)    = 0; // 00000000b
 Bool   VG_(clo_profyle_sbs)    = False;
 UChar  VG_(clo_profyle_flags)  = 0; // 00000000b
 ULong  VG_(clo_profyle_interval) = 0;
+Bool   VG_(clo_profile_translation) = False;
 Int    VG_(clo_trace_notbelow) = -1;  // unspecified
 Int    VG_(clo_trace_notabove) = -1;  // unspecified
 Bool   VG_(clo_trace_syscalls) = False;
@@ -101,6 +102,10 @@ enum FairSchedType
        VG_(clo_fair_sched)     = disable_fair_sched;
 Bool   VG_(clo_trace_sched)    = False;
 Bool   VG_(clo_profile_heap)   = False;
+Bool   VG_(clo_inline_ic)      = False;
+Bool   VG_(clo_ret_stack)      = False;
+Bool   VG_(clo_stack_trace_cache) = False;
+Int    VG_(clo_stack_trace_cache_check) = 0;
 Int    VG_(clo_core_redzone_size) = CORE_REDZONE_DEFAULT_SZB;
 // A value != -1 overrides the tool-specific value
 // VG_(needs_malloc_replacement).tool_client_redzone_szB
@@ -108,9 +108,29 @@
    give finer interleaving but much increased scheduling overheads. */
 #define SCHEDULING_QUANTUM   100000
 
+/* The quantum is adapted to the load: with N threads competing for
+   the_BigLock each gets SCHEDULING_QUANTUM / N, so a full round
+   takes about as long as one quantum used to, but never less than
+   SCHEDULING_QUANTUM_MIN.  A thread returning from a blocking
+   syscall is usually one a latency-sensitive client is waiting on,
+   so while any such thread is queued for the_BigLock the running
+   thread's slice is cut to SCHEDULING_QUANTUM_MIN, and at the end of
+   it the CPU is explicitly handed over with sched_yield. */
+#define SCHEDULING_QUANTUM_MIN  10000
+
+/* Number of threads which are back from a blocking syscall and are
+   waiting to reacquire the_BigLock.  Updated atomically, since it is
+   written without holding the lock. */
+static volatile UInt n_syscall_wakers = 0;
+
 /* If False, a fault is Valgrind-internal (ie, a bug) */
 Bool VG_(in_generated_code) = False;
 
+#if defined(VGP_amd64_linux)
+/* See pub_core_dispatch.h. */
+Long VG_(disp_guest_reg_cache)[2] = { -1, -1 };
+#endif
+
 /* 64-bit counter for the number of basic blocks done. */
 static ULong bbs_done = 0;
 
@@ -141,12 +161,40 @@ static ULong stats__n_xindir_misses = 0;
 /*global*/ UInt VG_(stats__n_xindirs_32) = 0;
 /*global*/ UInt VG_(stats__n_xindir_misses_32) = 0;
 
+/* Stats: number of returns sent to VG_(disp_cp_xindir_rs), how many
+   of them the shadow return stack predicted correctly, and their
+   32-bit temp bins.  Hits are not counted as indir transfers. */
+static ULong stats__n_xrets = 0;
+static ULong stats__n_xret_hits = 0;
+/*global*/ UInt VG_(stats__n_xrets_32) = 0;
+/*global*/ UInt VG_(stats__n_xret_hits_32) = 0;
+
+/* Stats: timeslices handed out and their total length, slices cut
+   short because a syscall waker was queued, and explicit handoffs to
+   such wakers. */
+static ULong stats__n_quanta          = 0;
+static ULong stats__quanta_total      = 0;
+static ULong stats__n_quanta_cut      = 0;
+static ULong stats__n_waker_handoffs  = 0;
+static ULong stats__n_syscall_wakeups = 0;
+
+/* Stats: returns to the scheduler from generated code, by the TRC
+   value they came back with: chain-me requests, fast-cache misses,
+   assisted jumps of each kind, and so on.  Every one of these is a
+   transfer that did not go directly from one block to the next.  All
+   the TRC values are small, odd numbers. */
+#define N_TRC_STATS 128
+static ULong stats__n_trc[N_TRC_STATS];
+
 /* Sanity checking counts. */
 static UInt sanity_fast_count = 0;
 static UInt sanity_slow_count = 0;
 
+static const HChar* name_of_sched_event ( UInt event ); /* forward */
+
 void VG_(print_scheduler_stats)(void)
 {
+   UInt trc;
    VG_(message)(Vg_DebugMsg,
       "scheduler: %'llu event checks.\n", bbs_done );
    VG_(message)(Vg_DebugMsg,
@@ -154,9 +202,29 @@ void VG_(print_scheduler_stats)(void)
                 stats__n_xindirs, stats__n_xindir_misses,
                 stats__n_xindirs / (stats__n_xindir_misses 
                                     ? stats__n_xindir_misses : 1));
+   if (VG_(clo_ret_stack))
+      VG_(message)(Vg_DebugMsg,
+                   "scheduler: %'llu returns, %'llu predicted by the "
+                   "ret-stack\n",
+                   stats__n_xrets, stats__n_xret_hits);
    VG_(message)(Vg_DebugMsg,
       "scheduler: %'llu/%'llu major/minor sched events.\n",
       n_scheduling_events_MAJOR, n_scheduling_events_MINOR);
+   for (trc = 0; trc < N_TRC_STATS; trc++) {
+      if (stats__n_trc[trc] == 0)
+         continue;
+      VG_(message)(Vg_DebugMsg,
+                   "scheduler: %'llu dispatcher exits with %s\n",
+                   stats__n_trc[trc], name_of_sched_event(trc));
+   }
+   VG_(message)(Vg_DebugMsg,
+      "scheduler: %'llu quanta, avg %'llu blocks, %'llu cut short\n",
+      stats__n_quanta,
+      stats__quanta_total / (stats__n_quanta ? stats__n_quanta : 1),
+      stats__n_quanta_cut);
+   VG_(message)(Vg_DebugMsg,
+      "scheduler: %'llu syscall wakeups, %'llu handoffs to them\n",
+      stats__n_syscall_wakeups, stats__n_waker_handoffs);
    VG_(message)(Vg_DebugMsg, 
                 "   sanity: %d cheap, %d expensive checks.\n",
                 sanity_fast_count, sanity_slow_count );
@@ -226,6 +294,7 @@ const HChar* name_of_sched_event ( UInt event )
       case VG_TRC_INVARIANT_FAILED:    return "INVFAILED";
       case VG_TRC_CHAIN_ME_TO_SLOW_EP: return "CHAIN_ME_SLOW";
       case VG_TRC_CHAIN_ME_TO_FAST_EP: return "CHAIN_ME_FAST";
+      case VG_TRC_PRIME_IC:            return "PRIME_IC";
       default:                         return "??UNKNOWN??";
   }
 }
@@ -261,6 +330,7 @@ ThreadId VG_(alloc_ThreadState) ( void )
 void VG_(acquire_BigLock)(ThreadId tid, const HChar* who)
 {
    ThreadState *tst;
+   Bool         from_syscall;
 
 #if 0
    if (VG_(clo_trace_sched)) {
@@ -271,11 +341,23 @@ void VG_(acquire_BigLock)(ThreadId tid, const HChar* who)
    }
 #endif
 
+   /* Our own status is ours to look at even without the lock.  If
+      we're coming back from a blocking syscall, let the running
+      thread know somebody is waiting, so it can shorten its slice. */
+   from_syscall = VG_(threads)[tid].status == VgTs_WaitSys;
+   if (from_syscall)
+      __sync_fetch_and_add(&n_syscall_wakers, 1);
+
    /* First, acquire the_BigLock.  We can't do anything else safely
       prior to this point.  Even doing debug printing prior to this
       point is, technically, wrong. */
    VG_(acquire_BigLock_LL)(NULL);
 
+   if (from_syscall) {
+      __sync_fetch_and_sub(&n_syscall_wakers, 1);
+      stats__n_syscall_wakeups++;
+   }
+
    tst = VG_(get_ThreadState)(tid);
 
    vg_assert(tst->status != VgTs_Runnable);
@@ -864,17 +946,22 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    } else {
       /* normal case -- redir translation */
       UInt cno = (UInt)VG_TT_FAST_HASH((Addr)tst->arch.vex.VG_INSTR_PTR);
-      if (LIKELY(VG_(tt_fast)[cno].guest == (Addr)tst->arch.vex.VG_INSTR_PTR))
-         host_code_addr = VG_(tt_fast)[cno].host;
+      if (LIKELY(VG_(tt_fast)[cno].way[0].guest
+                 == (Addr)tst->arch.vex.VG_INSTR_PTR))
+         host_code_addr = VG_(tt_fast)[cno].way[0].host;
       else {
          AddrH res   = 0;
-         /* not found in VG_(tt_fast). Searching here the transtab
-            improves the performance compared to returning directly
-            to the scheduler. */
-         Bool  found = VG_(search_transtab)(&res, NULL, NULL,
-                                            (Addr)tst->arch.vex.VG_INSTR_PTR,
-                                            True/*upd cache*/
-                                            );
+         /* not found in way 0 of VG_(tt_fast).  Try the other ways
+            and the victim cache, then the transtab proper.  Searching
+            here improves the performance compared to returning
+            directly to the scheduler. */
+         Bool  found = VG_(search_fast_cache)(&res,
+                                              (Addr)tst->arch.vex.VG_INSTR_PTR,
+                                              tid)
+                       || VG_(search_transtab)(&res, NULL, NULL,
+                                               (Addr)tst->arch.vex.VG_INSTR_PTR,
+                                               True/*upd cache*/
+                                               );
          if (LIKELY(found)) {
             host_code_addr = res;
          } else {
@@ -898,6 +985,9 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    tst->arch.vex.host_EvC_FAILADDR
       = (HWord)VG_(fnptr_to_fnentry)( &VG_(disp_cp_evcheck_fail) );
 
+   /* Generated code pushes and pops this thread's return stack. */
+   VG_(select_ret_stack)( tid );
+
    if (0) {
       vki_sigset_t m;
       Int i, err = VG_(sigprocmask)(VKI_SIG_SETMASK, NULL, &m);
@@ -946,6 +1036,10 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    VG_(stats__n_xindirs_32) = 0;
    stats__n_xindir_misses += (ULong)VG_(stats__n_xindir_misses_32);
    VG_(stats__n_xindir_misses_32) = 0;
+   stats__n_xrets += (ULong)VG_(stats__n_xrets_32);
+   VG_(stats__n_xrets_32) = 0;
+   stats__n_xret_hits += (ULong)VG_(stats__n_xret_hits_32);
+   VG_(stats__n_xret_hits_32) = 0;
 
    /* Inspect the event counter. */
    vg_assert((Int)tst->arch.vex.host_EvC_COUNTER >= -1);
@@ -978,7 +1072,8 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
       VG_(run_innerloop). */
    /* Stay sane .. */
    if (two_words[0] == VG_TRC_CHAIN_ME_TO_SLOW_EP
-       || two_words[0] == VG_TRC_CHAIN_ME_TO_FAST_EP) {
+       || two_words[0] == VG_TRC_CHAIN_ME_TO_FAST_EP
+       || two_words[0] == VG_TRC_PRIME_IC) {
       vg_assert(two_words[1] != 0); /* we have a legit patch addr */
    } else {
       vg_assert(two_words[1] == 0); /* nobody messed with it */
@@ -995,8 +1090,11 @@ static void handle_tt_miss ( ThreadId tid )
    Bool found;
    Addr ip = VG_(get_IP)(tid);
 
-   /* Trivial event.  Miss in the fast-cache.  Do a full
-      lookup for it. */
+   /* Trivial event.  Miss in the fast-cache.  Check the parts of
+      the fast-cache the dispatcher doesn't look at, and failing
+      that, do a full lookup for it. */
+   if (VG_(search_fast_cache)( NULL, ip, tid ))
+      return;
    found = VG_(search_transtab)( NULL, NULL, NULL,
                                  ip, True/*upd_fast_cache*/ );
    if (UNLIKELY(!found)) {
@@ -1127,6 +1225,31 @@ void handle_noredir_jump ( /*OUT*/HWord* two_words,
 }
 
 
+/* Choose the length of the next timeslice; see the comment at
+   SCHEDULING_QUANTUM. */
+static Int pick_quantum ( void )
+{
+   Int      q, n_competing = 0;
+   ThreadId tid;
+
+   if (n_syscall_wakers > 0) {
+      q = SCHEDULING_QUANTUM_MIN;
+   } else {
+      for (tid = 1; tid < VG_N_THREADS; tid++)
+         if (VG_(threads)[tid].status == VgTs_Runnable
+             || VG_(threads)[tid].status == VgTs_Yielding)
+            n_competing++;
+      q = n_competing > 1 ? SCHEDULING_QUANTUM / n_competing
+                          : SCHEDULING_QUANTUM;
+      if (q < SCHEDULING_QUANTUM_MIN)
+         q = SCHEDULING_QUANTUM_MIN;
+   }
+
+   stats__n_quanta++;
+   stats__quanta_total += q;
+   return q;
+}
+
 /* 
    Run a thread until it wants to exit.
    
@@ -1196,7 +1319,7 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
    
    vg_assert(VG_(is_running_thread)(tid));
 
-   dispatch_ctr = SCHEDULING_QUANTUM;
+   dispatch_ctr = pick_quantum();
 
    while (!VG_(is_exiting)(tid)) {
 
@@ -1224,6 +1347,13 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
                                    "VG_(scheduler):timeslice");
 	 /* ------------ now we don't have The Lock ------------ */
 
+         /* If a thread is back from a blocking syscall, make sure it
+            gets the CPU (and the lock) before we do again. */
+         if (n_syscall_wakers > 0) {
+            VG_(do_syscall0)(__NR_sched_yield);
+            stats__n_waker_handoffs++;
+         }
+
 	 VG_(acquire_BigLock)(tid, "VG_(scheduler):timeslice");
 	 /* ------------ now we do have The Lock ------------ */
 
@@ -1249,7 +1379,7 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
 	    decrement is done before the bb is actually run, so you
 	    always get at least one decrement even if nothing happens. */
          // FIXME is this right?
-         dispatch_ctr = SCHEDULING_QUANTUM;
+         dispatch_ctr = pick_quantum();
 
 	 /* paranoia ... */
 	 vg_assert(tst->tid == tid);
@@ -1268,6 +1398,9 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
                               &dispatch_ctr,
                               tid, 0/*ignored*/, False );
 
+      if (trc[0] < N_TRC_STATS)
+         stats__n_trc[trc[0]]++;
+
       if (VG_(clo_trace_sched) && VG_(clo_verbosity) > 2) {
 	 HChar buf[50];
 	 VG_(sprintf)(buf, "TRC: %s", name_of_sched_event(trc[0]));
@@ -1309,7 +1442,15 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
             request, since chaining in the no-redir cache is too
             complex. */
          vg_assert(trc[0] != VG_TRC_CHAIN_ME_TO_SLOW_EP
-                   && trc[0] != VG_TRC_CHAIN_ME_TO_FAST_EP);
+                   && trc[0] != VG_TRC_CHAIN_ME_TO_FAST_EP
+                   && trc[0] != VG_TRC_PRIME_IC);
+      }
+
+      /* Someone came back from a blocking syscall while we were
+         running.  Don't make them wait for the rest of our slice. */
+      if (n_syscall_wakers > 0 && dispatch_ctr > SCHEDULING_QUANTUM_MIN) {
+         dispatch_ctr = SCHEDULING_QUANTUM_MIN;
+         stats__n_quanta_cut++;
       }
 
       switch (trc[0]) {
@@ -1337,6 +1478,15 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
          break;
       }
 
+      case VG_TRC_PRIME_IC: {
+         /* First miss at an inline cache.  Make it predict where we
+            are going now, then carry on as for a fast-cache miss. */
+         if (0) VG_(printf)("sched: PRIME_IC: %p\n", (void*)trc[1] );
+         VG_(tt_tc_prime_ic)((void*)trc[1], VG_(get_IP)(tid));
+         handle_tt_miss(tid);
+         break;
+      }
+
       case VEX_TRC_JMP_CLIENTREQ:
 	 do_client_request(tid);
 	 break;
@@ -1904,6 +2054,49 @@ void do_client_request ( ThreadId tid )
          SET_CLREQ_RETVAL( tid, 0 );     /* return value is meaningless */
 	 break;
 
+      case VG_USERREQ__DISCARD_TRANSLATIONS_MANY: {
+         UWord* pairs = (UWord*)arg[1];
+         Int    n     = (Int)arg[2];
+         if (VG_(clo_verbosity) > 2)
+            VG_(printf)( "client request: DISCARD_TRANSLATIONS_MANY,"
+                         " ranges %p,  n %d\n", pairs, n );
+
+         /* Check n before using it to size anything, so that a
+            large n cannot wrap the length checked below. */
+         if (n < 0 || n > VG_MAX_DISCARD_RANGES
+             || (n > 0
+                 && !VG_(am_is_valid_for_client)( (Addr)pairs,
+                                                  (SizeT)n * 2 * sizeof(UWord),
+                                                  VKI_PROT_READ ))) {
+            VG_(umsg)("Warning: DISCARD_TRANSLATIONS_MANY: ignoring "
+                      "invalid ranges %p, n %d\n", pairs, n);
+         } else if (n > 0) {
+            VG_(discard_translations_many)(
+               pairs, n, "scheduler(VG_USERREQ__DISCARD_TRANSLATIONS_MANY)"
+            );
+         }
+
+         SET_CLREQ_RETVAL( tid, 0 );     /* return value is meaningless */
+         break;
+      }
+
+      case VG_USERREQ__JIT_ARENA_REGISTER:
+         if (VG_(clo_verbosity) > 2)
+            VG_(printf)( "client request: JIT_ARENA_REGISTER,"
+                         " addr %p,  len %lu\n",
+                         (void*)arg[1], arg[2] );
+         SET_CLREQ_RETVAL( tid, VG_(register_jit_arena)( arg[1], arg[2] )
+                                ? 1 : 0 );
+         break;
+
+      case VG_USERREQ__JIT_ARENA_DEREGISTER:
+         if (VG_(clo_verbosity) > 2)
+            VG_(printf)( "client request: JIT_ARENA_DEREGISTER,"
+                         " addr %p\n", (void*)arg[1] );
+         VG_(deregister_jit_arena)( arg[1] );
+         SET_CLREQ_RETVAL( tid, 0 );     /* return value is meaningless */
+         break;
+
       case VG_USERREQ__COUNT_ERRORS:  
          SET_CLREQ_RETVAL( tid, VG_(get_n_errs_found)() );
          break;
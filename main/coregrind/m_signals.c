@@ -208,6 +208,7 @@
 #include "pub_core_clientstate.h"
 #include "pub_core_aspacemgr.h"
 #include "pub_core_debugger.h"      // For VG_(start_debugger)
+#include "pub_core_dispatch.h"      // For VG_(disp_guest_reg_cache)
 #include "pub_core_errormgr.h"
 #include "pub_core_gdbserver.h"
 #include "pub_core_libcbase.h"
@@ -226,6 +227,7 @@
 #include "pub_core_syscall.h"
 #include "pub_core_syswrap.h"
 #include "pub_core_tooliface.h"
+#include "pub_core_transtab.h"      // For VG_(code_write_fault)
 #include "pub_core_coredump.h"
 
 
@@ -2410,6 +2412,33 @@ static Bool extend_stack_if_appropriate(ThreadId tid, vki_siginfo_t* info)
    }
 }
 
+/* On a fault in generated code, the current values of any guest
+   registers kept in host registers (see VG_(disp_guest_reg_cache))
+   are only in the faulting context, since the longjmp back to the
+   scheduler skips the dispatcher's postamble.  Copy them into the
+   guest state.  If the fault was in a helper called from generated
+   code, %r14 and %r15 may have been reused, but then the guest state
+   is already up to date: the registers are written back before any
+   helper which accesses memory is called. */
+static void save_cached_guest_regs ( ThreadId tid,
+                                     const struct vki_ucontext *uc )
+{
+#  if defined(VGP_amd64_linux)
+   NSegment const* seg;
+   UChar*          gst;
+
+   if (VG_(disp_guest_reg_cache)[0] < 0)
+      return;
+   seg = VG_(am_find_nsegment)( VG_UCONTEXT_INSTR_PTR(uc) );
+   if (seg == NULL || seg->kind != SkAnonV)
+      return;   /* not in the translation cache */
+   gst = (UChar*)&VG_(threads)[tid].arch.vex;
+   *(ULong*)(gst + VG_(disp_guest_reg_cache)[0]) = uc->uc_mcontext.r15;
+   if (VG_(disp_guest_reg_cache)[1] >= 0)
+      *(ULong*)(gst + VG_(disp_guest_reg_cache)[1]) = uc->uc_mcontext.r14;
+#  endif
+}
+
 static
 void sync_signalhandler_from_kernel ( ThreadId tid,
          Int sigNo, vki_siginfo_t *info, struct vki_ucontext *uc )
@@ -2426,6 +2455,13 @@ void sync_signalhandler_from_kernel ( ThreadId tid,
          so carry on panicking. */
    }
 
+   if (sigNo == VKI_SIGSEGV && info->si_code == VKI_SEGV_ACCERR
+       && VG_(code_write_fault)((Addr)info->VKI_SIGINFO_si_addr)) {
+      /* A write to a page write-protected for --smc-check=page-protect,
+         either by the client or by Valgrind on its behalf.  The page's
+         translations are gone and it is writable again, so restarting
+         the instruction will complete the write. */
+   } else
    if (extend_stack_if_appropriate(tid, info)) {
       /* Stack extension occurred, so we don't need to do anything else; upon
          returning from this function, we'll restart the host (hence guest)
@@ -2442,6 +2478,7 @@ void sync_signalhandler_from_kernel ( ThreadId tid,
       }
 
       if (VG_(in_generated_code)) {
+         save_cached_guest_regs(tid, uc);
          if (VG_(gdbserver_report_signal) (sigNo, tid)
              || VG_(sigismember)(&tst->sig_mask, sigNo)) {
             /* Can't continue; must longjmp back to the scheduler and thus
@@ -229,6 +229,11 @@ ML_(notify_core_and_tool_of_mprotect) ( Addr a, SizeT len, Int prot )
    d = VG_(am_notify_mprotect)(a, len, prot);
    VG_TRACK( change_mem_mprotect, a, len, rr, ww, xx );
    VG_(di_notify_mprotect)( a, len, prot );
+   /* With --smc-check=page-protect, code in non-writable memory is
+      neither checked nor protected, so it must be retranslated if the
+      memory becomes writable. */
+   if (ww && VG_(clo_smc_check) == Vg_SmcPageProtect)
+      d = True;
    if (d)
       VG_(discard_translations)( (Addr64)a, (ULong)len, 
                                  "ML_(notify_core_and_tool_of_mprotect)" );
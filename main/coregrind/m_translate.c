@@ -39,6 +39,7 @@
 #include "pub_core_libcbase.h"
 #include "pub_core_libcassert.h"
 #include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"   // VG_(read_cycle_counter)
 #include "pub_core_options.h"
 
 #include "pub_core_debuginfo.h"  // VG_(get_fnname_w_offset)
@@ -92,6 +93,177 @@ void VG_(print_translation_stats) ( void )
       n_SP_updates_generic_unknown, buf );
 }
 
+/*------------------------------------------------------------*/
+/*--- Translation profile (--profile-translation=yes)      ---*/
+/*------------------------------------------------------------*/
+
+/* The cost of each phase of LibVEX_Translate summed over all
+   translations, log2 histograms of the IR, vreg and spill counts of
+   each block, and the most expensive blocks to translate.  Costs are
+   in VG_(read_cycle_counter) units. */
+
+#define TP_N_BUCKETS 12    /* 0, 1, 2-3, 4-7, ..., 1024 and above */
+#define TP_N_TOP     20
+
+typedef
+   struct {
+      Addr64 addr;
+      ULong  cost;
+      UInt   n_guest_instrs;
+      UInt   n_ir_stmts;
+      UInt   n_vregs;
+      UInt   n_spills;
+   }
+   TPBlock;
+
+static ULong   tp_n_blocks = 0;
+static ULong   tp_phase_cost[VexPhase_N];
+static ULong   tp_hist_ir_stmts[TP_N_BUCKETS];
+static ULong   tp_hist_vregs[TP_N_BUCKETS];
+static ULong   tp_hist_spills[TP_N_BUCKETS];
+static TPBlock tp_top[TP_N_TOP];
+static Int     tp_n_top = 0;
+
+static Int tp_bucket ( UInt n )
+{
+   Int b = 0;
+   while (n > 0 && b < TP_N_BUCKETS-1) {
+      n >>= 1;
+      b++;
+   }
+   return b;
+}
+
+static void tp_record ( Addr64 addr, VexTranslateResult* tres )
+{
+   Int   i, victim;
+   ULong cost = 0;
+
+   tp_n_blocks++;
+   for (i = 0; i < VexPhase_N; i++) {
+      tp_phase_cost[i] += tres->phase_cost[i];
+      cost += tres->phase_cost[i];
+   }
+   tp_hist_ir_stmts[tp_bucket(tres->n_ir_stmts)]++;
+   tp_hist_vregs   [tp_bucket(tres->n_vregs)]++;
+   tp_hist_spills  [tp_bucket(tres->n_spills)]++;
+
+   /* Keep the TP_N_TOP most expensive blocks, replacing the
+      cheapest when full. */
+   if (tp_n_top < TP_N_TOP) {
+      victim = tp_n_top++;
+   } else {
+      victim = 0;
+      for (i = 1; i < TP_N_TOP; i++)
+         if (tp_top[i].cost < tp_top[victim].cost)
+            victim = i;
+      if (tp_top[victim].cost >= cost)
+         return;
+   }
+   tp_top[victim].addr           = addr;
+   tp_top[victim].cost           = cost;
+   tp_top[victim].n_guest_instrs = tres->n_guest_instrs;
+   tp_top[victim].n_ir_stmts     = tres->n_ir_stmts;
+   tp_top[victim].n_vregs        = tres->n_vregs;
+   tp_top[victim].n_spills       = tres->n_spills;
+}
+
+static Int cmp_TPBlock_by_cost ( const void* v1, const void* v2 )
+{
+   const TPBlock* b1 = v1;
+   const TPBlock* b2 = v2;
+   if (b1->cost > b2->cost) return -1;
+   if (b1->cost < b2->cost) return 1;
+   return 0;
+}
+
+static void tp_show_histogram ( const HChar* what, ULong* hist )
+{
+   Int  b;
+   HChar buf[7];
+   VG_(printf)("%s:\n", what);
+   for (b = 0; b < TP_N_BUCKETS; b++) {
+      if (hist[b] == 0)
+         continue;
+      VG_(percentify)(hist[b], tp_n_blocks, 1, 6, buf);
+      if (b == 0)
+         VG_(printf)("   %5u        : %'10llu %s\n", 0, hist[b], buf);
+      else if (b == TP_N_BUCKETS-1)
+         VG_(printf)("   %5u and up : %'10llu %s\n",
+                     1U << (b-1), hist[b], buf);
+      else
+         VG_(printf)("   %5u - %-5u: %'10llu %s\n",
+                     1U << (b-1), (1U << b) - 1, hist[b], buf);
+   }
+   VG_(printf)("\n");
+}
+
+void VG_(print_translation_profile) ( void )
+{
+   static const HChar* phase_names[VexPhase_N] = {
+      [VexPhaseFrontEnd]    = "front end (disassembly)",
+      [VexPhaseOpt1]        = "IR optimisation, pre-instrumentation",
+      [VexPhaseInstrument1] = NULL, /* the tool's name */
+      [VexPhaseInstrument2] = "core instrumentation (SP updates etc)",
+      [VexPhaseOpt2]        = "IR optimisation, post-instrumentation",
+      [VexPhaseISel]        = "instruction selection",
+      [VexPhaseRegAlloc]    = "register allocation",
+      [VexPhaseAssemble]    = "assembly"
+   };
+   ULong total = 0;
+   Int   i;
+   HChar buf[7];
+   HChar name[64];
+
+   for (i = 0; i < VexPhase_N; i++)
+      total += tp_phase_cost[i];
+
+   VG_(printf)("\n");
+   VG_(printf)("<<< BEGIN translation profile\n");
+   VG_(printf)("<<<\n");
+   VG_(printf)("\n");
+   VG_(printf)("Translations: %'llu, total cost %'llu ticks, "
+               "%'llu per translation\n\n",
+               tp_n_blocks, total,
+               tp_n_blocks == 0 ? 0ULL : total / tp_n_blocks);
+
+   VG_(printf)("Cost by phase:\n");
+   for (i = 0; i < VexPhase_N; i++) {
+      VG_(percentify)(tp_phase_cost[i], total, 1, 6, buf);
+      if (i == VexPhaseInstrument1)
+         VG_(printf)("   %'16llu %s   tool instrumentation (%s)\n",
+                     tp_phase_cost[i], buf, VG_(details).name);
+      else
+         VG_(printf)("   %'16llu %s   %s\n",
+                     tp_phase_cost[i], buf, phase_names[i]);
+   }
+   VG_(printf)("\n");
+
+   tp_show_histogram("IR statements per block, after instrumentation",
+                     tp_hist_ir_stmts);
+   tp_show_histogram("Virtual registers per block", tp_hist_vregs);
+   tp_show_histogram("Spills and reloads per block", tp_hist_spills);
+
+   VG_(ssort)(tp_top, tp_n_top, sizeof(TPBlock), cmp_TPBlock_by_cost);
+   VG_(printf)("Most expensive blocks to translate:\n");
+   VG_(printf)("rank        cost  insns  IRstmts  vregs  spills  "
+               "address\n");
+   for (i = 0; i < tp_n_top; i++) {
+      name[0] = 0;
+      VG_(get_fnname_w_offset)(tp_top[i].addr, name, sizeof(name));
+      name[sizeof(name)-1] = 0;
+      VG_(printf)("%3d: %'11llu  %5u  %7u  %5u  %6u  0x%llx %s\n",
+                  i, tp_top[i].cost, tp_top[i].n_guest_instrs,
+                  tp_top[i].n_ir_stmts, tp_top[i].n_vregs,
+                  tp_top[i].n_spills, tp_top[i].addr, name);
+   }
+
+   VG_(printf)("\n");
+   VG_(printf)("<<<\n");
+   VG_(printf)("<<< END translation profile\n");
+   VG_(printf)("\n");
+}
+
 /*------------------------------------------------------------*/
 /*--- %SP-update pass                                      ---*/
 /*------------------------------------------------------------*/
@@ -655,6 +827,135 @@ IRSB* vg_SP_update_pass ( void*             closureV,
 #undef DO_DIE
 }
 
+/*------------------------------------------------------------*/
+/*--- Shadow return-address stack                          ---*/
+/*------------------------------------------------------------*/
+
+/* With --ret-stack=yes, translations ending in Ijk_Call push their
+   return address, paired with the host address VG_(tt_fast) holds
+   for it at that moment, onto the running thread's return stack, and
+   translations ending in Ijk_Ret pop it again.  Their return exits,
+   and only those, go via VG_(disp_cp_xindir_rs), which jumps straight
+   to the popped host address when the guest addresses agree (see
+   pub_core_transtab_asm.h).  A call that Vex chased into would never
+   push, so m_main stops Vex chasing calls while this is in use.
+   Nothing else here has to be exact: longjmps, calls made by
+   indirect jumps and so on merely desynchronise the stack, after
+   which returns are looked up the normal way until it comes back
+   into step. */
+
+static Bool ret_stack_in_use ( void )
+{
+#  if defined(VGA_amd64) || defined(VGA_arm)
+   return VG_(clo_ret_stack);
+#  else
+   return False;
+#  endif
+}
+
+/* Bind 'e' to a new temporary of type 'ty', keeping bb flat. */
+static IRExpr* rs_assign ( IRSB* bb, IRType ty, IRExpr* e )
+{
+   IRTemp t = newIRTemp(bb->tyenv, ty);
+   addStmtToIRSB( bb, IRStmt_WrTmp(t, e) );
+   return IRExpr_RdTmp(t);
+}
+
+static
+IRSB* vg_ret_stack_pass ( void*             closureV,
+                          IRSB*             sb_in, 
+                          VexGuestLayout*   layout, 
+                          VexGuestExtents*  vge,
+                          VexArchInfo*      vai,
+                          IRType            gWordTy, 
+                          IRType            hWordTy )
+{
+   Int      i;
+   Bool     is32 = hWordTy == Ity_I32;
+   IROp     opAdd = is32 ? Iop_Add32 : Iop_Add64;
+   IROp     opSub = is32 ? Iop_Sub32 : Iop_Sub64;
+   IROp     opAnd = is32 ? Iop_And32 : Iop_And64;
+   IROp     opShl = is32 ? Iop_Shl32 : Iop_Shl64;
+   IRExpr   *rs, *top, *top_addr, *slot, *guest, *host;
+   IRSB*    bb;
+   Addr64   ret_addr = 0;
+   Bool     ret_addr_known = False;
+   FastCacheEntry* fce;
+
+   /* This pass replaces vg_SP_update_pass as instrument2, so run
+      that first if it is needed. */
+   bb = need_to_handle_SP_assignment()
+           ? vg_SP_update_pass( closureV, sb_in, layout, vge, vai,
+                                gWordTy, hWordTy )
+           : sb_in;
+
+   if (bb->jumpkind != Ijk_Call && bb->jumpkind != Ijk_Ret)
+      return bb;
+
+   if (bb->jumpkind == Ijk_Call) {
+      /* The return address is the address following the last guest
+         instruction in the block. */
+      for (i = bb->stmts_used-1; i >= 0; i--) {
+         IRStmt* st = bb->stmts[i];
+         if (st->tag == Ist_IMark) {
+            ret_addr = st->Ist.IMark.addr + st->Ist.IMark.len
+                       + st->Ist.IMark.delta;
+            ret_addr_known = True;
+            break;
+         }
+      }
+      if (!ret_addr_known)
+         return bb;
+   }
+
+   rs  = rs_assign( bb, hWordTy,
+                    IRExpr_Load( Iend_LE, hWordTy,
+                                 mkIRExpr_HWord( (HWord)&VG_(ret_stack_cur) ) ));
+   top_addr
+       = rs_assign( bb, hWordTy,
+                    IRExpr_Binop( opAdd, rs,
+                                  mkIRExpr_HWord( VG_RET_STACK_TOP_OFFSET ) ));
+   top = rs_assign( bb, hWordTy, IRExpr_Load( Iend_LE, hWordTy, top_addr ));
+
+   if (bb->jumpkind == Ijk_Ret) {
+      addStmtToIRSB( bb, IRStmt_Store( Iend_LE, top_addr,
+                                       rs_assign( bb, hWordTy,
+                                          IRExpr_Binop( opSub, top,
+                                             mkIRExpr_HWord(1) ))));
+      return bb;
+   }
+
+   /* Whatever is in way 0 of ret_addr's set gets pushed.  If that
+      isn't ret_addr itself, the entry just won't match on return. */
+   fce = &VG_(tt_fast)[VG_TT_FAST_HASH(ret_addr)].way[0];
+   guest = rs_assign( bb, hWordTy,
+                      IRExpr_Load( Iend_LE, hWordTy,
+                                   mkIRExpr_HWord( (HWord)&fce->guest ) ));
+   host  = rs_assign( bb, hWordTy,
+                      IRExpr_Load( Iend_LE, hWordTy,
+                                   mkIRExpr_HWord( (HWord)&fce->host ) ));
+
+   slot = rs_assign( bb, hWordTy,
+                     IRExpr_Binop( opAnd, top,
+                                   mkIRExpr_HWord( VG_RET_STACK_MASK ) ));
+   slot = rs_assign( bb, hWordTy,
+                     IRExpr_Binop( opShl, slot,
+                                   IRExpr_Const( IRConst_U8(
+                                      VG_RET_STACK_ENT_SHIFT ) )));
+   slot = rs_assign( bb, hWordTy, IRExpr_Binop( opAdd, rs, slot ));
+   addStmtToIRSB( bb, IRStmt_Store( Iend_LE, slot, guest ));
+   slot = rs_assign( bb, hWordTy,
+                     IRExpr_Binop( opAdd, slot,
+                                   mkIRExpr_HWord( sizeof(Addr) ) ));
+   addStmtToIRSB( bb, IRStmt_Store( Iend_LE, slot, host ));
+
+   addStmtToIRSB( bb, IRStmt_Store( Iend_LE, top_addr,
+                                    rs_assign( bb, hWordTy,
+                                       IRExpr_Binop( opAdd, top,
+                                          mkIRExpr_HWord(1) ))));
+   return bb;
+}
+
 /*------------------------------------------------------------*/
 /*--- Main entry point for the JITter.                     ---*/
 /*------------------------------------------------------------*/
@@ -834,6 +1135,24 @@ static UInt needs_self_check ( void* closureV,
                }
                break;
             }
+            case Vg_SmcPageProtect: {
+               /* as Vg_SmcStack for code in this thread's stack.
+                  Code in other writable memory is write-protected
+                  once translated (see write_protect_extents), unless
+                  it is in a page that keeps being written to, in
+                  which case it is checked. */
+               Addr sp = VG_(get_SP)(closure->tid);
+               if (!segA) {
+                  segA = VG_(am_find_nsegment)(addr);
+               }
+               NSegment const* segSP = VG_(am_find_nsegment)(sp);
+               if (segA && segSP && segA == segSP)
+                  check = True;
+               else if (segA && segA->hasW
+                        && !VG_(can_write_protect_code)(addr, len))
+                  check = True;
+               break;
+            }
             default:
                vg_assert(0);
          }
@@ -847,6 +1166,25 @@ static UInt needs_self_check ( void* closureV,
 }
 
 
+/* For --smc-check=page-protect: write-protect the pages that the
+   translation described by vge was made from, other than those
+   needs_self_check decided to check instead. */
+static void write_protect_extents ( ThreadId tid, VexGuestExtents* vge )
+{
+   UInt i;
+   NSegment const* segSP = VG_(am_find_nsegment)(VG_(get_SP)(tid));
+
+   for (i = 0; i < vge->n_used; i++) {
+      Addr  addr = (Addr)vge->base[i];
+      SizeT len  = (SizeT)vge->len[i];
+      if (segSP && VG_(am_find_nsegment)(addr) == segSP)
+         continue;
+      if (VG_(can_write_protect_code)(addr, len))
+         VG_(write_protect_code)(addr, len);
+   }
+}
+
+
 /* This is a callback passed to LibVEX_Translate.  It stops Vex from
    chasing into function entry points that we wish to redirect.
    Chasing across them obviously defeats the redirect mechanism, with
@@ -1504,6 +1842,8 @@ Bool VG_(translate) ( ThreadId tid,
 
 #  if defined(VGP_amd64_linux)
    vex_abiinfo.guest_amd64_assume_fs_is_zero  = True;
+   vex_abiinfo.host_amd64_guest_reg_cache[0]  = VG_(disp_guest_reg_cache)[0];
+   vex_abiinfo.host_amd64_guest_reg_cache[1]  = VG_(disp_guest_reg_cache)[1];
 #  endif
 #  if defined(VGP_amd64_darwin)
    vex_abiinfo.guest_amd64_assume_gs_is_0x60  = True;
@@ -1558,7 +1898,9 @@ Bool VG_(translate) ( ThreadId tid,
      vta.instrument1     = g;
    }
    /* No need for type kludgery here. */
-   vta.instrument2       = need_to_handle_SP_assignment()
+   vta.instrument2       = ret_stack_in_use() && allow_redirection
+                              ? vg_ret_stack_pass
+                              : need_to_handle_SP_assignment()
                               ? vg_SP_update_pass
                               : NULL;
    vta.finaltidy         = VG_(needs).final_IR_tidy_pass
@@ -1569,6 +1911,11 @@ Bool VG_(translate) ( ThreadId tid,
    vta.traceflags        = verbosity;
    vta.sigill_diag       = VG_(clo_sigill_diag);
    vta.addProfInc        = VG_(clo_profyle_sbs) && kind != T_NoRedir;
+   vta.shadow_opt        = VG_(needs).shadow_opt;
+   vta.phase_clock       = VG_(clo_profile_translation)
+                              && !debugging_translation
+                              ? VG_(read_cycle_counter)
+                              : NULL;
 
    /* Set up the dispatch continuation-point info.  If this is a
       no-redir translation then it cannot be chained, and the chain-me
@@ -1589,10 +1936,25 @@ Bool VG_(translate) ( ThreadId tid,
          = VG_(fnptr_to_fnentry)( &VG_(disp_cp_chain_me_to_fastEP) );
       vta.disp_cp_xindir
          = VG_(fnptr_to_fnentry)( &VG_(disp_cp_xindir) );
+#     if defined(VGA_amd64) || defined(VGA_arm)
+      vta.disp_cp_xindir_ret
+         = ret_stack_in_use()
+              ? VG_(fnptr_to_fnentry)( &VG_(disp_cp_xindir_rs) )
+              : NULL;
+      vta.disp_cp_prime_ic
+         = VG_(clo_inline_ic)
+              ? VG_(fnptr_to_fnentry)( &VG_(disp_cp_prime_ic) )
+              : NULL;
+#     else
+      vta.disp_cp_xindir_ret         = NULL;
+      vta.disp_cp_prime_ic           = NULL;
+#     endif
    } else {
       vta.disp_cp_chain_me_to_slowEP = NULL;
       vta.disp_cp_chain_me_to_fastEP = NULL;
       vta.disp_cp_xindir             = NULL;
+      vta.disp_cp_xindir_ret         = NULL;
+      vta.disp_cp_prime_ic           = NULL;
    }
    /* This doesn't involve chaining and so is always allowable. */
    vta.disp_cp_xassisted
@@ -1606,6 +1968,9 @@ Bool VG_(translate) ( ThreadId tid,
    vg_assert(tmpbuf_used <= N_TMPBUF);
    vg_assert(tmpbuf_used > 0);
 
+   if (vta.phase_clock)
+      tp_record( addr, &tres );
+
    /* Tell aspacem of all segments that have had translations taken
       from them.  Optimisation: don't re-look up vge.base[0] since seg
       should already point to it. */
@@ -1650,6 +2015,9 @@ Bool VG_(translate) ( ThreadId tid,
                                         (Addr)(&tmpbuf[0]), 
                                         tmpbuf_used );
       }
+
+      if (VG_(clo_smc_check) == Vg_SmcPageProtect)
+         write_protect_extents( tid, &vge );
    }
 
    return True;
@@ -44,6 +44,8 @@
 #include "pub_core_mallocfree.h" // VG_(out_of_memory_NORETURN)
 #include "pub_core_xarray.h"
 #include "pub_core_dispatch.h"   // For VG_(disp_cp*) addresses
+#include "pub_core_threadstate.h" // For VG_(running_tid)
+#include "pub_core_hashtable.h"
 
 
 #define DEBUG_TRANSTAB 0
@@ -364,9 +366,10 @@ static Int    tc_sector_szQ = 0;
 static Int sector_search_order[MAX_N_SECTORS];
 
 
-/* Fast helper for the TC.  A direct-mapped cache which holds a set of
-   recently used (guest address, host address) pairs.  This array is
-   referred to directly from m_dispatch/dispatch-<platform>.S.
+/* Fast helper for the TC.  A 4-way set associative cache which holds
+   a set of recently used (guest address, host address) pairs.  This
+   array is referred to directly from m_dispatch/dispatch-<platform>.S.
+   See pub_core_transtab_asm.h for the layout and replacement policy.
 
    Entries in tt_fast may refer to any valid TC entry, regardless of
    which sector it's in.  Consequently we must be very careful to
@@ -385,9 +388,32 @@ typedef
       Addr host;
    }
    FastCacheEntry;
+typedef
+   struct {
+      FastCacheEntry way[VG_TT_FAST_WAYS];
+   }
+   FastCacheSet;
 */
-/*global*/ __attribute__((aligned(16)))
-           FastCacheEntry VG_(tt_fast)[VG_TT_FAST_SIZE];
+/*global*/ __attribute__((aligned(64)))
+           FastCacheSet VG_(tt_fast)[VG_TT_FAST_SIZE];
+
+/* Per-thread victim caches for VG_(tt_fast).  When inserting into a
+   full set pushes an entry out of the last way, that entry is parked
+   in the victim cache of the running thread, replacing the victim
+   slots round-robin.  Only VG_(search_fast_cache) looks at these, so
+   the dispatchers need know nothing about them.  They hold pointers
+   into the TC just like VG_(tt_fast), and so are invalidated along
+   with it. */
+#define N_FAST_VICTIMS 8
+
+static FastCacheEntry fast_victims[VG_N_THREADS][N_FAST_VICTIMS];
+static UInt           fast_victims_next[VG_N_THREADS];
+
+/* Per-thread shadow return-address stacks.  These too hold pointers
+   into the TC, and so are emptied whenever VG_(tt_fast) is. */
+static RetStack ret_stacks[VG_N_THREADS];
+
+/*global*/ RetStack* VG_(ret_stack_cur) = &ret_stacks[0];
 
 /* Make sure we're not used before initialisation. */
 static Bool init_done = False;
@@ -399,6 +425,16 @@ static Bool init_done = False;
 static ULong n_fast_flushes = 0;
 static ULong n_fast_updates = 0;
 
+/* Number of fast-cache entries pushed out of their set, and number
+   of hits found by VG_(search_fast_cache) in the set and in the
+   victim caches respectively. */
+static ULong n_fast_evictions   = 0;
+static ULong n_fast_set_hits    = 0;
+static ULong n_fast_victim_hits = 0;
+
+/* Number of inline caches primed. */
+static ULong n_ic_primed = 0;
+
 /* Number of full lookups done. */
 static ULong n_full_lookups = 0;
 static ULong n_lookup_probes = 0;
@@ -418,6 +454,18 @@ static ULong n_dump_osize = 0;
 static ULong n_disc_count = 0;
 static ULong n_disc_osize = 0;
 
+/* Number of chainings done, chaining requests dropped because the
+   requesting block had gone, and chained jumps undone because their
+   target was deleted. */
+static ULong n_chainings        = 0;
+static ULong n_chainings_gone   = 0;
+static ULong n_unchainings      = 0;
+
+/* Number of batched discard requests, and of discards (single or
+   batched) which were satisfied from a JIT arena's index. */
+static ULong n_disc_batches    = 0;
+static ULong n_disc_jit_arena  = 0;
+
 
 /*-------------------------------------------------------------*/
 /*--- Misc                                                  ---*/
@@ -780,6 +828,7 @@ void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
                     "host code %p not found (discarded? sector recycled?)"
                     " => no chaining done\n",
                     from__patch_addr);
+      n_chainings_gone++;
       return;
    }
 
@@ -824,7 +873,51 @@ void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
    /* Add .. */
    InEdgeArr__add(&to_tte->in_edges, &ie);
    OutEdgeArr__add(&from_tte->out_edges, &oe);
+
+   n_chainings++;
+}
+
+
+#if defined(VGA_amd64) || defined(VGA_arm)
+void VG_(tt_tc_prime_ic) ( void* from__patch_addr, Addr64 guest_addr )
+{
+   VexArch vex_arch = VexArch_INVALID;
+   VG_(machine_get_VexArchInfo)( &vex_arch, NULL );
+
+   /* As with chaining, the from__ block might have gone away in the
+      meantime, in which case leave it alone. */
+   UInt from_sNo   = (UInt)-1;
+   UInt from_tteNo = (UInt)-1;
+   if (!find_TTEntry_from_hcode( &from_sNo, &from_tteNo,
+                                 from__patch_addr )) {
+      VG_(debugLog)(1,"transtab",
+                    "host code %p not found (discarded? sector recycled?)"
+                    " => no IC priming done\n",
+                    from__patch_addr);
+      return;
+   }
+
+   /* The chain-me point the IC guards needs no bookkeeping here; it
+      gets chained, and recorded in the in/out edge tables, the first
+      time it is reached, exactly as for an XDirect. */
+   VexInvalRange vir
+      = LibVEX_PrimeIC(
+           vex_arch,
+           from__patch_addr,
+           guest_addr,
+           VG_(fnptr_to_fnentry)( &VG_(disp_cp_prime_ic) ),
+           VG_(fnptr_to_fnentry)( &VG_(disp_cp_xindir) )
+        );
+   VG_(invalidate_icache)( (void*)vir.start, vir.len );
+   n_ic_primed++;
+}
+#else
+void VG_(tt_tc_prime_ic) ( void* from__patch_addr, Addr64 guest_addr )
+{
+   /* No inline caches are generated on this host. */
+   vg_assert(0);
 }
+#endif
 
 
 /* Unchain one patch, as described by the specified InEdge.  For
@@ -861,6 +954,7 @@ static void unchain_one ( VexArch vex_arch,
        = LibVEX_UnChain( vex_arch, place_to_patch, 
                          place_to_jump_to_EXPECTED, disp_cp_chain_me );
    VG_(invalidate_icache)( (void*)vir.start, vir.len );
+   n_unchainings++;
 }
 
 
@@ -1317,36 +1411,117 @@ static inline UInt HASH_TT ( Addr64 key )
    return k32 % N_TTES_PER_SECTOR;
 }
 
+/* Park an entry pushed out of VG_(tt_fast) in the running thread's
+   victim cache. */
+static void park_fast_victim ( FastCacheEntry* fe )
+{
+   ThreadId tid = VG_(running_tid);
+   UInt     vno;
+   if (tid == VG_INVALID_THREADID || tid >= VG_N_THREADS)
+      return;
+   vno = fast_victims_next[tid];
+   fast_victims[tid][vno] = *fe;
+   fast_victims_next[tid] = (vno + 1) % N_FAST_VICTIMS;
+}
+
+/* Make 'key' the most recently used entry of its set.  If it is
+   already present in some way, it is just moved to way 0; otherwise
+   the entries in ways 0 .. N-2 move down one and whatever falls out
+   of the last way goes to the victim cache. */
 static void setFastCacheEntry ( Addr64 key, ULong* tcptr )
 {
-   UInt cno = (UInt)VG_TT_FAST_HASH(key);
-   VG_(tt_fast)[cno].guest = (Addr)key;
-   VG_(tt_fast)[cno].host  = (Addr)tcptr;
-   n_fast_updates++;
+   UInt          cno = (UInt)VG_TT_FAST_HASH(key);
+   FastCacheSet* set = &VG_(tt_fast)[cno];
+   Int           w;
+
    /* This shouldn't fail.  It should be assured by m_translate
       which should reject any attempt to make translation of code
       starting at TRANSTAB_BOGUS_GUEST_ADDR. */
-   vg_assert(VG_(tt_fast)[cno].guest != TRANSTAB_BOGUS_GUEST_ADDR);
+   vg_assert((Addr)key != TRANSTAB_BOGUS_GUEST_ADDR);
+
+   for (w = 0; w < VG_TT_FAST_WAYS-1; w++) {
+      if (set->way[w].guest == (Addr)key)
+         break;
+   }
+   if (w == VG_TT_FAST_WAYS-1
+       && set->way[w].guest != (Addr)key
+       && set->way[w].guest != TRANSTAB_BOGUS_GUEST_ADDR) {
+      n_fast_evictions++;
+      park_fast_victim( &set->way[w] );
+   }
+   for (; w > 0; w--)
+      set->way[w] = set->way[w-1];
+   set->way[0].guest = (Addr)key;
+   set->way[0].host  = (Addr)tcptr;
+   n_fast_updates++;
 }
 
-/* Invalidate the fast cache VG_(tt_fast). */
+/* Invalidate the fast cache VG_(tt_fast), and the victim caches
+   along with it. */
 static void invalidateFastCache ( void )
 {
-   UInt j;
-   /* This loop is popular enough to make it worth unrolling a
-      bit, at least on ppc32. */
-   vg_assert(VG_TT_FAST_SIZE > 0 && (VG_TT_FAST_SIZE % 4) == 0);
-   for (j = 0; j < VG_TT_FAST_SIZE; j += 4) {
-      VG_(tt_fast)[j+0].guest = TRANSTAB_BOGUS_GUEST_ADDR;
-      VG_(tt_fast)[j+1].guest = TRANSTAB_BOGUS_GUEST_ADDR;
-      VG_(tt_fast)[j+2].guest = TRANSTAB_BOGUS_GUEST_ADDR;
-      VG_(tt_fast)[j+3].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+   UInt j, w;
+   vg_assert(VG_TT_FAST_SIZE > 0);
+   for (j = 0; j < VG_TT_FAST_SIZE; j++) {
+      for (w = 0; w < VG_TT_FAST_WAYS; w++)
+         VG_(tt_fast)[j].way[w].guest = TRANSTAB_BOGUS_GUEST_ADDR;
    }
-
    vg_assert(j == VG_TT_FAST_SIZE);
+
+   for (j = 0; j < VG_N_THREADS; j++) {
+      for (w = 0; w < N_FAST_VICTIMS; w++)
+         fast_victims[j][w].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+      fast_victims_next[j] = 0;
+      for (w = 0; w < VG_RET_STACK_SIZE; w++)
+         ret_stacks[j].ent[w].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+   }
    n_fast_flushes++;
 }
 
+void VG_(select_ret_stack) ( ThreadId tid )
+{
+   vg_assert(tid < VG_N_THREADS);
+   VG_(ret_stack_cur) = &ret_stacks[tid];
+}
+
+Bool VG_(search_fast_cache) ( /*OUT*/AddrH* res_hcode,
+                              Addr64        guest_addr,
+                              ThreadId      tid )
+{
+   UInt          cno = (UInt)VG_TT_FAST_HASH(guest_addr);
+   FastCacheSet* set = &VG_(tt_fast)[cno];
+   Addr          host;
+   UInt          w;
+
+   for (w = 0; w < VG_TT_FAST_WAYS; w++) {
+      if (set->way[w].guest == (Addr)guest_addr) {
+         host = set->way[w].host;
+         if (w > 0)
+            setFastCacheEntry( guest_addr, (ULong*)host );
+         n_fast_set_hits++;
+         if (res_hcode)
+            *res_hcode = (AddrH)host;
+         return True;
+      }
+   }
+
+   if (tid == VG_INVALID_THREADID || tid >= VG_N_THREADS)
+      return False;
+
+   for (w = 0; w < N_FAST_VICTIMS; w++) {
+      if (fast_victims[tid][w].guest == (Addr)guest_addr) {
+         host = fast_victims[tid][w].host;
+         fast_victims[tid][w].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+         setFastCacheEntry( guest_addr, (ULong*)host );
+         n_fast_victim_hits++;
+         if (res_hcode)
+            *res_hcode = (AddrH)host;
+         return True;
+      }
+   }
+   return False;
+}
+
 static void initialiseSector ( Int sno )
 {
    Int     i;
@@ -1496,6 +1671,9 @@ static void initialiseSector ( Int sno )
 }
 
 
+/* forward */
+static void jit_arenas_note_tte ( UInt sNo, Int tteNo );
+
 /* Add a translation of vge to TT/TC.  The translation is temporarily
    in code[0 .. code_len-1].
 
@@ -1661,6 +1839,9 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
 
    /* Note the eclass numbers for this translation. */
    upd_eclasses_after_add( &sectors[y], i );
+
+   /* And tell any JIT arena it came from. */
+   jit_arenas_note_tte( y, i );
 }
 
 
@@ -1734,6 +1915,183 @@ Bool VG_(search_transtab) ( /*OUT*/AddrH* res_hcode,
 }
 
 
+/*-------------------------------------------------------------*/
+/*--- Write-protected code pages (--smc-check=page-protect) ---*/
+/*-------------------------------------------------------------*/
+
+/* With --smc-check=page-protect, translations from writable client
+   memory are not made self-checking.  Instead the pages they come
+   from have write access removed, behind aspacem's back: aspacem
+   keeps the client's view of the permissions.  A write to such a
+   page faults, and VG_(code_write_fault) then discards the page's
+   translations and restores write access, after which the write is
+   restarted.  A page which keeps being written to probably holds
+   data as well as code; after CODE_PAGE_MAX_FAULTS faults it is no
+   longer protected, and m_translate makes self-checking
+   translations from it instead. */
+
+typedef
+   struct _CodePage {
+      struct _CodePage* next;
+      UWord             key;      /* page address */
+      Bool              isProt;   /* write access currently removed */
+      UInt              nFaults;  /* write faults taken so far */
+   }
+   CodePage;
+
+#define CODE_PAGE_MAX_FAULTS 8
+
+static VgHashTable code_pages        = NULL;
+static UInt        n_code_pages_prot = 0;  /* how many have isProt */
+
+/* Stats */
+static ULong n_code_page_protects = 0;
+static ULong n_code_write_faults  = 0;
+static ULong n_code_pages_dropped = 0;
+
+/* Returns the segment containing all of [a, a+len) if its pages may
+   be write-protected, else NULL. */
+static NSegment const* protectable_seg ( Addr a, SizeT len )
+{
+   NSegment const* seg = VG_(am_find_nsegment)(a);
+   if (seg == NULL
+       || (seg->kind != SkAnonC && seg->kind != SkFileC)
+       || !seg->hasW)
+      return NULL;
+   if (len > 0 && a + len - 1 > seg->end)
+      return NULL;
+   return seg;
+}
+
+static UInt seg_prot ( NSegment const* seg )
+{
+   return (seg->hasR ? VKI_PROT_READ  : 0)
+          | (seg->hasW ? VKI_PROT_WRITE : 0)
+          | (seg->hasX ? VKI_PROT_EXEC  : 0);
+}
+
+Bool VG_(can_write_protect_code) ( Addr a, SizeT len )
+{
+   Addr p, last;
+
+   if (VG_(clo_smc_check) != Vg_SmcPageProtect)
+      return False;
+   if (protectable_seg(a, len) == NULL)
+      return False;
+   if (code_pages == NULL)
+      return True;
+
+   last = VG_PGROUNDDN(len == 0 ? a : a + len - 1);
+   for (p = VG_PGROUNDDN(a); p <= last; p += VKI_PAGE_SIZE) {
+      CodePage* cp = VG_(HT_lookup)(code_pages, p);
+      if (cp && cp->nFaults >= CODE_PAGE_MAX_FAULTS)
+         return False;
+   }
+   return True;
+}
+
+void VG_(write_protect_code) ( Addr a, SizeT len )
+{
+   NSegment const* seg = protectable_seg(a, len);
+   Addr            p, last;
+
+   if (seg == NULL)
+      return;
+   if (code_pages == NULL)
+      code_pages = VG_(HT_construct)("transtab.code_pages");
+
+   last = VG_PGROUNDDN(len == 0 ? a : a + len - 1);
+   for (p = VG_PGROUNDDN(a); p <= last; p += VKI_PAGE_SIZE) {
+      CodePage* cp = VG_(HT_lookup)(code_pages, p);
+      if (cp == NULL) {
+         cp = ttaux_malloc("transtab.code_page", sizeof(CodePage));
+         cp->key     = p;
+         cp->isProt  = False;
+         cp->nFaults = 0;
+         VG_(HT_add_node)(code_pages, cp);
+      }
+      if (cp->isProt || cp->nFaults >= CODE_PAGE_MAX_FAULTS)
+         continue;
+      if (sr_isError(VG_(am_do_mprotect_NO_NOTIFY)(
+                        p, VKI_PAGE_SIZE, seg_prot(seg) & ~VKI_PROT_WRITE)))
+         continue;
+      cp->isProt = True;
+      n_code_pages_prot++;
+      n_code_page_protects++;
+   }
+}
+
+/* Give the page back the permissions the client thinks it has. */
+static void unprotect_code_page ( CodePage* cp )
+{
+   NSegment const* seg = VG_(am_find_nsegment)(cp->key);
+   vg_assert(cp->isProt);
+   cp->isProt = False;
+   n_code_pages_prot--;
+   if (seg && (seg->kind == SkAnonC || seg->kind == SkFileC))
+      (void)VG_(am_do_mprotect_NO_NOTIFY)(cp->key, VKI_PAGE_SIZE,
+                                          seg_prot(seg));
+}
+
+/* Apply fn to each protected page overlapping [a, a+len).  Walks
+   whichever is smaller, the range or the table. */
+static void for_each_protected_page ( Addr64 a, ULong len,
+                                      void (*fn)(CodePage*) )
+{
+   Addr      first, last, p;
+   CodePage* cp;
+
+   if (n_code_pages_prot == 0 || len == 0)
+      return;
+   first = VG_PGROUNDDN((Addr)a);
+   last  = VG_PGROUNDDN((Addr)(a + len - 1));
+   if ((last - first) / VKI_PAGE_SIZE < n_code_pages_prot) {
+      for (p = first; p <= last; p += VKI_PAGE_SIZE) {
+         cp = VG_(HT_lookup)(code_pages, p);
+         if (cp && cp->isProt)
+            fn(cp);
+      }
+   } else {
+      VG_(HT_ResetIter)(code_pages);
+      while ((cp = VG_(HT_Next)(code_pages)) != NULL) {
+         if (cp->isProt && cp->key >= first && cp->key <= last)
+            fn(cp);
+      }
+   }
+}
+
+static void discard_code_page ( CodePage* cp )
+{
+   /* This unprotects cp, via VG_(discard_translations). */
+   VG_(discard_translations)( (Addr64)cp->key, VKI_PAGE_SIZE,
+                              "discard_code_page" );
+   vg_assert(!cp->isProt);
+}
+
+Bool VG_(code_write_fault) ( Addr a )
+{
+   CodePage* cp;
+
+   if (n_code_pages_prot == 0)
+      return False;
+   cp = VG_(HT_lookup)(code_pages, VG_PGROUNDDN(a));
+   if (cp == NULL || !cp->isProt)
+      return False;
+
+   n_code_write_faults++;
+   cp->nFaults++;
+   if (cp->nFaults == CODE_PAGE_MAX_FAULTS)
+      n_code_pages_dropped++;
+   discard_code_page(cp);
+   return True;
+}
+
+void VG_(unprotect_code_for_write) ( Addr a, SizeT len )
+{
+   for_each_protected_page( a, len, discard_code_page );
+}
+
+
 /*-------------------------------------------------------------*/
 /*--- Delete translations.                                  ---*/
 /*-------------------------------------------------------------*/
@@ -1885,6 +2243,279 @@ Bool delete_translations_in_sector ( /*MOD*/Sector* sec, UInt secNo,
 } 
 
 
+/* Delete translations intersecting any of a set of ranges.  The
+   ranges are sorted by start address and do not overlap, so for each
+   extent of the translation only the last range starting at or before
+   the extent's end can intersect it. */
+
+typedef
+   struct {
+      Addr64 start;
+      ULong  len;
+   }
+   DiscardRange;
+
+static
+Bool overlaps_any ( DiscardRange* rs, Int n_rs, VexGuestExtents* vge )
+{
+   Int i, lo, hi, mid, k;
+   for (i = 0; i < vge->n_used; i++) {
+      Addr64 base = vge->base[i];
+      ULong  len  = (UInt)vge->len[i];
+      Addr64 end  = base + len - 1ULL;
+      if (len == 0)
+         continue;
+      lo = 0; hi = n_rs - 1; k = -1;
+      while (lo <= hi) {
+         mid = (lo + hi) / 2;
+         if (rs[mid].start <= end) {
+            k  = mid;
+            lo = mid + 1;
+         } else {
+            hi = mid - 1;
+         }
+      }
+      if (k >= 0 && overlap1(rs[k].start, rs[k].len, base, len))
+         return True;
+   }
+   return False;
+}
+
+
+/*-------------------------------------------------------------*/
+/*--- JIT arenas.                                           ---*/
+/*-------------------------------------------------------------*/
+
+/* A JIT arena is a range of client memory registered by a JIT (via
+   VALGRIND_JIT_ARENA_REGISTER) as holding generated code.  For each
+   arena we keep a list of the translations intersecting it, as
+   (sector << 16) | tte number, so that discards confined to the arena
+   need not visit every translation in every sector.
+
+   The list is not kept exact.  Entries are added as translations are
+   made, but not removed when a translation is deleted or its sector
+   recycled, so every entry is checked on use.  When the list has
+   grown to twice its size after the last compaction, stale and
+   duplicated entries are removed. */
+
+#define MAX_JIT_ARENAS 16
+
+typedef
+   struct {
+      Addr64  start;
+      ULong   len;
+      XArray* ttes;         /* of UInt */
+      Word    n_compacted;  /* size of ttes after last compaction */
+   }
+   JitArena;
+
+static JitArena jit_arenas[MAX_JIT_ARENAS];
+static Int      n_jit_arenas = 0;
+
+static inline UInt jit_arena_pack ( UInt sNo, Int tteNo )
+{
+   vg_assert(tteNo >= 0 && tteNo < N_TTES_PER_SECTOR);
+   return (sNo << 16) | (UInt)tteNo;
+}
+
+/* Is the packed entry e a live translation intersecting [start,
+   start+len) ?  If so, also return its sector and tte number. */
+static Bool jit_arena_entry_live ( UInt e, Addr64 start, ULong len,
+                                   /*OUT*/UInt* sNo, /*OUT*/Int* tteNo )
+{
+   UInt     s = e >> 16;
+   Int      t = (Int)(e & 0xFFFF);
+   TTEntry* tte;
+   if (s >= n_sectors || sectors[s].tc == NULL)
+      return False;
+   tte = &sectors[s].tt[t];
+   if (tte->status != InUse || !overlaps(start, len, &tte->vge))
+      return False;
+   *sNo   = s;
+   *tteNo = t;
+   return True;
+}
+
+static Int cmp_UInt ( const void* v1, const void* v2 )
+{
+   UInt u1 = *(const UInt*)v1;
+   UInt u2 = *(const UInt*)v2;
+   if (u1 < u2) return -1;
+   if (u1 > u2) return 1;
+   return 0;
+}
+
+static void compact_jit_arena ( JitArena* ja )
+{
+   Word  i, n, w;
+   UInt  e, prev, sNo;
+   Int   tteNo;
+   UInt* ttes;
+
+   VG_(setCmpFnXA)( ja->ttes, cmp_UInt );
+   VG_(sortXA)( ja->ttes );
+   n    = VG_(sizeXA)( ja->ttes );
+   ttes = n > 0 ? (UInt*)VG_(indexXA)( ja->ttes, 0 ) : NULL;
+   w    = 0;
+   prev = 0xFFFFFFFF;
+   for (i = 0; i < n; i++) {
+      e = ttes[i];
+      if (e == prev)
+         continue;
+      prev = e;
+      if (jit_arena_entry_live( e, ja->start, ja->len, &sNo, &tteNo ))
+         ttes[w++] = e;
+   }
+   VG_(dropTailXA)( ja->ttes, n - w );
+   ja->n_compacted = w;
+}
+
+static void jit_arenas_note_tte ( UInt sNo, Int tteNo )
+{
+   Int       i;
+   UInt      e;
+   JitArena* ja;
+   TTEntry*  tte;
+
+   if (LIKELY(n_jit_arenas == 0))
+      return;
+
+   tte = &sectors[sNo].tt[tteNo];
+   for (i = 0; i < n_jit_arenas; i++) {
+      ja = &jit_arenas[i];
+      if (!overlaps( ja->start, ja->len, &tte->vge ))
+         continue;
+      e = jit_arena_pack( sNo, tteNo );
+      VG_(addToXA)( ja->ttes, &e );
+      if (VG_(sizeXA)( ja->ttes ) > 2 * ja->n_compacted + 64)
+         compact_jit_arena( ja );
+   }
+}
+
+/* Find the arena wholly containing [start, start+len), if any. */
+static JitArena* find_jit_arena ( Addr64 start, ULong len )
+{
+   Int i;
+   for (i = 0; i < n_jit_arenas; i++) {
+      JitArena* ja = &jit_arenas[i];
+      if (start >= ja->start && start - ja->start + len <= ja->len)
+         return ja;
+   }
+   return NULL;
+}
+
+/* Delete the translations in ja's index which intersect any of the
+   given (sorted, disjoint) ranges. */
+static Bool delete_translations_in_jit_arena ( JitArena* ja,
+                                               DiscardRange* rs, Int n_rs,
+                                               VexArch vex_arch )
+{
+   Word  i, n;
+   UInt  sNo;
+   Int   tteNo;
+   Bool  anyDeld = False;
+
+   n_disc_jit_arena++;
+   n = VG_(sizeXA)( ja->ttes );
+   for (i = 0; i < n; i++) {
+      UInt e = *(UInt*)VG_(indexXA)( ja->ttes, i );
+      if (!jit_arena_entry_live( e, ja->start, ja->len, &sNo, &tteNo ))
+         continue;
+      if (overlaps_any( rs, n_rs, &sectors[sNo].tt[tteNo].vge )) {
+         delete_tte( &sectors[sNo], sNo, tteNo, vex_arch );
+         anyDeld = True;
+      }
+   }
+   if (anyDeld)
+      compact_jit_arena( ja );
+   return anyDeld;
+}
+
+Bool VG_(register_jit_arena) ( Addr64 start, ULong len )
+{
+   Int       i, sno;
+   JitArena* ja;
+
+   vg_assert(init_done);
+
+   VG_(debugLog)(2, "transtab",
+                    "register_jit_arena(0x%llx, %lld)\n", start, len );
+
+   if (len == 0 || start + len - 1ULL < start)
+      return False;
+   if (n_jit_arenas >= MAX_JIT_ARENAS)
+      return False;
+   for (i = 0; i < n_jit_arenas; i++) {
+      if (overlap1( start, len, jit_arenas[i].start, jit_arenas[i].len ))
+         return False;
+   }
+
+   ja = &jit_arenas[n_jit_arenas++];
+   ja->start       = start;
+   ja->len         = len;
+   ja->n_compacted = 0;
+   ja->ttes        = VG_(newXA)( ttaux_malloc, "transtab.rja.1",
+                                 ttaux_free, sizeof(UInt) );
+
+   /* Index whatever has already been translated from the arena. */
+   for (sno = 0; sno < n_sectors; sno++) {
+      Sector* sec = &sectors[sno];
+      if (sec->tc == NULL)
+         continue;
+      for (i = 0; i < N_TTES_PER_SECTOR; i++) {
+         if (sec->tt[i].status == InUse
+             && overlaps( start, len, &sec->tt[i].vge )) {
+            UInt e = jit_arena_pack( sno, i );
+            VG_(addToXA)( ja->ttes, &e );
+         }
+      }
+   }
+   ja->n_compacted = VG_(sizeXA)( ja->ttes );
+   return True;
+}
+
+void VG_(deregister_jit_arena) ( Addr64 start )
+{
+   Int i;
+
+   vg_assert(init_done);
+
+   VG_(debugLog)(2, "transtab",
+                    "deregister_jit_arena(0x%llx)\n", start );
+
+   for (i = 0; i < n_jit_arenas; i++) {
+      if (jit_arenas[i].start == start)
+         break;
+   }
+   if (i == n_jit_arenas)
+      return;
+   VG_(deleteXA)( jit_arenas[i].ttes );
+   jit_arenas[i] = jit_arenas[n_jit_arenas - 1];
+   n_jit_arenas--;
+}
+
+
+/* Post-deletion sanity check: nothing in [start, start+range) may
+   remain. */
+static void sanity_check_range_discarded ( Addr64 guest_start, ULong range )
+{
+   Int      sno, i;
+   Sector*  sec;
+   TTEntry* tte;
+   for (sno = 0; sno < n_sectors; sno++) {
+      sec = &sectors[sno];
+      if (sec->tc == NULL)
+         continue;
+      for (i = 0; i < N_TTES_PER_SECTOR; i++) {
+         tte = &sec->tt[i];
+         if (tte->status != InUse)
+            continue;
+         vg_assert(!overlaps( guest_start, range, &tte->vge ));
+      }
+   }
+}
+
+
 void VG_(discard_translations) ( Addr64 guest_start, ULong range,
                                  const HChar* who )
 {
@@ -1907,6 +2538,10 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
    if (range == 0)
       return;
 
+   /* Any of the range's pages we write-protected no longer need to
+      be. */
+   for_each_protected_page( guest_start, range, unprotect_code_page );
+
    VexArch vex_arch = VexArch_INVALID;
    VG_(machine_get_VexArchInfo)( &vex_arch, NULL );
 
@@ -1958,6 +2593,22 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
                        );
       }
 
+   } else if (find_jit_arena( guest_start, range ) != NULL) {
+
+      /* The range lies within a JIT arena, so only the translations
+         in its index need be looked at. */
+      DiscardRange r;
+
+      VG_(debugLog)(2, "transtab",
+                       "                    JIT ARENA\n");
+
+      r.start = guest_start;
+      r.len   = range;
+      anyDeleted = delete_translations_in_jit_arena(
+                      find_jit_arena( guest_start, range ), &r, 1,
+                      vex_arch
+                   );
+
    } else {
 
       /* slow scheme */
@@ -1983,24 +2634,137 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
 
    /* Post-deletion sanity check */
    if (VG_(clo_sanity_level >= 4)) {
-      Int      i;
-      TTEntry* tte;
-      Bool     sane = sanity_check_all_sectors();
+      Bool sane = sanity_check_all_sectors();
       vg_assert(sane);
       /* But now, also check the requested address range isn't
          present anywhere. */
+      sanity_check_range_discarded( guest_start, range );
+   }
+}
+
+
+static Int cmp_DiscardRange ( const void* v1, const void* v2 )
+{
+   const DiscardRange* r1 = v1;
+   const DiscardRange* r2 = v2;
+   if (r1->start < r2->start) return -1;
+   if (r1->start > r2->start) return 1;
+   return 0;
+}
+
+/* Discard translations intersecting any of n ranges at once.  This
+   does in one pass what would otherwise take n calls to
+   VG_(discard_translations), each of which, for ranges spanning more
+   than one eclass, inspects every translation in every sector, and
+   each of which flushes the fast cache. */
+void VG_(discard_translations_many) ( UWord* pairs, Int n,
+                                      const HChar* who )
+{
+   DiscardRange* rs;
+   JitArena*     ja;
+   Sector*       sec;
+   Int           i, j, n_rs, sno;
+   Bool          anyDeleted = False;
+
+   vg_assert(init_done);
+
+   VG_(debugLog)(2, "transtab",
+                    "discard_translations_many(%d ranges) req by %s\n",
+                    n, who );
+
+   if (n <= 0)
+      return;
+   vg_assert(n <= VG_MAX_DISCARD_RANGES);
+
+   n_disc_batches++;
+
+   /* Pre-deletion sanity check */
+   if (VG_(clo_sanity_level >= 4)) {
+      Bool sane = sanity_check_all_sectors();
+      vg_assert(sane);
+   }
+
+   /* Collect the non-empty ranges, sort them, and merge any which
+      overlap or abut. */
+   rs = ttaux_malloc( "transtab.dtm.1", (SizeT)n * sizeof(DiscardRange) );
+   n_rs = 0;
+   for (i = 0; i < n; i++) {
+      Addr64 start = pairs[2*i];
+      ULong  len   = pairs[2*i + 1];
+      if (len == 0)
+         continue;
+      if (start + len - 1ULL < start)
+         len = 0ULL - start; /* clip at the top of the address space */
+      rs[n_rs].start = start;
+      rs[n_rs].len   = len;
+      n_rs++;
+   }
+   if (n_rs == 0) {
+      ttaux_free( rs );
+      return;
+   }
+
+   VG_(ssort)( rs, n_rs, sizeof(DiscardRange), cmp_DiscardRange );
+   j = 0;
+   for (i = 1; i < n_rs; i++) {
+      Addr64 end_j = rs[j].start + rs[j].len;
+      if (end_j == 0)
+         continue; /* rs[j] runs to the top of the address space */
+      if (rs[i].start <= end_j) {
+         Addr64 end_i = rs[i].start + rs[i].len;
+         if (end_i == 0 || end_i > end_j)
+            rs[j].len = end_i - rs[j].start;
+      } else {
+         rs[++j] = rs[i];
+      }
+   }
+   n_rs = j + 1;
+
+   for (i = 0; i < n_rs; i++)
+      for_each_protected_page( rs[i].start, rs[i].len, unprotect_code_page );
+
+   VexArch vex_arch = VexArch_INVALID;
+   VG_(machine_get_VexArchInfo)( &vex_arch, NULL );
+
+   /* If every range is in the same JIT arena, only that arena's
+      translations need be looked at.  Otherwise visit each
+      translation once, checking it against all the ranges. */
+   ja = find_jit_arena( rs[0].start,
+                        rs[n_rs-1].start + rs[n_rs-1].len - rs[0].start );
+   if (ja) {
+      anyDeleted = delete_translations_in_jit_arena( ja, rs, n_rs,
+                                                     vex_arch );
+   } else {
       for (sno = 0; sno < n_sectors; sno++) {
          sec = &sectors[sno];
          if (sec->tc == NULL)
             continue;
          for (i = 0; i < N_TTES_PER_SECTOR; i++) {
-            tte = &sec->tt[i];
-            if (tte->status != InUse)
-               continue;
-            vg_assert(!overlaps( guest_start, range, &tte->vge ));
+            if (sec->tt[i].status == InUse
+                && overlaps_any( rs, n_rs, &sec->tt[i].vge )) {
+               anyDeleted = True;
+               delete_tte( sec, sno, i, vex_arch );
+            }
          }
       }
    }
+
+   if (anyDeleted)
+      invalidateFastCache();
+
+   /* don't forget the no-redir cache */
+   for (i = 0; i < n_rs; i++)
+      unredir_discard_translations( rs[i].start, rs[i].len );
+
+   /* Post-deletion sanity check */
+   if (VG_(clo_sanity_level >= 4)) {
+      Bool sane = sanity_check_all_sectors();
+      vg_assert(sane);
+      for (i = 0; i < n_rs; i++)
+         sanity_check_range_discarded( rs[i].start, rs[i].len );
+   }
+
+   ttaux_free( rs );
 }
 
 
@@ -2185,8 +2949,15 @@ void VG_(init_tt_tc) ( void )
    /* check fast cache entries really are 2 words long */
    vg_assert(sizeof(Addr) == sizeof(void*));
    vg_assert(sizeof(FastCacheEntry) == 2 * sizeof(Addr));
-   /* check fast cache entries are packed back-to-back with no spaces */
-   vg_assert(sizeof( VG_(tt_fast) ) == VG_TT_FAST_SIZE * sizeof(FastCacheEntry));
+   /* check fast cache sets are the size the dispatchers assume */
+   vg_assert(sizeof(FastCacheSet) == VG_TT_FAST_WAYS * sizeof(FastCacheEntry));
+   vg_assert(sizeof(FastCacheSet) == (1 << VG_TT_FAST_SET_SHIFT));
+   /* check the return stack layout is what generated code and the
+      dispatchers assume */
+   vg_assert(sizeof(RetStackEnt) == (1 << VG_RET_STACK_ENT_SHIFT));
+   vg_assert(offsetof(RetStack, top) == VG_RET_STACK_TOP_OFFSET);
+   /* check fast cache sets are packed back-to-back with no spaces */
+   vg_assert(sizeof( VG_(tt_fast) ) == VG_TT_FAST_SIZE * sizeof(FastCacheSet));
    /* check fast cache is aligned as we requested.  Not fatal if it
       isn't, but we might as well make sure. */
    vg_assert(VG_IS_16_ALIGNED( ((Addr) & VG_(tt_fast)[0]) ));
@@ -2268,6 +3039,17 @@ void VG_(print_tt_tc_stats) ( void )
    VG_(message)(Vg_DebugMsg,
       "    tt/tc: %'llu fast-cache updates, %'llu flushes\n",
       n_fast_updates, n_fast_flushes );
+   VG_(message)(Vg_DebugMsg,
+      "    tt/tc: %'llu fast-cache evictions; slow hits: %'llu set, "
+      "%'llu victim\n",
+      n_fast_evictions, n_fast_set_hits, n_fast_victim_hits );
+   if (VG_(clo_inline_ic))
+      VG_(message)(Vg_DebugMsg,
+         "    tt/tc: %'llu inline caches primed\n", n_ic_primed );
+   VG_(message)(Vg_DebugMsg,
+      "    tt/tc: %'llu chainings, %'llu unchainings, "
+      "%'llu chain requests from discarded blocks\n",
+      n_chainings, n_unchainings, n_chainings_gone );
 
    VG_(message)(Vg_DebugMsg,
                 " transtab: new        %'lld "
@@ -2281,6 +3063,17 @@ void VG_(print_tt_tc_stats) ( void )
    VG_(message)(Vg_DebugMsg,
                 " transtab: discarded  %'llu (%'llu -> ?" "?)\n",
                 n_disc_count, n_disc_osize );
+   if (n_disc_batches > 0 || n_disc_jit_arena > 0)
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: %'llu batched discards, "
+                   "%'llu discards via JIT arena index\n",
+                   n_disc_batches, n_disc_jit_arena );
+   if (VG_(clo_smc_check) == Vg_SmcPageProtect)
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: %'llu code pages write-protected, "
+                   "%'llu write faults, %'llu pages given up\n",
+                   n_code_page_protects, n_code_write_faults,
+                   n_code_pages_dropped );
 
    if (DEBUG_TRANSTAB) {
       Int i;
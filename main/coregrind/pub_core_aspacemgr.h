@@ -203,6 +203,12 @@ extern Bool VG_(am_notify_munmap)( Addr start, SizeT len );
 extern SysRes VG_(am_do_mmap_NO_NOTIFY)
    ( Addr start, SizeT length, UInt prot, UInt flags, Int fd, Off64T offset);
 
+/* Likewise for mprotect.  The only legitimate use is by m_transtab,
+   to write-protect pages that translations were made from without
+   changing the client's view of their permissions. */
+extern SysRes VG_(am_do_mprotect_NO_NOTIFY)
+   ( Addr start, SizeT length, UInt prot );
+
 
 //--------------------------------------------------------------
 // Dealing with mappings which do not arise directly from the
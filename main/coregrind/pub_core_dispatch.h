@@ -59,12 +59,21 @@
 
    two_words holds the return values (two words).  First is
    a TRC value.  Second is generally unused, except in the case
-   where we have to return a chain-me request.
+   where we have to return a chain-me or prime-IC request.
 */
 void VG_(disp_run_translations)( HWord* two_words,
                                  void*  guest_state, 
                                  Addr   host_addr );
 
+#if defined(VGP_amd64_linux)
+/* Guest state offsets of the guest registers which generated code
+   keeps in %r15 and %r14 (see VexAbiInfo.host_amd64_guest_reg_cache),
+   or -1.  VG_(disp_run_translations) loads those host registers on
+   entry and stores them back to the guest state when it returns.
+   Set by --vex-guest-reg-cache, and fixed thereafter. */
+extern Long VG_(disp_guest_reg_cache)[2];
+#endif
+
 /* We need to know addresses of the continuation-point (cp_) labels so
    we can tell VEX what they are.  They will get baked into the code
    VEX generates.  The type is entirely mythical, but we need to
@@ -74,6 +83,13 @@ void VG_(disp_cp_chain_me_to_fastEP)(void);
 void VG_(disp_cp_xindir)(void);
 void VG_(disp_cp_xassisted)(void);
 void VG_(disp_cp_evcheck_fail)(void);
+#if defined(VGA_amd64) || defined(VGA_arm)
+/* Only on hosts for which VEX can generate inline caches. */
+void VG_(disp_cp_prime_ic)(void);
+/* Only on hosts whose dispatchers know about the shadow return
+   stack. */
+void VG_(disp_cp_xindir_rs)(void);
+#endif
 
 #endif   // __PUB_CORE_DISPATCH_H
 
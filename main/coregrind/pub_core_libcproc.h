@@ -87,6 +87,11 @@ extern void VG_(do_atfork_child)  ( ThreadId tid );
 // icache invalidation
 extern void VG_(invalidate_icache) ( void *ptr, SizeT nbytes );
 
+// A cheap, fine-grained, monotonic-ish clock for profiling short
+// intervals: the CPU cycle counter where there is a user-readable
+// one, otherwise nanoseconds.
+extern ULong VG_(read_cycle_counter) ( void );
+
 
 #endif   // __PUB_CORE_LIBCPROC_H
 
@@ -157,6 +157,10 @@ extern UChar VG_(clo_profyle_flags);
    profiling results only at the end of the run. */
 extern ULong VG_(clo_profyle_interval);
 
+/* DEBUG: time each phase of each translation, and show a report of
+   where translation time went at exit?  default: NO */
+extern Bool  VG_(clo_profile_translation);
+
 /* DEBUG: if tracing codegen, be quiet until after this bb */
 extern Int   VG_(clo_trace_notbelow);
 /* DEBUG: if tracing codegen, be quiet after this bb  */
@@ -186,6 +190,19 @@ extern enum FairSchedType VG_(clo_fair_sched);
 extern Bool  VG_(clo_trace_sched);
 /* DEBUG: do heap profiling?  default: NO */
 extern Bool  VG_(clo_profile_heap);
+/* Give indirect transfers inline caches, on hosts which support
+   them (amd64, arm)?  default: NO */
+extern Bool  VG_(clo_inline_ic);
+/* Predict guest returns with a shadow return-address stack, on
+   hosts which support it (amd64, arm)?  default: NO */
+extern Bool  VG_(clo_ret_stack);
+/* Reuse the ExeContext recorded by a thread when the registers and
+   frames it is recorded from are unchanged (x86, amd64)?
+   default: NO */
+extern Bool  VG_(clo_stack_trace_cache);
+/* DEBUG: if non-zero, unwind anyway for one stack trace cache hit in
+   this many, counting the hits which were wrong.  default: 0 */
+extern Int   VG_(clo_stack_trace_cache_check);
 #define MAX_REDZONE_SZB 128
 // Maximum for the default values for core arenas and for client
 // arena given by the tool.
@@ -287,8 +304,10 @@ typedef
       Vg_SmcStack, // generate s-c-t's for code found in stacks
                    // (this is the default)
       Vg_SmcAll,   // make all translations self-checking.
-      Vg_SmcAllNonFile // make all translations derived from
+      Vg_SmcAllNonFile, // make all translations derived from
                    // non-file-backed memory self checking
+      Vg_SmcPageProtect // as Vg_SmcStack, but write-protect the
+                   // other writable pages translations come from
    } 
    VgSmc;
 
@@ -92,6 +92,7 @@ typedef
       Bool malloc_replacement;
       Bool xml_output;
       Bool final_IR_tidy_pass;
+      Bool shadow_opt;
    } 
    VgNeeds;
 
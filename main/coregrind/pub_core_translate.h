@@ -48,6 +48,9 @@ Bool VG_(translate) ( ThreadId tid,
 
 extern void VG_(print_translation_stats) ( void );
 
+/* Show the --profile-translation report. */
+extern void VG_(print_translation_profile) ( void );
+
 #endif   // __PUB_CORE_TRANSLATE_H
 
 /*--------------------------------------------------------------------*/
@@ -48,11 +48,42 @@ typedef
    }
    FastCacheEntry;
 
-extern __attribute__((aligned(16)))
-       FastCacheEntry VG_(tt_fast) [VG_TT_FAST_SIZE];
+/* One set of the fast-cache.  way[0] is the most recently used
+   entry. */
+typedef
+   struct {
+      FastCacheEntry way[VG_TT_FAST_WAYS];
+   }
+   FastCacheSet;
+
+extern __attribute__((aligned(64)))
+       FastCacheSet VG_(tt_fast) [VG_TT_FAST_SIZE];
 
 #define TRANSTAB_BOGUS_GUEST_ADDR ((Addr)1)
 
+/* The per-thread shadow return-address stack; see
+   pub_core_transtab_asm.h for the protocol.  VG_(ret_stack_cur)
+   points at the running thread's stack and is what generated code
+   and the dispatcher use. */
+typedef
+   struct {
+      Addr guest;
+      Addr host;
+   }
+   RetStackEnt;
+
+typedef
+   struct {
+      RetStackEnt ent[VG_RET_STACK_SIZE];
+      UWord       top;
+   }
+   RetStack;
+
+extern RetStack* VG_(ret_stack_cur);
+
+/* Make VG_(ret_stack_cur) refer to tid's stack. */
+extern void VG_(select_ret_stack) ( ThreadId tid );
+
 
 /* Initialises the TC, using VG_(clo_num_transtab_sectors).
    VG_(clo_num_transtab_sectors) must be >= MIN_N_SECTORS
@@ -92,15 +123,59 @@ void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
                               UInt  to_tteNo,
                               Bool  to_fastEP );
 
+/* Prime the inline cache of the XIndir whose call to
+   VG_(disp_cp_prime_ic) is at from__patch_addr, so that it predicts
+   guest_addr. */
+extern
+void VG_(tt_tc_prime_ic) ( void* from__patch_addr, Addr64 guest_addr );
+
 extern Bool VG_(search_transtab) ( /*OUT*/AddrH* res_hcode,
                                    /*OUT*/UInt*  res_sNo,
                                    /*OUT*/UInt*  res_tteNo,
                                    Addr64        guest_addr, 
                                    Bool          upd_cache );
 
+/* Look up guest_addr in all ways of its VG_(tt_fast) set and then in
+   the victim cache of thread tid, without going near the TT proper.
+   A hit in the victim cache moves the entry back into the fast-cache.
+   This is what the scheduler tries after the dispatcher reports a
+   fast-cache miss, before resorting to VG_(search_transtab). */
+extern Bool VG_(search_fast_cache) ( /*OUT*/AddrH* res_hcode,
+                                     Addr64        guest_addr,
+                                     ThreadId      tid );
+
 extern void VG_(discard_translations) ( Addr64 start, ULong range,
                                         const HChar* who );
 
+/* Discard translations intersecting any of n ranges, given as pairs
+   (start, length) in pairs[0 .. 2*n-1], in a single pass.  n may be
+   at most VG_MAX_DISCARD_RANGES. */
+#define VG_MAX_DISCARD_RANGES (1 << 20)
+
+extern void VG_(discard_translations_many) ( UWord* pairs, Int n,
+                                             const HChar* who );
+
+/* JIT arenas: client address ranges for which an index of the
+   translations made from them is maintained, so that discards
+   confined to an arena only visit that arena's translations.
+   Registration fails if the range is empty, overlaps an existing
+   arena, or there are too many arenas already. */
+extern Bool VG_(register_jit_arena)   ( Addr64 start, ULong len );
+extern void VG_(deregister_jit_arena) ( Addr64 start );
+
+/* Support for --smc-check=page-protect.  VG_(can_write_protect_code)
+   says whether code at [a, a+len) can be protected against writes
+   rather than translated self-checking, and VG_(write_protect_code)
+   protects it, once translated.  VG_(code_write_fault) is for the
+   SIGSEGV handler: if a is in a protected page, it discards that
+   page's translations, makes it writable again and returns True.
+   VG_(unprotect_code_for_write) does the same for any protected
+   pages in [a, a+len), ahead of a write to them by the kernel. */
+extern Bool VG_(can_write_protect_code)    ( Addr a, SizeT len );
+extern void VG_(write_protect_code)        ( Addr a, SizeT len );
+extern Bool VG_(code_write_fault)          ( Addr a );
+extern void VG_(unprotect_code_for_write)  ( Addr a, SizeT len );
+
 extern void VG_(print_tt_tc_stats) ( void );
 
 extern UInt VG_(get_bbs_translated) ( void );
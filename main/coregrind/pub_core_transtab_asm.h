@@ -31,10 +31,19 @@
 #ifndef __PUB_CORE_TRANSTAB_ASM_H
 #define __PUB_CORE_TRANSTAB_ASM_H
 
-/* Constants for the fast translation lookup cache.  It is a direct
-   mapped cache, with 2^VG_TT_FAST_BITS entries.
-
-   On x86/amd64, the cache index is computed as
+/* Constants for the fast translation lookup cache.  It is a 4-way
+   set associative cache, with 2^VG_TT_FAST_BITS sets of
+   VG_TT_FAST_WAYS entries each.  Within a set, way 0 holds the most
+   recently used entry; a hit in a higher way is promoted one step
+   towards way 0, and new entries are inserted at way 0, pushing the
+   entry in the last way out.
+
+   A set is VG_TT_FAST_WAYS FastCacheEntrys laid out back to back, so
+   it is 32 bytes on 32-bit hosts and 64 bytes (one cache line on
+   most hosts) on 64-bit hosts.  VG_TT_FAST_SET_SHIFT is log2 of
+   that size, for use by the dispatchers.
+
+   On x86/amd64, the set index is computed as
    'address[VG_TT_FAST_BITS-1 : 0]'.
 
    On ppc32/ppc64, the bottom two bits of instruction addresses are
@@ -47,12 +56,52 @@
    into account all but the least significant bit.
 
    On s390x the rightmost bit of an instruction address is zero.
-   For best table utilization shift the address to the right by 1 bit. */
+   For best table utilization shift the address to the right by 1 bit.
+
+   The x86, amd64 and arm dispatchers probe all ways of the set
+   inline.  The other dispatchers only probe way 0 and leave the
+   remaining ways to VG_(search_fast_cache), which the scheduler
+   consults before doing a full VG_(search_transtab). */
 
-#define VG_TT_FAST_BITS 15
+#define VG_TT_FAST_WAYS 4
+#define VG_TT_FAST_BITS 13
 #define VG_TT_FAST_SIZE (1 << VG_TT_FAST_BITS)
 #define VG_TT_FAST_MASK ((VG_TT_FAST_SIZE) - 1)
 
+#if defined(VGA_x86) || defined(VGA_arm) || defined(VGA_ppc32) \
+    || defined(VGA_mips32)
+#  define VG_TT_FAST_SET_SHIFT 5
+#else
+#  define VG_TT_FAST_SET_SHIFT 6
+#endif
+
+/* Shadow return-address stack (--ret-stack=yes).  Each thread has a
+   ring of VG_RET_STACK_SIZE {guest, host} pairs followed by a
+   free-running .top counter; the live entry is .ent[.top & MASK].
+   Translations ending in Ijk_Call push the return address together
+   with whatever VG_(tt_fast) currently holds for it in way 0;
+   translations ending in Ijk_Ret pop.  VG_(disp_cp_xindir_rs) then
+   compares the popped entry's .guest with the real target and, if
+   they agree, jumps straight to its .host, avoiding the fast-cache
+   probe.  The prediction is only a hint: a stale or mismatched entry
+   simply falls through to the normal VG_(disp_cp_xindir) lookup.
+   VG_RET_STACK_ENT_SHIFT is log2(sizeof(RetStackEnt)). */
+
+#define VG_RET_STACK_BITS 4
+#define VG_RET_STACK_SIZE (1 << VG_RET_STACK_BITS)
+#define VG_RET_STACK_MASK ((VG_RET_STACK_SIZE) - 1)
+
+#if defined(VGA_x86) || defined(VGA_arm) || defined(VGA_ppc32) \
+    || defined(VGA_mips32)
+#  define VG_RET_STACK_ENT_SHIFT 3
+#else
+#  define VG_RET_STACK_ENT_SHIFT 4
+#endif
+
+/* Byte offset of .top within a RetStack. */
+#define VG_RET_STACK_TOP_OFFSET \
+   ((VG_RET_STACK_SIZE) << (VG_RET_STACK_ENT_SHIFT))
+
 /* This macro isn't usable in asm land; nevertheless this seems
    like a good place to put it. */
 
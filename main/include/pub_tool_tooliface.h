@@ -482,6 +482,13 @@ extern void VG_(needs_xml_output) ( void );
    function here. */
 extern void VG_(needs_final_IR_tidy_pass) ( IRSB*(*final_tidy)(IRSB*) );
 
+/* Does the tool's instrumentation keep shadow values in the shadow
+   guest state?  If so, VEX runs an extra optimisation pass over the
+   instrumented code: CSE over the whole superblock, and removal of
+   shadow PUTs that are overwritten before being read.  This may be
+   called from the tool's post_clo_init function. */
+extern void VG_(needs_shadow_opt) ( void );
+
 
 /* ------------------------------------------------------------------ */
 /* Core events to track */
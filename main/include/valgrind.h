@@ -5009,7 +5009,12 @@ typedef
           VG_USERREQ__CHANGE_ERR_DISABLEMENT = 0x1801,
 
           /* Initialise IR injection */
-          VG_USERREQ__VEX_INIT_FOR_IRI = 0x1901
+          VG_USERREQ__VEX_INIT_FOR_IRI = 0x1901,
+
+          /* Code cache management for JIT compilers. */
+          VG_USERREQ__DISCARD_TRANSLATIONS_MANY = 0x1a01,
+          VG_USERREQ__JIT_ARENA_REGISTER        = 0x1a02,
+          VG_USERREQ__JIT_ARENA_DEREGISTER      = 0x1a03
    } Vg_ClientRequest;
 
 #if !defined(__GNUC__)
@@ -5035,6 +5040,35 @@ typedef
     VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__DISCARD_TRANSLATIONS,  \
                                     _qzz_addr, _qzz_len, 0, 0, 0)
 
+/* Discard translations of code in several ranges at once.  _qzz_ranges
+   points at _qzz_n pairs of words, each an address followed by a
+   length, for example an array of
+      struct { void* addr; unsigned long len; }.
+   Equivalent to calling VALGRIND_DISCARD_TRANSLATIONS on each pair,
+   but much cheaper when a JIT frees many small pieces of code at
+   once.  _qzz_n may be at most 1048576; the request is ignored, with
+   a warning, if it is larger or the ranges are not readable.  Returns
+   no value. */
+#define VALGRIND_DISCARD_TRANSLATIONS_MANY(_qzz_ranges,_qzz_n)         \
+    VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__DISCARD_TRANSLATIONS_MANY, \
+                                    _qzz_ranges, _qzz_n, 0, 0, 0)
+
+/* Tell Valgrind that [_qzz_addr .. _qzz_addr + _qzz_len - 1] is a
+   JIT code arena.  Valgrind then keeps an index of the translations
+   made from that range, so that discards inside it need not inspect
+   every translation.  Arenas may not overlap.  Returns 1 if the
+   arena was registered, 0 otherwise (and when running natively). */
+#define VALGRIND_JIT_ARENA_REGISTER(_qzz_addr,_qzz_len)                \
+    (unsigned)VALGRIND_DO_CLIENT_REQUEST_EXPR(0,                       \
+                                    VG_USERREQ__JIT_ARENA_REGISTER,    \
+                                    _qzz_addr, _qzz_len, 0, 0, 0)
+
+/* Forget the JIT code arena starting at _qzz_addr.  Translations
+   made from it are not discarded.  Returns no value. */
+#define VALGRIND_JIT_ARENA_DEREGISTER(_qzz_addr)                       \
+    VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__JIT_ARENA_DEREGISTER,  \
+                                    _qzz_addr, 0, 0, 0, 0)
+
 
 /* These requests are for getting Valgrind itself to print something.
    Possibly with a backtrace.  This is a really ugly hack.  The return value
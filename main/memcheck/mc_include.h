@@ -377,6 +377,11 @@ extern HChar * MC_(snprintf_delta) (HChar * buf, Int size,
 Bool MC_(is_valid_aligned_word)     ( Addr a );
 Bool MC_(is_within_valid_secondary) ( Addr a );
 
+// For --leak-check-incremental: may the 64k chunk of address space
+// containing a have changed since the last MC_(clear_lc_changed)?
+Bool MC_(lc_changed)       ( Addr a );
+void MC_(clear_lc_changed) ( void );
+
 // Prints as user msg a description of the given loss record.
 void MC_(pp_LossRecord)(UInt n_this_record, UInt n_total_records,
                         LossRecord* l);
@@ -535,6 +540,16 @@ typedef
    Default : no heuristic. */
 extern UInt MC_(clo_leak_check_heuristics);
 
+/* Reuse, in a leak search, the root-set scan results of memory that
+   has not changed since the previous leak search?  default: NO */
+extern Bool MC_(clo_leak_check_incremental);
+
+/* Run Vex's post-instrumentation shadow state optimiser (block-wide
+   CSE and dead shadow PUT removal)?  It removes about 6% of the
+   statements of instrumented blocks but has not been shown to make
+   Memcheck faster.  default: NO */
+extern Bool MC_(clo_shadow_opt);
+
 /* Assume accesses immediately below %esp are due to gcc-2.96 bugs.
  * default: NO */
 extern Bool MC_(clo_workaround_gcc296_bugs);
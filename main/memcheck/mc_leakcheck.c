@@ -46,6 +46,7 @@
 #include "pub_tool_signals.h"       // Needed for mc_include.h
 #include "pub_tool_libcsetjmp.h"    // setjmp facilities
 #include "pub_tool_tooliface.h"     // Needed for mc_include.h
+#include "pub_tool_xarray.h"
 
 #include "mc_include.h"
 
@@ -496,6 +497,36 @@ static SizeT lc_scanned_szB;
 // caused a signal such as SIGSEGV.
 static SizeT lc_sig_skipped_szB;
 
+// Root-set scan results kept from one leak search to the next, for
+// --leak-check-incremental=yes.  The root-set scan is split at 64k
+// boundaries, which is the granularity at which mc_main.c tracks
+// changes (see MC_(lc_changed)).  For each piece, we keep the values
+// of its valid aligned words that lie in [lc_cache_lo, lc_cache_hi[,
+// a widened copy of the address span of the heap blocks.  While the
+// piece is unchanged and the heap blocks stay within that span, a
+// leak search pushes the kept values instead of rescanning the piece:
+// values outside the span cannot point to any block, and the values
+// inside it are checked against the current blocks as usual.
+typedef
+   struct _LC_RootCache {
+      struct _LC_RootCache* next;
+      Addr    key;          // Start of the piece.
+      SizeT   len;          // Length of the piece.
+      UInt    gen;          // MC_(leak_search_gen) of its last use.
+      SizeT   scanned_szB;  // Bytes of valid words found in the piece.
+      XArray* vals;         // Kept values (Addr), in address order.
+   }
+   LC_RootCache;
+
+static VgHashTable lc_root_caches = NULL;
+static Addr        lc_cache_lo;
+static Addr        lc_cache_hi;
+// Bytes of the root set not rescanned thanks to lc_root_caches.
+static SizeT       lc_reused_szB;
+// When not NULL, lc_scan_memory appends the values in
+// [lc_cache_lo, lc_cache_hi[ to this array, instead of pushing them.
+static XArray*     lc_collect = NULL;
+
 
 SizeT MC_(bytes_leaked)     = 0;
 SizeT MC_(bytes_indirect)   = 0;
@@ -516,6 +547,144 @@ static SizeT MC_(bytes_heuristically_reachable)[N_LEAK_CHECK_HEURISTICS]
 static SizeT MC_(blocks_heuristically_reachable)[N_LEAK_CHECK_HEURISTICS]
                                                 = {0,0,0,0};
 
+// Search structures built from lc_chunks once per leak search, so that
+// the many words scanned can be checked cheaply.
+//
+// lc_chunk_filter has one bit per (1 << lc_chunk_filter_shift) bytes of
+// [lc_chunk_filter_lo, lc_chunk_filter_hi[, set if some block overlaps
+// these bytes.  Most scanned words do not point into the heap at all,
+// and are rejected with a single load.
+//
+// lc_eytz holds the start addresses of lc_chunks in Eytzinger order
+// (the breadth-first order of the implicit binary search tree, with the
+// root at index 1), and lc_eytz_idx[k] is the lc_chunks index of
+// lc_eytz[k].  Searching walks down a contiguous array whose top levels
+// stay in the cache, rather than dereferencing an MC_Chunk at each step.
+static UChar* lc_chunk_filter;
+static Addr   lc_chunk_filter_lo;
+static Addr   lc_chunk_filter_hi;
+static UInt   lc_chunk_filter_shift;
+static Addr*  lc_eytz;
+static Int*   lc_eytz_idx;
+
+// Filter granularity is at least 64k, and coarser if needed to keep
+// lc_chunk_filter below 1Mb.
+#define LC_FILTER_MIN_SHIFT 16
+#define LC_FILTER_MAX_BITS  (8 * 1024 * 1024)
+
+static void lc_free_chunk_index(void)
+{
+   if (lc_chunk_filter) {
+      VG_(free)(lc_chunk_filter);
+      lc_chunk_filter = NULL;
+   }
+   if (lc_eytz) {
+      VG_(free)(lc_eytz);
+      VG_(free)(lc_eytz_idx);
+      lc_eytz = NULL;
+      lc_eytz_idx = NULL;
+   }
+   lc_chunk_filter_lo = lc_chunk_filter_hi = 0;
+}
+
+// Fill the subtree of lc_eytz rooted at k with lc_chunks[i ..], in
+// order.  Returns the index of the first chunk not used.
+static Int lc_fill_eytz(Int i, UWord k)
+{
+   if (k <= (UWord)lc_n_chunks) {
+      i = lc_fill_eytz(i, 2*k);
+      lc_eytz[k] = lc_chunks[i]->data;
+      lc_eytz_idx[k] = i;
+      i++;
+      i = lc_fill_eytz(i, 2*k+1);
+   }
+   return i;
+}
+
+// Build lc_chunk_filter and lc_eytz from the sorted, non overlapping
+// lc_chunks.
+static void lc_build_chunk_index(void)
+{
+   Int   i;
+   Addr  lo, hi;
+   UWord n_bits;
+
+   lc_free_chunk_index();
+   tl_assert(lc_n_chunks > 0);
+
+   // A zero-sized block is treated as if it had size 1, as in
+   // find_chunk_for.
+   lo = lc_chunks[0]->data;
+   hi = lo;
+   for (i = 0; i < lc_n_chunks; i++) {
+      MC_Chunk* ch = lc_chunks[i];
+      Addr end = ch->data + (ch->szB == 0 ? 1 : ch->szB);
+      if (end > hi)
+         hi = end;
+   }
+
+   lc_chunk_filter_shift = LC_FILTER_MIN_SHIFT;
+   while (((hi - 1 - lo) >> lc_chunk_filter_shift) >= LC_FILTER_MAX_BITS)
+      lc_chunk_filter_shift++;
+   n_bits = ((hi - 1 - lo) >> lc_chunk_filter_shift) + 1;
+   lc_chunk_filter = VG_(calloc)("mc.lbci.1", (n_bits + 7) / 8, 1);
+   lc_chunk_filter_lo = lo;
+   lc_chunk_filter_hi = hi;
+   for (i = 0; i < lc_n_chunks; i++) {
+      MC_Chunk* ch = lc_chunks[i];
+      UWord b    = (ch->data - lo) >> lc_chunk_filter_shift;
+      UWord last = (ch->data + (ch->szB == 0 ? 1 : ch->szB) - 1 - lo)
+                   >> lc_chunk_filter_shift;
+      for (; b <= last; b++)
+         lc_chunk_filter[b >> 3] |= (UChar)(1 << (b & 7));
+   }
+
+   lc_eytz     = VG_(malloc)("mc.lbci.2", (lc_n_chunks + 1) * sizeof(Addr));
+   lc_eytz_idx = VG_(malloc)("mc.lbci.3", (lc_n_chunks + 1) * sizeof(Int));
+   i = lc_fill_eytz(0, 1);
+   tl_assert(i == lc_n_chunks);
+}
+
+// Cheap test done before anything else: False if ptr can definitely not
+// point at or inside any block of lc_chunks.
+static Bool lc_might_be_a_chunk_ptr(Addr ptr)
+{
+   UWord b;
+   if (ptr < lc_chunk_filter_lo || ptr >= lc_chunk_filter_hi)
+      return False;
+   b = (ptr - lc_chunk_filter_lo) >> lc_chunk_filter_shift;
+   return (lc_chunk_filter[b >> 3] >> (b & 7)) & 1;
+}
+
+// Same as find_chunk_for(ptr, lc_chunks, lc_n_chunks), using lc_eytz.
+static Int lc_find_chunk_for(Addr ptr)
+{
+   UWord k = 1;
+   Int   i;
+   MC_Chunk* ch;
+
+   // Walk down the tree, going right when the start is <= ptr.  At the
+   // end, dropping the trailing right moves and the last left move of
+   // the path gives the node of the first start > ptr (0 if none).
+   while (k <= (UWord)lc_n_chunks)
+      k = 2*k + (lc_eytz[k] <= ptr);
+   while (k & 1)
+      k >>= 1;
+   k >>= 1;
+
+   i = (k == 0 ? lc_n_chunks : lc_eytz_idx[k]) - 1;
+   if (i >= 0) {
+      ch = lc_chunks[i];
+      if (ptr >= ch->data + (ch->szB == 0 ? 1 : ch->szB))
+         i = -1;
+   }
+
+#  if VG_DEBUG_LEAKCHECK
+   tl_assert(i == find_chunk_for(ptr, lc_chunks, lc_n_chunks));
+#  endif
+   return i;
+}
+
 // Determines if a pointer is to a chunk.  Returns the chunk number et al
 // via call-by-reference.
 static Bool
@@ -525,6 +694,9 @@ lc_is_a_chunk_ptr(Addr ptr, Int* pch_no, MC_Chunk** pch, LC_Extra** pex)
    MC_Chunk* ch;
    LC_Extra* ex;
 
+   if (!lc_might_be_a_chunk_ptr(ptr))
+      return False;
+
    // Quick filter. Note: implemented with am, not with get_vabits2
    // as ptr might be random data pointing anywhere. On 64 bit
    // platforms, getting va bits for random data can be quite costly
@@ -532,7 +704,7 @@ lc_is_a_chunk_ptr(Addr ptr, Int* pch_no, MC_Chunk** pch, LC_Extra** pex)
    if (!VG_(am_is_valid_for_client)(ptr, 1, VKI_PROT_READ)) {
       return False;
    } else {
-      ch_no = find_chunk_for(ptr, lc_chunks, lc_n_chunks);
+      ch_no = lc_find_chunk_for(ptr);
       tl_assert(ch_no >= -1 && ch_no < lc_n_chunks);
 
       if (ch_no == -1) {
@@ -899,6 +1071,20 @@ lc_push_if_a_chunk_ptr(Addr ptr,
 static VG_MINIMAL_JMP_BUF(memscan_jmpbuf);
 static volatile Addr bad_scanned_addr;
 
+// The signal mask to restore after a read error has been caught (we
+// leave the fault catcher by longjmp, with the handler's mask still
+// in force).  It is obtained once per leak search or pointer search,
+// by lc_scan_start, rather than in each lc_scan_memory call: the
+// mark stack processing scans every reachable block separately, and
+// a sigprocmask syscall per block dominated the time spent marking
+// heaps made of many small blocks.
+static vki_sigset_t lc_scan_sigmask;
+
+static void lc_scan_start(void)
+{
+   VG_(sigprocmask)(VKI_SIG_SETMASK, NULL, &lc_scan_sigmask);
+}
+
 static
 void scan_all_valid_memory_catcher ( Int sigNo, Addr addr )
 {
@@ -956,12 +1142,13 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
 #endif
    Addr ptr = VG_ROUNDUP(start, sizeof(Addr));
    const Addr end = VG_ROUNDDN(start+len, sizeof(Addr));
-   vki_sigset_t sigmask;
 
    if (VG_DEBUG_LEAKCHECK)
       VG_(printf)("scan %#lx-%#lx (%lu)\n", start, end, len);
 
-   VG_(sigprocmask)(VKI_SIG_SETMASK, NULL, &sigmask);
+   if (ptr >= end)
+      return;
+
    VG_(set_fault_catcher)(scan_all_valid_memory_catcher);
 
    /* Optimisation: the loop below will check for each begin
@@ -1001,7 +1188,7 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
       // Catch read error ...
       // We need to restore the signal mask, because we were
       // longjmped out of a signal handler.
-      VG_(sigprocmask)(VKI_SIG_SETMASK, &sigmask, NULL);
+      VG_(sigprocmask)(VKI_SIG_SETMASK, &lc_scan_sigmask, NULL);
 #     if defined(VGA_s390x)
       // For a SIGSEGV, s390 delivers the page address of the bad address.
       // For a SIGBUS, old s390 kernels deliver a NULL address.
@@ -1073,6 +1260,9 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
                   }
                }
             }
+         } else if (UNLIKELY(lc_collect != NULL)) {
+            if (addr >= lc_cache_lo && addr < lc_cache_hi)
+               VG_(addToXA)(lc_collect, &addr);
          } else {
             lc_push_if_a_chunk_ptr(addr, clique, cur_clique, is_prior_definite);
          }
@@ -1082,7 +1272,6 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
       ptr += sizeof(Addr);
    }
 
-   VG_(sigprocmask)(VKI_SIG_SETMASK, &sigmask, NULL);
    VG_(set_fault_catcher)(NULL);
 }
 
@@ -1574,6 +1763,97 @@ Bool MC_(print_block_list) ( UInt loss_record_nr)
    return True;
 }
 
+static void lc_free_root_cache(void* p)
+{
+   LC_RootCache* rc = p;
+   VG_(deleteXA)(rc->vals);
+   VG_(free)(rc);
+}
+
+// Called before the root-set scan of a leak search, once lc_chunks is
+// sorted.  Discards all the kept results if the heap blocks no longer
+// fit in the span they were filtered with.
+static void lc_root_caches_start(void)
+{
+   MC_Chunk* last = lc_chunks[lc_n_chunks-1];
+   Addr lo = lc_chunks[0]->data;
+   Addr hi = last->data + last->szB + 1;
+   SizeT slack;
+
+   if (lc_root_caches == NULL)
+      lc_root_caches = VG_(HT_construct)("mc.lrcs.1");
+
+   if (lo >= lc_cache_lo && hi <= lc_cache_hi)
+      return;
+
+   VG_(HT_destruct)(lc_root_caches, lc_free_root_cache);
+   lc_root_caches = VG_(HT_construct)("mc.lrcs.1");
+   // Leave room for the heap to grow a bit before everything has
+   // to be rescanned again.
+   slack = (hi - lo) / 4 + 1024 * 1024;
+   lc_cache_lo = lo > slack ? lo - slack : 0;
+   lc_cache_hi = hi + slack > hi ? hi + slack : ~(Addr)0;
+}
+
+// Called after the root-set scan of a leak search: discards the results
+// of pieces which are no longer part of the root set, and starts
+// tracking changes afresh.
+static void lc_root_caches_end(void)
+{
+   UInt i, n;
+   VgHashNode** nodes = VG_(HT_to_array)(lc_root_caches, &n);
+
+   for (i = 0; i < n; i++) {
+      LC_RootCache* rc = (LC_RootCache*)nodes[i];
+      if (rc->gen != MC_(leak_search_gen)) {
+         VG_(HT_remove)(lc_root_caches, rc->key);
+         lc_free_root_cache(rc);
+      }
+   }
+   VG_(free)(nodes);
+   MC_(clear_lc_changed)();
+}
+
+// Scan the root-set piece [start, start+len[, which does not cross a
+// 64k boundary, reusing the values kept from the previous leak search
+// if the piece has not changed since.
+static void lc_scan_root_piece(Addr start, SizeT len)
+{
+   LC_RootCache* rc = VG_(HT_lookup)(lc_root_caches, start);
+   Word i, n;
+
+   if (rc != NULL && (rc->len != len || MC_(lc_changed)(start))) {
+      VG_(HT_remove)(lc_root_caches, start);
+      lc_free_root_cache(rc);
+      rc = NULL;
+   }
+
+   if (rc == NULL) {
+      SizeT scanned_before = lc_scanned_szB;
+      rc = VG_(malloc)("mc.lsrp.1", sizeof(LC_RootCache));
+      rc->key  = start;
+      rc->len  = len;
+      rc->vals = VG_(newXA)(VG_(malloc), "mc.lsrp.2", VG_(free),
+                            sizeof(Addr));
+      lc_collect = rc->vals;
+      lc_scan_memory(start, len, /*is_prior_definite*/True,
+                     /*clique*/-1, /*cur_clique*/-1,
+                     /*searched*/0, 0);
+      lc_collect = NULL;
+      rc->scanned_szB = lc_scanned_szB - scanned_before;
+      VG_(HT_add_node)(lc_root_caches, rc);
+   } else {
+      lc_reused_szB += rc->scanned_szB;
+   }
+   rc->gen = MC_(leak_search_gen);
+
+   n = VG_(sizeXA)(rc->vals);
+   for (i = 0; i < n; i++)
+      lc_push_if_a_chunk_ptr(*(Addr*)VG_(indexXA)(rc->vals, i),
+                             /*clique*/-1, /*cur_clique*/-1,
+                             /*is_prior_definite*/True);
+}
+
 // If searched = 0, scan memory root set, pushing onto the mark stack the blocks
 // encountered.
 // Otherwise (searched != 0), scan the memory root set searching for ptr
@@ -1588,6 +1868,7 @@ static void scan_memory_root_set(Addr searched, SizeT szB)
 
    lc_scanned_szB = 0;
    lc_sig_skipped_szB = 0;
+   lc_reused_szB = 0;
 
    // VG_(am_show_nsegments)( 0, "leakcheck");
    for (i = 0; i < n_seg_starts; i++) {
@@ -1624,9 +1905,22 @@ static void scan_memory_root_set(Addr searched, SizeT szB)
                       "  Scanning root segment: %#lx..%#lx (%lu)\n",
                       seg->start, seg->end, seg_size);
       }
-      lc_scan_memory(seg->start, seg_size, /*is_prior_definite*/True,
-                     /*clique*/-1, /*cur_clique*/-1,
-                     searched, szB);
+      if (MC_(clo_leak_check_incremental) && searched == 0) {
+         Addr a = seg->start;
+         for (;;) {
+            Addr piece_end = VG_ROUNDDN(a, SM_SIZE) + SM_SIZE - 1;
+            if (piece_end > seg->end || piece_end < a)
+               piece_end = seg->end;
+            lc_scan_root_piece(a, piece_end - a + 1);
+            if (piece_end == seg->end)
+               break;
+            a = piece_end + 1;
+         }
+      } else {
+         lc_scan_memory(seg->start, seg_size, /*is_prior_definite*/True,
+                        /*clique*/-1, /*cur_clique*/-1,
+                        searched, szB);
+      }
    }
    VG_(free)(seg_starts);
 }
@@ -1659,6 +1953,7 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
       VG_(free)(lc_chunks);
       lc_chunks = NULL;
    }
+   lc_free_chunk_index();
    lc_chunks = find_active_chunks(&lc_n_chunks);
    lc_chunks_n_frees_marker = MC_(get_cmalloc_n_frees)();
    if (lc_n_chunks == 0) {
@@ -1750,6 +2045,8 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
       }
    }
 
+   lc_build_chunk_index();
+
    // Initialise lc_extras.
    if (lc_extras) {
       VG_(free)(lc_extras);
@@ -1778,7 +2075,12 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
 
    // Scan the memory root-set, pushing onto the mark stack any blocks
    // pointed to.
+   lc_scan_start();
+   if (MC_(clo_leak_check_incremental))
+      lc_root_caches_start();
    scan_memory_root_set(/*searched*/0, 0);
+   if (MC_(clo_leak_check_incremental))
+      lc_root_caches_end();
 
    // Scan GP registers for chunk pointers.
    VG_(apply_to_GP_regs)(lc_push_if_a_chunk_ptr_register);
@@ -1789,6 +2091,9 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
 
    if (VG_(clo_verbosity) > 1 && !VG_(clo_xml)) {
       VG_(umsg)("Checked %'lu bytes\n", lc_scanned_szB);
+      if (lc_reused_szB > 0)
+         VG_(umsg)("Reused the previous search results for %'lu bytes\n",
+                   lc_reused_szB);
       if (lc_sig_skipped_szB > 0)
          VG_(umsg)("Skipped %'lu bytes due to read errors\n",
                    lc_sig_skipped_szB);
@@ -1868,6 +2173,7 @@ void MC_(who_points_at) ( Addr address, SizeT szB)
    chunks = find_active_chunks(&n_chunks);
 
    // Scan memory root-set, searching for ptr pointing in address[szB]
+   lc_scan_start();
    scan_memory_root_set(address, szB);
 
    // Scan active malloc-ed chunks
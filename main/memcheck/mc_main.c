@@ -318,6 +318,7 @@ static Int   max_noaccess_SMs  = 0;
 static Int   max_undefined_SMs = 0;
 static Int   max_defined_SMs   = 0;
 static Int   max_non_DSM_SMs   = 0;
+static Int   n_redistinguished_SMs = 0;
 
 /* # searches initiated in auxmap_L1, and # base cmps required */
 static ULong n_auxmap_L1_searches  = 0;
@@ -623,9 +624,59 @@ static INLINE SecMap* get_secmap_for_reading_high ( Addr a )
    return *get_secmap_high_ptr(a);
 }
 
+/* --------------- Leak check change tracking --------------- */
+
+/* With --leak-check-incremental=yes, one bit per 64k chunk of the
+   primary map records whether anything in that chunk -- contents or
+   V+A bits -- may have changed since the leak checker last called
+   MC_(clear_lc_changed).  Every client store goes through a STOREV
+   helper, and every other change (syscall results, mmap, munmap,
+   mprotect, realloc copies) goes through set_address_range_perms or
+   get_secmap_for_writing, so those are the places that set the bits.
+   Addresses above MAX_PRIMARY_ADDRESS are not tracked, and are always
+   reported as changed. */
+static UChar lc_changed_map[N_PRIMARY_MAP / 8];
+
+static INLINE void mark_lc_changed ( Addr a )
+{
+   if (LIKELY(a <= MAX_PRIMARY_ADDRESS)) {
+      UWord pm_off = a >> 16;
+      lc_changed_map[pm_off >> 3] |= (UChar)(1 << (pm_off & 7));
+   }
+}
+
+static void mark_lc_changed_range ( Addr a, SizeT len )
+{
+   UWord pm_off, pm_last;
+   if (len == 0 || a > MAX_PRIMARY_ADDRESS)
+      return;
+   pm_off  = a >> 16;
+   pm_last = (a + len - 1 < a || a + len - 1 > MAX_PRIMARY_ADDRESS)
+             ? N_PRIMARY_MAP - 1
+             : (a + len - 1) >> 16;
+   for (; pm_off <= pm_last; pm_off++)
+      lc_changed_map[pm_off >> 3] |= (UChar)(1 << (pm_off & 7));
+}
+
+Bool MC_(lc_changed) ( Addr a )
+{
+   UWord pm_off;
+   if (a > MAX_PRIMARY_ADDRESS)
+      return True;
+   pm_off = a >> 16;
+   return (lc_changed_map[pm_off >> 3] >> (pm_off & 7)) & 1;
+}
+
+void MC_(clear_lc_changed) ( void )
+{
+   VG_(memset)(lc_changed_map, 0, sizeof(lc_changed_map));
+}
+
 static INLINE SecMap* get_secmap_for_writing_low(Addr a)
 {
    SecMap** p = get_secmap_low_ptr(a);
+   if (UNLIKELY(MC_(clo_leak_check_incremental)))
+      mark_lc_changed(a);
    if (UNLIKELY(is_distinguished_sm(*p)))
       *p = copy_for_writing(*p);
    return *p;
@@ -1477,10 +1528,51 @@ void mc_STOREVn_slow ( Addr a, SizeT nBits, ULong vbytes, Bool bigendian )
 /*--- Setting permissions over address ranges.             ---*/
 /*------------------------------------------------------------*/
 
+/* Set the V+A bits for [a, a+len) within the non-distinguished
+   secondary 'sm' to vabits16.  'a' must be 8-aligned and 'len' a
+   multiple of 8.  Since every byte of the range gets the same V+A
+   bits, this is a fill of len/4 bytes of sm->vabits8; once the
+   destination is word-aligned, it is done a word (32 or 64 client
+   bytes) at a time, unrolled by four. */
+static INLINE void fill_vabits8 ( SecMap* sm, Addr a, SizeT len,
+                                  UWord vabits16 )
+{
+   UShort* p16   = &((UShort*)(sm->vabits8))[SM_OFF_16(a)];
+   SizeT   n16   = len >> 3;
+   UWord   wfill = (vabits16 & 0xFF) * (~(UWord)0 / 0xFF);
+   UWord*  pW;
+   SizeT   nW;
+
+   while (n16 > 0 && !VG_IS_WORD_ALIGNED(p16)) {
+      *p16++ = vabits16;
+      n16--;
+   }
+   pW = (UWord*)p16;
+   nW = n16 / (sizeof(UWord) / 2);
+   n16 -= nW * (sizeof(UWord) / 2);
+   while (nW >= 4) {
+      pW[0] = wfill;
+      pW[1] = wfill;
+      pW[2] = wfill;
+      pW[3] = wfill;
+      pW += 4;
+      nW -= 4;
+   }
+   while (nW > 0) {
+      *pW++ = wfill;
+      nW--;
+   }
+   p16 = (UShort*)pW;
+   while (n16 > 0) {
+      *p16++ = vabits16;
+      n16--;
+   }
+}
+
 static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
                                       UWord dsm_num )
 {
-   UWord    sm_off, sm_off16;
+   UWord    sm_off;
    UWord    vabits2 = vabits16 & 0x3;
    SizeT    lenA, lenB, len_to_next_secmap;
    Addr     aNext;
@@ -1502,6 +1594,9 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
    if (lenT == 0)
       return;
 
+   if (UNLIKELY(MC_(clo_leak_check_incremental)))
+      mark_lc_changed_range(a, lenT);
+
    if (lenT > 256 * 1024 * 1024) {
       if (VG_(clo_verbosity) > 0 && !VG_(clo_xml)) {
          const HChar* s = "unknown???";
@@ -1564,7 +1659,8 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
    // sec-map (lenA), and the rest (lenB);   lenT == lenA + lenB.
    aNext = start_of_this_sm(a) + SM_SIZE;
    len_to_next_secmap = aNext - a;
-   if ( lenT <= len_to_next_secmap ) {
+   if ( lenT < len_to_next_secmap
+        || (lenT == len_to_next_secmap && !is_start_of_sm(a)) ) {
       // Range entirely within one sec-map.  Covers almost all cases.
       PROF_EVENT(151, "set_address_range_perms-single-secmap");
       lenA = lenT;
@@ -1616,13 +1712,11 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       lenA -= 1;
    }
    // 8-aligned, 8 byte steps
-   while (True) {
-      if (lenA < 8) break;
+   if (lenA >= 8) {
       PROF_EVENT(157, "set_address_range_perms-loop8a");
-      sm_off16 = SM_OFF_16(a);
-      ((UShort*)(sm->vabits8))[sm_off16] = vabits16;
-      a    += 8;
-      lenA -= 8;
+      fill_vabits8( sm, a, lenA & ~(SizeT)7, vabits16 );
+      a    += lenA & ~(SizeT)7;
+      lenA &= 7;
    }
    // 1 byte steps
    while (True) {
@@ -1689,13 +1783,11 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
    sm = *sm_ptr;
 
    // 8-aligned, 8 byte steps
-   while (True) {
-      if (lenB < 8) break;
+   if (lenB >= 8) {
       PROF_EVENT(163, "set_address_range_perms-loop8b");
-      sm_off16 = SM_OFF_16(a);
-      ((UShort*)(sm->vabits8))[sm_off16] = vabits16;
-      a    += 8;
-      lenB -= 8;
+      fill_vabits8( sm, a, lenB & ~(SizeT)7, vabits16 );
+      a    += lenB & ~(SizeT)7;
+      lenB &= 7;
    }
    // 1 byte steps
    while (True) {
@@ -1709,6 +1801,69 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
 }
 
 
+/* --- Returning uniform secondaries to the distinguished ones --- */
+
+/* A secondary covering memory that is mapped, protected and unmapped
+   piecemeal -- a shared object's segments, or a file mapped a few
+   pages at a time -- is copied for writing as soon as part of it is
+   painted, and stays a private copy even once later paints have made
+   it uniform again.  maybe_redistinguish_sm checks whether the
+   secondary holding 'a' is a non-distinguished one whose V+A bits are
+   all the same, and if so installs the matching distinguished
+   secondary and frees the copy.  The check reads up to 16k of V+A
+   bits, so it is only made for the first and last secondaries of
+   mmap, mprotect and munmap ranges.  The secondaries in between were
+   whole ones, and set_address_range_perms has already made them
+   distinguished. */
+static void maybe_redistinguish_sm ( Addr a )
+{
+   SecMap** sm_ptr;
+   SecMap*  sm;
+   SecMap*  dsm;
+   UWord*   w;
+   UWord    w0, i;
+   SysRes   sres;
+
+   if (a > MAX_PRIMARY_ADDRESS && maybe_find_in_auxmap(a) == NULL)
+      return;
+   sm_ptr = get_secmap_ptr(a);
+   sm     = *sm_ptr;
+   if (is_distinguished_sm(sm))
+      return;
+
+   w  = (UWord*)(sm->vabits8);
+   w0 = w[0];
+   if (w0 == (UWord)VA_BITS8_NOACCESS * (~(UWord)0 / 0xFF))
+      dsm = &sm_distinguished[SM_DIST_NOACCESS];
+   else if (w0 == (UWord)VA_BITS8_UNDEFINED * (~(UWord)0 / 0xFF))
+      dsm = &sm_distinguished[SM_DIST_UNDEFINED];
+   else if (w0 == (UWord)VA_BITS8_DEFINED * (~(UWord)0 / 0xFF))
+      dsm = &sm_distinguished[SM_DIST_DEFINED];
+   else
+      return;
+   for (i = 1; i < SM_CHUNKS / sizeof(UWord); i++) {
+      if (w[i] != w0)
+         return;
+   }
+
+   PROF_EVENT(165, "maybe_redistinguish_sm-freed");
+   update_SM_counts(sm, dsm);
+   *sm_ptr = dsm;
+   n_redistinguished_SMs++;
+   sres = VG_(am_munmap_valgrind)((Addr)sm, sizeof(SecMap));
+   tl_assert2(! sr_isError(sres), "SecMap valgrind munmap failure\n");
+}
+
+static void maybe_redistinguish_range ( Addr a, SizeT len )
+{
+   if (len == 0)
+      return;
+   maybe_redistinguish_sm(a);
+   if (start_of_this_sm(a + len - 1) != start_of_this_sm(a))
+      maybe_redistinguish_sm(a + len - 1);
+}
+
+
 /* --- Set permissions for arbitrary address ranges --- */
 
 void MC_(make_mem_noaccess) ( Addr a, SizeT len )
@@ -1793,20 +1948,52 @@ static void make_mem_defined_if_addressable ( Addr a, SizeT len )
    }
 }
 
-/* Similarly (needed for mprotect handling ..) */
+/* Similarly (needed for mprotect handling ..).  This works a
+   secondary at a time, so that a distinguished secondary is either
+   skipped or handed to set_address_range_perms as a whole, rather
+   than being copied for writing by the first byte that changes.  In a
+   private secondary, groups of 4 bytes with no noaccess byte are
+   skipped. */
 static void make_mem_defined_if_noaccess ( Addr a, SizeT len )
 {
-   SizeT i;
-   UChar vabits2;
+   SizeT   i, n;
+   UChar   vabits2, vabits8;
+   SecMap* sm;
    DEBUG("make_mem_defined_if_noaccess(%p, %llu)\n", a, (ULong)len);
-   for (i = 0; i < len; i++) {
-      vabits2 = get_vabits2( a+i );
-      if (LIKELY(VA_BITS2_NOACCESS == vabits2)) {
-         set_vabits2(a+i, VA_BITS2_DEFINED);
-         if (UNLIKELY(MC_(clo_mc_level) >= 3)) {
-            MC_(helperc_b_store1)( a+i, 0 ); /* clear the origin tag */
-         } 
+   while (len > 0) {
+      n = start_of_this_sm(a) + SM_SIZE - a;
+      if (n > len)
+         n = len;
+      sm = get_secmap_for_reading(a);
+      if (sm == &sm_distinguished[SM_DIST_NOACCESS]) {
+         /* All of it changes. */
+         set_address_range_perms(a, n, VA_BITS16_DEFINED, SM_DIST_DEFINED);
+         if (UNLIKELY(MC_(clo_mc_level) >= 3))
+            ocache_sarp_Clear_Origins(a, n);
+      } else if (!is_distinguished_sm(sm)) {
+         for (i = 0; i < n; i++) {
+            if (VG_IS_4_ALIGNED(a+i) && i + 4 <= n) {
+               vabits8 = sm->vabits8[SM_OFF(a+i)];
+               if (((vabits8 | (vabits8 >> 1)) & 0x55) == 0x55) {
+                  /* none of these 4 bytes is noaccess */
+                  i += 3;
+                  continue;
+               }
+            }
+            vabits2 = get_vabits2( a+i );
+            if (LIKELY(VA_BITS2_NOACCESS == vabits2)) {
+               set_vabits2(a+i, VA_BITS2_DEFINED);
+               if (UNLIKELY(MC_(clo_mc_level) >= 3)) {
+                  MC_(helperc_b_store1)( a+i, 0 ); /* clear the origin tag */
+               } 
+            }
+         }
+      } else {
+         /* Undefined or defined distinguished secondary: no noaccess
+            bytes, so nothing changes. */
       }
+      a   += n;
+      len -= n;
    }
 }
 
@@ -1830,29 +2017,58 @@ void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
 
    if (nooverlap && aligned) {
 
-      /* Vectorised fast case, when no overlap and suitably aligned */
-      /* vector loop */
+      /* Vectorised fast case, when no overlap and suitably aligned.
+         Work in pieces that lie within a single secondary on both the
+         source and destination sides.  A piece whose source secondary
+         is distinguished is a uniform range, handed to
+         set_address_range_perms, which in turn can install
+         distinguished secondaries on the destination side.
+         Otherwise the source's vabits8 are block-copied, and only the
+         entries holding partially-defined bytes need further
+         work. */
       i = 0;
       while (len >= 4) {
-         vabits8 = get_vabits8_for_aligned_word32( src+i );
-         set_vabits8_for_aligned_word32( dst+i, vabits8 );
-         if (LIKELY(VA_BITS8_DEFINED == vabits8 
-                            || VA_BITS8_UNDEFINED == vabits8 
-                            || VA_BITS8_NOACCESS == vabits8)) {
-            /* do nothing */
+         SizeT   n, k;
+         SecMap* sm_src;
+         SecMap* sm_dst;
+         UChar*  vsrc;
+         n = len & ~(SizeT)3;
+         if (n > start_of_this_sm(src+i) + SM_SIZE - (src+i))
+            n = start_of_this_sm(src+i) + SM_SIZE - (src+i);
+         if (n > start_of_this_sm(dst+i) + SM_SIZE - (dst+i))
+            n = start_of_this_sm(dst+i) + SM_SIZE - (dst+i);
+         PROF_EVENT(53, "MC_(copy_address_range_state)(piece)");
+         sm_src = get_secmap_for_reading( src+i );
+         if (sm_src == &sm_distinguished[SM_DIST_NOACCESS]) {
+            set_address_range_perms( dst+i, n, VA_BITS16_NOACCESS,
+                                     SM_DIST_NOACCESS );
+         } else if (sm_src == &sm_distinguished[SM_DIST_UNDEFINED]) {
+            set_address_range_perms( dst+i, n, VA_BITS16_UNDEFINED,
+                                     SM_DIST_UNDEFINED );
+         } else if (sm_src == &sm_distinguished[SM_DIST_DEFINED]) {
+            set_address_range_perms( dst+i, n, VA_BITS16_DEFINED,
+                                     SM_DIST_DEFINED );
          } else {
-            /* have to copy secondary map info */
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+0 ))
-               set_sec_vbits8( dst+i+0, get_sec_vbits8( src+i+0 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+1 ))
-               set_sec_vbits8( dst+i+1, get_sec_vbits8( src+i+1 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+2 ))
-               set_sec_vbits8( dst+i+2, get_sec_vbits8( src+i+2 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+3 ))
-               set_sec_vbits8( dst+i+3, get_sec_vbits8( src+i+3 ) );
+            sm_dst = get_secmap_for_writing( dst+i );
+            vsrc   = &sm_src->vabits8[SM_OFF(src+i)];
+            VG_(memcpy)( &sm_dst->vabits8[SM_OFF(dst+i)], vsrc, n >> 2 );
+            for (k = 0; k < (n >> 2); k++) {
+               vabits8 = vsrc[k];
+               if (LIKELY(VA_BITS8_DEFINED == vabits8 
+                          || VA_BITS8_UNDEFINED == vabits8 
+                          || VA_BITS8_NOACCESS == vabits8)) {
+                  /* do nothing */
+               } else {
+                  /* have to copy secondary map info */
+                  for (j = 4*k; j < 4*k + 4; j++) {
+                     if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+j ))
+                        set_sec_vbits8( dst+i+j, get_sec_vbits8( src+i+j ) );
+                  }
+               }
+            }
          }
-         i += 4;
-         len -= 4;
+         i += n;
+         len -= n;
       }
       /* fixup loop */
       while (len >= 1) {
@@ -2218,6 +2434,9 @@ static UWord stats__ocacheL2_refs          = 0;
 static UWord stats__ocacheL2_misses        = 0;
 static UWord stats__ocacheL2_n_nodes_max   = 0;
 
+static UWord stats_ocache_page_skips       = 0;
+static UWord stats_ocache_pages_cleared    = 0;
+
 /* Cache of 32-bit values, one every 32 bits of address space */
 
 #define OC_BITS_PER_LINE 5
@@ -2283,12 +2502,64 @@ typedef
 static OCache* ocacheL1 = NULL;
 static UWord   ocacheL1_event_ctr = 0;
 
+/* Page-granular summary of the origin cache.  Most of memory never
+   holds an undefined value, and so never has a nonzero otag.  One bit
+   per 4k page of the primary map's range records whether the page may
+   hold any nonzero otag, in either cache level.  Loads and zero-stores
+   (clearing of otags) on a page whose bit is clear are answered here,
+   without touching the cache, so origin-free memory does not compete
+   for ocacheL1 lines or fill up ocacheL2.  The bit is set before any
+   nonzero otag is stored in the page, and cleared only when the whole
+   page's otags have just been cleared.  Addresses above
+   MAX_PRIMARY_ADDRESS are always treated as possibly holding
+   origins. */
+#define OC_PAGE_BITS 12
+#define OC_PAGE_SIZE (((UWord)1) << OC_PAGE_BITS)
+#define OC_PAGE_MAP_SIZEB \
+   ((MAX_PRIMARY_ADDRESS >> OC_PAGE_BITS) / 8 + 1)
+
+static UChar* ocache_page_map = NULL;
+
+static INLINE Bool oc_page_may_have_origins ( Addr a )
+{
+   UWord pg;
+   if (UNLIKELY(a > MAX_PRIMARY_ADDRESS))
+      return True;
+   pg = a >> OC_PAGE_BITS;
+   return (ocache_page_map[pg >> 3] >> (pg & 7)) & 1;
+}
+
+static INLINE void oc_page_set_has_origins ( Addr a )
+{
+   UWord pg;
+   if (LIKELY(a <= MAX_PRIMARY_ADDRESS)) {
+      pg = a >> OC_PAGE_BITS;
+      ocache_page_map[pg >> 3] |= (UChar)(1 << (pg & 7));
+   }
+}
+
+static INLINE void oc_page_clear_has_origins ( Addr a )
+{
+   UWord pg;
+   if (LIKELY(a <= MAX_PRIMARY_ADDRESS)) {
+      pg = a >> OC_PAGE_BITS;
+      ocache_page_map[pg >> 3] &= (UChar)~(1 << (pg & 7));
+   }
+}
+
 static void init_ocacheL2 ( void ); /* fwds */
 static void init_OCache ( void )
 {
    UWord line, set;
    tl_assert(MC_(clo_mc_level) >= 3);
    tl_assert(ocacheL1 == NULL);
+   tl_assert(ocache_page_map == NULL);
+   ocache_page_map = VG_(am_shadow_alloc)(OC_PAGE_MAP_SIZEB);
+   if (ocache_page_map == NULL) {
+      VG_(out_of_memory_NORETURN)( "memcheck:allocating ocache page map",
+                                   OC_PAGE_MAP_SIZEB );
+   }
+   VG_(memset)(ocache_page_map, 0, OC_PAGE_MAP_SIZEB);
    ocacheL1 = VG_(am_shadow_alloc)(sizeof(OCache));
    if (ocacheL1 == NULL) {
       VG_(out_of_memory_NORETURN)( "memcheck:allocating ocacheL1", 
@@ -2510,6 +2781,7 @@ static INLINE void set_aligned_word64_Origin_to_undef ( Addr a, UInt otag )
         tl_assert(lineoff >= 0 
                   && lineoff < OC_W32S_PER_LINE -1/*'cos 8-aligned*/);
      }
+     oc_page_set_has_origins( a );
      line = find_OCacheLine( a );
      line->descr[lineoff+0] = 0xF;
      line->descr[lineoff+1] = 0xF;
@@ -2564,6 +2836,7 @@ void make_aligned_word32_undefined_w_otag ( Addr a, UInt otag )
      if (OC_ENABLE_ASSERTIONS) {
         tl_assert(lineoff >= 0 && lineoff < OC_W32S_PER_LINE);
      }
+     oc_page_set_has_origins( a );
      line = find_OCacheLine( a );
      line->descr[lineoff] = 0xF;
      line->w32[lineoff]   = otag;
@@ -2595,7 +2868,8 @@ void make_aligned_word32_noaccess ( Addr a )
 
       //// BEGIN inlined, specialised version of MC_(helperc_b_store4)
       //// Set the origins for a+0 .. a+3.
-      if (UNLIKELY( MC_(clo_mc_level) == 3 )) {
+      if (UNLIKELY( MC_(clo_mc_level) == 3 )
+          && oc_page_may_have_origins( a )) {
          OCacheLine* line;
          UWord lineoff = oc_line_offset(a);
          if (OC_ENABLE_ASSERTIONS) {
@@ -2647,6 +2921,7 @@ void make_aligned_word64_undefined_w_otag ( Addr a, UInt otag )
      UWord lineoff = oc_line_offset(a);
      tl_assert(lineoff >= 0 
                && lineoff < OC_W32S_PER_LINE -1/*'cos 8-aligned*/);
+     oc_page_set_has_origins( a );
      line = find_OCacheLine( a );
      line->descr[lineoff+0] = 0xF;
      line->descr[lineoff+1] = 0xF;
@@ -2680,7 +2955,8 @@ void make_aligned_word64_noaccess ( Addr a )
 
       //// BEGIN inlined, specialised version of MC_(helperc_b_store8)
       //// Clear the origins for a+0 .. a+7.
-      if (UNLIKELY( MC_(clo_mc_level) == 3 )) {
+      if (UNLIKELY( MC_(clo_mc_level) == 3 )
+          && oc_page_may_have_origins( a )) {
          OCacheLine* line;
          UWord lineoff = oc_line_offset(a);
          tl_assert(lineoff >= 0 
@@ -3998,14 +4274,20 @@ void mc_new_mem_mmap ( Addr a, SizeT len, Bool rr, Bool ww, Bool xx,
       /* (1) mmap/mprotect NONE  -> noaccess */
       MC_(make_mem_noaccess)(a, len);
    }
+   maybe_redistinguish_range(a, len);
 }
 
 static
 void mc_new_mem_mprotect ( Addr a, SizeT len, Bool rr, Bool ww, Bool xx )
 {
+   /* Readability decides what the leak checker may scan, even when
+      the V+A bits do not change. */
+   if (UNLIKELY(MC_(clo_leak_check_incremental)))
+      mark_lc_changed_range(a, len);
    if (rr || ww || xx) {
       /* (4) mprotect other  ->  change any "noaccess" to "defined" */
       make_mem_defined_if_noaccess(a, len);
+      maybe_redistinguish_range(a, len);
    } else {
       /* (3) mprotect NONE   ->  # no change */
       /* do nothing */
@@ -4013,6 +4295,13 @@ void mc_new_mem_mprotect ( Addr a, SizeT len, Bool rr, Bool ww, Bool xx )
 }
 
 
+static
+void mc_die_mem_munmap ( Addr a, SizeT len )
+{
+   MC_(make_mem_noaccess)(a, len);
+   maybe_redistinguish_range(a, len);
+}
+
 static
 void mc_new_mem_startup( Addr a, SizeT len,
                          Bool rr, Bool ww, Bool xx, ULong di_handle )
@@ -4342,6 +4631,11 @@ void mc_STOREV64 ( Addr a, ULong vbits64, Bool isBigEndian )
 {
    PROF_EVENT(210, "mc_STOREV64");
 
+   if (UNLIKELY(MC_(clo_leak_check_incremental))) {
+      mark_lc_changed(a);
+      mark_lc_changed(a + 7);
+   }
+
 #ifndef PERF_FAST_STOREV
    // XXX: this slow case seems to be marginally faster than the fast case!
    // Investigate further.
@@ -4452,6 +4746,11 @@ void mc_STOREV32 ( Addr a, UWord vbits32, Bool isBigEndian )
 {
    PROF_EVENT(230, "mc_STOREV32");
 
+   if (UNLIKELY(MC_(clo_leak_check_incremental))) {
+      mark_lc_changed(a);
+      mark_lc_changed(a + 3);
+   }
+
 #ifndef PERF_FAST_STOREV
    mc_STOREVn_slow( a, 32, (ULong)vbits32, isBigEndian );
 #else
@@ -4570,6 +4869,11 @@ void mc_STOREV16 ( Addr a, UWord vbits16, Bool isBigEndian )
 {
    PROF_EVENT(250, "mc_STOREV16");
 
+   if (UNLIKELY(MC_(clo_leak_check_incremental))) {
+      mark_lc_changed(a);
+      mark_lc_changed(a + 1);
+   }
+
 #ifndef PERF_FAST_STOREV
    mc_STOREVn_slow( a, 16, (ULong)vbits16, isBigEndian );
 #else
@@ -4673,6 +4977,9 @@ void MC_(helperc_STOREV8) ( Addr a, UWord vbits8 )
 {
    PROF_EVENT(270, "mc_STOREV8");
 
+   if (UNLIKELY(MC_(clo_leak_check_incremental)))
+      mark_lc_changed(a);
+
 #ifndef PERF_FAST_STOREV
    mc_STOREVn_slow( a, 8, (ULong)vbits8, False/*irrelevant*/ );
 #else
@@ -5039,7 +5346,9 @@ VgRes         MC_(clo_leak_resolution)        = Vg_HighRes;
 UInt          MC_(clo_show_leak_kinds)        = R2S(Possible) | R2S(Unreached);
 UInt          MC_(clo_error_for_leak_kinds)   = R2S(Possible) | R2S(Unreached);
 UInt          MC_(clo_leak_check_heuristics)  = 0;
+Bool          MC_(clo_leak_check_incremental) = False;
 Bool          MC_(clo_workaround_gcc296_bugs) = False;
+Bool          MC_(clo_shadow_opt)             = False;
 Int           MC_(clo_malloc_fill)            = -1;
 Int           MC_(clo_free_fill)              = -1;
 KeepStacktraces MC_(clo_keep_stacktraces)     = KS_alloc_then_free;
@@ -5183,6 +5492,11 @@ static Bool mc_process_cmd_line_options(const HChar* arg)
    else if VG_XACT_CLO(arg, "--leak-check=full",
                             MC_(clo_leak_check), LC_Full) {}
 
+   else if VG_BOOL_CLO(arg, "--leak-check-incremental",
+                            MC_(clo_leak_check_incremental)) {}
+
+   else if VG_BOOL_CLO(arg, "--shadow-opt", MC_(clo_shadow_opt)) {}
+
    else if VG_XACT_CLO(arg, "--leak-resolution=low",
                             MC_(clo_leak_resolution), Vg_LowRes) {}
    else if VG_XACT_CLO(arg, "--leak-resolution=med",
@@ -5256,6 +5570,8 @@ static void mc_print_usage(void)
 "    --leak-check-heuristics=heur1,heur2,... which heuristics to use for\n"
 "        improving leak search false positive [none]\n"
 "        where heur is one of stdstring newarray multipleinheritance all none\n"
+"    --leak-check-incremental=no|yes  reuse the root-set scan of memory unchanged\n"
+"        since the previous leak search [no]\n"
 "    --show-reachable=yes             same as --show-leak-kinds=all\n"
 "    --show-reachable=no --show-possibly-lost=yes\n"
 "                                     same as --show-leak-kinds=definite,possible\n"
@@ -5278,7 +5594,8 @@ static void mc_print_usage(void)
 static void mc_print_debug_usage(void)
 {  
    VG_(printf)(
-"    (none)\n"
+"    --shadow-opt=no|yes              run Vex's shadow state optimiser over\n"
+"        the instrumented code [no]\n"
    );
 }
 
@@ -6079,6 +6396,11 @@ UWord VG_REGPARM(1) MC_(helperc_b_load1)( Addr a ) {
       tl_assert(lineoff >= 0 && lineoff < OC_W32S_PER_LINE);
    }
 
+   if (!oc_page_may_have_origins( a )) {
+      stats_ocache_page_skips++;
+      return 0;
+   }
+
    line = find_OCacheLine( a );
 
    descr = line->descr[lineoff];
@@ -6111,6 +6433,11 @@ UWord VG_REGPARM(1) MC_(helperc_b_load2)( Addr a ) {
    if (OC_ENABLE_ASSERTIONS) {
       tl_assert(lineoff >= 0 && lineoff < OC_W32S_PER_LINE);
    }
+   if (!oc_page_may_have_origins( a )) {
+      stats_ocache_page_skips++;
+      return 0;
+   }
+
    line = find_OCacheLine( a );
 
    descr = line->descr[lineoff];
@@ -6142,6 +6469,11 @@ UWord VG_REGPARM(1) MC_(helperc_b_load4)( Addr a ) {
       tl_assert(lineoff >= 0 && lineoff < OC_W32S_PER_LINE);
    }
 
+   if (!oc_page_may_have_origins( a )) {
+      stats_ocache_page_skips++;
+      return 0;
+   }
+
    line = find_OCacheLine( a );
 
    descr = line->descr[lineoff];
@@ -6173,6 +6505,11 @@ UWord VG_REGPARM(1) MC_(helperc_b_load8)( Addr a ) {
       tl_assert(lineoff == (lineoff & 6)); /*0,2,4,6*//*since 8-aligned*/
    }
 
+   if (!oc_page_may_have_origins( a )) {
+      stats_ocache_page_skips++;
+      return 0;
+   }
+
    line = find_OCacheLine( a );
 
    descrLo = line->descr[lineoff + 0];
@@ -6222,6 +6559,15 @@ void VG_REGPARM(2) MC_(helperc_b_store1)( Addr a, UWord d32 ) {
       tl_assert(lineoff >= 0 && lineoff < OC_W32S_PER_LINE);
    }
 
+   if (d32 == 0) {
+      if (!oc_page_may_have_origins( a )) {
+         stats_ocache_page_skips++;
+         return;
+      }
+   } else {
+      oc_page_set_has_origins( a );
+   }
+
    line = find_OCacheLine( a );
 
    if (d32 == 0) {
@@ -6250,6 +6596,15 @@ void VG_REGPARM(2) MC_(helperc_b_store2)( Addr a, UWord d32 ) {
       tl_assert(lineoff >= 0 && lineoff < OC_W32S_PER_LINE);
    }
 
+   if (d32 == 0) {
+      if (!oc_page_may_have_origins( a )) {
+         stats_ocache_page_skips++;
+         return;
+      }
+   } else {
+      oc_page_set_has_origins( a );
+   }
+
    line = find_OCacheLine( a );
 
    if (d32 == 0) {
@@ -6276,6 +6631,15 @@ void VG_REGPARM(2) MC_(helperc_b_store4)( Addr a, UWord d32 ) {
       tl_assert(lineoff >= 0 && lineoff < OC_W32S_PER_LINE);
    }
 
+   if (d32 == 0) {
+      if (!oc_page_may_have_origins( a )) {
+         stats_ocache_page_skips++;
+         return;
+      }
+   } else {
+      oc_page_set_has_origins( a );
+   }
+
    line = find_OCacheLine( a );
 
    if (d32 == 0) {
@@ -6302,6 +6666,15 @@ void VG_REGPARM(2) MC_(helperc_b_store8)( Addr a, UWord d32 ) {
       tl_assert(lineoff == (lineoff & 6)); /*0,2,4,6*//*since 8-aligned*/
    }
 
+   if (d32 == 0) {
+      if (!oc_page_may_have_origins( a )) {
+         stats_ocache_page_skips++;
+         return;
+      }
+   } else {
+      oc_page_set_has_origins( a );
+   }
+
    line = find_OCacheLine( a );
 
    if (d32 == 0) {
@@ -6364,8 +6737,7 @@ static void ocache_sarp_Set_Origins ( Addr a, UWord len, UInt otag ) {
    tl_assert(len == 0);
 }
 
-__attribute__((noinline))
-static void ocache_sarp_Clear_Origins ( Addr a, UWord len ) {
+static void ocache_sarp_Clear_Origins_in_page ( Addr a, UWord len ) {
    if ((a & 1) && len >= 1) {
       MC_(helperc_b_store1)( a, 0 );
       a++;
@@ -6396,6 +6768,28 @@ static void ocache_sarp_Clear_Origins ( Addr a, UWord len ) {
    tl_assert(len == 0);
 }
 
+/* Clear the otags a page at a time, skipping pages that hold none.  A
+   page covered completely is then known to hold none. */
+__attribute__((noinline))
+static void ocache_sarp_Clear_Origins ( Addr a, UWord len ) {
+   while (len > 0) {
+      UWord n = OC_PAGE_SIZE - (a & (OC_PAGE_SIZE - 1));
+      if (n > len)
+         n = len;
+      if (oc_page_may_have_origins( a )) {
+         ocache_sarp_Clear_Origins_in_page( a, n );
+         if (n == OC_PAGE_SIZE) {
+            oc_page_clear_has_origins( a );
+            stats_ocache_pages_cleared++;
+         }
+      } else {
+         stats_ocache_page_skips++;
+      }
+      a   += n;
+      len -= n;
+   }
+}
+
 
 /*------------------------------------------------------------*/
 /*--- Setup and finalisation                               ---*/
@@ -6419,6 +6813,9 @@ static void mc_post_clo_init ( void )
 
    tl_assert( MC_(clo_mc_level) >= 1 && MC_(clo_mc_level) <= 3 );
 
+   if (MC_(clo_shadow_opt))
+      VG_(needs_shadow_opt)();
+
    if (MC_(clo_mc_level) == 3) {
       /* We're doing origin tracking. */
 #     ifdef PERF_FAST_STACK
@@ -6604,6 +7001,8 @@ static void mc_fini ( Int exitcode )
       print_SM_info("max_undefined", max_undefined_SMs);
       print_SM_info("max_defined  ", max_defined_SMs);
       print_SM_info("max_non_DSM  ", max_non_DSM_SMs);
+      print_SM_info("curr_non_DSM ", n_non_DSM_SMs);
+      print_SM_info("redist       ", n_redistinguished_SMs);
 
       // Three DSMs, plus the non-DSM ones
       max_SMs_szB = (3 + max_non_DSM_SMs) * sizeof(SecMap);
@@ -6649,6 +7048,10 @@ static void mc_fini ( Int exitcode )
                       " ocacheL1: %'12lu sizeB  %'12u useful\n",
                       (UWord)sizeof(OCache),
                       4 * OC_W32S_PER_LINE * OC_LINES_PER_SET * OC_N_SETS );
+         VG_(message)(Vg_DebugMsg,
+                      " ocache:   %'12lu page skips %'9lu pages cleared\n",
+                      stats_ocache_page_skips,
+                      stats_ocache_pages_cleared );
          VG_(message)(Vg_DebugMsg,
                       " ocacheL2: %'12lu refs   %'12lu misses\n",
                       stats__ocacheL2_refs, 
@@ -6753,7 +7156,7 @@ static void mc_pre_clo_init(void)
 
    VG_(track_die_mem_stack_signal)( MC_(make_mem_noaccess) ); 
    VG_(track_die_mem_brk)         ( MC_(make_mem_noaccess) );
-   VG_(track_die_mem_munmap)      ( MC_(make_mem_noaccess) ); 
+   VG_(track_die_mem_munmap)      ( mc_die_mem_munmap ); 
 
    /* Defer the specification of the new_mem_stack functions to the
       post_clo_init function, since we need to first parse the command
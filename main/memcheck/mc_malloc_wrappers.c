@@ -94,6 +94,103 @@ void delete_MC_Chunk (MC_Chunk* mc);
 static MC_Chunk* freed_list_start[2]  = {NULL, NULL};
 static MC_Chunk* freed_list_end[2]    = {NULL, NULL};
 
+/* MC_(get_freed_block_bracketting) is called to describe every
+   erroneous address that is not in a live block, and the small blocks
+   freed list can hold many blocks (--freelist-vol is often raised to
+   catch more use-after-free errors).  So the blocks of this list are
+   also indexed by address: for each 4Kb page touched by a block or its
+   redzones, freed_index holds a FreedPage listing these blocks.  As
+   a small block is less than MC_(clo_freelist_big_blocks) bytes, it
+   appears in a bounded number of pages.  Each entry also holds the
+   position of the block in the list, so that when several blocks
+   bracket an address, the one found is the first in the list, as it
+   is when scanning the list.  The big blocks list is short, and is
+   still scanned. */
+#define FREED_PAGE_SHIFT 12
+
+typedef
+   struct {
+      MC_Chunk* mc;
+      Long      pos;     // Increasing from list start to list end.
+   }
+   FreedRef;
+
+typedef
+   struct _FreedPage {
+      struct _FreedPage* next;
+      UWord     key;     // Address >> FREED_PAGE_SHIFT.
+      UInt      n_refs;
+      UInt      sz_refs;
+      FreedRef* refs;
+   }
+   FreedPage;
+
+static VgHashTable freed_index = NULL;
+// Positions given to the next block put at the start/end of the list.
+static Long freed_pos_start = 0;
+static Long freed_pos_end   = 1;
+
+static void freed_block_pages ( MC_Chunk* mc, UWord* first, UWord* last )
+{
+   const SizeT rzB = MC_(Malloc_Redzone_SzB);
+   const Addr  lo  = mc->data >= rzB ? mc->data - rzB : 0;
+   const Addr  hi  = mc->data + mc->szB + rzB - 1;
+   *first = lo >> FREED_PAGE_SHIFT;
+   *last  = (hi >= lo ? hi : ~(Addr)0) >> FREED_PAGE_SHIFT;
+}
+
+static void add_to_freed_index ( MC_Chunk* mc, Long pos )
+{
+   UWord pg, last;
+
+   if (freed_index == NULL)
+      freed_index = VG_(HT_construct)( "Memcheck freed blocks index" );
+
+   freed_block_pages(mc, &pg, &last);
+   for (; pg <= last; pg++) {
+      FreedPage* fp = VG_(HT_lookup)( freed_index, pg );
+      if (fp == NULL) {
+         fp = VG_(malloc)( "mc.afti.1", sizeof(FreedPage) );
+         fp->key     = pg;
+         fp->n_refs  = 0;
+         fp->sz_refs = 4;
+         fp->refs    = VG_(malloc)( "mc.afti.2", 4 * sizeof(FreedRef) );
+         VG_(HT_add_node)( freed_index, fp );
+      } else if (fp->n_refs == fp->sz_refs) {
+         fp->sz_refs *= 2;
+         fp->refs = VG_(realloc)( "mc.afti.3", fp->refs,
+                                  fp->sz_refs * sizeof(FreedRef) );
+      }
+      fp->refs[fp->n_refs].mc  = mc;
+      fp->refs[fp->n_refs].pos = pos;
+      fp->n_refs++;
+      if (pg == ~(UWord)0)
+         break;
+   }
+}
+
+static void remove_from_freed_index ( MC_Chunk* mc )
+{
+   UWord pg, last, i;
+
+   freed_block_pages(mc, &pg, &last);
+   for (; pg <= last; pg++) {
+      FreedPage* fp = VG_(HT_lookup)( freed_index, pg );
+      tl_assert(fp);
+      for (i = 0; i < fp->n_refs && fp->refs[i].mc != mc; i++)
+         ;
+      tl_assert(i < fp->n_refs);
+      fp->refs[i] = fp->refs[--fp->n_refs];
+      if (fp->n_refs == 0) {
+         VG_(HT_remove)( freed_index, pg );
+         VG_(free)( fp->refs );
+         VG_(free)( fp );
+      }
+      if (pg == ~(UWord)0)
+         break;
+   }
+}
+
 /* Put a shadow chunk on the freed blocks queue, possibly freeing up
    some of the oldest blocks in the queue at the same time. */
 static void add_to_freed_queue ( MC_Chunk* mc )
@@ -108,15 +205,21 @@ static void add_to_freed_queue ( MC_Chunk* mc )
       tl_assert(freed_list_start[l] == NULL);
       mc->next = NULL;
       freed_list_end[l]    = freed_list_start[l] = mc;
+      if (l == 1)
+         add_to_freed_index(mc, freed_pos_end++);
    } else {
       tl_assert(freed_list_end[l]->next == NULL);
       if (mc->szB >= MC_(clo_freelist_vol)) {
          mc->next = freed_list_start[l];
          freed_list_start[l] = mc;
+         if (l == 1)
+            add_to_freed_index(mc, freed_pos_start--);
       } else {
          mc->next = NULL;
          freed_list_end[l]->next = mc;
          freed_list_end[l]       = mc;
+         if (l == 1)
+            add_to_freed_index(mc, freed_pos_end++);
       }
    }
    VG_(free_queue_volume) += (Long)mc->szB;
@@ -159,6 +262,8 @@ static void release_oldest_block(void)
             freed_list_start[i] = mc1->next;
          }
          mc1->next = NULL; /* just paranoia */
+         if (i == 1)
+            remove_from_freed_index(mc1);
 
          /* free MC_Chunk */
          if (MC_AllocCustom != mc1->allockind)
@@ -170,18 +275,35 @@ static void release_oldest_block(void)
 
 MC_Chunk* MC_(get_freed_block_bracketting) (Addr a)
 {
-   int i;
-   for (i = 0; i < 2; i++) {
-      MC_Chunk*  mc;
-      mc = freed_list_start[i];
-      while (mc) {
-         if (VG_(addr_is_in_block)( a, mc->data, mc->szB,
-                                    MC_(Malloc_Redzone_SzB) ))
-            return mc;
-         mc = mc->next;
+   MC_Chunk*  mc;
+   FreedPage* fp;
+   MC_Chunk*  found = NULL;
+   Long       found_pos = 0;
+   UInt       i;
+
+   mc = freed_list_start[0];
+   while (mc) {
+      if (VG_(addr_is_in_block)( a, mc->data, mc->szB,
+                                 MC_(Malloc_Redzone_SzB) ))
+         return mc;
+      mc = mc->next;
+   }
+
+   if (freed_index == NULL)
+      return NULL;
+   fp = VG_(HT_lookup)( freed_index, a >> FREED_PAGE_SHIFT );
+   if (fp == NULL)
+      return NULL;
+   for (i = 0; i < fp->n_refs; i++) {
+      mc = fp->refs[i].mc;
+      if ((found == NULL || fp->refs[i].pos < found_pos)
+          && VG_(addr_is_in_block)( a, mc->data, mc->szB,
+                                    MC_(Malloc_Redzone_SzB) )) {
+         found     = mc;
+         found_pos = fp->refs[i].pos;
       }
    }
-   return NULL;
+   return found;
 }
 
 /* Allocate a shadow chunk, put it on the appropriate list.
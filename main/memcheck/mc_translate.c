@@ -167,6 +167,34 @@ typedef
    TempMapEnt;
 
 
+/* Describes the value of an original tmp as a constant offset from
+   the value of the guest stack or frame pointer at some point in the
+   superblock.  .base is the tmp which holds that pointer value, or
+   IRTemp_INVALID if the tmp is not known to be stack-relative.
+   See "Forwarding of stack slot shadows" below. */
+typedef
+   struct {
+      IRTemp base;
+      Long   off;
+   }
+   StackRel;
+
+/* A stack slot whose V bits are currently known at translation time:
+   the .szB bytes at .base + .off, accessed with endianness .end, have
+   the V bits held in the shadow atom .vbits. */
+typedef
+   struct {
+      IRTemp    base;
+      Long      off;
+      Int       szB;
+      IREndness end;
+      IRExpr*   vbits;
+   }
+   StackSlot;
+
+#define N_STACK_SLOTS 16
+
+
 /* Carries around state during memcheck instrumentation. */
 typedef
    struct _MCEnv {
@@ -209,6 +237,23 @@ typedef
          arguments of type 'HWord' to be passed to helper functions.
          Ity_I32 or Ity_I64 only. */
       IRType hWordTy;
+
+      /* MODIFIED: state for forwarding of stack slot shadows.
+         .stackRel is a table [0 .. #temps_in_sb_in-1] saying which
+         original tmps are stack-relative.  .spBase/.spOff give the
+         current value of the guest stack pointer in the same terms,
+         with .spBase being IRTemp_INVALID if that is unknown, and
+         .fpRel likewise for the guest frame pointer.
+         .slots[0 .. .nSlots-1] are the slots whose V bits are
+         currently known.  .stackRel is NULL if forwarding is
+         disabled. */
+      StackRel* stackRel;
+      Int       nStackRel;
+      IRTemp    spBase;
+      Long      spOff;
+      StackRel  fpRel;
+      StackSlot slots[N_STACK_SLOTS];
+      Int       nSlots;
    }
    MCEnv;
 
@@ -5705,11 +5750,265 @@ static void do_shadow_LoadG ( MCEnv* mce, IRLoadG* lg )
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Forwarding of stack slot shadows                     ---*/
+/*------------------------------------------------------------*/
+
+/* Code reloads stack slots which it has only just written, or read,
+   in the same superblock, especially around function prologues and
+   epilogues.  Each such load would normally cost a call to a LOADV
+   helper, even though the V bits it returns are already sitting in a
+   shadow temporary.  So, within a superblock, we keep track of the V
+   bits of recently stored and loaded stack slots and use them
+   directly for a later load of exactly the same slot.
+
+   A tmp is stack-relative if it is known to hold the value of the
+   guest stack pointer, or of the guest frame pointer, at some point
+   in the block, plus a constant; that is, it is a Get of one of
+   those, or a copy of, or a constant added to or subtracted from,
+   another stack-relative tmp.  Puts of stack-relative values to the
+   stack and frame pointers are followed, so that the tmps in a block
+   usually share just one or two bases.  Slots are identified by base
+   and offset; since the relationship between different bases is not
+   known, they are assumed to possibly overlap.
+
+   A slot relative to the stack pointer is only recorded if it lies
+   at or above the current stack pointer less the redzone, so that it
+   is addressable stack.  The recorded V bits are forgotten when they
+   might become stale:
+
+   - a store to a stack-relative address invalidates all overlapping
+     slots, and all slots with a different base.  A store to any
+     other address might alias the stack, and so invalidates every
+     slot.  So do StoreG, CAS, LLSC, dirty helper calls and AbiHints
+     (which paint the stack undefined).
+
+   - a Put to the stack pointer causes the core to mark stack memory
+     between the old and new stack pointers as undefined or
+     inaccessible, so slots relative to the stack pointer but below
+     the higher of the two are dropped, as are all slots with other
+     bases.  A Put of anything other than a stack-relative value
+     drops all slots.
+
+   A forwarded load still has its address checked for definedness,
+   and its origin is computed as usual.  What is lost is the check of
+   the address' validity.  Since the slot was just accessed by the
+   same block, that only means an invalid access which is repeated
+   within a superblock is reported once rather than twice.
+
+   Forwarding is not done at --undef-value-errors=no, since V bits
+   are then not tracked. */
+
+static void forgetStackSlots ( MCEnv* mce )
+{
+   mce->nSlots = 0;
+}
+
+/* A dirty helper may write memory, and the guest state too. */
+static void noteStackDirty ( MCEnv* mce, IRDirty* d )
+{
+   forgetStackSlots(mce);
+   if (d->nFxState > 0) {
+      mce->spBase     = IRTemp_INVALID;
+      mce->fpRel.base = IRTemp_INVALID;
+   }
+}
+
+/* Is |at| a stack-relative original tmp?  Returns the base and
+   offset, or a base of IRTemp_INVALID if not. */
+static StackRel stackRelOfAtom ( MCEnv* mce, IRAtom* at )
+{
+   StackRel none = { IRTemp_INVALID, 0 };
+   if (at->tag != Iex_RdTmp || at->Iex.RdTmp.tmp >= mce->nStackRel)
+      return none;
+   return mce->stackRel[at->Iex.RdTmp.tmp];
+}
+
+/* May a slot at |rel| be recorded at this point? */
+static Bool isLiveStackRel ( MCEnv* mce, StackRel rel )
+{
+   if (rel.base == IRTemp_INVALID)
+      return False;
+   return rel.base != mce->spBase
+          || rel.off >= mce->spOff - VG_STACK_REDZONE_SZB;
+}
+
+static void addStackSlot ( MCEnv* mce, StackRel rel, Int szB,
+                           IREndness end, IRAtom* vbits )
+{
+   StackSlot* sl;
+   tl_assert(isShadowAtom(mce, vbits));
+   if (mce->nSlots == N_STACK_SLOTS) {
+      /* Full; drop the oldest. */
+      VG_(memmove)(&mce->slots[0], &mce->slots[1],
+                   (N_STACK_SLOTS-1) * sizeof(StackSlot));
+      mce->nSlots--;
+   }
+   sl = &mce->slots[mce->nSlots++];
+   sl->base  = rel.base;
+   sl->off   = rel.off;
+   sl->szB   = szB;
+   sl->end   = end;
+   sl->vbits = vbits;
+}
+
+/* Note the stack-relativity, if any, of original tmp |t| := |e|. */
+static void noteStackWrTmp ( MCEnv* mce, IRTemp t, IRExpr* e )
+{
+   StackRel rel = { IRTemp_INVALID, 0 };
+   IROp     opAdd = mce->hWordTy == Ity_I32 ? Iop_Add32 : Iop_Add64;
+   IROp     opSub = mce->hWordTy == Ity_I32 ? Iop_Sub32 : Iop_Sub64;
+   tl_assert(t < mce->nStackRel);
+
+   switch (e->tag) {
+      case Iex_Get:
+         if (e->Iex.Get.offset == mce->layout->offset_SP
+             && sizeofIRType(e->Iex.Get.ty) == mce->layout->sizeof_SP) {
+            if (mce->spBase == IRTemp_INVALID) {
+               mce->spBase = t;
+               mce->spOff  = 0;
+            }
+            rel.base = mce->spBase;
+            rel.off  = mce->spOff;
+         }
+         else
+         if (e->Iex.Get.offset == mce->layout->offset_FP
+             && sizeofIRType(e->Iex.Get.ty) == mce->layout->sizeof_FP) {
+            if (mce->fpRel.base == IRTemp_INVALID) {
+               mce->fpRel.base = t;
+               mce->fpRel.off  = 0;
+            }
+            rel = mce->fpRel;
+         }
+         break;
+      case Iex_RdTmp:
+         rel = stackRelOfAtom(mce, e);
+         break;
+      case Iex_Binop:
+         if ((e->Iex.Binop.op == opAdd || e->Iex.Binop.op == opSub)
+             && e->Iex.Binop.arg2->tag == Iex_Const) {
+            IRConst* con = e->Iex.Binop.arg2->Iex.Const.con;
+            Long     c;
+            rel = stackRelOfAtom(mce, e->Iex.Binop.arg1);
+            switch (con->tag) {
+               case Ico_U32: c = (Long)(Int)con->Ico.U32; break;
+               case Ico_U64: c = (Long)con->Ico.U64; break;
+               default: tl_assert(0);
+            }
+            /* Only plausible frame offsets; this also avoids any
+               overflow of .off. */
+            if (c < -0x100000 || c > 0x100000) {
+               rel.base = IRTemp_INVALID;
+               break;
+            }
+            rel.off += e->Iex.Binop.op == opAdd ? c : -c;
+         }
+         break;
+      default:
+         break;
+   }
+   mce->stackRel[t] = rel;
+}
+
+/* Note a Put of |data| at guest state |offset|. */
+static void noteStackPut ( MCEnv* mce, Int offset, IRAtom* data )
+{
+   Int      szB  = sizeofIRType(typeOfIRExpr(mce->sb->tyenv, data));
+   Int      spO  = mce->layout->offset_SP;
+   Int      fpO  = mce->layout->offset_FP;
+   Int      i, n = 0;
+   StackRel rel  = stackRelOfAtom(mce, data);
+   if (offset < fpO + mce->layout->sizeof_FP && offset + szB > fpO) {
+      if (offset == fpO && szB == mce->layout->sizeof_FP) {
+         mce->fpRel = rel;
+      } else {
+         mce->fpRel.base = IRTemp_INVALID;
+      }
+   }
+   if (offset >= spO + mce->layout->sizeof_SP || offset + szB <= spO)
+      return;
+   if (offset != spO || szB != mce->layout->sizeof_SP
+       || rel.base == IRTemp_INVALID) {
+      forgetStackSlots(mce);
+      mce->spBase = IRTemp_INVALID;
+      return;
+   }
+   if (rel.base == mce->spBase) {
+      /* Stack memory below the higher of the old and new SP values
+         is about to be painted; keep only slots above it. */
+      Long lo = (mce->spOff > rel.off ? mce->spOff : rel.off)
+                - VG_STACK_REDZONE_SZB;
+      for (i = 0; i < mce->nSlots; i++) {
+         if (mce->slots[i].base == rel.base && mce->slots[i].off >= lo)
+            mce->slots[n++] = mce->slots[i];
+      }
+      mce->nSlots = n;
+   } else {
+      forgetStackSlots(mce);
+      mce->spBase = rel.base;
+   }
+   mce->spOff = rel.off;
+}
+
+/* Note a store of data with V bits |vdata| to |addr|. */
+static void noteStackStore ( MCEnv* mce, IRAtom* addr, IREndness end,
+                             IRAtom* vdata )
+{
+   Int      szB = sizeofIRType(typeOfIRExpr(mce->sb->tyenv, vdata));
+   StackRel rel = stackRelOfAtom(mce, addr);
+   Int      i, n = 0;
+   if (rel.base == IRTemp_INVALID) {
+      forgetStackSlots(mce);
+      return;
+   }
+   for (i = 0; i < mce->nSlots; i++) {
+      StackSlot* sl = &mce->slots[i];
+      if (sl->base == rel.base
+          && (sl->off + sl->szB <= rel.off || rel.off + szB <= sl->off))
+         mce->slots[n++] = *sl;
+   }
+   mce->nSlots = n;
+   if (isLiveStackRel(mce, rel))
+      addStackSlot(mce, rel, szB, end, vdata);
+}
+
+/* Generate V bits for |dst| := |ld|, forwarding them from a known
+   stack slot if possible. */
+static void do_shadow_WrTmp_Load ( MCEnv* mce, IRTemp dst, IRExpr* ld )
+{
+   IRType   tyV = shadowTypeV(ld->Iex.Load.ty);
+   Int      szB = sizeofIRType(ld->Iex.Load.ty);
+   StackRel rel = stackRelOfAtom(mce, ld->Iex.Load.addr);
+   IRTemp   vtmp;
+   Int      i;
+
+   if (isLiveStackRel(mce, rel)) {
+      for (i = mce->nSlots-1; i >= 0; i--) {
+         StackSlot* sl = &mce->slots[i];
+         if (sl->base == rel.base && sl->off == rel.off
+             && sl->szB == szB && sl->end == ld->Iex.Load.end
+             && typeOfIRExpr(mce->sb->tyenv, sl->vbits) == tyV) {
+            complainIfUndefined( mce, ld->Iex.Load.addr, NULL );
+            assign( 'V', mce, findShadowTmpV(mce, dst), sl->vbits );
+            return;
+         }
+      }
+   }
+
+   vtmp = findShadowTmpV(mce, dst);
+   assign( 'V', mce, vtmp, expr2vbits( mce, ld ) );
+   if (isLiveStackRel(mce, rel))
+      addStackSlot(mce, rel, szB, ld->Iex.Load.end, mkexpr(vtmp));
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Memcheck main                                        ---*/
 /*------------------------------------------------------------*/
 
 static void schemeS ( MCEnv* mce, IRStmt* st );
+static Bool is_deferred_origins_Load ( MCEnv* mce, IRStmt* st );
+static void do_origins_WrTmp_Load ( MCEnv* mce, IRTemp dst, IRExpr* ld );
 
 static Bool isBogusAtom ( IRAtom* at )
 {
@@ -5920,6 +6219,25 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
    }
    tl_assert( VG_(sizeXA)( mce.tmpMap ) == sb_in->tyenv->types_used );
 
+   /* Set up for forwarding of stack slot shadows; see comments
+      above. */
+   mce.stackRel   = NULL;
+   mce.nStackRel  = 0;
+   mce.spBase     = IRTemp_INVALID;
+   mce.spOff      = 0;
+   mce.fpRel.base = IRTemp_INVALID;
+   mce.fpRel.off  = 0;
+   mce.nSlots     = 0;
+   if (MC_(clo_mc_level) >= 2 && sb_in->tyenv->types_used > 0) {
+      mce.nStackRel = sb_in->tyenv->types_used;
+      mce.stackRel  = VG_(malloc)( "mc.MC_(instrument).2",
+                                   mce.nStackRel * sizeof(StackRel) );
+      for (i = 0; i < mce.nStackRel; i++) {
+         mce.stackRel[i].base = IRTemp_INVALID;
+         mce.stackRel[i].off  = 0;
+      }
+   }
+
    /* Make a preliminary inspection of the statements, to see if there
       are any dodgy-looking literals.  If there are, we generate
       extra-detailed (hence extra-expensive) instrumentation in
@@ -6025,8 +6343,10 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
       }
 
       if (MC_(clo_mc_level) == 3) {
-         /* See comments on case Ist_CAS below. */
-         if (st->tag != Ist_CAS) 
+         /* See comments on case Ist_CAS below.  Most loads into
+            temporaries are handled after the V bits instead; see
+            do_origins_WrTmp_Load. */
+         if (st->tag != Ist_CAS && !is_deferred_origins_Load( &mce, st ))
             schemeS( &mce, st );
       }
 
@@ -6035,8 +6355,15 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
       switch (st->tag) {
 
          case Ist_WrTmp:
-            assign( 'V', &mce, findShadowTmpV(&mce, st->Ist.WrTmp.tmp), 
-                               expr2vbits( &mce, st->Ist.WrTmp.data) );
+            if (mce.stackRel && st->Ist.WrTmp.data->tag == Iex_Load) {
+               do_shadow_WrTmp_Load( &mce, st->Ist.WrTmp.tmp,
+                                           st->Ist.WrTmp.data );
+            } else {
+               assign( 'V', &mce, findShadowTmpV(&mce, st->Ist.WrTmp.tmp), 
+                                  expr2vbits( &mce, st->Ist.WrTmp.data) );
+            }
+            if (mce.stackRel)
+               noteStackWrTmp( &mce, st->Ist.WrTmp.tmp, st->Ist.WrTmp.data );
             break;
 
          case Ist_Put:
@@ -6044,6 +6371,8 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
                            st->Ist.Put.offset,
                            st->Ist.Put.data,
                            NULL /* shadow atom */, NULL /* guard */ );
+            if (mce.stackRel)
+               noteStackPut( &mce, st->Ist.Put.offset, st->Ist.Put.data );
             break;
 
          case Ist_PutI:
@@ -6051,15 +6380,26 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
             break;
 
          case Ist_Store:
-            do_shadow_Store( &mce, st->Ist.Store.end,
-                                   st->Ist.Store.addr, 0/* addr bias */,
-                                   st->Ist.Store.data,
-                                   NULL /* shadow data */,
-                                   NULL/*guard*/ );
+            if (mce.stackRel) {
+               IRAtom* vdata = expr2vbits( &mce, st->Ist.Store.data );
+               do_shadow_Store( &mce, st->Ist.Store.end,
+                                      st->Ist.Store.addr, 0/* addr bias */,
+                                      NULL /* data */, vdata,
+                                      NULL/*guard*/ );
+               noteStackStore( &mce, st->Ist.Store.addr,
+                                     st->Ist.Store.end, vdata );
+            } else {
+               do_shadow_Store( &mce, st->Ist.Store.end,
+                                      st->Ist.Store.addr, 0/* addr bias */,
+                                      st->Ist.Store.data,
+                                      NULL /* shadow data */,
+                                      NULL/*guard*/ );
+            }
             break;
 
          case Ist_StoreG:
             do_shadow_StoreG( &mce, st->Ist.StoreG.details );
+            forgetStackSlots( &mce );
             break;
 
          case Ist_LoadG:
@@ -6079,12 +6419,14 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
 
          case Ist_Dirty:
             do_shadow_Dirty( &mce, st->Ist.Dirty.details );
+            noteStackDirty( &mce, st->Ist.Dirty.details );
             break;
 
          case Ist_AbiHint:
             do_AbiHint( &mce, st->Ist.AbiHint.base,
                               st->Ist.AbiHint.len,
                               st->Ist.AbiHint.nia );
+            forgetStackSlots( &mce );
             break;
 
          case Ist_CAS:
@@ -6095,6 +6437,7 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
                skip the origin-tracking stuff (call to schemeS) above,
                since that's all tangled up with it too; do_shadow_CAS
                does it all. */
+            forgetStackSlots( &mce );
             break;
 
          case Ist_LLSC:
@@ -6103,6 +6446,7 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
                             st->Ist.LLSC.result,
                             st->Ist.LLSC.addr,
                             st->Ist.LLSC.storedata );
+            forgetStackSlots( &mce );
             break;
 
          default:
@@ -6113,6 +6457,10 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
 
       } /* switch (st->tag) */
 
+      if (MC_(clo_mc_level) == 3 && is_deferred_origins_Load( &mce, st ))
+         do_origins_WrTmp_Load( &mce, st->Ist.WrTmp.tmp,
+                                      st->Ist.WrTmp.data );
+
       if (0 && verboze) {
          for (j = first_stmt; j < sb_out->stmts_used; j++) {
             VG_(printf)("   ");
@@ -6153,6 +6501,8 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
       that should be investigated. */
    tl_assert( VG_(sizeXA)( mce.tmpMap ) == mce.sb->tyenv->types_used );
    VG_(deleteXA)( mce.tmpMap );
+   if (mce.stackRel)
+      VG_(free)( mce.stackRel );
 
    tl_assert(mce.sb == sb_out);
    return sb_out;
@@ -6934,6 +7284,47 @@ static void do_origins_LoadG ( MCEnv* mce, IRLoadG* lg )
 }
 
 
+/* A load into a temporary, WrTmp(dst, Load), whose V shadow is an
+   integer type, has its origin computed by do_origins_WrTmp_Load
+   after the V bits for the load have been generated, rather than by
+   schemeS beforehand.  That allows the origin load to be guarded on
+   the loaded value being at least partly undefined.  A fully defined
+   value has no use for an origin, and nearly all loaded values are
+   defined, so this avoids most calls to the origin load helpers.
+   Vector loads are left to schemeS, since mkPCastTo cannot collapse
+   their V bits to a single bit.  This needs the host back end to
+   support conditional helper calls returning a value, which only the
+   x86, amd64 and arm back ends do. */
+static Bool is_deferred_origins_Load ( MCEnv* mce, IRStmt* st )
+{
+#  if defined(VGA_x86) || defined(VGA_amd64) || defined(VGA_arm)
+   IRType tyV;
+   if (st->tag != Ist_WrTmp || st->Ist.WrTmp.data->tag != Iex_Load)
+      return False;
+   tyV = shadowTypeV( st->Ist.WrTmp.data->Iex.Load.ty );
+   return tyV == Ity_I8 || tyV == Ity_I16
+          || tyV == Ity_I32 || tyV == Ity_I64;
+#  else
+   return False;
+#  endif
+}
+
+static void do_origins_WrTmp_Load ( MCEnv* mce, IRTemp dst, IRExpr* ld )
+{
+   IRAtom* vbits;
+   IRAtom* undef;
+   IRAtom* ori;
+   tl_assert(ld->tag == Iex_Load);
+   tl_assert(isIRAtom(ld->Iex.Load.addr));
+   vbits = mkexpr( findShadowTmpV(mce, dst) );
+   undef = mkPCastTo( mce, Ity_I1, vbits );
+   ori   = expr2ori_Load_guarded_General( mce, ld->Iex.Load.ty,
+                                          ld->Iex.Load.addr, 0/*bias*/,
+                                          undef, mkU32(0) );
+   assign( 'B', mce, findShadowTmpB(mce, dst), ori );
+}
+
+
 static void schemeS ( MCEnv* mce, IRStmt* st )
 {
    tl_assert(MC_(clo_mc_level) == 3);
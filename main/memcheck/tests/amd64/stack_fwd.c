@@ -0,0 +1,115 @@
+
+/* Memcheck forwards the V bits of a stack slot from a store, or an
+   earlier load, to a later load of the same slot in the same
+   superblock, rather than reading them from shadow memory again.
+   Check that defined and undefined values survive that, and that an
+   invalid slot accessed twice in a superblock is reported once: the
+   forwarded access doesn't have its address checked.  Each asm block
+   below runs as one superblock, addressing the slot through %rsp. */
+
+#include <stdio.h>
+#include "../../memcheck.h"
+
+#define JZ_NEXT ".byte 0x74,0x00"  /* jz the-next-insn */
+
+/* Stores v to a stack slot and loads it straight back. */
+__attribute__((noinline))
+static long store_then_load ( long v )
+{
+   long r;
+   __asm__ __volatile__(
+      "subq   $256, %%rsp\n\t"
+      "movq   %1, 8(%%rsp)\n\t"
+      "movq   8(%%rsp), %0\n\t"
+      "addq   $256, %%rsp\n\t"
+      : "=&r"(r) : "r"(v) : "cc", "memory"
+   );
+   return r;
+}
+
+/* Loads a freshly allocated, hence undefined, stack slot twice and
+   returns the second value. */
+__attribute__((noinline))
+static long load_then_load ( void )
+{
+   long r1, r2;
+   __asm__ __volatile__(
+      "subq   $256, %%rsp\n\t"
+      "movq   8(%%rsp), %0\n\t"
+      "movq   8(%%rsp), %1\n\t"
+      "addq   $256, %%rsp\n\t"
+      : "=&r"(r1), "=&r"(r2) : : "cc", "memory"
+   );
+   return r2;
+}
+
+/* Makes a stack slot inaccessible with a client request, then, in the
+   superblock following it, loads the slot twice. */
+__attribute__((noinline))
+static void invalid_load_then_load ( void )
+{
+   long args[6] = { VG_USERREQ__MAKE_MEM_NOACCESS, 0, 8, 0, 0, 0 };
+   long r;
+   __asm__ __volatile__(
+      "subq   $256, %%rsp\n\t"
+      "leaq   8(%%rsp), %%rdx\n\t"
+      "movq   %%rdx, 8(%1)\n\t"
+      "movq   %1, %%rax\n\t"
+      "xorl   %%edx, %%edx\n\t"
+      __SPECIAL_INSTRUCTION_PREAMBLE
+      "xchgq  %%rbx, %%rbx\n\t"
+      "movq   8(%%rsp), %0\n\t"
+      "addq   8(%%rsp), %0\n\t"
+      "addq   $256, %%rsp\n\t"
+      : "=&r"(r) : "r"(args) : "rax", "rdx", "rdi", "cc", "memory"
+   );
+}
+
+/* The same, but storing to the inaccessible slot and then loading
+   it. */
+__attribute__((noinline))
+static void invalid_store_then_load ( void )
+{
+   long args[6] = { VG_USERREQ__MAKE_MEM_NOACCESS, 0, 8, 0, 0, 0 };
+   long r;
+   __asm__ __volatile__(
+      "subq   $256, %%rsp\n\t"
+      "leaq   8(%%rsp), %%rdx\n\t"
+      "movq   %%rdx, 8(%1)\n\t"
+      "movq   %1, %%rax\n\t"
+      "xorl   %%edx, %%edx\n\t"
+      __SPECIAL_INSTRUCTION_PREAMBLE
+      "xchgq  %%rbx, %%rbx\n\t"
+      "movq   $42, 8(%%rsp)\n\t"
+      "movq   8(%%rsp), %0\n\t"
+      "addq   $256, %%rsp\n\t"
+      : "=&r"(r) : "r"(args) : "rax", "rdx", "rdi", "cc", "memory"
+   );
+}
+
+/* Branches on v, so Memcheck complains if it is undefined. */
+#define USE(v) \
+   __asm__ __volatile__( "cmpq $0, %0\n\t" JZ_NEXT : : "r"(v) : "cc" )
+
+int main ( void )
+{
+   long undef;
+   VALGRIND_MAKE_MEM_UNDEFINED(&undef, sizeof(undef));
+
+   fprintf(stderr, "store then load, defined\n");
+   USE(store_then_load(42));
+
+   fprintf(stderr, "store then load, undefined\n");
+   USE(store_then_load(undef));
+
+   fprintf(stderr, "load then load, undefined\n");
+   USE(load_then_load());
+
+   fprintf(stderr, "load then load, invalid\n");
+   invalid_load_then_load();
+
+   fprintf(stderr, "store then load, invalid\n");
+   invalid_store_then_load();
+
+   return 0;
+}
@@ -0,0 +1,98 @@
+
+/* Test --smc-check=page-protect.  Translations of code in writable
+   anonymous memory are not self-checking in that mode; instead the
+   pages the code came from are write-protected, and a write to them
+   discards the translations.  Check that every way of rewriting such
+   code is noticed:
+
+   - plain stores from the client, over and over;
+   - stores to data that shares a page with hot code, which makes
+     Valgrind give up protecting the page and self-check its code
+     instead;
+   - a read() from a pipe, where the kernel does the writing;
+   - stores after the code page has been made read-only and then
+     writable again with mprotect.
+
+   If a rewrite is missed, a stale translation runs and prints the old
+   value. */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include "tests/sys_mman.h"
+
+typedef unsigned char UChar;
+
+#define PAGE 4096
+
+/* Make 'code' be  movl $v, %eax ; ret */
+static void set_ret ( UChar* code, unsigned int v )
+{
+   code[0] = 0xB8;
+   code[1] = v & 0xFF;
+   code[2] = (v >> 8) & 0xFF;
+   code[3] = (v >> 16) & 0xFF;
+   code[4] = (v >> 24) & 0xFF;
+   code[5] = 0xC3;
+}
+
+/* Call through a function pointer, so Vex can't chase into the code
+   and merge it into the caller's superblock. */
+__attribute__((noinline))
+static unsigned int run ( UChar* code )
+{
+   return ((unsigned int(*)(void))code)();
+}
+
+int main ( void )
+{
+   int i, fds[2];
+   unsigned int sum;
+   UChar new_code[6];
+   UChar* code = mmap(NULL, 2*PAGE, PROT_READ|PROT_WRITE|PROT_EXEC,
+                      MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+   assert(code != MAP_FAILED);
+
+   /* Plain stores, rewriting code that has just been run. */
+   for (i = 0; i < 5; i++) {
+      set_ret(code, i);
+      printf("direct: %u\n", run(code));
+   }
+
+   /* A counter on the same page as hot code.  After enough write
+      faults the page is no longer protected, and rewrites of the code
+      must still be seen. */
+   set_ret(code + PAGE, 7);
+   sum = 0;
+   for (i = 0; i < 10000; i++) {
+      code[PAGE + 512]++;
+      sum += run(code + PAGE);
+   }
+   printf("mixed: sum %u, counter %u\n", sum, code[PAGE + 512]);
+   set_ret(code + PAGE, 8);
+   printf("mixed: %u\n", run(code + PAGE));
+
+   /* The kernel writes the new code. */
+   assert(pipe(fds) == 0);
+   set_ret(new_code, 0x4242);
+   assert(write(fds[1], new_code, sizeof(new_code)) == sizeof(new_code));
+   set_ret(code, 1);
+   printf("read: before %u\n", run(code));
+   assert(read(fds[0], code, sizeof(new_code)) == sizeof(new_code));
+   printf("read: after 0x%x\n", run(code));
+   close(fds[0]);
+   close(fds[1]);
+
+   /* Made read-only, run, made writable again and rewritten. */
+   set_ret(code, 11);
+   printf("mprotect: %u\n", run(code));
+   assert(mprotect(code, PAGE, PROT_READ|PROT_EXEC) == 0);
+   printf("mprotect: read-only %u\n", run(code));
+   assert(mprotect(code, PAGE, PROT_READ|PROT_WRITE|PROT_EXEC) == 0);
+   set_ret(code, 12);
+   printf("mprotect: rewritten %u\n", run(code));
+
+   munmap(code, 2*PAGE);
+   return 0;
+}
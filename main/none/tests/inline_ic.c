@@ -0,0 +1,72 @@
+
+/* Exercise inline caches for indirect transfers (--inline-ic=yes):
+   call sites which always go to the same place, call sites which
+   alternate between targets, returns to many different callers, and
+   a predicted target whose translation is discarded after the cache
+   at the call site has been primed. */
+
+#include <stdio.h>
+#include "../../include/valgrind.h"
+
+typedef unsigned long (*Fn)(unsigned long);
+
+__attribute__((noinline)) unsigned long inc ( unsigned long x )
+{
+   return x + 1;
+}
+
+__attribute__((noinline)) unsigned long dbl ( unsigned long x )
+{
+   return x * 2 + 1;
+}
+
+__attribute__((noinline)) unsigned long rot ( unsigned long x )
+{
+   return (x << 3) | (x >> 29);
+}
+
+Fn volatile table[3] = { inc, dbl, rot };
+
+/* Monomorphic site: the same target every time. */
+__attribute__((noinline)) unsigned long mono ( Fn f, int n )
+{
+   unsigned long s = 1;
+   int i;
+   for (i = 0; i < n; i++)
+      s = f(s) & 0xFFFFFF;
+   return s;
+}
+
+/* Polymorphic site: cycles through all the targets. */
+__attribute__((noinline)) unsigned long poly ( int n )
+{
+   unsigned long s = 1;
+   int i;
+   for (i = 0; i < n; i++)
+      s = table[i % 3](s) & 0xFFFFFF;
+   return s;
+}
+
+/* Returns go back to many different places. */
+__attribute__((noinline)) unsigned long fib ( unsigned long n )
+{
+   return n < 2 ? n : fib(n-1) + fib(n-2);
+}
+
+int main ( void )
+{
+   int i;
+   printf("mono inc: %lu\n", mono(inc, 100000));
+   printf("mono dbl: %lu\n", mono(dbl, 100000));
+   printf("poly:     %lu\n", poly(100000));
+   printf("fib(20):  %lu\n", fib(20));
+
+   /* Prime the cache in mono for inc, then throw away inc's
+      translation; the chained cache must be unchained, and later
+      calls must still arrive at inc. */
+   for (i = 0; i < 3; i++) {
+      printf("discard %d: %lu\n", i, mono(inc, 1000));
+      VALGRIND_DISCARD_TRANSLATIONS((void*)inc, 64);
+   }
+   return 0;
+}
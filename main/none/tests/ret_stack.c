@@ -0,0 +1,33 @@
+
+/* Lots of calls and returns, from many call sites and at many
+   depths, for checking that --ret-stack=yes predicts nearly all of
+   the returns.  The interesting output is in the --stats=yes
+   summary; see ret_stack.stderr.filter. */
+
+#include <stdio.h>
+
+__attribute__((noinline)) unsigned long leaf ( unsigned long x )
+{
+   return x * 3 + 1;
+}
+
+__attribute__((noinline)) unsigned long mid ( unsigned long x )
+{
+   return leaf(x) ^ leaf(x >> 1);
+}
+
+__attribute__((noinline)) unsigned long fib ( unsigned long n )
+{
+   return n < 2 ? n : fib(n-1) + fib(n-2);
+}
+
+int main ( void )
+{
+   unsigned long s = 0;
+   int i;
+   for (i = 0; i < 100000; i++)
+      s = (s + mid(i)) & 0xFFFFFF;
+   printf("mid:     %lu\n", s);
+   printf("fib(24): %lu\n", fib(24));
+   return 0;
+}